@@ -50,11 +50,23 @@ check_include_file(sched.h HAVE_SCHED_H)
 check_include_file(string.h HAVE_STRING_H)
 check_include_file(strings.h HAVE_STRINGS_H)
 
+# compression libraries are only used when enabled by DefineOptions
+if(WITH_LZ4)
+    set(HAVE_LZ4_H 1)
+endif()
+if(WITH_ZSTD)
+    set(HAVE_ZSTD_H 1)
+endif()
+if(WITH_SNAPPY)
+    set(HAVE_SNAPPY_C_H 1)
+endif()
+
 check_function_exists(gethostbyname HAVE_GETHOSTBYNAME)
 check_function_exists(gethostbyname_r HAVE_GETHOSTBYNAME_R)
 check_function_exists(strerror_r HAVE_STRERROR_R)
 check_function_exists(sched_get_priority_max HAVE_SCHED_GET_PRIORITY_MAX)
 check_function_exists(sched_get_priority_min HAVE_SCHED_GET_PRIORITY_MIN)
+check_function_exists(fdatasync HAVE_FDATASYNC)
 
 include(CheckCSourceCompiles)
 include(CheckCXXSourceCompiles)
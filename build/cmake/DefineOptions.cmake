@@ -72,6 +72,19 @@ if(WITH_CPP)
     find_package(ZLIB QUIET)
     CMAKE_DEPENDENT_OPTION(WITH_ZLIB "Build with ZLIB support" ON
                            "ZLIB_FOUND" OFF)
+    # Optional THeaderTransport compression transforms, built into thriftz
+    find_path(LZ4_INCLUDE_DIR lz4.h)
+    find_library(LZ4_LIBRARY lz4)
+    CMAKE_DEPENDENT_OPTION(WITH_LZ4 "Build with LZ4 header transform support" ON
+                           "WITH_ZLIB;LZ4_INCLUDE_DIR;LZ4_LIBRARY" OFF)
+    find_path(ZSTD_INCLUDE_DIR zstd.h)
+    find_library(ZSTD_LIBRARY zstd)
+    CMAKE_DEPENDENT_OPTION(WITH_ZSTD "Build with Zstandard header transform support" ON
+                           "WITH_ZLIB;ZSTD_INCLUDE_DIR;ZSTD_LIBRARY" OFF)
+    find_path(SNAPPY_INCLUDE_DIR snappy-c.h)
+    find_library(SNAPPY_LIBRARY snappy)
+    CMAKE_DEPENDENT_OPTION(WITH_SNAPPY "Build with Snappy header transform support" ON
+                           "WITH_ZLIB;SNAPPY_INCLUDE_DIR;SNAPPY_LIBRARY" OFF)
     find_package(Libevent QUIET)
     CMAKE_DEPENDENT_OPTION(WITH_LIBEVENT "Build with libevent support" ON
                            "Libevent_FOUND" OFF)
@@ -215,5 +228,8 @@ message(STATUS "  Build with OpenSSL support:                 ${WITH_OPENSSL}")
 message(STATUS "  Build with Qt4 support:                     ${WITH_QT4}")
 message(STATUS "  Build with Qt5 support:                     ${WITH_QT5}")
 message(STATUS "  Build with ZLIB support:                    ${WITH_ZLIB}")
+message(STATUS "  Build with LZ4 support:                     ${WITH_LZ4}")
+message(STATUS "  Build with Zstandard support:               ${WITH_ZSTD}")
+message(STATUS "  Build with Snappy support:                  ${WITH_SNAPPY}")
 message(STATUS "----------------------------------------------------------")
 endmacro(PRINT_CONFIG_SUMMARY)
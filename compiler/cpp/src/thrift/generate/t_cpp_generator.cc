@@ -21,6 +21,7 @@
  * details.
  */
 
+#include <algorithm>
 #include <cassert>
 
 #include <fstream>
@@ -42,6 +43,17 @@ using std::vector;
 
 static const string endl = "\n"; // avoid ostream << std::endl flushes
 
+/**
+ * Whether a field is annotated cpp.lazy and can be kept undecoded, as
+ * structs and containers held by value can.
+ */
+static bool is_lazy_field(const t_field* tfield) {
+  const t_type* type = tfield->get_type()->get_true_type();
+  return tfield->annotations_.find("cpp.lazy") != tfield->annotations_.end()
+         && !tfield->get_reference()
+         && (type->is_struct() || type->is_xception() || type->is_container());
+}
+
 /**
  * C++ code generator. This is legitimacy incarnate.
  *
@@ -63,9 +75,11 @@ public:
     gen_no_default_operators_ = false;
     gen_templates_ = false;
     gen_templates_only_ = false;
+    gen_inline_serializers_ = false;
     gen_moveable_ = false;
     gen_no_ostream_operators_ = false;
     gen_no_skeleton_ = false;
+    gen_simple_json_ = false;
 
     for( iter = parsed_options.begin(); iter != parsed_options.end(); ++iter) {
       if( iter->first.compare("pure_enums") == 0) {
@@ -81,12 +95,17 @@ public:
       } else if( iter->first.compare("templates") == 0) {
         gen_templates_ = true;
         gen_templates_only_ = (iter->second == "only");
+      } else if( iter->first.compare("inline_serializers") == 0) {
+        gen_inline_serializers_ = true;
+        gen_templates_ = true;
       } else if( iter->first.compare("moveable_types") == 0) {
         gen_moveable_ = true;
       } else if ( iter->first.compare("no_ostream_operators") == 0) {
         gen_no_ostream_operators_ = true;
       } else if ( iter->first.compare("no_skeleton") == 0) {
         gen_no_skeleton_ = true;
+      } else if ( iter->first.compare("simple_json") == 0) {
+        gen_simple_json_ = true;
       } else {
         throw "unknown option cpp:" + iter->first;
       }
@@ -147,8 +166,17 @@ public:
   void generate_assignment_operator(std::ofstream& out, t_struct* tstruct);
   void generate_move_assignment_operator(std::ofstream& out, t_struct* tstruct);
   void generate_assignment_helper(std::ofstream& out, t_struct* tstruct, bool is_move);
-  void generate_struct_reader(std::ofstream& out, t_struct* tstruct, bool pointers = false);
+  void generate_struct_reader(std::ofstream& out,
+                              t_struct* tstruct,
+                              bool pointers = false,
+                              bool inlined = false);
   void generate_struct_writer(std::ofstream& out, t_struct* tstruct, bool pointers = false);
+  void generate_struct_inline_writer(std::ofstream& out, t_struct* tstruct);
+  void generate_struct_serialized_size(std::ostream& out, t_struct* tstruct);
+  void generate_serialized_size_value(std::ostream& out,
+                                      t_type* ttype,
+                                      string name,
+                                      bool pointer = false);
   void generate_struct_result_writer(std::ofstream& out, t_struct* tstruct, bool pointers = false);
   void generate_struct_swap(std::ofstream& out, t_struct* tstruct);
   void generate_struct_print_method(std::ofstream& out, t_struct* tstruct);
@@ -204,6 +232,10 @@ public:
                                 std::string prefix = "",
                                 std::string suffix = "");
 
+  void generate_deserialize_lazy_field(std::ofstream& out, t_field* tfield);
+
+  void generate_serialize_lazy_field(std::ofstream& out, t_field* tfield);
+
   void generate_serialize_struct(std::ofstream& out,
                                  t_struct* tstruct,
                                  std::string prefix = "",
@@ -310,6 +342,12 @@ private:
    */
   bool gen_templates_only_;
 
+  /**
+   * True if we should generate readers and writers specialized for the
+   * binary and compact protocols.  Implies gen_templates_.
+   */
+  bool gen_inline_serializers_;
+
   /**
    * True if we should generate move constructors & assignment operators.
    */
@@ -320,6 +358,12 @@ private:
    */
   bool gen_no_ostream_operators_;
 
+  /**
+   * True if readers should look up fields that arrive by name, as
+   * TSimpleJSONProtocol sends them.
+   */
+  bool gen_simple_json_;
+
   /**
    * True iff we should use a path prefix in our #include statements for other
    * thrift-generated header files.
@@ -361,6 +405,9 @@ private:
   std::ofstream f_types_;
   std::ofstream f_types_impl_;
   std::ofstream f_types_tcc_;
+  // serializedSize() definitions, for the end of the types header when not
+  // generating templates
+  std::ostringstream f_types_sizes_;
   std::ofstream f_header_;
   std::ofstream f_service_;
   std::ofstream f_service_tcc_;
@@ -416,6 +463,23 @@ void t_cpp_generator::init_generator() {
            << "#include <thrift/protocol/TProtocol.h>" << endl
            << "#include <thrift/transport/TTransport.h>" << endl
            << endl;
+  if (gen_inline_serializers_) {
+    f_types_ << "#include <thrift/protocol/TBinaryProtocol.h>" << endl
+             << "#include <thrift/protocol/TCompactProtocol.h>" << endl
+             << endl;
+  }
+  // Fields annotated cpp.lazy keep their encoding in a TLazyValue
+  bool has_lazy_fields = false;
+  const vector<t_struct*>& objects = program_->get_objects();
+  for (size_t i = 0; i < objects.size(); ++i) {
+    const vector<t_field*>& members = objects[i]->get_members();
+    for (size_t j = 0; j < members.size(); ++j) {
+      has_lazy_fields = has_lazy_fields || is_lazy_field(members[j]);
+    }
+  }
+  if (has_lazy_fields) {
+    f_types_ << "#include <thrift/protocol/TLazyValue.h>" << endl << endl;
+  }
   // Include C++xx compatibility header
   f_types_ << "#include <thrift/stdcxx.h>" << endl;
 
@@ -471,7 +535,7 @@ void t_cpp_generator::init_generator() {
  */
 void t_cpp_generator::close_generator() {
   // Close namespace
-  f_types_ << ns_close_ << endl << endl;
+  f_types_ << f_types_sizes_.str() << ns_close_ << endl << endl;
   f_types_impl_ << ns_close_ << endl;
   f_types_tcc_ << ns_close_ << endl << endl;
 
@@ -827,6 +891,15 @@ void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception)
   std::ofstream& out = (gen_templates_ ? f_types_tcc_ : f_types_impl_);
   generate_struct_reader(out, tstruct);
   generate_struct_writer(out, tstruct);
+  if (gen_inline_serializers_) {
+    generate_struct_reader(out, tstruct, false, true);
+    generate_struct_inline_writer(out, tstruct);
+  }
+  if (gen_templates_) {
+    generate_struct_serialized_size(f_types_tcc_, tstruct);
+  } else {
+    generate_struct_serialized_size(f_types_sizes_, tstruct);
+  }
   generate_struct_swap(f_types_impl_, tstruct);
   generate_copy_constructor(f_types_impl_, tstruct, is_exception);
   if (gen_moveable_) {
@@ -901,6 +974,11 @@ void t_cpp_generator::generate_constructor_helper(ofstream& out,
       has_nonrequired_fields = true;
     indent(out) << (*f_iter)->get_name() << " = "
                 << maybeMove(tmp_name + "." + (*f_iter)->get_name(), is_move) << ";" << endl;
+    if (is_lazy_field(*f_iter)) {
+      indent(out) << "__lazy_" << (*f_iter)->get_name() << " = "
+                  << maybeMove(tmp_name + ".__lazy_" + (*f_iter)->get_name(), is_move) << ";"
+                  << endl;
+    }
   }
 
   if (has_nonrequired_fields) {
@@ -946,6 +1024,11 @@ void t_cpp_generator::generate_assignment_helper(ofstream& out, t_struct* tstruc
       has_nonrequired_fields = true;
     indent(out) << (*f_iter)->get_name() << " = "
                 << maybeMove(tmp_name + "." + (*f_iter)->get_name(), is_move) << ";" << endl;
+    if (is_lazy_field(*f_iter)) {
+      indent(out) << "__lazy_" << (*f_iter)->get_name() << " = "
+                  << maybeMove(tmp_name + ".__lazy_" + (*f_iter)->get_name(), is_move) << ";"
+                  << endl;
+    }
   }
   if (has_nonrequired_fields) {
     indent(out) << "__isset = " << maybeMove(tmp_name + ".__isset", is_move) << ";" << endl;
@@ -1097,8 +1180,13 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
     out << endl << indent() << "virtual ~" << tstruct->get_name() << "() throw();" << endl;
   }
 
-  // Declare all fields
+  // Declare all fields; those annotated cpp.lazy are private, below
+  bool has_lazy_fields = false;
   for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    if (!pointers && is_lazy_field(*m_iter)) {
+      has_lazy_fields = true;
+      continue;
+    }
     indent(out) << declare_field(*m_iter,
                                  false,
                                  (pointers && !(*m_iter)->get_type()->is_xception()),
@@ -1124,6 +1212,16 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
           << type_name((*m_iter)->get_type(), false, true);
       out << " val);" << endl;
     }
+    if (is_lazy_field(*m_iter)) {
+      string name = (*m_iter)->get_name();
+      string type = type_name((*m_iter)->get_type());
+      out << endl << indent() << "// Decodes the field on first use, so even const access is not"
+          << endl << indent() << "// safe from several threads until it has been decoded." << endl
+          << indent() << "const " << type << "& get_" << name << "() const;" << endl << endl
+          << indent() << type << "& mutable_" << name << "();" << endl << endl << indent()
+          << "bool __is_encoded_" << name << "() const { return !__lazy_" << name
+          << ".empty(); }" << endl;
+    }
   }
   out << endl;
 
@@ -1136,17 +1234,20 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
           << (members.size() > 0 ? "rhs" : "/* rhs */") << ") const" << endl;
       scope_up(out);
       for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+        string value = (*m_iter)->get_name();
+        if (is_lazy_field(*m_iter)) {
+          value = "get_" + value + "()";
+        }
         // Most existing Thrift code does not use isset or optional/required,
         // so we treat "default" fields as required.
         if ((*m_iter)->get_req() != t_field::T_OPTIONAL) {
-          out << indent() << "if (!(" << (*m_iter)->get_name() << " == rhs."
-              << (*m_iter)->get_name() << "))" << endl << indent() << "  return false;" << endl;
+          out << indent() << "if (!(" << value << " == rhs." << value << "))" << endl << indent()
+              << "  return false;" << endl;
         } else {
           out << indent() << "if (__isset." << (*m_iter)->get_name() << " != rhs.__isset."
               << (*m_iter)->get_name() << ")" << endl << indent() << "  return false;" << endl
-              << indent() << "else if (__isset." << (*m_iter)->get_name() << " && !("
-              << (*m_iter)->get_name() << " == rhs." << (*m_iter)->get_name() << "))" << endl
-              << indent() << "  return false;" << endl;
+              << indent() << "else if (__isset." << (*m_iter)->get_name() << " && !(" << value
+              << " == rhs." << value << "))" << endl << indent() << "  return false;" << endl;
         }
       }
       indent(out) << "return true;" << endl;
@@ -1181,6 +1282,38 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
           << "::apache::thrift::protocol::TProtocol* oprot) const;" << endl;
     }
   }
+  if (is_user_struct) {
+    out << endl << indent() << "template <class Protocol_>" << endl << indent()
+        << "uint32_t serializedSize() const;" << endl;
+  }
+  if (is_user_struct && gen_inline_serializers_) {
+    // Partial ordering picks these over the generic templates
+    const char* protocols[] = {"template <class Transport_, class ByteOrder_>",
+                               "::apache::thrift::protocol::TBinaryProtocolT<Transport_, "
+                               "ByteOrder_>",
+                               "template <class Transport_>",
+                               "::apache::thrift::protocol::TCompactProtocolT<Transport_>"};
+    for (int i = 0; i < 4; i += 2) {
+      if (read) {
+        out << indent() << protocols[i] << endl << indent() << "uint32_t read("
+            << protocols[i + 1] << "* iprot) {" << endl << indent()
+            << "  return readInline(iprot);" << endl << indent() << "}" << endl;
+      }
+      if (write) {
+        out << indent() << protocols[i] << endl << indent() << "uint32_t write("
+            << protocols[i + 1] << "* oprot) const {" << endl << indent()
+            << "  return writeInline(oprot);" << endl << indent() << "}" << endl;
+      }
+    }
+    if (read) {
+      out << indent() << "template <class Protocol_>" << endl << indent()
+          << "uint32_t readInline(Protocol_* iprot);" << endl;
+    }
+    if (write) {
+      out << indent() << "template <class Protocol_>" << endl << indent()
+          << "uint32_t writeInline(Protocol_* oprot) const;" << endl;
+    }
+  }
   out << endl;
 
   if (is_user_struct && !has_custom_ostream(tstruct)) {
@@ -1197,6 +1330,24 @@ void t_cpp_generator::generate_struct_declaration(ofstream& out,
     out << ";" << endl;
   }
 
+  // Fields annotated cpp.lazy are only reached through get_, mutable_ and
+  // __set_, so that a change to one always drops its kept encoding
+  if (has_lazy_fields) {
+    out << endl << " private:" << endl;
+    for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+      if (is_lazy_field(*m_iter)) {
+        indent(out) << "mutable " << declare_field(*m_iter, false, false, !read) << endl;
+        indent(out) << "mutable ::apache::thrift::protocol::TLazyValue __lazy_"
+                    << (*m_iter)->get_name() << ";" << endl;
+        indent(out) << "void __decode_" << (*m_iter)->get_name() << "() const;" << endl;
+      }
+    }
+    if (swap) {
+      out << endl << indent() << "friend void swap(" << tstruct->get_name() << " &a, "
+          << tstruct->get_name() << " &b);" << endl;
+    }
+  }
+
   indent_down();
   indent(out) << "};" << endl << endl;
 
@@ -1246,6 +1397,9 @@ void t_cpp_generator::generate_struct_definition(ofstream& out,
       }
       indent_up();
       out << indent() << "this->" << (*m_iter)->get_name() << " = val;" << endl;
+      if (is_lazy_field(*m_iter)) {
+        out << indent() << "this->__lazy_" << (*m_iter)->get_name() << ".clear();" << endl;
+      }
       indent_down();
 
       // assume all fields are required except optional fields.
@@ -1255,6 +1409,33 @@ void t_cpp_generator::generate_struct_definition(ofstream& out,
         out << indent() << indent() << "__isset." << (*m_iter)->get_name() << " = true;" << endl;
       }
       out << indent() << "}" << endl;
+
+      if (is_lazy_field(*m_iter)) {
+        string name = (*m_iter)->get_name();
+        string type = type_name((*m_iter)->get_type());
+        out << endl << indent() << "const " << type << "& " << tstruct->get_name() << "::get_"
+            << name << "() const {" << endl << indent() << "  __decode_" << name << "();" << endl
+            << indent() << "  return " << name << ";" << endl << indent() << "}" << endl;
+        out << endl << indent() << type << "& " << tstruct->get_name() << "::mutable_" << name
+            << "() {" << endl << indent() << "  __decode_" << name << "();" << endl << indent()
+            << "  return " << name << ";" << endl << indent() << "}" << endl;
+
+        // The encoding goes once the field is decoded, since it may change
+        out << endl << indent() << "void " << tstruct->get_name() << "::__decode_" << name
+            << "() const {" << endl;
+        indent_up();
+        out << indent() << "if (__lazy_" << name << ".empty()) {" << endl << indent()
+            << "  return;" << endl << indent() << "}" << endl << indent()
+            << "::apache::thrift::stdcxx::shared_ptr< ::apache::thrift::protocol::TProtocol> "
+               "lazy = __lazy_" << name << ".getProtocol();" << endl << indent()
+            << "::apache::thrift::protocol::TProtocol* iprot = lazy.get();" << endl << indent()
+            << "uint32_t xfer = 0;" << endl;
+        generate_deserialize_field(out, *m_iter, "this->");
+        out << indent() << "(void)xfer;" << endl << indent() << "__lazy_" << name
+            << ".clear();" << endl;
+        indent_down();
+        out << indent() << "}" << endl;
+      }
     }
   }
   if (is_user_struct) {
@@ -1269,10 +1450,21 @@ void t_cpp_generator::generate_struct_definition(ofstream& out,
  * @param out Stream to write to
  * @param tstruct The struct
  */
-void t_cpp_generator::generate_struct_reader(ofstream& out, t_struct* tstruct, bool pointers) {
+namespace {
+// Orders fields by name, as the tables for lookupFieldName() must be
+bool fieldNameLess(const t_field* a, const t_field* b) {
+  return a->get_name() < b->get_name();
+}
+}
+
+void t_cpp_generator::generate_struct_reader(ofstream& out,
+                                             t_struct* tstruct,
+                                             bool pointers,
+                                             bool inlined) {
   if (gen_templates_) {
     out << indent() << "template <class Protocol_>" << endl << indent() << "uint32_t "
-        << tstruct->get_name() << "::read(Protocol_* iprot) {" << endl;
+        << tstruct->get_name() << (inlined ? "::readInline" : "::read")
+        << "(Protocol_* iprot) {" << endl;
   } else {
     indent(out) << "uint32_t " << tstruct->get_name()
                 << "::read(::apache::thrift::protocol::TProtocol* iprot) {" << endl;
@@ -1302,6 +1494,29 @@ void t_cpp_generator::generate_struct_reader(ofstream& out, t_struct* tstruct, b
   }
   out << endl;
 
+  // Fields that come in order skip the loop below
+  if (inlined) {
+    vector<t_field*> sorted = tstruct->get_sorted_members();
+    for (f_iter = sorted.begin(); f_iter != sorted.end(); ++f_iter) {
+      out << indent() << "if (iprot->readExpectedField(" << type_to_enum((*f_iter)->get_type())
+          << ", " << (*f_iter)->get_key() << ", xfer)) {" << endl;
+      indent_up();
+      if (is_lazy_field(*f_iter)) {
+        generate_deserialize_lazy_field(out, *f_iter);
+      } else {
+        generate_deserialize_field(out, *f_iter, "this->");
+      }
+      out << indent() << "xfer += iprot->readFieldEnd();" << endl << indent()
+          << ((*f_iter)->get_req() != t_field::T_REQUIRED ? "this->__isset." : "isset_")
+          << (*f_iter)->get_name() << " = true;" << endl;
+      indent_down();
+      out << indent() << "}" << endl;
+    }
+    if (!sorted.empty()) {
+      out << endl;
+    }
+  }
+
   // Loop over reading in fields
   indent(out) << "while (true)" << endl;
   scope_up(out);
@@ -1316,6 +1531,25 @@ void t_cpp_generator::generate_struct_reader(ofstream& out, t_struct* tstruct, b
   if (fields.empty()) {
     out << indent() << "xfer += iprot->skip(ftype);" << endl;
   } else {
+    if (gen_simple_json_) {
+      // Protocols that key fields by name return them as T_VOID
+      vector<t_field*> by_name(fields);
+      std::sort(by_name.begin(), by_name.end(), fieldNameLess);
+      out << indent() << "if (ftype == ::apache::thrift::protocol::T_VOID) {" << endl;
+      indent_up();
+      out << indent() << "static const ::apache::thrift::protocol::TFieldName fieldNames[] = {"
+          << endl;
+      for (f_iter = by_name.begin(); f_iter != by_name.end(); ++f_iter) {
+        out << indent() << "  {\"" << (*f_iter)->get_name() << "\", " << (*f_iter)->get_key()
+            << ", " << type_to_enum((*f_iter)->get_type()) << "}," << endl;
+      }
+      out << indent() << "};" << endl << indent()
+          << "::apache::thrift::protocol::lookupFieldName(fieldNames, " << by_name.size()
+          << ", fname, fid, ftype);" << endl;
+      indent_down();
+      out << indent() << "}" << endl;
+    }
+
     // Switch statement on the field we are reading
     indent(out) << "switch (fid)" << endl;
 
@@ -1343,6 +1577,8 @@ void t_cpp_generator::generate_struct_reader(ofstream& out, t_struct* tstruct, b
 
       if (pointers && !(*f_iter)->get_type()->is_xception()) {
         generate_deserialize_field(out, *f_iter, "(*(this->", "))");
+      } else if (!pointers && is_lazy_field(*f_iter)) {
+        generate_deserialize_lazy_field(out, *f_iter);
       } else {
         generate_deserialize_field(out, *f_iter, "this->");
       }
@@ -1428,6 +1664,8 @@ void t_cpp_generator::generate_struct_writer(ofstream& out, t_struct* tstruct, b
     // Write field contents
     if (pointers && !(*f_iter)->get_type()->is_xception()) {
       generate_serialize_field(out, *f_iter, "(*(this->", "))");
+    } else if (!pointers && is_lazy_field(*f_iter)) {
+      generate_serialize_lazy_field(out, *f_iter);
     } else {
       generate_serialize_field(out, *f_iter, "this->");
     }
@@ -1450,6 +1688,255 @@ void t_cpp_generator::generate_struct_writer(ofstream& out, t_struct* tstruct, b
   indent(out) << "}" << endl << endl;
 }
 
+namespace {
+// Names the encode function of fields that fit in a fixed number of bytes
+string inline_field_encoder(t_type* type) {
+  if (type->is_enum()) {
+    return "encodeI32Field";
+  }
+  if (!type->is_base_type()) {
+    return "";
+  }
+  switch (((t_base_type*)type)->get_base()) {
+  case t_base_type::TYPE_BOOL:
+    return "encodeBoolField";
+  case t_base_type::TYPE_I8:
+    return "encodeByteField";
+  case t_base_type::TYPE_I16:
+    return "encodeI16Field";
+  case t_base_type::TYPE_I32:
+    return "encodeI32Field";
+  case t_base_type::TYPE_I64:
+    return "encodeI64Field";
+  case t_base_type::TYPE_DOUBLE:
+    return "encodeDoubleField";
+  default:
+    return "";
+  }
+}
+}
+
+/**
+ * Generates the writer used with the binary and compact protocols.  Fixed
+ * size fields are encoded into a buffer on the stack, together with the
+ * header of the field that follows them, and written out in one go.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_inline_writer(ofstream& out, t_struct* tstruct) {
+  string name = tstruct->get_name();
+  const vector<t_field*>& fields = tstruct->get_sorted_members();
+  vector<t_field*>::const_iterator f_iter;
+
+  // The buffer holds the longest run of encoded fields and headers
+  int run = 1;
+  int longest = 1;
+  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+    t_type* type = get_true_type((*f_iter)->get_type());
+    if (inline_field_encoder(type).empty() || is_reference(*f_iter)) {
+      run = 1;
+    } else {
+      ++run;
+    }
+    longest = (std::max)(longest, run);
+  }
+
+  out << indent() << "template <class Protocol_>" << endl << indent() << "uint32_t " << name
+      << "::writeInline(Protocol_* oprot) const {" << endl;
+  indent_up();
+
+  out << indent() << "uint32_t xfer = 0;" << endl << indent()
+      << "::apache::thrift::protocol::TOutputRecursionTracker tracker(*oprot);" << endl
+      << indent() << "uint8_t buf[" << longest << " * Protocol_::MAX_ENCODED_FIELD_SIZE];" << endl
+      << indent() << "uint8_t* end = buf;" << endl << indent()
+      << "xfer += oprot->writeStructBegin(\"" << name << "\");" << endl;
+
+  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+    t_type* type = get_true_type((*f_iter)->get_type());
+    string encoder = is_reference(*f_iter) ? "" : inline_field_encoder(type);
+    bool check_if_set = (*f_iter)->get_req() == t_field::T_OPTIONAL
+                        || (*f_iter)->get_type()->is_xception();
+    if (check_if_set) {
+      out << endl << indent() << "if (this->__isset." << (*f_iter)->get_name() << ") {" << endl;
+      indent_up();
+    } else {
+      out << endl;
+    }
+
+    if (!encoder.empty()) {
+      out << indent() << "end = oprot->" << encoder << "(end, " << (*f_iter)->get_key() << ", "
+          << (type->is_enum() ? "(int32_t)" : "") << "this->" << (*f_iter)->get_name() << ");"
+          << endl;
+    } else {
+      if (type->is_bool()) {
+        // The compact protocol folds bools into their headers
+        out << indent() << "xfer += oprot->writeEncoded(buf, end);" << endl << indent()
+            << "xfer += oprot->writeFieldBegin(\"" << (*f_iter)->get_name() << "\", "
+            << type_to_enum((*f_iter)->get_type()) << ", " << (*f_iter)->get_key() << ");"
+            << endl;
+      } else {
+        out << indent() << "end = oprot->encodeFieldBegin(end, "
+            << type_to_enum((*f_iter)->get_type()) << ", " << (*f_iter)->get_key() << ");"
+            << endl << indent() << "xfer += oprot->writeEncoded(buf, end);" << endl;
+      }
+      out << indent() << "end = buf;" << endl;
+      if (is_lazy_field(*f_iter)) {
+        generate_serialize_lazy_field(out, *f_iter);
+      } else {
+        generate_serialize_field(out, *f_iter, "this->");
+      }
+      indent(out) << "xfer += oprot->writeFieldEnd();" << endl;
+    }
+    if (check_if_set) {
+      indent_down();
+      indent(out) << '}';
+    }
+  }
+
+  out << endl;
+
+  out << indent() << "end = oprot->encodeFieldStop(end);" << endl << indent()
+      << "xfer += oprot->writeEncoded(buf, end);" << endl << indent()
+      << "xfer += oprot->writeStructEnd();" << endl << indent() << "return xfer;" << endl;
+
+  indent_down();
+  indent(out) << "}" << endl << endl;
+}
+
+/**
+ * Generates serializedSize(), which adds up what write() would put on the
+ * wire with the size functions of the protocol.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_serialized_size(ostream& out, t_struct* tstruct) {
+  const vector<t_field*>& fields = tstruct->get_sorted_members();
+  vector<t_field*>::const_iterator f_iter;
+
+  out << indent() << "template <class Protocol_>" << endl << indent() << "uint32_t "
+      << tstruct->get_name() << "::serializedSize() const {" << endl;
+  indent_up();
+  out << indent() << "uint32_t xfer = 0;" << endl;
+
+  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+    bool check_if_set = (*f_iter)->get_req() == t_field::T_OPTIONAL
+                        || (*f_iter)->get_type()->is_xception();
+    if (check_if_set) {
+      out << indent() << "if (this->__isset." << (*f_iter)->get_name() << ") {" << endl;
+      indent_up();
+    }
+    out << indent() << "xfer += Protocol_::serializedSizeFieldBegin("
+        << type_to_enum((*f_iter)->get_type()) << ", " << (*f_iter)->get_key() << ");" << endl;
+    generate_serialized_size_value(out,
+                                   (*f_iter)->get_type(),
+                                   is_lazy_field(*f_iter)
+                                       ? "this->get_" + (*f_iter)->get_name() + "()"
+                                       : "this->" + (*f_iter)->get_name(),
+                                   is_reference(*f_iter));
+    if (check_if_set) {
+      indent_down();
+      out << indent() << "}" << endl;
+    }
+  }
+
+  out << indent() << "xfer += Protocol_::serializedSizeFieldStop();" << endl << indent()
+      << "return xfer;" << endl;
+  indent_down();
+  out << indent() << "}" << endl << endl;
+}
+
+/**
+ * Adds the size of a value to xfer.
+ *
+ * @param out Stream to write to
+ * @param ttype The type of the value
+ * @param name The value
+ * @param pointer Whether the value is a pointer to a struct
+ */
+void t_cpp_generator::generate_serialized_size_value(ostream& out,
+                                                     t_type* ttype,
+                                                     string name,
+                                                     bool pointer) {
+  t_type* type = get_true_type(ttype);
+
+  if (type->is_struct() || type->is_xception()) {
+    if (pointer) {
+      // A missing struct is written as an empty one
+      out << indent() << "xfer += " << name << " ? " << name
+          << "->serializedSize<Protocol_>() : Protocol_::serializedSizeFieldStop();" << endl;
+    } else {
+      out << indent() << "xfer += " << name << ".serializedSize<Protocol_>();" << endl;
+    }
+  } else if (type->is_container()) {
+    scope_up(out);
+    if (type->is_map()) {
+      out << indent() << "xfer += Protocol_::serializedSizeMapBegin("
+          << type_to_enum(((t_map*)type)->get_key_type()) << ", "
+          << type_to_enum(((t_map*)type)->get_val_type()) << ", static_cast<uint32_t>(" << name
+          << ".size()));" << endl;
+    } else if (type->is_set()) {
+      out << indent() << "xfer += Protocol_::serializedSizeSetBegin("
+          << type_to_enum(((t_set*)type)->get_elem_type()) << ", static_cast<uint32_t>(" << name
+          << ".size()));" << endl;
+    } else {
+      out << indent() << "xfer += Protocol_::serializedSizeListBegin("
+          << type_to_enum(((t_list*)type)->get_elem_type()) << ", static_cast<uint32_t>(" << name
+          << ".size()));" << endl;
+    }
+
+    string iter = tmp("_iter");
+    out << indent() << type_name(type) << "::const_iterator " << iter << ";" << endl << indent()
+        << "for (" << iter << " = " << name << ".begin(); " << iter << " != " << name
+        << ".end(); ++" << iter << ")" << endl;
+    scope_up(out);
+    if (type->is_map()) {
+      generate_serialized_size_value(out, ((t_map*)type)->get_key_type(), iter + "->first");
+      generate_serialized_size_value(out, ((t_map*)type)->get_val_type(), iter + "->second");
+    } else if (type->is_set()) {
+      generate_serialized_size_value(out, ((t_set*)type)->get_elem_type(), "(*" + iter + ")");
+    } else {
+      generate_serialized_size_value(out, ((t_list*)type)->get_elem_type(), "(*" + iter + ")");
+    }
+    scope_down(out);
+    scope_down(out);
+  } else if (type->is_enum()) {
+    out << indent() << "xfer += Protocol_::serializedSizeI32((int32_t)" << name << ");" << endl;
+  } else if (type->is_base_type()) {
+    out << indent() << "xfer += Protocol_::";
+    t_base_type::t_base tbase = ((t_base_type*)type)->get_base();
+    switch (tbase) {
+    case t_base_type::TYPE_STRING:
+      out << (type->is_binary() ? "serializedSizeBinary(" : "serializedSizeString(");
+      break;
+    case t_base_type::TYPE_BOOL:
+      out << "serializedSizeBool(";
+      break;
+    case t_base_type::TYPE_I8:
+      out << "serializedSizeByte(";
+      break;
+    case t_base_type::TYPE_I16:
+      out << "serializedSizeI16(";
+      break;
+    case t_base_type::TYPE_I32:
+      out << "serializedSizeI32(";
+      break;
+    case t_base_type::TYPE_I64:
+      out << "serializedSizeI64(";
+      break;
+    case t_base_type::TYPE_DOUBLE:
+      out << "serializedSizeDouble(";
+      break;
+    default:
+      throw "compiler error: no C++ size for base type " + t_base_type::t_base_name(tbase) + name;
+    }
+    out << name << ");" << endl;
+  } else {
+    throw "compiler error: no C++ size for type " + type_name(type) + " of " + name;
+  }
+}
+
 /**
  * Struct writer for result of a function, which can have only one of its
  * fields set and does a conditional if else look up into the __isset field
@@ -1543,6 +2030,10 @@ void t_cpp_generator::generate_struct_swap(ofstream& out, t_struct* tstruct) {
 
     out << indent() << "swap(a." << tfield->get_name() << ", b." << tfield->get_name() << ");"
         << endl;
+    if (is_lazy_field(tfield)) {
+      out << indent() << "swap(a.__lazy_" << tfield->get_name() << ", b.__lazy_"
+          << tfield->get_name() << ");" << endl;
+    }
   }
 
   if (has_nonrequired_fields) {
@@ -1600,7 +2091,11 @@ void t_cpp_generator::generate_exception_what_method_decl(std::ofstream& out,
 
 namespace struct_ostream_operator_generator {
 void generate_required_field_value(std::ofstream& out, const t_field* field) {
-  out << " << to_string(" << field->get_name() << ")";
+  if (is_lazy_field(field)) {
+    out << " << to_string(get_" << field->get_name() << "())";
+  } else {
+    out << " << to_string(" << field->get_name() << ")";
+  }
 }
 
 void generate_optional_field_value(std::ofstream& out, const t_field* field) {
@@ -1839,6 +2334,14 @@ void t_cpp_generator::generate_service_helpers(t_service* tservice) {
     t_struct* ts = (*f_iter)->get_arglist();
     string name_orig = ts->get_name();
 
+    const vector<t_field*>& args = ts->get_members();
+    for (vector<t_field*>::const_iterator a_iter = args.begin(); a_iter != args.end(); ++a_iter) {
+      if (is_lazy_field(*a_iter)) {
+        throw "compiler error: cpp.lazy is only supported on struct fields: "
+            + (*f_iter)->get_name() + "." + (*a_iter)->get_name();
+      }
+    }
+
     // TODO(dreiss): Why is this stuff not in generate_function_helpers?
     ts->set_name(tservice->get_name() + "_" + (*f_iter)->get_name() + "_args");
     generate_struct_declaration(f_header_, ts, false);
@@ -3787,6 +4290,20 @@ void t_cpp_generator::generate_deserialize_field(ofstream& out,
   }
 }
 
+/**
+ * Reads a field annotated cpp.lazy, keeping its encoding if the protocol can
+ * and decoding it otherwise.
+ */
+void t_cpp_generator::generate_deserialize_lazy_field(ofstream& out, t_field* tfield) {
+  string lazy = "this->__lazy_" + tfield->get_name();
+  out << indent() << "xfer += " << lazy << ".read(iprot, " << type_to_enum(tfield->get_type())
+      << ");" << endl << indent() << "if (" << lazy << ".empty()) {" << endl;
+  indent_up();
+  generate_deserialize_field(out, tfield, "this->");
+  indent_down();
+  out << indent() << "}" << endl;
+}
+
 /**
  * Generates an unserializer for a variable. This makes two key assumptions,
  * first that there is a const char* variable named data that points to the
@@ -3994,6 +4511,21 @@ void t_cpp_generator::generate_serialize_field(ofstream& out,
   }
 }
 
+/**
+ * Writes a field annotated cpp.lazy, putting its encoding back on the wire
+ * if it was never decoded and the protocol uses the same one.
+ */
+void t_cpp_generator::generate_serialize_lazy_field(ofstream& out, t_field* tfield) {
+  string lazy = "this->__lazy_" + tfield->get_name();
+  out << indent() << "if (" << lazy << ".isWritableTo(oprot)) {" << endl << indent()
+      << "  xfer += " << lazy << ".write(oprot);" << endl << indent() << "} else {" << endl;
+  indent_up();
+  out << indent() << "this->__decode_" << tfield->get_name() << "();" << endl;
+  generate_serialize_field(out, tfield, "this->");
+  indent_down();
+  out << indent() << "}" << endl;
+}
+
 /**
  * Serializes all the members of a struct.
  *
@@ -4008,9 +4540,9 @@ void t_cpp_generator::generate_serialize_struct(ofstream& out,
     indent(out) << "if (" << prefix << ") {" << endl;
     indent(out) << "  xfer += " << prefix << "->write(oprot); " << endl;
     indent(out) << "} else {"
-                << "oprot->writeStructBegin(\"" << tstruct->get_name() << "\"); " << endl;
-    indent(out) << "  oprot->writeStructEnd();" << endl;
-    indent(out) << "  oprot->writeFieldStop();" << endl;
+                << "xfer += oprot->writeStructBegin(\"" << tstruct->get_name() << "\"); " << endl;
+    indent(out) << "  xfer += oprot->writeFieldStop();" << endl;
+    indent(out) << "  xfer += oprot->writeStructEnd();" << endl;
     indent(out) << "}" << endl;
   } else {
     indent(out) << "xfer += " << prefix << ".write(oprot);" << endl;
@@ -4478,9 +5010,13 @@ THRIFT_REGISTER_GENERATOR(
     "    no_default_operators:\n"
     "                     Omits generation of default operators ==, != and <\n"
     "    templates:       Generate templatized reader/writer methods.\n"
+    "    inline_serializers:\n"
+    "                     Also generate readers/writers specialized for the binary and\n"
+    "                     compact protocols. Implies templates.\n"
     "    pure_enums:      Generate pure enums instead of wrapper classes.\n"
     "    include_prefix:  Use full include paths in generated files.\n"
     "    moveable_types:  Generate move constructors and assignment operators.\n"
     "    no_ostream_operators:\n"
     "                     Omit generation of ostream definitions.\n"
-    "    no_skeleton:     Omits generation of skeleton.\n")
+    "    no_skeleton:     Omits generation of skeleton.\n"
+    "    simple_json:     Generate readers that can read TSimpleJSONProtocol.\n")
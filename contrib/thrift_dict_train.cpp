@@ -0,0 +1,100 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * Trains a THeaderDictionary from a TFileTransport capture of real
+ * traffic, one sample per logged event, and writes the raw dictionary to
+ * stdout.  Load it on both ends with
+ *
+ *   new THeaderDictionary(id, contentsOfTheFile)
+ *
+ * The CMake build makes it as the thrift_dict_train target whenever zlib
+ * support is enabled.  Elsewhere, build it against libthrift and
+ * libthriftz (plus whichever of lz4, zstd and snappy they were built
+ * with), e.g.
+ *   g++ thrift_dict_train.cpp -lthriftz -lthrift -lz -o thrift_dict_train
+ */
+
+#include <cstdlib>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_array.hpp>
+
+#include <thrift/transport/TFileTransport.h>
+#include <thrift/transport/THeaderTransport.h>
+
+using namespace apache::thrift::transport;
+
+void usage() {
+  fprintf(stderr,
+      "usage: thrift_dict_train [-s max_dict_bytes] [-n max_samples] capture > dict\n"
+      "  -s size of the dictionary, at most 32768 for zlib (default 16384)\n"
+      "  -n number of events to sample from the start of the capture (default 10000)\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  size_t maxSize = 16 * 1024;
+  size_t maxSamples = 10000;
+  int arg = 1;
+  for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+    if (argv[arg] == std::string("-s")) {
+      maxSize = strtoul(argv[arg + 1], NULL, 10);
+    } else if (argv[arg] == std::string("-n")) {
+      maxSamples = strtoul(argv[arg + 1], NULL, 10);
+    } else {
+      usage();
+    }
+  }
+  if (arg + 1 != argc || maxSize == 0) {
+    usage();
+  }
+
+  std::vector<std::string> samples;
+  try {
+    TFileTransport capture(argv[arg], true);
+    capture.setReadTimeout(TFileTransport::NO_TAIL_READ_TIMEOUT);
+
+    // each read returns at most one whole event
+    uint32_t bufSize = capture.getMaxEventSize();
+    if (bufSize == 0) {
+      bufSize = 16 * 1024 * 1024;
+    }
+    boost::scoped_array<uint8_t> buf(new uint8_t[bufSize]);
+    while (samples.size() < maxSamples) {
+      uint32_t got = capture.read(buf.get(), bufSize);
+      if (got == 0) {
+        break;
+      }
+      samples.push_back(std::string(reinterpret_cast<const char*>(buf.get()), got));
+    }
+  } catch (TTransportException& e) {
+    std::cerr << "Error reading " << argv[arg] << ": " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string dict = THeaderDictionary::train(samples, maxSize);
+  std::cerr << "Trained a " << dict.size() << " byte dictionary from " << samples.size()
+            << " events" << std::endl;
+  fwrite(dict.data(), 1, dict.size(), stdout);
+  return 0;
+}
@@ -163,8 +163,11 @@
 #endif
 
 /**
- * T_GLOBAL_DEBUG_VIRTUAL = 0 or unset: normal operation,
- *                                      virtual call debug messages disabled
+ * T_GLOBAL_DEBUG_VIRTUAL < 0:          virtual call debugging compiled out
+ * T_GLOBAL_DEBUG_VIRTUAL = 0 or unset: normal operation; avoidable virtual
+ *                                      calls are sampled only while
+ *                                      apache::thrift::profile_sampling_start()
+ *                                      has turned sampling on
  * T_GLOBAL_DEBUG_VIRTUAL = 1:          log a debug messages whenever an
  *                                      avoidable virtual call is made
  * T_GLOBAL_DEBUG_VIRTUAL = 2:          record detailed info that can be
@@ -187,6 +190,21 @@
       fprintf(stderr, "[%s,%d] failed to cast to specific protocol type\n", __FILE__, __LINE__);   \
     }                                                                                              \
   } while (0)
+#elif T_GLOBAL_DEBUG_VIRTUAL == 0
+#define T_VIRTUAL_CALL()                                                                           \
+  do {                                                                                             \
+    if (::apache::thrift::profile_sample_rate.load(boost::memory_order_relaxed) != 0) {            \
+      ::apache::thrift::profile_sample_virtual_call(typeid(*this), __FUNCTION__);                  \
+    }                                                                                              \
+  } while (0)
+#define T_GENERIC_PROTOCOL(template_class, generic_prot, specific_prot)                            \
+  do {                                                                                             \
+    if (::apache::thrift::profile_sample_rate.load(boost::memory_order_relaxed) != 0               \
+        && !(specific_prot)) {                                                                     \
+      ::apache::thrift::profile_sample_generic_protocol(typeid(*template_class),                   \
+                                                        typeid(*generic_prot));                    \
+    }                                                                                              \
+  } while (0)
 #else
 #define T_VIRTUAL_CALL()
 #define T_GENERIC_PROTOCOL(template_class, generic_prot, specific_prot)
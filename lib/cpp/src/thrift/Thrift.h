@@ -42,6 +42,7 @@
 #include <exception>
 #include <typeinfo>
 
+#include <boost/atomic.hpp>
 #include <boost/utility/enable_if.hpp>
 #include <boost/type_traits/is_convertible.hpp>
 
@@ -50,6 +51,14 @@
 
 #define THRIFT_UNUSED_VARIABLE(x) ((void)(x))
 
+// Declares a variable of which each thread has its own copy.  It must be
+// plain data with a constant initializer.
+#ifdef _MSC_VER
+#define THRIFT_THREAD_LOCAL __declspec(thread)
+#else
+#define THRIFT_THREAD_LOCAL __thread
+#endif
+
 namespace apache {
 namespace thrift {
 
@@ -123,6 +132,31 @@ TDelayedException* TDelayedException::delayException(const E& e) {
   return new TExceptionWrapper<E>(e);
 }
 
+/**
+ * Sampled profiling of avoidable virtual calls, which can be turned on and
+ * off in a running program.  While it is on, one in every sampleRate calls
+ * made through the virtual TProtocol and TTransport interfaces, or to a
+ * templated processor with a protocol it was not specialized for, is counted
+ * by the concrete types involved.  Threads count into buffers of their own,
+ * and only take a lock when they hand a full buffer over, so that sampling
+ * can be left on in production.
+ *
+ * profile_sampling_info() reports the counts, most frequent first, as
+ * estimates of the number of calls.  A thread hands its buffer over when it
+ * fills, every 16 samples, and when the thread exits where threads are
+ * pthreads, so up to 15 of each other running thread's latest samples are
+ * not counted yet; the calling thread's own are.
+ */
+extern boost::atomic<uint32_t> profile_sample_rate;
+void profile_sampling_start(uint32_t sampleRate);
+void profile_sampling_stop();
+void profile_sampling_reset();
+std::string profile_sampling_info();
+void profile_sampling_print(FILE* f);
+void profile_sample_virtual_call(const std::type_info& info, const char* function);
+void profile_sample_generic_protocol(const std::type_info& template_type,
+                                     const std::type_info& prot_type);
+
 #if T_GLOBAL_DEBUG_VIRTUAL > 1
 void profile_virtual_call(const std::type_info& info);
 void profile_generic_protocol(const std::type_info& template_type, const std::type_info& prot_type);
@@ -18,8 +18,261 @@
  */
 
 #include <thrift/Thrift.h>
+#include <thrift/concurrency/Mutex.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+
+#ifdef __GNUG__
+#include <cxxabi.h>
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+namespace apache {
+namespace thrift {
+
+boost::atomic<uint32_t> profile_sample_rate(0);
+
+namespace {
+
+/**
+ * One sampled call: the type called on and the function called, or the
+ * processor type and the protocol type it was given.
+ */
+struct Sample {
+  const char* typeName1;
+  const char* typeName2;
+  const char* function;
+  uint32_t weight;
+};
+
+const uint32_t SAMPLE_BUFFER_SIZE = 16;
+
+/**
+ * The samples a thread has taken since it last handed them over.  Plain data,
+ * so that it can live in thread local storage.
+ */
+struct SampleBuffer {
+  uint32_t countdown;
+  uint32_t random;
+  uint32_t generation;
+  uint32_t size;
+  bool flushesAtExit;
+  Sample samples[SAMPLE_BUFFER_SIZE];
+};
+
+THRIFT_THREAD_LOCAL SampleBuffer sample_buffer;
+
+int compareNames(const char* name1, const char* name2) {
+  if (name1 == name2) {
+    return 0;
+  }
+  if (name1 == NULL || name2 == NULL) {
+    return name1 == NULL ? -1 : 1;
+  }
+  return strcmp(name1, name2);
+}
+
+/**
+ * Names compare by value, since type_info::name() need not return the same
+ * pointer for a type everywhere.
+ */
+struct SampleLess {
+  bool operator()(const Sample& sample1, const Sample& sample2) const {
+    int ret = compareNames(sample1.typeName1, sample2.typeName1);
+    if (ret == 0) {
+      ret = compareNames(sample1.typeName2, sample2.typeName2);
+    }
+    if (ret == 0) {
+      ret = compareNames(sample1.function, sample2.function);
+    }
+    return ret < 0;
+  }
+};
+
+struct SampleCount {
+  SampleCount() : samples(0), calls(0) {}
+
+  uint64_t samples;
+  uint64_t calls;
+};
+
+typedef std::map<Sample, SampleCount, SampleLess> SampleMap;
+
+concurrency::Mutex samples_mutex;
+SampleMap samples;
+// bumped by reset, so that threads drop the samples they took before it
+boost::atomic<uint32_t> samples_generation(0);
+
+void flushSamples(SampleBuffer& buffer) {
+  concurrency::Guard g(samples_mutex);
+  if (buffer.generation == samples_generation.load(boost::memory_order_relaxed)) {
+    for (uint32_t i = 0; i < buffer.size; ++i) {
+      SampleCount& count = samples[buffer.samples[i]];
+      ++count.samples;
+      count.calls += buffer.samples[i].weight;
+    }
+  }
+  buffer.size = 0;
+}
+
+#ifdef HAVE_PTHREAD_H
+// its destructor hands over the samples of a thread that exits
+pthread_key_t exit_key;
+pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+
+void flushAtExit(void* buffer) {
+  flushSamples(*static_cast<SampleBuffer*>(buffer));
+}
+
+void createExitKey() {
+  pthread_key_create(&exit_key, flushAtExit);
+}
+
+void flushSamplesAtExit(SampleBuffer& buffer) {
+  pthread_once(&exit_key_once, createExitKey);
+  pthread_setspecific(exit_key, &buffer);
+  buffer.flushesAtExit = true;
+}
+#else
+void flushSamplesAtExit(SampleBuffer& buffer) {
+  // a thread's last samples are lost when it exits
+  buffer.flushesAtExit = true;
+}
+#endif
+
+void takeSample(const char* typeName1, const char* typeName2, const char* function) {
+  // sampling may have been turned off since the caller looked
+  uint32_t rate = profile_sample_rate.load(boost::memory_order_relaxed);
+  if (rate == 0) {
+    return;
+  }
+  // A countdown of rate every time would keep landing on the same call of a
+  // repeating sequence of calls, so it is drawn from [1, 2 * rate - 1].  One
+  // drawn for a higher rate than the current one is drawn again.
+  SampleBuffer& buffer = sample_buffer;
+  uint64_t range = 2 * static_cast<uint64_t>(rate) - 1;
+  if (buffer.countdown > 1 && buffer.countdown <= range) {
+    --buffer.countdown;
+    return;
+  }
+  if (buffer.random == 0) {
+    buffer.random = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&buffer)) | 1;
+  }
+  buffer.random ^= buffer.random << 13;
+  buffer.random ^= buffer.random >> 17;
+  buffer.random ^= buffer.random << 5;
+  buffer.countdown = 1 + static_cast<uint32_t>(buffer.random % range);
+
+  if (!buffer.flushesAtExit) {
+    flushSamplesAtExit(buffer);
+  }
+  if (buffer.size == 0) {
+    buffer.generation = samples_generation.load(boost::memory_order_relaxed);
+  }
+  Sample& sample = buffer.samples[buffer.size++];
+  sample.typeName1 = typeName1;
+  sample.typeName2 = typeName2;
+  sample.function = function;
+  sample.weight = rate;
+  if (buffer.size == SAMPLE_BUFFER_SIZE) {
+    flushSamples(buffer);
+  }
+}
+
+std::string demangle(const char* name) {
+#ifdef __GNUG__
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(name, NULL, NULL, &status);
+  if (demangled != NULL) {
+    std::string result(demangled);
+    free(demangled);
+    return result;
+  }
+#endif
+  return name;
+}
+
+bool countGreater(const std::pair<Sample, SampleCount>& entry1,
+                  const std::pair<Sample, SampleCount>& entry2) {
+  return entry1.second.calls > entry2.second.calls;
+}
+}
+
+void profile_sampling_start(uint32_t sampleRate) {
+  profile_sample_rate.store(sampleRate == 0 ? 1 : sampleRate, boost::memory_order_relaxed);
+}
+
+void profile_sampling_stop() {
+  profile_sample_rate.store(0, boost::memory_order_relaxed);
+}
+
+void profile_sampling_reset() {
+  concurrency::Guard g(samples_mutex);
+  samples.clear();
+  samples_generation.fetch_add(1, boost::memory_order_relaxed);
+}
+
+/**
+ * Record a sampled call through the virtual interface of a protocol or a
+ * transport.
+ *
+ * This method is invoked by the T_VIRTUAL_CALL() macro.
+ */
+void profile_sample_virtual_call(const std::type_info& info, const char* function) {
+  takeSample(info.name(), NULL, function);
+}
+
+/**
+ * Record a sampled call to a template processor with a protocol that is not
+ * the one specified in the template parameter.
+ *
+ * This method is invoked by the T_GENERIC_PROTOCOL() macro.
+ */
+void profile_sample_generic_protocol(const std::type_info& template_type,
+                                     const std::type_info& prot_type) {
+  takeSample(template_type.name(), prot_type.name(), NULL);
+}
+
+std::string profile_sampling_info() {
+  flushSamples(sample_buffer);
+
+  std::vector<std::pair<Sample, SampleCount> > sorted;
+  {
+    concurrency::Guard g(samples_mutex);
+    sorted.assign(samples.begin(), samples.end());
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), countGreater);
+
+  std::ostringstream out;
+  std::vector<std::pair<Sample, SampleCount> >::const_iterator it;
+  for (it = sorted.begin(); it != sorted.end(); ++it) {
+    const Sample& sample = it->first;
+    if (sample.typeName2 != NULL) {
+      out << "T_GENERIC_PROTOCOL: ~" << it->second.calls << " calls (" << it->second.samples
+          << " sampled) to " << demangle(sample.typeName1) << " with a "
+          << demangle(sample.typeName2) << "\n";
+    } else {
+      out << "T_VIRTUAL_CALL: ~" << it->second.calls << " calls (" << it->second.samples
+          << " sampled) to " << sample.function << "() on " << demangle(sample.typeName1)
+          << "\n";
+    }
+  }
+  return out.str();
+}
+
+void profile_sampling_print(FILE* f) {
+  fputs(profile_sampling_info().c_str(), f);
+}
+}
+} // apache::thrift
 
-// Do nothing if virtual call profiling is not enabled
+// The rest is the backtrace profiling of T_GLOBAL_DEBUG_VIRTUAL=2
 #if T_GLOBAL_DEBUG_VIRTUAL > 1
 
 // TODO: This code only works with g++ (since we rely on the fact
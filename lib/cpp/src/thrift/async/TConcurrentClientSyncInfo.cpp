@@ -26,22 +26,35 @@ namespace apache { namespace thrift { namespace async {
 
 using namespace ::apache::thrift::concurrency;
 
-TConcurrentClientSyncInfo::TConcurrentClientSyncInfo() :
+TConcurrentClientSyncInfo::TConcurrentClientSyncInfo(size_t maxPending) :
   stop_(false),
-  seqidMutex_(),
   // test rollover all the time
   nextseqid_((std::numeric_limits<int32_t>::max)()-10),
-  seqidToMonitorMap_(),
-  freeMonitors_(),
+  slots_(),
+  slotMask_(0),
+  slotMonitor_(),
+  slotWaiters_(0),
   writeMutex_(),
   readMutex_(),
   recvPending_(false),
   wakeupSomeone_(false),
   seqidPending_(0),
   fnamePending_(),
-  mtypePending_(::apache::thrift::protocol::T_CALL)
+  mtypePending_(::apache::thrift::protocol::T_CALL),
+  firstWaiter_(NULL),
+  lastWaiter_(NULL)
 {
-  freeMonitors_.reserve(MONITOR_CACHE_SIZE);
+  size_t slotCount = 1;
+  while(slotCount < maxPending)
+    slotCount <<= 1;
+  slots_.reset(new Slot[slotCount]);
+  slotMask_ = slotCount - 1;
+}
+
+TConcurrentClientSyncInfo::~TConcurrentClientSyncInfo()
+{
+  for(size_t i = 0; i <= slotMask_; ++i)
+    delete slots_[i].monitor.load(boost::memory_order_relaxed);
 }
 
 bool TConcurrentClientSyncInfo::getPending(
@@ -72,38 +85,67 @@ void TConcurrentClientSyncInfo::updatePending(
   seqidPending_ = rseqid;
   fnamePending_ = fname;
   mtypePending_ = mtype;
-  MonitorPtr monitor;
-  {
-    Guard seqidGuard(seqidMutex_);
-    MonitorMap::iterator i = seqidToMonitorMap_.find(rseqid);
-    if(i == seqidToMonitorMap_.end())
-      throwBadSeqId_();
-    monitor = i->second;
-  }
-  monitor->notify();
+  Slot* slot = findSlot_(rseqid);
+  if(slot == NULL)
+    throwBadSeqId_();
+  slot->monitor.load(boost::memory_order_acquire)->notify();
 }
 
 void TConcurrentClientSyncInfo::waitForWork(int32_t seqid)
 {
-  MonitorPtr m;
+  Slot* slot = findSlot_(seqid);
+  if(slot == NULL)
+    throwBadSeqId_();
+  Monitor* m = slot->monitor.load(boost::memory_order_acquire);
+  pushWaiter_(slot);
+  try
   {
-    Guard seqidGuard(seqidMutex_);
-    m = seqidToMonitorMap_[seqid];
+    while(true)
+    {
+      // be very careful about setting state in this loop that affects waking up.  You may exit
+      // this function, attempt to grab some work, and someone else could have beaten you (or not
+      // left) the read mutex, and that will put you right back in this loop, with the mangled
+      // state you left behind.
+      if(stop_)
+        throwDeadConnection_();
+      if(wakeupSomeone_)
+        break;
+      if(recvPending_ && seqidPending_ == seqid)
+        break;
+      m->waitForever();
+    }
   }
-  while(true)
+  catch(...)
   {
-    // be very careful about setting state in this loop that affects waking up.  You may exit
-    // this function, attempt to grab some work, and someone else could have beaten you (or not
-    // left) the read mutex, and that will put you right back in this loop, with the mangled
-    // state you left behind.
-    if(stop_)
-      throwDeadConnection_();
-    if(wakeupSomeone_)
-      return;
-    if(recvPending_ && seqidPending_ == seqid)
-      return;
-    m->waitForever();
+    removeWaiter_(slot);
+    throw;
   }
+  removeWaiter_(slot);
+}
+
+void TConcurrentClientSyncInfo::pushWaiter_(Slot* slot)
+{
+  slot->prevWaiter = lastWaiter_;
+  slot->nextWaiter = NULL;
+  if(lastWaiter_ != NULL)
+    lastWaiter_->nextWaiter = slot;
+  else
+    firstWaiter_ = slot;
+  lastWaiter_ = slot;
+}
+
+void TConcurrentClientSyncInfo::removeWaiter_(Slot* slot)
+{
+  if(slot->prevWaiter != NULL)
+    slot->prevWaiter->nextWaiter = slot->nextWaiter;
+  else
+    firstWaiter_ = slot->nextWaiter;
+  if(slot->nextWaiter != NULL)
+    slot->nextWaiter->prevWaiter = slot->prevWaiter;
+  else
+    lastWaiter_ = slot->prevWaiter;
+  slot->prevWaiter = NULL;
+  slot->nextWaiter = NULL;
 }
 
 void TConcurrentClientSyncInfo::throwBadSeqId_()
@@ -120,72 +162,127 @@ void TConcurrentClientSyncInfo::throwDeadConnection_()
     "this client died on another thread, and is now in an unusable state");
 }
 
-void TConcurrentClientSyncInfo::wakeupAnyone_(const Guard &)
+TConcurrentClientSyncInfo::Slot* TConcurrentClientSyncInfo::findSlot_(int32_t seqid)
+{
+  Slot& slot = slots_[static_cast<uint32_t>(seqid) & slotMask_];
+  // the owner publishes seqid after claiming the slot, and a response can
+  // only arrive after its request was sent, so a match here is stable
+  if(slot.busy.load(boost::memory_order_acquire)
+     && slot.seqid.load(boost::memory_order_acquire) == seqid)
+    return &slot;
+  return NULL;
+}
+
+void TConcurrentClientSyncInfo::releaseSlot_(int32_t seqid)
+{
+  Slot* slot = findSlot_(seqid);
+  if(slot != NULL)
+    freeSlot_(*slot);
+}
+
+void TConcurrentClientSyncInfo::freeSlot_(Slot& slot)
+{
+  // sequentially consistent, so that either a waiter sees the slot free or
+  // this sees the waiter
+  slot.busy.store(false, boost::memory_order_seq_cst);
+  if(slotWaiters_.load(boost::memory_order_seq_cst) > 0)
+  {
+    Synchronized s(slotMonitor_);
+    slotMonitor_.notify();
+  }
+}
+
+void TConcurrentClientSyncInfo::wakeupAnyone_()
 {
+  if(stop_)
+  {
+    // markBad_() may have run on a sending thread that couldn't take the read
+    // mutex; repeat its wakeups now that no waiter can miss them.
+    markBad_();
+    return;
+  }
   wakeupSomeone_ = true;
-  if(!seqidToMonitorMap_.empty())
+  if(lastWaiter_ != NULL)
   {
-    // The monitor map maps integers to monitors.  Larger integers are more recent
-    // messages.  Since this is ordered, it means that the last element is the most recent.
-    // We are trying to guess which thread will have its message complete next, so we are picking
-    // the most recent. The oldest message is likely to be some polling, long lived message.
+    // We are trying to guess which thread will have its message complete next.  The most
+    // recent waiter is the most likely to still be hot in cache, and the oldest is likely
+    // to be some polling, long lived message.
     // If we guess right, the thread we wake up will handle the message that comes in.
     // If we guess wrong, the thread we wake up will hand off the work to the correct thread,
     // costing us an extra context switch.
-    seqidToMonitorMap_.rbegin()->second->notify();
+    lastWaiter_->monitor.load(boost::memory_order_acquire)->notify();
   }
 }
 
-void TConcurrentClientSyncInfo::markBad_(const Guard &)
+void TConcurrentClientSyncInfo::markBad_()
 {
-  wakeupSomeone_ = true;
   stop_ = true;
-  for(MonitorMap::iterator i = seqidToMonitorMap_.begin(); i != seqidToMonitorMap_.end(); ++i)
-    i->second->notify();
+  for(size_t i = 0; i <= slotMask_; ++i)
+  {
+    if(!slots_[i].busy.load(boost::memory_order_acquire))
+      continue;
+    Monitor* m = slots_[i].monitor.load(boost::memory_order_acquire);
+    if(m != NULL)
+      m->notify();
+  }
+  Synchronized s(slotMonitor_);
+  slotMonitor_.notifyAll();
 }
 
-TConcurrentClientSyncInfo::MonitorPtr
-TConcurrentClientSyncInfo::newMonitor_(const Guard &)
+int32_t TConcurrentClientSyncInfo::generateSeqId()
 {
-  if(freeMonitors_.empty())
-    return MonitorPtr(new Monitor(&readMutex_));
-  MonitorPtr retval;
-  //swapping to avoid an atomic operation
-  retval.swap(freeMonitors_.back());
-  freeMonitors_.pop_back();
-  return retval;
-}
+  int32_t seqid;
+  if(claimSlot_(seqid))
+    return seqid;
 
-void TConcurrentClientSyncInfo::deleteMonitor_(
-  const Guard &,
-  TConcurrentClientSyncInfo::MonitorPtr &m) /*noexcept*/
-{
-  if(freeMonitors_.size() > MONITOR_CACHE_SIZE)
+  // every slot is held; wait for a call to finish
+  Synchronized s(slotMonitor_);
+  ++slotWaiters_;
+  try
   {
-    m.reset();
-    return;
+    while(!claimSlot_(seqid))
+      slotMonitor_.waitForever();
   }
-  //freeMonitors_ was reserved up to MONITOR_CACHE_SIZE in the ctor,
-  //so this shouldn't throw
-  freeMonitors_.push_back(TConcurrentClientSyncInfo::MonitorPtr());
-  //swapping to avoid an atomic operation
-  m.swap(freeMonitors_.back());
+  catch(...)
+  {
+    --slotWaiters_;
+    throw;
+  }
+  --slotWaiters_;
+  return seqid;
 }
 
-int32_t TConcurrentClientSyncInfo::generateSeqId()
+bool TConcurrentClientSyncInfo::claimSlot_(int32_t& seqid)
 {
-  Guard seqidGuard(seqidMutex_);
   if(stop_)
     throwDeadConnection_();
 
-  if(!seqidToMonitorMap_.empty())
-    if(nextseqid_ == seqidToMonitorMap_.begin()->first)
-      throw apache::thrift::TApplicationException(
-        TApplicationException::BAD_SEQUENCE_ID,
-        "about to repeat a seqid");
-  int32_t newSeqId = nextseqid_++;
-  seqidToMonitorMap_[newSeqId] = newMonitor_(seqidGuard);
-  return newSeqId;
+  // A slot still held by a long running call is skipped rather than waited for;
+  // the server just echoes whatever seqid it is sent, so the gap is harmless.
+  for(size_t attempt = 0; attempt <= slotMask_; ++attempt)
+  {
+    int32_t newSeqId = nextseqid_.fetch_add(1, boost::memory_order_relaxed);
+    Slot& slot = slots_[static_cast<uint32_t>(newSeqId) & slotMask_];
+    if(slot.busy.exchange(true, boost::memory_order_acquire))
+      continue;
+    if(slot.monitor.load(boost::memory_order_relaxed) == NULL)
+    {
+      try
+      {
+        slot.monitor.store(new Monitor(&readMutex_), boost::memory_order_release);
+      }
+      catch(...)
+      {
+        // give the slot back, or it would stay busy for good
+        freeSlot_(slot);
+        throw;
+      }
+    }
+    slot.seqid.store(newSeqId, boost::memory_order_release);
+    seqid = newSeqId;
+    return true;
+  }
+  return false;
 }
 
 TConcurrentRecvSentry::TConcurrentRecvSentry(TConcurrentClientSyncInfo *sync, int32_t seqid) :
@@ -198,16 +295,11 @@ TConcurrentRecvSentry::TConcurrentRecvSentry(TConcurrentClientSyncInfo *sync, in
 
 TConcurrentRecvSentry::~TConcurrentRecvSentry()
 {
-  {
-    Guard seqidGuard(sync_.seqidMutex_);
-    sync_.deleteMonitor_(seqidGuard, sync_.seqidToMonitorMap_[seqid_]);
-
-    sync_.seqidToMonitorMap_.erase(seqid_);
-    if(committed_)
-      sync_.wakeupAnyone_(seqidGuard);
-    else
-      sync_.markBad_(seqidGuard);
-  }
+  sync_.releaseSlot_(seqid_);
+  if(committed_)
+    sync_.wakeupAnyone_();
+  else
+    sync_.markBad_();
   sync_.getReadMutex().unlock();
 }
 
@@ -226,10 +318,7 @@ TConcurrentSendSentry::TConcurrentSendSentry(TConcurrentClientSyncInfo *sync) :
 TConcurrentSendSentry::~TConcurrentSendSentry()
 {
   if(!committed_)
-  {
-    Guard seqidGuard(sync_.seqidMutex_);
-    sync_.markBad_(seqidGuard);
-  }
+    sync_.markBad_();
   sync_.getWriteMutex().unlock();
 }
 
@@ -23,9 +23,9 @@
 #include <thrift/concurrency/Mutex.h>
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/stdcxx.h>
-#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
 #include <string>
-#include <map>
 
 namespace apache {
 namespace thrift {
@@ -58,13 +58,34 @@ private:
   bool committed_;
 };
 
+/**
+ * Coordinates the threads sharing a Concurrent client's connection.
+ *
+ * Every outstanding call owns a slot in a fixed-size table indexed by its
+ * seqid.  Slots are claimed with atomic operations, so senders never touch
+ * the receive-side lock, and each slot carries its own condition so that a
+ * response read by another thread wakes exactly the caller it belongs to.
+ *
+ * Receiving stays serialized on readMutex_, which hands out the right to
+ * read from the shared input protocol; there is only one stream to read.
+ * What the table buys on that side is that the work done under the lock
+ * (finding a waiter, parking and unparking it) is constant time.
+ *
+ * When every slot is held, generateSeqId() waits for a call to finish
+ * rather than failing, so a client shared by more threads than there are
+ * slots still works, with the table bounding how many calls are on the
+ * wire at once.  A thread that sends more requests than there are slots
+ * before receiving any replies waits forever.
+ */
 class TConcurrentClientSyncInfo {
-private: // typedefs
-  typedef stdcxx::shared_ptr< ::apache::thrift::concurrency::Monitor> MonitorPtr;
-  typedef std::map<int32_t, MonitorPtr> MonitorMap;
-
 public:
-  TConcurrentClientSyncInfo();
+  /**
+   * @param maxPending upper bound on calls outstanding at the same time;
+   *                   rounded up to a power of two.  Generated clients use
+   *                   the default.
+   */
+  explicit TConcurrentClientSyncInfo(size_t maxPending = DEFAULT_MAX_PENDING);
+  ~TConcurrentClientSyncInfo();
 
   int32_t generateSeqId();
 
@@ -81,29 +102,42 @@ public:
   ::apache::thrift::concurrency::Mutex& getReadMutex() { return readMutex_; }
   ::apache::thrift::concurrency::Mutex& getWriteMutex() { return writeMutex_; }
 
-private: // constants
-  enum { MONITOR_CACHE_SIZE = 10 };
+  enum { DEFAULT_MAX_PENDING = 1024 };
+
+private: // types
+  struct Slot {
+    Slot() : busy(false), seqid(0), monitor(NULL), prevWaiter(NULL), nextWaiter(NULL) {}
+
+    boost::atomic<bool> busy;
+    boost::atomic<int32_t> seqid;
+    boost::atomic< ::apache::thrift::concurrency::Monitor*> monitor;
+    // links in the list of waiting slots, protected by readMutex_
+    Slot* prevWaiter;
+    Slot* nextWaiter;
+  };
 
 private: // functions
-  MonitorPtr newMonitor_(
-      const ::apache::thrift::concurrency::Guard& seqidGuard); /* requires seqidMutex_ */
-  void deleteMonitor_(const ::apache::thrift::concurrency::Guard& seqidGuard, MonitorPtr& m);
-      /*noexcept*/ /* requires seqidMutex_ */
-  void wakeupAnyone_(
-      const ::apache::thrift::concurrency::Guard& seqidGuard);           /* requires seqidMutex_ */
-  void markBad_(const ::apache::thrift::concurrency::Guard& seqidGuard); /* requires seqidMutex_ */
+  bool claimSlot_(int32_t& seqid);
+  void freeSlot_(Slot& slot);
+  Slot* findSlot_(int32_t seqid);
+  void releaseSlot_(int32_t seqid); /* requires readMutex_ */
+  void wakeupAnyone_();             /* requires readMutex_ */
+  void pushWaiter_(Slot* slot);     /* requires readMutex_ */
+  void removeWaiter_(Slot* slot);   /* requires readMutex_ */
+  void markBad_();
   void throwBadSeqId_();
   void throwDeadConnection_();
 
 private: // data members
-  volatile bool stop_;
+  boost::atomic<bool> stop_;
+
+  boost::atomic<int32_t> nextseqid_;
+  boost::scoped_array<Slot> slots_;
+  size_t slotMask_;
 
-  ::apache::thrift::concurrency::Mutex seqidMutex_;
-  // begin seqidMutex_ protected members
-  int32_t nextseqid_;
-  MonitorMap seqidToMonitorMap_;
-  std::vector<MonitorPtr> freeMonitors_;
-  // end seqidMutex_ protected members
+  // generateSeqId() waits here while every slot is held
+  ::apache::thrift::concurrency::Monitor slotMonitor_;
+  boost::atomic<uint32_t> slotWaiters_;
 
   ::apache::thrift::concurrency::Mutex writeMutex_;
 
@@ -114,6 +148,8 @@ private: // data members
   int32_t seqidPending_;
   std::string fnamePending_;
   ::apache::thrift::protocol::TMessageType mtypePending_;
+  Slot* firstWaiter_;
+  Slot* lastWaiter_;
   // end readMutex_ protected members
 
   friend class TConcurrentSendSentry;
@@ -0,0 +1,136 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/async/THedgedCall.h>
+
+#include <algorithm>
+#include <math.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+using namespace ::apache::thrift::concurrency;
+
+THedgePolicy::THedgePolicy(double percentile,
+                           int64_t minDelayUs,
+                           int64_t maxDelayUs,
+                           size_t windowSize,
+                           size_t minSamples)
+  : percentile_(percentile),
+    minDelayUs_(minDelayUs),
+    maxDelayUs_(maxDelayUs),
+    minSamples_(minSamples),
+    // re-sorting the whole window on every sample would cost more than the
+    // requests being measured, so the percentile is refreshed periodically
+    recomputeInterval_((std::max)(windowSize / 16, static_cast<size_t>(1))),
+    samples_(windowSize ? windowSize : 1, 0),
+    nextSample_(0),
+    sampleCount_(0),
+    sinceRecompute_(0),
+    computed_(false),
+    delayUs_(maxDelayUs) {
+  if (percentile_ <= 0.0 || percentile_ > 100.0) {
+    throw TException("THedgePolicy: percentile must be in (0, 100]");
+  }
+  if (minDelayUs_ < 0 || maxDelayUs_ < minDelayUs_) {
+    throw TException("THedgePolicy: invalid delay bounds");
+  }
+}
+
+void THedgePolicy::recordLatency(int64_t latencyUs) {
+  Guard g(mutex_);
+  samples_[nextSample_] = latencyUs;
+  nextSample_ = (nextSample_ + 1) % samples_.size();
+  if (sampleCount_ < samples_.size()) {
+    ++sampleCount_;
+  }
+  ++sinceRecompute_;
+}
+
+int64_t THedgePolicy::getHedgeDelay() const {
+  Guard g(mutex_);
+  if (sampleCount_ == 0 || sampleCount_ < minSamples_) {
+    return maxDelayUs_;
+  }
+  if (!computed_ || sinceRecompute_ >= recomputeInterval_) {
+    recompute_();
+  }
+  return delayUs_;
+}
+
+size_t THedgePolicy::getSampleCount() const {
+  Guard g(mutex_);
+  return sampleCount_;
+}
+
+void THedgePolicy::recompute_() const {
+  std::vector<int64_t> sorted(samples_.begin(), samples_.begin() + sampleCount_);
+  // nearest rank: the smallest sample with at least percentile_% of the
+  // window at or below it
+  double position = ceil((percentile_ / 100.0) * static_cast<double>(sorted.size()));
+  size_t rank = position < 1.0 ? 0 : static_cast<size_t>(position) - 1;
+  if (rank >= sorted.size()) {
+    rank = sorted.size() - 1;
+  }
+  std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+  delayUs_ = (std::min)((std::max)(sorted[rank], minDelayUs_), maxDelayUs_);
+  sinceRecompute_ = 0;
+  computed_ = true;
+}
+
+void THedgedCall::waitUntil(const Monitor& monitor, int64_t deadlineUs) {
+  struct THRIFT_TIMESPEC abstime;
+  abstime.tv_sec = static_cast<time_t>(deadlineUs / 1000000);
+  abstime.tv_nsec = static_cast<long>((deadlineUs % 1000000) * 1000);
+  monitor.waitForTime(&abstime);
+}
+
+void THedgedCall::launch(const VoidFunc& runner) {
+  threadManager_->add(FunctionRunner::create(runner));
+}
+
+void THedgedCall::recordOutcome(bool hedged, bool backupWon) {
+  Guard g(statsMutex_);
+  ++calls_;
+  if (hedged) {
+    ++hedges_;
+  }
+  if (backupWon) {
+    ++backupWins_;
+  }
+}
+
+uint64_t THedgedCall::getCallCount() const {
+  Guard g(statsMutex_);
+  return calls_;
+}
+
+uint64_t THedgedCall::getHedgeCount() const {
+  Guard g(statsMutex_);
+  return hedges_;
+}
+
+uint64_t THedgedCall::getBackupWinCount() const {
+  Guard g(statsMutex_);
+  return backupWins_;
+}
+}
+}
+} // apache::thrift::async
@@ -0,0 +1,282 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_ASYNC_THEDGEDCALL_H_
+#define _THRIFT_ASYNC_THEDGEDCALL_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/concurrency/FunctionRunner.h>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/concurrency/Util.h>
+#include <thrift/stdcxx.h>
+
+#include <boost/exception_ptr.hpp>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+/**
+ * Decides how long a hedged call waits for its primary request before it
+ * sends a backup request.
+ *
+ * The delay tracks a percentile of the most recent winning latencies
+ * (a sliding window of windowSize samples), clamped to
+ * [minDelayUs, maxDelayUs].  Until minSamples latencies have been recorded
+ * the policy uses maxDelayUs, so a cold client does not flood the backup.
+ */
+class THedgePolicy {
+public:
+  THedgePolicy(double percentile = 95.0,
+               int64_t minDelayUs = 1000,
+               int64_t maxDelayUs = 1000000,
+               size_t windowSize = 1024,
+               size_t minSamples = 32);
+
+  /** Records the latency in microseconds of a request that succeeded. */
+  void recordLatency(int64_t latencyUs);
+
+  /** Returns the current hedge delay in microseconds. */
+  int64_t getHedgeDelay() const;
+
+  double getPercentile() const { return percentile_; }
+
+  size_t getSampleCount() const;
+
+private:
+  void recompute_() const; /* requires mutex_ */
+
+  double percentile_;
+  int64_t minDelayUs_;
+  int64_t maxDelayUs_;
+  size_t minSamples_;
+  size_t recomputeInterval_;
+
+  mutable ::apache::thrift::concurrency::Mutex mutex_;
+  // begin mutex_ protected members
+  std::vector<int64_t> samples_;
+  size_t nextSample_;
+  size_t sampleCount_;
+  mutable size_t sinceRecompute_;
+  mutable bool computed_;
+  mutable int64_t delayUs_;
+  // end mutex_ protected members
+};
+
+/**
+ * Issues an idempotent call against a primary endpoint and, if it has not
+ * answered within the THedgePolicy delay, a duplicate call against a backup
+ * endpoint.  The first successful response is returned to the caller; the
+ * other leg keeps running on its pool thread and its response is discarded.
+ *
+ * Each leg is an arbitrary callable, which is usually a bound method of a
+ * generated Concurrent client.  Because the concurrent client demultiplexes
+ * responses by seqid, the abandoned leg drains its reply without blocking
+ * other callers sharing that connection:
+ *
+ *   THedgedCall hedge(threadManager, policy);
+ *   std::string name;
+ *   hedge.call<std::string>(name,
+ *                           bind(&FooConcurrentClient::getName, primary, _1, id),
+ *                           bind(&FooConcurrentClient::getName, backup, _1, id));
+ *
+ * If the primary leg fails before the delay expires, the backup is sent
+ * immediately.  If every leg that was sent fails, the primary's exception
+ * is rethrown.  The ThreadManager needs at least two workers per
+ * concurrently outstanding hedged call.
+ */
+class THedgedCall {
+public:
+  typedef stdcxx::function<void()> VoidFunc;
+
+  THedgedCall(stdcxx::shared_ptr< ::apache::thrift::concurrency::ThreadManager> threadManager,
+              stdcxx::shared_ptr<THedgePolicy> policy
+              = stdcxx::shared_ptr<THedgePolicy>(new THedgePolicy()))
+    : threadManager_(threadManager), policy_(policy), calls_(0), hedges_(0), backupWins_(0) {}
+
+  /**
+   * Runs a call whose result is delivered through its single reference
+   * argument, e.g. the generated "void getName(std::string& _return, ...)".
+   * Result must be default constructible and swappable.
+   */
+  template <typename Result>
+  void call(Result& result,
+            const stdcxx::function<void(Result&)>& primary,
+            const stdcxx::function<void(Result&)>& backup);
+
+  /** Runs a call with no result, such as a void service method. */
+  void call(const VoidFunc& primary, const VoidFunc& backup);
+
+  stdcxx::shared_ptr<THedgePolicy> getPolicy() const { return policy_; }
+
+  /** Number of calls issued through this object. */
+  uint64_t getCallCount() const;
+
+  /** Number of calls for which a backup request was sent. */
+  uint64_t getHedgeCount() const;
+
+  /** Number of calls answered by the backup request. */
+  uint64_t getBackupWinCount() const;
+
+private:
+  enum { PRIMARY = 0, BACKUP = 1 };
+
+  /**
+   * State shared by the caller and both legs.  It outlives call() when a
+   * losing leg is still running, so the legs only touch heap storage.
+   */
+  template <typename Result>
+  struct State {
+    State() : done(false), winner(PRIMARY), launched(1), failed(0) {}
+
+    ::apache::thrift::concurrency::Monitor monitor;
+    // begin monitor protected members
+    bool done;
+    int winner;
+    int launched;
+    int failed;
+    Result result;
+    boost::exception_ptr errors[2];
+    // end monitor protected members
+  };
+
+  template <typename Result>
+  static void runLeg(stdcxx::shared_ptr<State<Result> > state,
+                     stdcxx::function<void(Result&)> fn,
+                     stdcxx::shared_ptr<THedgePolicy> policy,
+                     int leg);
+
+  static void invokeVoid(const VoidFunc& fn, bool&) { fn(); }
+
+  static void waitUntil(const ::apache::thrift::concurrency::Monitor& monitor, int64_t deadlineUs);
+  void launch(const VoidFunc& runner);
+  void recordOutcome(bool hedged, bool backupWon);
+
+  stdcxx::shared_ptr< ::apache::thrift::concurrency::ThreadManager> threadManager_;
+  stdcxx::shared_ptr<THedgePolicy> policy_;
+
+  mutable ::apache::thrift::concurrency::Mutex statsMutex_;
+  uint64_t calls_;
+  uint64_t hedges_;
+  uint64_t backupWins_;
+};
+
+template <typename Result>
+void THedgedCall::runLeg(stdcxx::shared_ptr<State<Result> > state,
+                         stdcxx::function<void(Result&)> fn,
+                         stdcxx::shared_ptr<THedgePolicy> policy,
+                         int leg) {
+  using ::apache::thrift::concurrency::Synchronized;
+  using ::apache::thrift::concurrency::Util;
+
+  int64_t start = Util::currentTimeUsec();
+  Result local;
+  try {
+    fn(local);
+  } catch (...) {
+    Synchronized s(state->monitor);
+    state->errors[leg] = boost::current_exception();
+    ++state->failed;
+    state->monitor.notify();
+    return;
+  }
+  int64_t latencyUs = Util::currentTimeUsec() - start;
+
+  {
+    Synchronized s(state->monitor);
+    if (state->done) {
+      // a losing leg's latency would skew the window toward slow replies
+      return;
+    }
+    using std::swap;
+    swap(state->result, local);
+    state->winner = leg;
+    state->done = true;
+    state->monitor.notify();
+  }
+  policy->recordLatency(latencyUs);
+}
+
+template <typename Result>
+void THedgedCall::call(Result& result,
+                       const stdcxx::function<void(Result&)>& primary,
+                       const stdcxx::function<void(Result&)>& backup) {
+  using ::apache::thrift::concurrency::Synchronized;
+  using ::apache::thrift::concurrency::Util;
+
+  stdcxx::shared_ptr<State<Result> > state(new State<Result>());
+  int64_t hedgeAtUs = Util::currentTimeUsec() + policy_->getHedgeDelay();
+
+  launch(stdcxx::bind(&THedgedCall::runLeg<Result>, state, primary, policy_, (int)PRIMARY));
+
+  bool hedged = false;
+  {
+    Synchronized s(state->monitor);
+    while (!state->done) {
+      bool allFailed = (state->failed == state->launched);
+      if (hedged) {
+        if (allFailed) {
+          break;
+        }
+        state->monitor.waitForever();
+        continue;
+      }
+      if (!allFailed && Util::currentTimeUsec() < hedgeAtUs) {
+        waitUntil(state->monitor, hedgeAtUs);
+        continue;
+      }
+      // the primary is slow (or already failed): send the backup request
+      hedged = true;
+      ++state->launched;
+      state->monitor.unlock();
+      try {
+        launch(stdcxx::bind(&THedgedCall::runLeg<Result>, state, backup, policy_, (int)BACKUP));
+      } catch (...) {
+        state->monitor.lock();
+        --state->launched;
+        throw;
+      }
+      state->monitor.lock();
+    }
+
+    if (!state->done) {
+      recordOutcome(hedged, false);
+      boost::rethrow_exception(state->errors[PRIMARY] ? state->errors[PRIMARY]
+                                                      : state->errors[BACKUP]);
+    }
+    using std::swap;
+    swap(result, state->result);
+    recordOutcome(hedged, state->winner == BACKUP);
+  }
+}
+
+inline void THedgedCall::call(const VoidFunc& primary, const VoidFunc& backup) {
+  bool unused;
+  call<bool>(unused,
+             stdcxx::bind(&THedgedCall::invokeVoid, primary, stdcxx::placeholders::_1),
+             stdcxx::bind(&THedgedCall::invokeVoid, backup, stdcxx::placeholders::_1));
+}
+}
+}
+} // apache::thrift::async
+
+#endif // _THRIFT_ASYNC_THEDGEDCALL_H_
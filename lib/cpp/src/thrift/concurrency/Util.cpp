@@ -39,6 +39,20 @@ int64_t Util::currentTimeTicks(int64_t ticksPerSec) {
   toTicks(result, now, ticksPerSec);
   return result;
 }
+
+int64_t Util::monotonicTimeTicks(int64_t ticksPerSec) {
+#ifdef CLOCK_MONOTONIC
+  int64_t result;
+  struct timespec now;
+  int ret = clock_gettime(CLOCK_MONOTONIC, &now);
+  assert(ret == 0);
+  THRIFT_UNUSED_VARIABLE(ret); // squelching "unused variable" warning
+  toTicks(result, now.tv_sec, now.tv_nsec, NS_PER_S, ticksPerSec);
+  return result;
+#else
+  return currentTimeTicks(ticksPerSec);
+#endif
+}
 }
 }
 } // apache::thrift::concurrency
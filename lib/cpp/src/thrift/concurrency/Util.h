@@ -143,6 +143,18 @@ public:
    * Get current time as micros from epoch
    */
   static int64_t currentTimeUsec() { return currentTimeTicks(US_PER_S); }
+
+  /**
+   * Get the time as a number of arbitrary-size ticks from an unspecified
+   * start, on a clock that setting the time of day does not move, where the
+   * platform has one.  For measuring intervals.
+   */
+  static int64_t monotonicTimeTicks(int64_t ticksPerSec);
+
+  /**
+   * Get the monotonic time as micros
+   */
+  static int64_t monotonicTimeUsec() { return monotonicTimeTicks(US_PER_S); }
 };
 }
 }
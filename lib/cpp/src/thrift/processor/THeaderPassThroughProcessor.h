@@ -0,0 +1,81 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_THEADERPASSTHROUGHPROCESSOR_H_
+#define _THRIFT_PROCESSOR_THEADERPASSTHROUGHPROCESSOR_H_ 1
+
+#include <string>
+#include <thrift/processor/TPassThroughProcessor.h>
+#include <thrift/transport/THeaderTransport.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * A TPassThroughProcessor for THeader connections.  It passes the headers of
+ * each call and reply along when both sides use THeaderTransport, and can
+ * route calls on the value of a header before their names.
+ *
+ * Like THeaderTransport, it needs libthriftz.
+ */
+class THeaderPassThroughProcessor : public TPassThroughProcessor {
+public:
+  /**
+   * Routes calls on the value of this header before their names.
+   */
+  void setRouteHeader(const std::string& header) { routeHeader_ = header; }
+
+protected:
+  virtual std::string routeKey(protocol::TProtocol& in) {
+    transport::THeaderTransport* trans = getHeaderTransport(in);
+    if (routeHeader_.empty() || trans == NULL) {
+      return std::string();
+    }
+    const transport::THeaderTransport::StringToStringMap& headers = trans->getHeaders();
+    transport::THeaderTransport::StringToStringMap::const_iterator value
+        = headers.find(routeHeader_);
+    return value == headers.end() ? std::string() : value->second;
+  }
+
+  virtual void forwardHeaders(protocol::TProtocol& from, protocol::TProtocol& to) {
+    transport::THeaderTransport* source = getHeaderTransport(from);
+    transport::THeaderTransport* sink = getHeaderTransport(to);
+    if (source == NULL || sink == NULL) {
+      return;
+    }
+    const transport::THeaderTransport::StringToStringMap& headers = source->getHeaders();
+    transport::THeaderTransport::StringToStringMap::const_iterator it;
+    for (it = headers.begin(); it != headers.end(); ++it) {
+      sink->setHeader(it->first, it->second);
+    }
+  }
+
+private:
+  static transport::THeaderTransport* getHeaderTransport(protocol::TProtocol& proto) {
+    return dynamic_cast<transport::THeaderTransport*>(proto.getTransport().get());
+  }
+
+  std::string routeHeader_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_THEADERPASSTHROUGHPROCESSOR_H_
@@ -0,0 +1,145 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/processor/THttp2ConcurrentProcessor.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THttp2Transport.h>
+
+#include <string>
+
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::transport::THttp2Connection;
+using apache::thrift::transport::THttp2Server;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransportException;
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+namespace {
+
+/**
+ * The call on one stream, run by a worker thread.
+ */
+class StreamCall : public Runnable {
+public:
+  StreamCall(stdcxx::shared_ptr<TProcessor> processor,
+             stdcxx::shared_ptr<TProtocolFactory> protocolFactory,
+             stdcxx::shared_ptr<THttp2Connection> connection,
+             int32_t stream,
+             void* connectionContext)
+    : processor_(processor),
+      protocolFactory_(protocolFactory),
+      connection_(connection),
+      stream_(stream),
+      connectionContext_(connectionContext) {}
+
+  std::string& body() { return body_; }
+
+  void run() {
+    stdcxx::shared_ptr<TMemoryBuffer> input(
+        new TMemoryBuffer(reinterpret_cast<uint8_t*>(const_cast<char*>(body_.data())),
+                          static_cast<uint32_t>(body_.size())));
+    stdcxx::shared_ptr<TMemoryBuffer> output(new TMemoryBuffer());
+    try {
+      processor_->process(protocolFactory_->getProtocol(input),
+                          protocolFactory_->getProtocol(output),
+                          connectionContext_);
+    } catch (const TException& te) {
+      GlobalOutput.printf("THttp2ConcurrentProcessor: call failed: %s", te.what());
+      connection_->resetStream(stream_);
+      return;
+    }
+
+    // a oneway call gets an empty response, which closes its stream
+    uint8_t* buf;
+    uint32_t len;
+    output->getBuffer(&buf, &len);
+    try {
+      connection_->sendResponse(stream_, buf, len);
+    } catch (const TException& te) {
+      GlobalOutput.printf("THttp2ConcurrentProcessor: response failed: %s", te.what());
+    }
+  }
+
+private:
+  stdcxx::shared_ptr<TProcessor> processor_;
+  stdcxx::shared_ptr<TProtocolFactory> protocolFactory_;
+  stdcxx::shared_ptr<THttp2Connection> connection_;
+  int32_t stream_;
+  void* connectionContext_;
+  std::string body_;
+};
+}
+
+THttp2ConcurrentProcessor::THttp2ConcurrentProcessor(
+    stdcxx::shared_ptr<TProcessor> processor,
+    stdcxx::shared_ptr<TProtocolFactory> protocolFactory,
+    stdcxx::shared_ptr<ThreadManager> threadManager)
+  : processor_(processor), protocolFactory_(protocolFactory), threadManager_(threadManager) {
+}
+
+THttp2ConcurrentProcessor::~THttp2ConcurrentProcessor() {
+}
+
+bool THttp2ConcurrentProcessor::process(stdcxx::shared_ptr<TProtocol> in,
+                                        stdcxx::shared_ptr<TProtocol> out,
+                                        void* connectionContext) {
+  THRIFT_UNUSED_VARIABLE(out);
+  stdcxx::shared_ptr<THttp2Server> server
+      = stdcxx::dynamic_pointer_cast<THttp2Server>(in->getTransport());
+  if (!server) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "THttp2ConcurrentProcessor needs a THttp2Server transport");
+  }
+  stdcxx::shared_ptr<THttp2Connection> connection = server->getConnection();
+
+  // the calls still running use the connection, and the context, until
+  // they are answered
+  std::string body;
+  int32_t stream;
+  try {
+    stream = connection->receiveRequest(body);
+  } catch (...) {
+    connection->waitForAnswers();
+    throw;
+  }
+  if (stream == 0) {
+    connection->waitForAnswers();
+    return false;
+  }
+
+  stdcxx::shared_ptr<StreamCall> call(
+      new StreamCall(processor_, protocolFactory_, connection, stream, connectionContext));
+  call->body().swap(body);
+  try {
+    threadManager_->add(call);
+  } catch (const TException& te) {
+    GlobalOutput.printf("THttp2ConcurrentProcessor: call not run: %s", te.what());
+    connection->resetStream(stream);
+  }
+  return true;
+}
+}
+}
+} // apache::thrift::processor
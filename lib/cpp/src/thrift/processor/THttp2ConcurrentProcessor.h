@@ -0,0 +1,68 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_THTTP2CONCURRENTPROCESSOR_H_
+#define _THRIFT_PROCESSOR_THTTP2CONCURRENTPROCESSOR_H_ 1
+
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/stdcxx.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * A processor for servers whose transports are THttp2Server, that runs the
+ * call of each stream as a task on a ThreadManager, so that a slow call
+ * does not hold up the other streams of its connection.
+ *
+ * process() takes the next complete request off the connection, hands it
+ * to processor on a worker thread with protocols from protocolFactory over
+ * the request and response bodies, and returns for the next one.  A call
+ * that throws, or that the ThreadManager does not take, has its stream
+ * reset.  Once the client has gone, process() waits for the calls still
+ * running before it returns false.
+ *
+ * processor and its handler are used from several threads at once.  How
+ * many calls a connection has running is bounded by its maximum number of
+ * concurrent streams.
+ */
+class THttp2ConcurrentProcessor : public TProcessor {
+public:
+  THttp2ConcurrentProcessor(stdcxx::shared_ptr<TProcessor> processor,
+                            stdcxx::shared_ptr<protocol::TProtocolFactory> protocolFactory,
+                            stdcxx::shared_ptr<concurrency::ThreadManager> threadManager);
+  virtual ~THttp2ConcurrentProcessor();
+
+  virtual bool process(stdcxx::shared_ptr<protocol::TProtocol> in,
+                       stdcxx::shared_ptr<protocol::TProtocol> out,
+                       void* connectionContext);
+
+private:
+  stdcxx::shared_ptr<TProcessor> processor_;
+  stdcxx::shared_ptr<protocol::TProtocolFactory> protocolFactory_;
+  stdcxx::shared_ptr<concurrency::ThreadManager> threadManager_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_THTTP2CONCURRENTPROCESSOR_H_
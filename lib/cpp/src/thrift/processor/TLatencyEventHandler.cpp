@@ -0,0 +1,519 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/processor/TLatencyEventHandler.h>
+#include <thrift/concurrency/Util.h>
+
+#include <boost/atomic.hpp>
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+#include <vector>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Util;
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+TLatencyHistogram::TLatencyHistogram() {
+  clear();
+}
+
+uint32_t TLatencyHistogram::getBucket(uint64_t value) {
+  if (value < (1u << SUB_BUCKET_BITS)) {
+    return static_cast<uint32_t>(value);
+  }
+  uint32_t exponent = SUB_BUCKET_BITS;
+  while (exponent < VALUE_BITS && (value >> (exponent + 1)) != 0) {
+    ++exponent;
+  }
+  if (exponent >= VALUE_BITS) {
+    return BUCKET_COUNT - 1;
+  }
+  uint32_t shift = exponent - SUB_BUCKET_BITS;
+  uint32_t sub = static_cast<uint32_t>(value >> shift) & ((1u << SUB_BUCKET_BITS) - 1);
+  return ((shift + 1) << SUB_BUCKET_BITS) + sub;
+}
+
+uint64_t TLatencyHistogram::getBucketLimit(uint32_t bucket) {
+  if (bucket < (1u << SUB_BUCKET_BITS)) {
+    return bucket;
+  }
+  uint32_t shift = (bucket >> SUB_BUCKET_BITS) - 1;
+  uint64_t sub = (1u << SUB_BUCKET_BITS) + (bucket & ((1u << SUB_BUCKET_BITS) - 1));
+  return ((sub + 1) << shift) - 1;
+}
+
+void TLatencyHistogram::record(int64_t usec) {
+  // nothing takes negative time
+  if (usec < 0) {
+    usec = 0;
+  }
+  ++counts_[getBucket(static_cast<uint64_t>(usec))];
+  if (count_ == 0 || usec < min_) {
+    min_ = usec;
+  }
+  if (usec > max_) {
+    max_ = usec;
+  }
+  ++count_;
+  sum_ += static_cast<uint64_t>(usec);
+}
+
+void TLatencyHistogram::merge(const TLatencyHistogram& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+  for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  if (count_ == 0 || other.min_ < min_) {
+    min_ = other.min_;
+  }
+  if (other.max_ > max_) {
+    max_ = other.max_;
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+void TLatencyHistogram::clear() {
+  for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+    counts_[i] = 0;
+  }
+  count_ = 0;
+  sum_ = 0;
+  min_ = 0;
+  max_ = 0;
+}
+
+int64_t TLatencyHistogram::getPercentile(double percent) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  double rank = percent / 100.0 * static_cast<double>(count_);
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < BUCKET_COUNT; ++i) {
+    seen += counts_[i];
+    if (seen > 0 && static_cast<double>(seen) >= rank) {
+      if (i == BUCKET_COUNT - 1) {
+        return max_;
+      }
+      int64_t limit = static_cast<int64_t>(getBucketLimit(i));
+      return limit > max_ ? max_ : (limit < min_ ? min_ : limit);
+    }
+  }
+  return max_;
+}
+
+void TMethodLatency::merge(const TMethodLatency& other) {
+  read.merge(other.read);
+  handler.merge(other.handler);
+  write.merge(other.write);
+  total.merge(other.total);
+  errors += other.errors;
+}
+
+/**
+ * The times of the phases of one call, in microseconds on the monotonic
+ * clock; zero until they happen.  Kept for reuse once the call is over.
+ */
+struct TLatencyEventHandler::CallTimes {
+  ThreadLatency* thread;
+  TMethodLatency* latency;
+  int64_t start;
+  int64_t readStart;
+  int64_t readEnd;
+  int64_t writeStart;
+  int64_t writeEnd;
+  bool error;
+};
+
+/**
+ * What one thread has recorded.  Only that thread adds methods and calls, and
+ * the mutex keeps getSnapshot() and reset() out while it records.
+ */
+struct TLatencyEventHandler::ThreadLatency {
+  // the names of stale pointers are dropped past this many
+  static const size_t MAX_NAMES = 1024;
+
+  ~ThreadLatency() {
+    for (size_t i = 0; i < freeCalls.size(); ++i) {
+      delete freeCalls[i];
+    }
+  }
+
+  /**
+   * Generated processors pass their method names as literals, so a method is
+   * looked up by the pointer to its name, and only the first call to it
+   * copies the name.
+   */
+  TMethodLatency& getMethod(const char* fn_name) {
+    std::map<const char*, TLatencySnapshot::iterator>::iterator name = names.find(fn_name);
+    if (name != names.end() && strcmp(name->second->first.c_str(), fn_name) == 0) {
+      return name->second->second;
+    }
+    if (names.size() >= MAX_NAMES) {
+      names.clear();
+    }
+    TLatencySnapshot::iterator method = methods.find(fn_name);
+    if (method == methods.end()) {
+      method = methods.insert(TLatencySnapshot::value_type(fn_name, TMethodLatency())).first;
+    }
+    names[fn_name] = method;
+    return method->second;
+  }
+
+  concurrency::Mutex mutex;
+  TLatencySnapshot methods;
+  std::map<const char*, TLatencySnapshot::iterator> names;
+  std::vector<CallTimes*> freeCalls;
+};
+
+namespace {
+
+boost::atomic<uint64_t> handler_serials(0);
+
+// the handler this thread last recorded into, and its ThreadLatency there
+THRIFT_THREAD_LOCAL uint64_t cached_handler = 0;
+THRIFT_THREAD_LOCAL void* cached_latency = NULL;
+
+// The address of this tells live threads apart.  A thread started after
+// another has exited may get the same one, once the first one's histograms
+// have been retired.
+THRIFT_THREAD_LOCAL char thread_marker;
+
+#ifdef HAVE_PTHREAD_H
+// the handlers alive, by serial, for exiting threads to find theirs in
+concurrency::Mutex live_handlers_mutex;
+std::map<uint64_t, TLatencyEventHandler*> live_handlers;
+
+// the serials of the handlers this thread has recorded into
+THRIFT_THREAD_LOCAL std::vector<uint64_t>* thread_handlers = NULL;
+
+// its destructor retires the histograms of a thread that exits
+pthread_key_t exit_key;
+pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+#endif
+
+const double PERCENTILES[] = {50.0, 90.0, 99.0, 99.9};
+const char* const PERCENTILE_NAMES[] = {"p50", "p90", "p99", "p99.9"};
+const size_t PERCENTILE_COUNT = sizeof(PERCENTILES) / sizeof(PERCENTILES[0]);
+
+const char* const PHASE_NAMES[] = {"read", "handler", "write", "total"};
+const size_t PHASE_COUNT = sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]);
+
+const TLatencyHistogram& getPhase(const TMethodLatency& latency, size_t phase) {
+  switch (phase) {
+  case 0:
+    return latency.read;
+  case 1:
+    return latency.handler;
+  case 2:
+    return latency.write;
+  default:
+    return latency.total;
+  }
+}
+
+void writeJSONString(std::ostringstream& out, const std::string& str) {
+  out << '"';
+  for (std::string::const_iterator it = str.begin(); it != str.end(); ++it) {
+    if (*it == '"' || *it == '\\') {
+      out << '\\';
+    }
+    out << *it;
+  }
+  out << '"';
+}
+}
+
+/**
+ * Retires what a thread recorded in each handler when it exits, where
+ * pthreads let a thread run code on its way out; elsewhere it is kept until
+ * the handler goes.
+ */
+struct TLatencyEventHandler::ThreadExit {
+#ifdef HAVE_PTHREAD_H
+  static void createKey() { pthread_key_create(&exit_key, retire); }
+
+  static void retire(void* handlers) {
+    std::vector<uint64_t>* serials = static_cast<std::vector<uint64_t>*>(handlers);
+    {
+      // keeps the handlers from being destroyed under us
+      Guard g(live_handlers_mutex);
+      for (size_t i = 0; i < serials->size(); ++i) {
+        std::map<uint64_t, TLatencyEventHandler*>::iterator handler
+            = live_handlers.find((*serials)[i]);
+        if (handler != live_handlers.end()) {
+          handler->second->retireThread(&thread_marker);
+        }
+      }
+    }
+    delete serials;
+  }
+
+  static void add(TLatencyEventHandler* handler) {
+    Guard g(live_handlers_mutex);
+    live_handlers[handler->serial_] = handler;
+  }
+
+  static void remove(TLatencyEventHandler* handler) {
+    Guard g(live_handlers_mutex);
+    live_handlers.erase(handler->serial_);
+  }
+
+  static void watch(uint64_t serial) {
+    if (thread_handlers == NULL) {
+      pthread_once(&exit_key_once, createKey);
+      thread_handlers = new std::vector<uint64_t>();
+      pthread_setspecific(exit_key, thread_handlers);
+    }
+    thread_handlers->push_back(serial);
+  }
+#else
+  static void add(TLatencyEventHandler* handler) { (void)handler; }
+  static void remove(TLatencyEventHandler* handler) { (void)handler; }
+  static void watch(uint64_t serial) { (void)serial; }
+#endif
+};
+
+TLatencyEventHandler::TLatencyEventHandler() : serial_(++handler_serials) {
+  ThreadExit::add(this);
+}
+
+TLatencyEventHandler::~TLatencyEventHandler() {
+  ThreadExit::remove(this);
+  std::map<const void*, ThreadLatency*>::iterator it;
+  for (it = threads_.begin(); it != threads_.end(); ++it) {
+    delete it->second;
+  }
+}
+
+TLatencyEventHandler::ThreadLatency& TLatencyEventHandler::getThreadLatency() {
+  // serials are never reused, so a thread cannot find a destroyed handler here
+  if (cached_handler == serial_) {
+    return *static_cast<ThreadLatency*>(cached_latency);
+  }
+  ThreadLatency* latency;
+  {
+    Guard g(mutex_);
+    ThreadLatency*& entry = threads_[&thread_marker];
+    if (entry == NULL) {
+      entry = new ThreadLatency();
+      ThreadExit::watch(serial_);
+    }
+    latency = entry;
+  }
+  cached_handler = serial_;
+  cached_latency = latency;
+  return *latency;
+}
+
+void* TLatencyEventHandler::getContext(const char* fn_name, void* serverContext) {
+  (void)serverContext;
+  ThreadLatency& thread = getThreadLatency();
+  CallTimes* times;
+  {
+    Guard g(thread.mutex);
+    if (thread.freeCalls.empty()) {
+      times = new CallTimes();
+    } else {
+      times = thread.freeCalls.back();
+      thread.freeCalls.pop_back();
+    }
+    times->latency = &thread.getMethod(fn_name);
+  }
+  times->thread = &thread;
+  times->readStart = 0;
+  times->readEnd = 0;
+  times->writeStart = 0;
+  times->writeEnd = 0;
+  times->error = false;
+  times->start = Util::monotonicTimeUsec();
+  return times;
+}
+
+void TLatencyEventHandler::preRead(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  static_cast<CallTimes*>(ctx)->readStart = Util::monotonicTimeUsec();
+}
+
+void TLatencyEventHandler::postRead(void* ctx, const char* fn_name, uint32_t bytes) {
+  (void)fn_name;
+  (void)bytes;
+  static_cast<CallTimes*>(ctx)->readEnd = Util::monotonicTimeUsec();
+}
+
+void TLatencyEventHandler::preWrite(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  static_cast<CallTimes*>(ctx)->writeStart = Util::monotonicTimeUsec();
+}
+
+void TLatencyEventHandler::postWrite(void* ctx, const char* fn_name, uint32_t bytes) {
+  (void)fn_name;
+  (void)bytes;
+  static_cast<CallTimes*>(ctx)->writeEnd = Util::monotonicTimeUsec();
+}
+
+void TLatencyEventHandler::handlerError(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  static_cast<CallTimes*>(ctx)->error = true;
+}
+
+void TLatencyEventHandler::freeContext(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  CallTimes* times = static_cast<CallTimes*>(ctx);
+  if (times == NULL) {
+    return;
+  }
+  int64_t end = Util::monotonicTimeUsec();
+
+  ThreadLatency& thread = *times->thread;
+  Guard g(thread.mutex);
+  TMethodLatency& latency = *times->latency;
+  if (times->readStart != 0 && times->readEnd != 0) {
+    latency.read.record(times->readEnd - times->readStart);
+    // oneway calls end with their handler
+    latency.handler.record((times->writeStart != 0 ? times->writeStart : end) - times->readEnd);
+  }
+  if (times->writeStart != 0 && times->writeEnd != 0) {
+    latency.write.record(times->writeEnd - times->writeStart);
+  }
+  latency.total.record(end - times->start);
+  if (times->error) {
+    ++latency.errors;
+  }
+  thread.freeCalls.push_back(times);
+}
+
+void TLatencyEventHandler::retireThread(const void* marker) {
+  Guard g(mutex_);
+  std::map<const void*, ThreadLatency*>::iterator thread = threads_.find(marker);
+  if (thread == threads_.end()) {
+    return;
+  }
+  TLatencySnapshot::const_iterator it;
+  for (it = thread->second->methods.begin(); it != thread->second->methods.end(); ++it) {
+    if (it->second.total.getCount() != 0) {
+      retired_[it->first].merge(it->second);
+    }
+  }
+  delete thread->second;
+  threads_.erase(thread);
+}
+
+void TLatencyEventHandler::getSnapshot(TLatencySnapshot& snapshot) const {
+  Guard g(mutex_);
+  TLatencySnapshot::const_iterator it;
+  for (it = retired_.begin(); it != retired_.end(); ++it) {
+    snapshot[it->first].merge(it->second);
+  }
+  std::map<const void*, ThreadLatency*>::const_iterator thread;
+  for (thread = threads_.begin(); thread != threads_.end(); ++thread) {
+    Guard tg(thread->second->mutex);
+    for (it = thread->second->methods.begin(); it != thread->second->methods.end(); ++it) {
+      // reset() leaves methods in place, empty
+      if (it->second.total.getCount() != 0) {
+        snapshot[it->first].merge(it->second);
+      }
+    }
+  }
+}
+
+void TLatencyEventHandler::reset() {
+  Guard g(mutex_);
+  retired_.clear();
+  std::map<const void*, ThreadLatency*>::iterator thread;
+  for (thread = threads_.begin(); thread != threads_.end(); ++thread) {
+    // calls under way hold on to their methods, so these are cleared, not erased
+    Guard tg(thread->second->mutex);
+    TLatencySnapshot::iterator it;
+    for (it = thread->second->methods.begin(); it != thread->second->methods.end(); ++it) {
+      it->second = TMethodLatency();
+    }
+  }
+}
+
+std::string TLatencyEventHandler::toText(const TLatencySnapshot& snapshot) {
+  std::ostringstream out;
+  out << std::left << std::setw(40) << "method" << std::setw(8) << "phase" << std::right
+      << std::setw(10) << "count" << std::setw(10) << "min" << std::setw(10) << "mean";
+  for (size_t p = 0; p < PERCENTILE_COUNT; ++p) {
+    out << std::setw(10) << PERCENTILE_NAMES[p];
+  }
+  out << std::setw(10) << "max" << std::setw(8) << "errors" << "\n";
+
+  out << std::fixed << std::setprecision(1);
+  TLatencySnapshot::const_iterator it;
+  for (it = snapshot.begin(); it != snapshot.end(); ++it) {
+    for (size_t phase = 0; phase < PHASE_COUNT; ++phase) {
+      const TLatencyHistogram& histogram = getPhase(it->second, phase);
+      if (histogram.getCount() == 0) {
+        continue;
+      }
+      out << std::left << std::setw(40) << it->first << std::setw(8) << PHASE_NAMES[phase]
+          << std::right << std::setw(10) << histogram.getCount() << std::setw(10)
+          << histogram.getMin() << std::setw(10) << histogram.getMean();
+      for (size_t p = 0; p < PERCENTILE_COUNT; ++p) {
+        out << std::setw(10) << histogram.getPercentile(PERCENTILES[p]);
+      }
+      out << std::setw(10) << histogram.getMax();
+      if (phase == PHASE_COUNT - 1) {
+        out << std::setw(8) << it->second.errors;
+      }
+      out << "\n";
+    }
+  }
+  return out.str();
+}
+
+std::string TLatencyEventHandler::toJSON(const TLatencySnapshot& snapshot) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1) << "{";
+  TLatencySnapshot::const_iterator it;
+  for (it = snapshot.begin(); it != snapshot.end(); ++it) {
+    if (it != snapshot.begin()) {
+      out << ",";
+    }
+    writeJSONString(out, it->first);
+    out << ":{\"errors\":" << it->second.errors;
+    for (size_t phase = 0; phase < PHASE_COUNT; ++phase) {
+      const TLatencyHistogram& histogram = getPhase(it->second, phase);
+      out << ",\"" << PHASE_NAMES[phase] << "\":{\"count\":" << histogram.getCount()
+          << ",\"min\":" << histogram.getMin() << ",\"mean\":" << histogram.getMean();
+      for (size_t p = 0; p < PERCENTILE_COUNT; ++p) {
+        out << ",\"" << PERCENTILE_NAMES[p] << "\":" << histogram.getPercentile(PERCENTILES[p]);
+      }
+      out << ",\"max\":" << histogram.getMax() << "}";
+    }
+    out << "}";
+  }
+  out << "}";
+  return out.str();
+}
+}
+}
+} // apache::thrift::processor
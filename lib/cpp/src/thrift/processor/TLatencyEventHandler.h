@@ -0,0 +1,180 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_TLATENCYEVENTHANDLER_H_
+#define _THRIFT_PROCESSOR_TLATENCYEVENTHANDLER_H_ 1
+
+#include <map>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/Mutex.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * A histogram of latencies in microseconds, with log-linear buckets in the
+ * manner of HdrHistogram: values below 8 are counted exactly, and larger ones
+ * in buckets that are each within 12.5% of the values they hold.  It takes a
+ * fixed 2KB whatever the number of values, and two histograms merge by adding
+ * up their buckets.
+ *
+ * Not thread safe.
+ */
+class TLatencyHistogram {
+public:
+  TLatencyHistogram();
+
+  void record(int64_t usec);
+
+  void merge(const TLatencyHistogram& other);
+
+  void clear();
+
+  uint64_t getCount() const { return count_; }
+
+  int64_t getMin() const { return count_ == 0 ? 0 : min_; }
+
+  int64_t getMax() const { return max_; }
+
+  double getMean() const { return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_; }
+
+  /**
+   * Returns a value that at least percent percent of the values are at most,
+   * to within the precision of the buckets.
+   */
+  int64_t getPercentile(double percent) const;
+
+private:
+  static const uint32_t SUB_BUCKET_BITS = 3;
+  // values from 2^36 usec (19 hours) up share the last bucket
+  static const uint32_t VALUE_BITS = 36;
+  static const uint32_t BUCKET_COUNT = (VALUE_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  static uint32_t getBucket(uint64_t value);
+  static uint64_t getBucketLimit(uint32_t bucket);
+
+  uint64_t counts_[BUCKET_COUNT];
+  uint64_t count_;
+  uint64_t sum_;
+  int64_t min_;
+  int64_t max_;
+};
+
+/**
+ * The latencies of the calls to one method.  The read, handler and write
+ * phases run from preRead() to postRead(), postRead() to preWrite() and
+ * preWrite() to postWrite(); total runs from getContext() to freeContext().
+ * Oneway calls, and calls whose handler threw an undeclared exception, have
+ * no write phase.
+ */
+struct TMethodLatency {
+  TMethodLatency() : errors(0) {}
+
+  void merge(const TMethodLatency& other);
+
+  TLatencyHistogram read;
+  TLatencyHistogram handler;
+  TLatencyHistogram write;
+  TLatencyHistogram total;
+  // calls whose handler threw an undeclared exception
+  uint64_t errors;
+};
+
+typedef std::map<std::string, TMethodLatency> TLatencySnapshot;
+
+/**
+ * A processor event handler that records how long each method takes, by
+ * phase, into TLatencyHistograms:
+ *
+ *   processor->setEventHandler(latency);
+ *   ...
+ *   TLatencySnapshot snapshot;
+ *   latency->getSnapshot(snapshot);
+ *   std::cout << TLatencyEventHandler::toText(snapshot);
+ *
+ * Each thread records its calls into histograms of its own, so that server
+ * threads do not wait on each other, and getSnapshot() merges them.  When a
+ * thread exits, its histograms are merged into those of the threads gone
+ * before it and freed.  Phases are timed on a monotonic clock, so setting
+ * the time of day does not skew them.
+ *
+ * A call's context must be freed by the thread that got it, as generated
+ * processors do.
+ *
+ * The generated code does not free the contexts of cob_style processors, so
+ * this is for the ones generated without it.
+ */
+class TLatencyEventHandler : public TProcessorEventHandler, boost::noncopyable {
+public:
+  TLatencyEventHandler();
+  virtual ~TLatencyEventHandler();
+
+  virtual void* getContext(const char* fn_name, void* serverContext);
+  virtual void freeContext(void* ctx, const char* fn_name);
+  virtual void preRead(void* ctx, const char* fn_name);
+  virtual void postRead(void* ctx, const char* fn_name, uint32_t bytes);
+  virtual void preWrite(void* ctx, const char* fn_name);
+  virtual void postWrite(void* ctx, const char* fn_name, uint32_t bytes);
+  virtual void handlerError(void* ctx, const char* fn_name);
+
+  /**
+   * Merges what has been recorded so far into snapshot.
+   */
+  void getSnapshot(TLatencySnapshot& snapshot) const;
+
+  void reset();
+
+  /**
+   * Formats a snapshot as a table, one line per method and phase, in
+   * microseconds.
+   */
+  static std::string toText(const TLatencySnapshot& snapshot);
+
+  /**
+   * Formats a snapshot as a JSON object keyed by method name.
+   */
+  static std::string toJSON(const TLatencySnapshot& snapshot);
+
+private:
+  struct CallTimes;
+  struct ThreadLatency;
+  struct ThreadExit;
+
+  ThreadLatency& getThreadLatency();
+
+  // merges what the thread with this marker recorded into retired_
+  void retireThread(const void* marker);
+
+  // tells apart handlers in the cache each thread keeps of the last one
+  const uint64_t serial_;
+  // guards threads_ and retired_
+  mutable concurrency::Mutex mutex_;
+  // by an address that tells live threads apart
+  std::map<const void*, ThreadLatency*> threads_;
+  // what exited threads recorded
+  TLatencySnapshot retired_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_TLATENCYEVENTHANDLER_H_
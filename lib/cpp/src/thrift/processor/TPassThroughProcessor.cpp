@@ -0,0 +1,208 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/processor/TPassThroughProcessor.h>
+#include <thrift/TApplicationException.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TProtocolTap.h>
+#include <thrift/transport/TBufferTransports.h>
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolTap;
+using apache::thrift::protocol::TRawEncoding;
+using apache::thrift::transport::TMemoryBuffer;
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+namespace {
+
+/**
+ * Copies the struct that from is at into to, as the bytes it arrived as when
+ * the two share an encoding.
+ */
+void spliceStruct(stdcxx::shared_ptr<TProtocol> from, stdcxx::shared_ptr<TProtocol> to) {
+  TRawEncoding encoding = from->getRawEncoding();
+  if (encoding != protocol::T_RAW_NONE && encoding == to->getRawEncoding()) {
+    std::string raw;
+    if (from->readRaw(protocol::T_STRUCT, raw) != 0) {
+      to->writeRaw(raw);
+      return;
+    }
+  }
+  TProtocolTap tap(from, to);
+  tap.skip(protocol::T_STRUCT);
+}
+
+/**
+ * A struct read whole off one protocol, to be written to another later: as
+ * the bytes it arrived as when it can be written in that encoding, and
+ * otherwise copied value by value into the binary encoding in memory.
+ */
+class HeldStruct {
+public:
+  void read(stdcxx::shared_ptr<TProtocol> from, TRawEncoding encoding) {
+    raw_.clear();
+    copy_.reset();
+    TRawEncoding fromEncoding = from->getRawEncoding();
+    if (fromEncoding != protocol::T_RAW_NONE && fromEncoding == encoding
+        && from->readRaw(protocol::T_STRUCT, raw_) != 0) {
+      return;
+    }
+    copy_.reset(new TMemoryBuffer());
+    TProtocolTap tap(from, stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(copy_)));
+    tap.skip(protocol::T_STRUCT);
+  }
+
+  void write(stdcxx::shared_ptr<TProtocol> to) {
+    if (copy_) {
+      spliceStruct(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(copy_)), to);
+    } else {
+      to->writeRaw(raw_);
+    }
+  }
+
+private:
+  std::string raw_;
+  stdcxx::shared_ptr<TMemoryBuffer> copy_;
+};
+}
+
+TPassThroughProcessor::TPassThroughProcessor() {
+}
+
+TPassThroughProcessor::~TPassThroughProcessor() {
+}
+
+void TPassThroughProcessor::addRoute(const std::string& key,
+                                     stdcxx::shared_ptr<TProtocol> upstream) {
+  routes_[key].reset(new Upstream(upstream));
+}
+
+void TPassThroughProcessor::setDefaultRoute(stdcxx::shared_ptr<TProtocol> upstream) {
+  defaultRoute_.reset(new Upstream(upstream));
+}
+
+stdcxx::shared_ptr<TPassThroughProcessor::Upstream> TPassThroughProcessor::findRoute(
+    const std::string& name,
+    TProtocol& in) {
+  RouteMap::const_iterator route;
+  std::string key = routeKey(in);
+  if (!key.empty() && (route = routes_.find(key)) != routes_.end()) {
+    return route->second;
+  }
+
+  if ((route = routes_.find(name)) != routes_.end()) {
+    return route->second;
+  }
+
+  std::string::size_type colon = name.find(':');
+  if (colon != std::string::npos
+      && (route = routes_.find(name.substr(0, colon))) != routes_.end()) {
+    return route->second;
+  }
+
+  return defaultRoute_;
+}
+
+bool TPassThroughProcessor::process(stdcxx::shared_ptr<TProtocol> in,
+                                    stdcxx::shared_ptr<TProtocol> out,
+                                    void* connectionContext) {
+  (void)connectionContext;
+  std::string name;
+  TMessageType type;
+  int32_t seqid;
+  in->readMessageBegin(name, type, seqid);
+
+  stdcxx::shared_ptr<Upstream> route = findRoute(name, *in);
+  if (!route) {
+    in->skip(protocol::T_STRUCT);
+    in->readMessageEnd();
+    in->getTransport()->readEnd();
+    TApplicationException x(TApplicationException::UNKNOWN_METHOD,
+                            "Invalid method name: '" + name + "'");
+    out->writeMessageBegin(name, protocol::T_EXCEPTION, seqid);
+    x.write(out.get());
+    out->writeMessageEnd();
+    out->getTransport()->writeEnd();
+    out->getTransport()->flush();
+    return true;
+  }
+
+  // The whole call is read before the upstream is touched, so that a client
+  // that goes away part way cannot leave half a message on it
+  stdcxx::shared_ptr<TProtocol> upstream = route->protocol;
+  HeldStruct args;
+  args.read(in, upstream->getRawEncoding());
+  in->readMessageEnd();
+  in->getTransport()->readEnd();
+
+  std::string replyName;
+  TMessageType replyType;
+  HeldStruct reply;
+  {
+    Guard g(route->mutex);
+    try {
+      if (!upstream->getTransport()->isOpen()) {
+        upstream->getTransport()->open();
+      }
+      forwardHeaders(*in, *upstream);
+      upstream->writeMessageBegin(name, type, seqid);
+      args.write(upstream);
+      upstream->writeMessageEnd();
+      upstream->getTransport()->writeEnd();
+      upstream->getTransport()->flush();
+
+      if (type == protocol::T_ONEWAY) {
+        return true;
+      }
+
+      int32_t replySeqid;
+      upstream->readMessageBegin(replyName, replyType, replySeqid);
+      reply.read(upstream, out->getRawEncoding());
+      upstream->readMessageEnd();
+      upstream->getTransport()->readEnd();
+      forwardHeaders(*upstream, *out);
+    } catch (...) {
+      // A call cut off part way leaves the upstream out of step with us, so
+      // it is closed, to be opened again by the next call
+      try {
+        upstream->getTransport()->close();
+      } catch (...) {
+        // it is being dropped anyway
+      }
+      throw;
+    }
+  }
+
+  // and the reply is written out without holding up the upstream
+  out->writeMessageBegin(replyName, replyType, seqid);
+  reply.write(out);
+  out->writeMessageEnd();
+  out->getTransport()->writeEnd();
+  out->getTransport()->flush();
+  return true;
+}
+}
+}
+} // apache::thrift::processor
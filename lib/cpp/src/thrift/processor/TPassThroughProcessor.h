@@ -0,0 +1,116 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_TPASSTHROUGHPROCESSOR_H_
+#define _THRIFT_PROCESSOR_TPASSTHROUGHPROCESSOR_H_ 1
+
+#include <map>
+#include <string>
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/stdcxx.h>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * A processor for proxies, that forwards each call to the server that
+ * handles it without decoding the arguments or the reply.
+ *
+ * Calls are routed by the key that routeKey() returns for them, if any, then
+ * by method name, then by the service name of multiplexed ("Service:method")
+ * calls, and finally to the default route.  Calls that match no route are
+ * answered with an UNKNOWN_METHOD TApplicationException, as a generated
+ * processor would.
+ *
+ * Only the message header is decoded.  The arguments and the reply are copied
+ * as the bytes they arrived as when both sides speak the same encoding and the
+ * transport holds the message whole, and value by value otherwise, so that a
+ * binary client can still be proxied to a compact server.
+ *
+ * Each call is read whole before it is sent on, and each reply before it is
+ * passed back, either as bytes or in a copy in memory.  Each upstream
+ * protocol carries one call at a time; calls to the same upstream from
+ * several server threads are serialized while they are sent and answered
+ * upstream.  If a call fails part way upstream, the upstream transport is
+ * closed, and opened again for the next call.
+ *
+ * THeaderPassThroughProcessor also routes on, and passes along, THeader
+ * headers.
+ */
+class TPassThroughProcessor : public TProcessor {
+public:
+  TPassThroughProcessor();
+  virtual ~TPassThroughProcessor();
+
+  /**
+   * Sends calls whose route key (method name, service name or header value)
+   * is key to upstream.
+   */
+  void addRoute(const std::string& key, stdcxx::shared_ptr<protocol::TProtocol> upstream);
+
+  /**
+   * Sends calls that match no route to upstream.
+   */
+  void setDefaultRoute(stdcxx::shared_ptr<protocol::TProtocol> upstream);
+
+  virtual bool process(stdcxx::shared_ptr<protocol::TProtocol> in,
+                       stdcxx::shared_ptr<protocol::TProtocol> out,
+                       void* connectionContext);
+
+protected:
+  /**
+   * Returns the key to route a call on before its name, or an empty string.
+   */
+  virtual std::string routeKey(protocol::TProtocol& in) {
+    THRIFT_UNUSED_VARIABLE(in);
+    return std::string();
+  }
+
+  /**
+   * Passes on whatever the transport of from received with the message just
+   * read, outside of it, with the next message written to to.
+   */
+  virtual void forwardHeaders(protocol::TProtocol& from, protocol::TProtocol& to) {
+    THRIFT_UNUSED_VARIABLE(from);
+    THRIFT_UNUSED_VARIABLE(to);
+  }
+
+private:
+  struct Upstream {
+    explicit Upstream(stdcxx::shared_ptr<protocol::TProtocol> protocol) : protocol(protocol) {}
+
+    stdcxx::shared_ptr<protocol::TProtocol> protocol;
+    concurrency::Mutex mutex;
+  };
+
+  typedef std::map<std::string, stdcxx::shared_ptr<Upstream> > RouteMap;
+
+  stdcxx::shared_ptr<Upstream> findRoute(const std::string& name, protocol::TProtocol& in);
+
+  RouteMap routes_;
+  stdcxx::shared_ptr<Upstream> defaultRoute_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_TPASSTHROUGHPROCESSOR_H_
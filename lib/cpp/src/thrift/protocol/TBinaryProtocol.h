@@ -166,6 +166,89 @@ public:
 
   inline uint32_t readBinary(std::string& str);
 
+  /**
+   * Encoding functions, for code generated with cpp:inline_serializers.
+   *
+   * The encode functions put a whole field, or a field header, into a buffer
+   * of the caller's and return the end of what they wrote, so that runs of
+   * fields go out in one writeEncoded().  Each field takes at most
+   * MAX_ENCODED_FIELD_SIZE bytes.
+   */
+
+  static const uint32_t MAX_ENCODED_FIELD_SIZE = 11;
+
+  inline uint8_t* encodeFieldBegin(uint8_t* buf, const TType fieldType, const int16_t fieldId);
+
+  inline uint8_t* encodeFieldStop(uint8_t* buf);
+
+  inline uint8_t* encodeBoolField(uint8_t* buf, const int16_t fieldId, const bool value);
+
+  inline uint8_t* encodeByteField(uint8_t* buf, const int16_t fieldId, const int8_t byte);
+
+  inline uint8_t* encodeI16Field(uint8_t* buf, const int16_t fieldId, const int16_t i16);
+
+  inline uint8_t* encodeI32Field(uint8_t* buf, const int16_t fieldId, const int32_t i32);
+
+  inline uint8_t* encodeI64Field(uint8_t* buf, const int16_t fieldId, const int64_t i64);
+
+  inline uint8_t* encodeDoubleField(uint8_t* buf, const int16_t fieldId, const double dub);
+
+  inline uint32_t writeEncoded(const uint8_t* buf, const uint8_t* end);
+
+  /**
+   * Reads the header of the next field if it is the given one, adding its
+   * size to xfer.  Returns false and reads nothing otherwise, or when the
+   * transport has no buffer to peek into.
+   */
+  inline bool readExpectedField(const TType fieldType, const int16_t fieldId, uint32_t& xfer);
+
+  /**
+   * Raw values, for fields annotated cpp.lazy.  readRaw() keeps values that
+   * the transport holds whole in its buffer, and reads nothing otherwise.
+   */
+  inline uint32_t readRaw(const TType type, std::string& raw);
+
+  inline uint32_t writeRaw(const std::string& raw);
+
+  TRawEncoding getRawEncoding() {
+    return ByteOrder_::toWire16(1) == htons(1) ? T_RAW_BINARY : T_RAW_BINARY_LE;
+  }
+
+  /**
+   * Size functions, for the serializedSize() of generated structs.
+   *
+   * Each returns the number of bytes the matching write function puts on
+   * the wire.
+   */
+
+  static inline uint32_t serializedSizeFieldBegin(const TType fieldType, const int16_t fieldId);
+
+  static inline uint32_t serializedSizeFieldStop();
+
+  static inline uint32_t serializedSizeMapBegin(const TType keyType,
+                                                const TType valType,
+                                                const uint32_t size);
+
+  static inline uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size);
+
+  static inline uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size);
+
+  static inline uint32_t serializedSizeBool(const bool value);
+
+  static inline uint32_t serializedSizeByte(const int8_t byte);
+
+  static inline uint32_t serializedSizeI16(const int16_t i16);
+
+  static inline uint32_t serializedSizeI32(const int32_t i32);
+
+  static inline uint32_t serializedSizeI64(const int64_t i64);
+
+  static inline uint32_t serializedSizeDouble(const double dub);
+
+  static inline uint32_t serializedSizeString(const std::string& str);
+
+  static inline uint32_t serializedSizeBinary(const std::string& str);
+
 protected:
   template <typename StrType>
   uint32_t readStringBody(StrType& str, int32_t sz);
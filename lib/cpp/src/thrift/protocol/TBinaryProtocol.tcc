@@ -21,7 +21,9 @@
 #define _THRIFT_PROTOCOL_TBINARYPROTOCOL_TCC_ 1
 
 #include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
 
+#include <cstring>
 #include <limits>
 
 namespace apache {
@@ -447,6 +449,232 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringBody(StrType& str,
   this->trans_->readAll(reinterpret_cast<uint8_t*>(&str[0]), size);
   return (uint32_t)size;
 }
+
+template <class Transport_, class ByteOrder_>
+uint8_t* TBinaryProtocolT<Transport_, ByteOrder_>::encodeFieldBegin(uint8_t* buf,
+                                                                    const TType fieldType,
+                                                                    const int16_t fieldId) {
+  int16_t net = (int16_t)ByteOrder_::toWire16(fieldId);
+  buf[0] = (uint8_t)fieldType;
+  std::memcpy(buf + 1, &net, 2);
+  return buf + 3;
+}
+
+template <class Transport_, class ByteOrder_>
+uint8_t* TBinaryProtocolT<Transport_, ByteOrder_>::encodeFieldStop(uint8_t* buf) {
+  buf[0] = (uint8_t)T_STOP;
+  return buf + 1;
+}
+
+template <class Transport_, class ByteOrder_>
+uint8_t* TBinaryProtocolT<Transport_, ByteOrder_>::encodeBoolField(uint8_t* buf,
+                                                                   const int16_t fieldId,
+                                                                   const bool value) {
+  buf = encodeFieldBegin(buf, T_BOOL, fieldId);
+  buf[0] = (uint8_t)(value ? 1 : 0);
+  return buf + 1;
+}
+
+template <class Transport_, class ByteOrder_>
+uint8_t* TBinaryProtocolT<Transport_, ByteOrder_>::encodeByteField(uint8_t* buf,
+                                                                   const int16_t fieldId,
+                                                                   const int8_t byte) {
+  buf = encodeFieldBegin(buf, T_BYTE, fieldId);
+  buf[0] = (uint8_t)byte;
+  return buf + 1;
+}
+
+template <class Transport_, class ByteOrder_>
+uint8_t* TBinaryProtocolT<Transport_, ByteOrder_>::encodeI16Field(uint8_t* buf,
+                                                                  const int16_t fieldId,
+                                                                  const int16_t i16) {
+  int16_t net = (int16_t)ByteOrder_::toWire16(i16);
+  buf = encodeFieldBegin(buf, T_I16, fieldId);
+  std::memcpy(buf, &net, 2);
+  return buf + 2;
+}
+
+template <class Transport_, class ByteOrder_>
+uint8_t* TBinaryProtocolT<Transport_, ByteOrder_>::encodeI32Field(uint8_t* buf,
+                                                                  const int16_t fieldId,
+                                                                  const int32_t i32) {
+  int32_t net = (int32_t)ByteOrder_::toWire32(i32);
+  buf = encodeFieldBegin(buf, T_I32, fieldId);
+  std::memcpy(buf, &net, 4);
+  return buf + 4;
+}
+
+template <class Transport_, class ByteOrder_>
+uint8_t* TBinaryProtocolT<Transport_, ByteOrder_>::encodeI64Field(uint8_t* buf,
+                                                                  const int16_t fieldId,
+                                                                  const int64_t i64) {
+  int64_t net = (int64_t)ByteOrder_::toWire64(i64);
+  buf = encodeFieldBegin(buf, T_I64, fieldId);
+  std::memcpy(buf, &net, 8);
+  return buf + 8;
+}
+
+template <class Transport_, class ByteOrder_>
+uint8_t* TBinaryProtocolT<Transport_, ByteOrder_>::encodeDoubleField(uint8_t* buf,
+                                                                     const int16_t fieldId,
+                                                                     const double dub) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+
+  uint64_t bits = bitwise_cast<uint64_t>(dub);
+  bits = ByteOrder_::toWire64(bits);
+  buf = encodeFieldBegin(buf, T_DOUBLE, fieldId);
+  std::memcpy(buf, &bits, 8);
+  return buf + 8;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeEncoded(const uint8_t* buf,
+                                                                const uint8_t* end) {
+  uint32_t size = static_cast<uint32_t>(end - buf);
+  this->trans_->write(buf, size);
+  return size;
+}
+
+template <class Transport_, class ByteOrder_>
+bool TBinaryProtocolT<Transport_, ByteOrder_>::readExpectedField(const TType fieldType,
+                                                                 const int16_t fieldId,
+                                                                 uint32_t& xfer) {
+  uint32_t got = 3;
+  const uint8_t* header = this->trans_->borrow(NULL, &got);
+  if (header == NULL || header[0] != (uint8_t)fieldType) {
+    return false;
+  }
+  int16_t net;
+  std::memcpy(&net, header + 1, 2);
+  if ((int16_t)ByteOrder_::fromWire16(net) != fieldId) {
+    return false;
+  }
+  this->trans_->consume(3);
+  xfer += 3;
+  return true;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readRaw(const TType type, std::string& raw) {
+  uint32_t got = 0;
+  const uint8_t* buf = this->trans_->borrow(NULL, &got);
+  if (buf == NULL) {
+    return 0;
+  }
+
+  // Find the end of the value in the buffer, and leave it to be decoded if
+  // it runs past the end
+  stdcxx::shared_ptr<transport::TMemoryBuffer> window(
+      new transport::TMemoryBuffer(const_cast<uint8_t*>(buf), got));
+  TBinaryProtocolT<transport::TMemoryBuffer, ByteOrder_> scanner(window,
+                                                                 string_limit_,
+                                                                 container_limit_,
+                                                                 false,
+                                                                 false);
+  uint32_t size;
+  try {
+    size = scanner.skip(type);
+  } catch (transport::TTransportException&) {
+    return 0;
+  }
+  raw.assign(reinterpret_cast<const char*>(buf), size);
+  this->trans_->consume(size);
+  return size;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeRaw(const std::string& raw) {
+  uint32_t size = static_cast<uint32_t>(raw.size());
+  this->trans_->write(reinterpret_cast<const uint8_t*>(raw.data()), size);
+  return size;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeFieldBegin(
+    const TType fieldType,
+    const int16_t fieldId) {
+  (void)fieldType;
+  (void)fieldId;
+  return 3;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeFieldStop() {
+  return 1;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeMapBegin(const TType keyType,
+                                                                          const TType valType,
+                                                                          const uint32_t size) {
+  (void)keyType;
+  (void)valType;
+  (void)size;
+  return 6;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeListBegin(const TType elemType,
+                                                                           const uint32_t size) {
+  (void)elemType;
+  (void)size;
+  return 5;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeSetBegin(const TType elemType,
+                                                                          const uint32_t size) {
+  (void)elemType;
+  (void)size;
+  return 5;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeBool(const bool value) {
+  (void)value;
+  return 1;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeByte(const int8_t byte) {
+  (void)byte;
+  return 1;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeI16(const int16_t i16) {
+  (void)i16;
+  return 2;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeI32(const int32_t i32) {
+  (void)i32;
+  return 4;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeI64(const int64_t i64) {
+  (void)i64;
+  return 8;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeDouble(const double dub) {
+  (void)dub;
+  return 8;
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeString(const std::string& str) {
+  return 4 + static_cast<uint32_t>(str.size());
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::serializedSizeBinary(const std::string& str) {
+  return serializedSizeString(str);
+}
 }
 }
 } // apache::thrift::protocol
@@ -150,7 +150,80 @@ public:
   uint32_t writeSetEnd() { return 0; }
   uint32_t writeFieldEnd() { return 0; }
 
+  /**
+   * Encoding functions, for code generated with cpp:inline_serializers.
+   *
+   * The encode functions put a whole field, or a field header, into a buffer
+   * of the caller's and return the end of what they wrote, so that runs of
+   * fields go out in one writeEncoded().  Each field takes at most
+   * MAX_ENCODED_FIELD_SIZE bytes.  Bool fields must go through
+   * encodeBoolField(), as their value is part of the header.
+   */
+
+  static const uint32_t MAX_ENCODED_FIELD_SIZE = 14;
+
+  uint8_t* encodeFieldBegin(uint8_t* buf, const TType fieldType, const int16_t fieldId);
+
+  uint8_t* encodeFieldStop(uint8_t* buf);
+
+  uint8_t* encodeBoolField(uint8_t* buf, const int16_t fieldId, const bool value);
+
+  uint8_t* encodeByteField(uint8_t* buf, const int16_t fieldId, const int8_t byte);
+
+  uint8_t* encodeI16Field(uint8_t* buf, const int16_t fieldId, const int16_t i16);
+
+  uint8_t* encodeI32Field(uint8_t* buf, const int16_t fieldId, const int32_t i32);
+
+  uint8_t* encodeI64Field(uint8_t* buf, const int16_t fieldId, const int64_t i64);
+
+  uint8_t* encodeDoubleField(uint8_t* buf, const int16_t fieldId, const double dub);
+
+  uint32_t writeEncoded(const uint8_t* buf, const uint8_t* end);
+
+  /**
+   * Size functions, for the serializedSize() of generated structs.
+   *
+   * Each returns the number of bytes the matching write function puts on
+   * the wire, except that
+   * bool fields are counted a byte larger than they are, and field headers
+   * are counted as if the previous field was missing, so they add up to an
+   * upper bound.
+   */
+
+  static uint32_t serializedSizeFieldBegin(const TType fieldType, const int16_t fieldId);
+
+  static uint32_t serializedSizeFieldStop();
+
+  static uint32_t serializedSizeMapBegin(const TType keyType,
+                                         const TType valType,
+                                         const uint32_t size);
+
+  static uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size);
+
+  static uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size);
+
+  static uint32_t serializedSizeBool(const bool value);
+
+  static uint32_t serializedSizeByte(const int8_t byte);
+
+  static uint32_t serializedSizeI16(const int16_t i16);
+
+  static uint32_t serializedSizeI32(const int32_t i32);
+
+  static uint32_t serializedSizeI64(const int64_t i64);
+
+  static uint32_t serializedSizeDouble(const double dub);
+
+  static uint32_t serializedSizeString(const std::string& str);
+
+  static uint32_t serializedSizeBinary(const std::string& str);
+
 protected:
+  uint8_t* encodeFieldHeader(uint8_t* buf, const int16_t fieldId, int8_t compactType);
+  static uint8_t* encodeVarint32(uint8_t* buf, uint32_t n);
+  static uint8_t* encodeVarint64(uint8_t* buf, uint64_t n);
+  static uint32_t varintSize32(uint32_t n);
+  static uint32_t varintSize64(uint64_t n);
   int32_t writeFieldBeginInternal(const char* name,
                                   const TType fieldType,
                                   const int16_t fieldId,
@@ -158,8 +231,8 @@ protected:
   uint32_t writeCollectionBegin(const TType elemType, int32_t size);
   uint32_t writeVarint32(uint32_t n);
   uint32_t writeVarint64(uint64_t n);
-  uint64_t i64ToZigzag(const int64_t l);
-  uint32_t i32ToZigzag(const int32_t n);
+  static uint64_t i64ToZigzag(const int64_t l);
+  static uint32_t i32ToZigzag(const int32_t n);
   inline int8_t getCompactType(const TType ttype);
 
 public:
@@ -195,6 +268,25 @@ public:
 
   uint32_t readBinary(std::string& str);
 
+  /**
+   * Reads the header of the next field if it is the given one, adding its
+   * size to xfer.  Returns false and reads nothing otherwise, or when the
+   * transport has no buffer to peek into.  Only headers that carry the
+   * field id as a delta are matched.
+   */
+  bool readExpectedField(const TType fieldType, const int16_t fieldId, uint32_t& xfer);
+
+  /**
+   * Raw values, for fields annotated cpp.lazy.  readRaw() keeps values that
+   * the transport holds whole in its buffer, and reads nothing otherwise.
+   * Bools, which may be folded into the field header, are never kept.
+   */
+  uint32_t readRaw(const TType type, std::string& raw);
+
+  uint32_t writeRaw(const std::string& raw);
+
+  TRawEncoding getRawEncoding() { return T_RAW_COMPACT; }
+
   /*
    *These methods are here for the struct to call, but don't have any wire
    * encoding.
@@ -19,9 +19,11 @@
 #ifndef _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_
 #define _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_ 1
 
+#include <cstring>
 #include <limits>
 
 #include "thrift/config.h"
+#include <thrift/transport/TBufferTransports.h>
 
 /*
  * TCompactProtocol::i*ToZigzag depend on the fact that the right shift
@@ -285,6 +287,176 @@ uint32_t TCompactProtocolT<Transport_>::writeBinary(const std::string& str) {
   return wsize;
 }
 
+//
+// Encoding methods
+//
+
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeFieldBegin(uint8_t* buf,
+                                                         const TType fieldType,
+                                                         const int16_t fieldId) {
+  return encodeFieldHeader(buf, fieldId, getCompactType(fieldType));
+}
+
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeFieldStop(uint8_t* buf) {
+  *buf++ = static_cast<uint8_t>(detail::compact::CT_STOP);
+  return buf;
+}
+
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeBoolField(uint8_t* buf,
+                                                        const int16_t fieldId,
+                                                        const bool value) {
+  return encodeFieldHeader(buf,
+                           fieldId,
+                           static_cast<int8_t>(value ? detail::compact::CT_BOOLEAN_TRUE
+                                                     : detail::compact::CT_BOOLEAN_FALSE));
+}
+
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeByteField(uint8_t* buf,
+                                                        const int16_t fieldId,
+                                                        const int8_t byte) {
+  buf = encodeFieldHeader(buf, fieldId, detail::compact::CT_BYTE);
+  *buf++ = static_cast<uint8_t>(byte);
+  return buf;
+}
+
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeI16Field(uint8_t* buf,
+                                                       const int16_t fieldId,
+                                                       const int16_t i16) {
+  buf = encodeFieldHeader(buf, fieldId, detail::compact::CT_I16);
+  return encodeVarint32(buf, i32ToZigzag(i16));
+}
+
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeI32Field(uint8_t* buf,
+                                                       const int16_t fieldId,
+                                                       const int32_t i32) {
+  buf = encodeFieldHeader(buf, fieldId, detail::compact::CT_I32);
+  return encodeVarint32(buf, i32ToZigzag(i32));
+}
+
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeI64Field(uint8_t* buf,
+                                                       const int16_t fieldId,
+                                                       const int64_t i64) {
+  buf = encodeFieldHeader(buf, fieldId, detail::compact::CT_I64);
+  return encodeVarint64(buf, i64ToZigzag(i64));
+}
+
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeDoubleField(uint8_t* buf,
+                                                          const int16_t fieldId,
+                                                          const double dub) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+
+  uint64_t bits = bitwise_cast<uint64_t>(dub);
+  bits = THRIFT_htolell(bits);
+  buf = encodeFieldHeader(buf, fieldId, detail::compact::CT_DOUBLE);
+  std::memcpy(buf, &bits, 8);
+  return buf + 8;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeEncoded(const uint8_t* buf, const uint8_t* end) {
+  uint32_t wsize = static_cast<uint32_t>(end - buf);
+  trans_->write(buf, wsize);
+  return wsize;
+}
+
+//
+// Size methods
+//
+
+/**
+ * A field header takes one byte when the id is within 15 of the previous
+ * one, which is certain for ids 1 to 15.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeFieldBegin(const TType fieldType,
+                                                                 const int16_t fieldId) {
+  (void) fieldType;
+  if (fieldId > 0 && fieldId <= 15) {
+    return 1;
+  }
+  return 1 + varintSize32(i32ToZigzag(fieldId));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeFieldStop() {
+  return 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeMapBegin(const TType keyType,
+                                                               const TType valType,
+                                                               const uint32_t size) {
+  (void) keyType;
+  (void) valType;
+  return size == 0 ? 1 : varintSize32(size) + 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeListBegin(const TType elemType,
+                                                                const uint32_t size) {
+  (void) elemType;
+  return size <= 14 ? 1 : 1 + varintSize32(size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeSetBegin(const TType elemType,
+                                                               const uint32_t size) {
+  return serializedSizeListBegin(elemType, size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeBool(const bool value) {
+  (void) value;
+  return 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeByte(const int8_t byte) {
+  (void) byte;
+  return 1;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI16(const int16_t i16) {
+  return varintSize32(i32ToZigzag(i16));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI32(const int32_t i32) {
+  return varintSize32(i32ToZigzag(i32));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeI64(const int64_t i64) {
+  return varintSize64(i64ToZigzag(i64));
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeDouble(const double dub) {
+  (void) dub;
+  return 8;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeString(const std::string& str) {
+  return serializedSizeBinary(str);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::serializedSizeBinary(const std::string& str) {
+  uint32_t ssize = static_cast<uint32_t>(str.size());
+  return varintSize32(ssize) + ssize;
+}
+
 //
 // Internal Writing methods
 //
@@ -301,24 +473,33 @@ int32_t TCompactProtocolT<Transport_>::writeFieldBeginInternal(
     const int16_t fieldId,
     int8_t typeOverride) {
   (void) name;
-  uint32_t wsize = 0;
+  uint8_t buf[4];
 
   // if there's a type override, use that.
   int8_t typeToWrite = (typeOverride == -1 ? getCompactType(fieldType) : typeOverride);
 
+  return writeEncoded(buf, encodeFieldHeader(buf, fieldId, typeToWrite));
+}
+
+/**
+ * Encode a field header, updating the last field id. Takes 1-4 bytes.
+ */
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeFieldHeader(uint8_t* buf,
+                                                          const int16_t fieldId,
+                                                          int8_t compactType) {
   // check if we can use delta encoding for the field id
   if (fieldId > lastFieldId_ && fieldId - lastFieldId_ <= 15) {
     // write them together
-    wsize += writeByte(static_cast<int8_t>((fieldId - lastFieldId_)
-                                           << 4 | typeToWrite));
+    *buf++ = static_cast<uint8_t>((fieldId - lastFieldId_) << 4 | compactType);
   } else {
     // write them separate
-    wsize += writeByte(typeToWrite);
-    wsize += writeI16(fieldId);
+    *buf++ = static_cast<uint8_t>(compactType);
+    buf = encodeVarint32(buf, i32ToZigzag(fieldId));
   }
 
   lastFieldId_ = fieldId;
-  return wsize;
+  return buf;
 }
 
 /**
@@ -345,40 +526,74 @@ uint32_t TCompactProtocolT<Transport_>::writeCollectionBegin(const TType elemTyp
 template <class Transport_>
 uint32_t TCompactProtocolT<Transport_>::writeVarint32(uint32_t n) {
   uint8_t buf[5];
-  uint32_t wsize = 0;
+  return writeEncoded(buf, encodeVarint32(buf, n));
+}
 
+/**
+ * Write an i64 as a varint. Results in 1-10 bytes on the wire.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeVarint64(uint64_t n) {
+  uint8_t buf[10];
+  return writeEncoded(buf, encodeVarint64(buf, n));
+}
+
+/**
+ * Encode an i32 as a varint, returning the end of it.
+ */
+template <class Transport_>
+uint8_t* TCompactProtocolT<Transport_>::encodeVarint32(uint8_t* buf, uint32_t n) {
   while (true) {
     if ((n & ~0x7F) == 0) {
-      buf[wsize++] = (int8_t)n;
-      break;
+      *buf++ = (uint8_t)n;
+      return buf;
     } else {
-      buf[wsize++] = (int8_t)((n & 0x7F) | 0x80);
+      *buf++ = (uint8_t)((n & 0x7F) | 0x80);
       n >>= 7;
     }
   }
-  trans_->write(buf, wsize);
-  return wsize;
 }
 
 /**
- * Write an i64 as a varint. Results in 1-10 bytes on the wire.
+ * Encode an i64 as a varint, returning the end of it.
  */
 template <class Transport_>
-uint32_t TCompactProtocolT<Transport_>::writeVarint64(uint64_t n) {
-  uint8_t buf[10];
-  uint32_t wsize = 0;
-
+uint8_t* TCompactProtocolT<Transport_>::encodeVarint64(uint8_t* buf, uint64_t n) {
   while (true) {
-    if ((n & ~0x7FL) == 0) {
-      buf[wsize++] = (int8_t)n;
-      break;
+    if ((n & ~0x7FULL) == 0) {
+      *buf++ = (uint8_t)n;
+      return buf;
     } else {
-      buf[wsize++] = (int8_t)((n & 0x7F) | 0x80);
+      *buf++ = (uint8_t)((n & 0x7F) | 0x80);
       n >>= 7;
     }
   }
-  trans_->write(buf, wsize);
-  return wsize;
+}
+
+/**
+ * Number of bytes of an i32 varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::varintSize32(uint32_t n) {
+  uint32_t size = 1;
+  while (n >= 0x80) {
+    n >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+/**
+ * Number of bytes of an i64 varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::varintSize64(uint64_t n) {
+  uint32_t size = 1;
+  while (n >= 0x80) {
+    n >>= 7;
+    ++size;
+  }
+  return size;
 }
 
 /**
@@ -511,6 +726,72 @@ uint32_t TCompactProtocolT<Transport_>::readFieldBegin(std::string& name,
   return rsize;
 }
 
+/**
+ * Read a field header off the wire if it is the expected one. Only the one
+ * byte form, with the field id as a delta, is looked at.
+ */
+template <class Transport_>
+bool TCompactProtocolT<Transport_>::readExpectedField(const TType fieldType,
+                                                      const int16_t fieldId,
+                                                      uint32_t& xfer) {
+  if (fieldId <= lastFieldId_ || fieldId - lastFieldId_ > 15) {
+    return false;
+  }
+  uint32_t got = 1;
+  const uint8_t* header = trans_->borrow(NULL, &got);
+  if (header == NULL || (header[0] >> 4) != fieldId - lastFieldId_) {
+    return false;
+  }
+  int8_t type = (int8_t)(header[0] & 0x0f);
+  if (fieldType == T_BOOL) {
+    if (type != detail::compact::CT_BOOLEAN_TRUE && type != detail::compact::CT_BOOLEAN_FALSE) {
+      return false;
+    }
+    boolValue_.hasBoolValue = true;
+    boolValue_.boolValue = (type == detail::compact::CT_BOOLEAN_TRUE);
+  } else if (type != getCompactType(fieldType)) {
+    return false;
+  }
+  trans_->consume(1);
+  xfer += 1;
+  lastFieldId_ = fieldId;
+  return true;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readRaw(const TType type, std::string& raw) {
+  if (type == T_BOOL) {
+    return 0;
+  }
+  uint32_t got = 0;
+  const uint8_t* buf = trans_->borrow(NULL, &got);
+  if (buf == NULL) {
+    return 0;
+  }
+
+  // Find the end of the value in the buffer, and leave it to be decoded if
+  // it runs past the end
+  stdcxx::shared_ptr<transport::TMemoryBuffer> window(
+      new transport::TMemoryBuffer(const_cast<uint8_t*>(buf), got));
+  TCompactProtocolT<transport::TMemoryBuffer> scanner(window, string_limit_, container_limit_);
+  uint32_t size;
+  try {
+    size = scanner.skip(type);
+  } catch (transport::TTransportException&) {
+    return 0;
+  }
+  raw.assign(reinterpret_cast<const char*>(buf), size);
+  trans_->consume(size);
+  return size;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeRaw(const std::string& raw) {
+  uint32_t size = static_cast<uint32_t>(raw.size());
+  trans_->write(reinterpret_cast<const uint8_t*>(raw.data()), size);
+  return size;
+}
+
 /**
  * Read a map header off the wire. If the size is zero, skip reading the key
  * and value type. This means that 0-length maps will yield TMaps without the
@@ -247,6 +247,18 @@ uint32_t THeaderProtocol::readString(std::string& str) {
 uint32_t THeaderProtocol::readBinary(std::string& binary) {
   return proto_->readBinary(binary);
 }
+
+uint32_t THeaderProtocol::readRaw(TType type, std::string& raw) {
+  return proto_->readRaw(type, raw);
+}
+
+uint32_t THeaderProtocol::writeRaw(const std::string& raw) {
+  return proto_->writeRaw(raw);
+}
+
+TRawEncoding THeaderProtocol::getRawEncoding() {
+  return proto_->getRawEncoding();
+}
 }
 }
 } // apache::thrift::protocol
@@ -181,6 +181,12 @@ public:
 
   uint32_t readBinary(std::string& binary);
 
+  uint32_t readRaw(TType type, std::string& raw);
+
+  uint32_t writeRaw(const std::string& raw);
+
+  TRawEncoding getRawEncoding();
+
 protected:
   stdcxx::shared_ptr<THeaderTransport> trans_;
 
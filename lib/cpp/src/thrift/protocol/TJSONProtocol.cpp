@@ -24,14 +24,12 @@
 #include <boost/math/special_functions/sign.hpp>
 
 #include <cmath>
+#include <cstring>
 #include <limits>
-#include <locale>
-#include <sstream>
-#include <stdexcept>
 
 #include <thrift/protocol/TBase64Utils.h>
+#include <thrift/protocol/TJSONUtils.h>
 #include <thrift/transport/TTransportException.h>
-#include <thrift/TToString.h>
 
 using namespace apache::thrift::transport;
 
@@ -49,11 +47,8 @@ static const uint8_t kJSONPairSeparator = ':';
 static const uint8_t kJSONElemSeparator = ',';
 static const uint8_t kJSONBackslash = '\\';
 static const uint8_t kJSONStringDelimiter = '"';
-static const uint8_t kJSONZeroChar = '0';
 static const uint8_t kJSONEscapeChar = 'u';
 
-static const std::string kJSONEscapePrefix("\\u00");
-
 static const uint32_t kThriftVersion1 = 1;
 
 static const std::string kThriftNan("NaN");
@@ -151,62 +146,6 @@ static TType getTypeIDForTypeName(const std::string& name) {
   return result;
 }
 
-// This table describes the handling for the first 0x30 characters
-//  0 : escape using "\u00xx" notation
-//  1 : just output index
-// <other> : escape using "\<other>" notation
-static const uint8_t kJSONCharTable[0x30] = {
-    //  0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    'b',
-    't',
-    'n',
-    0,
-    'f',
-    'r',
-    0,
-    0, // 0
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0,
-    0, // 1
-    1,
-    1,
-    '"',
-    1,
-    1,
-    1,
-    1,
-    1,
-    1,
-    1,
-    1,
-    1,
-    1,
-    1,
-    1,
-    1, // 2
-};
-
 // This string's characters must match up with the elements in kEscapeCharVals.
 // I don't have '/' on this list even though it appears on www.json.org --
 // it is not in the RFC
@@ -253,17 +192,6 @@ static uint8_t hexVal(uint8_t ch) {
   }
 }
 
-// Return the hex character representing the integer val. The value is masked
-// to make sure it is in the correct range.
-static uint8_t hexChar(uint8_t val) {
-  val &= 0x0F;
-  if (val < 10) {
-    return val + '0';
-  } else {
-    return val - 10 + 'a';
-  }
-}
-
 // Return true if the character ch is in [-+0-9.Ee]; false otherwise
 static bool isJSONNumeric(uint8_t ch) {
   switch (ch) {
@@ -418,55 +346,16 @@ void TJSONProtocol::popContext() {
   contexts_.pop();
 }
 
-// Write the character ch as a JSON escape sequence ("\u00xx")
-uint32_t TJSONProtocol::writeJSONEscapeChar(uint8_t ch) {
-  trans_->write((const uint8_t*)kJSONEscapePrefix.c_str(),
-                static_cast<uint32_t>(kJSONEscapePrefix.length()));
-  uint8_t outCh = hexChar(ch >> 4);
-  trans_->write(&outCh, 1);
-  outCh = hexChar(ch);
-  trans_->write(&outCh, 1);
-  return 6;
-}
-
-// Write the character ch as part of a JSON string, escaping as appropriate.
-uint32_t TJSONProtocol::writeJSONChar(uint8_t ch) {
-  if (ch >= 0x30) {
-    if (ch == kJSONBackslash) { // Only special character >= 0x30 is '\'
-      trans_->write(&kJSONBackslash, 1);
-      trans_->write(&kJSONBackslash, 1);
-      return 2;
-    } else {
-      trans_->write(&ch, 1);
-      return 1;
-    }
-  } else {
-    uint8_t outCh = kJSONCharTable[ch];
-    // Check if regular character, backslash escaped, or JSON escaped
-    if (outCh == 1) {
-      trans_->write(&ch, 1);
-      return 1;
-    } else if (outCh > 1) {
-      trans_->write(&kJSONBackslash, 1);
-      trans_->write(&outCh, 1);
-      return 2;
-    } else {
-      return writeJSONEscapeChar(ch);
-    }
-  }
-}
-
 // Write out the contents of the string str as a JSON string, escaping
 // characters as appropriate.
 uint32_t TJSONProtocol::writeJSONString(const std::string& str) {
   uint32_t result = context_->write(*trans_);
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  std::string::const_iterator iter(str.begin());
-  std::string::const_iterator end(str.end());
-  while (iter != end) {
-    result += writeJSONChar(*iter++);
-  }
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(str.data());
+  if (str.length() > (std::numeric_limits<uint32_t>::max)())
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  result += json_write_string_chars(*trans_, p, static_cast<uint32_t>(str.length()));
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
 }
@@ -504,73 +393,60 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
 template <typename NumberType>
 uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
   uint32_t result = context_->write(*trans_);
-  std::string val(to_string(num));
+  char buf[kJSONNumberBufferSize + 2];
+  char* p = buf;
   bool escapeNum = context_->escapeNum();
   if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+    *p++ = kJSONStringDelimiter;
   }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
+  p += json_write_integer(static_cast<int64_t>(num), p);
   if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+    *p++ = kJSONStringDelimiter;
   }
-  return result;
-}
-
-namespace {
-std::string doubleToString(double d) {
-  std::ostringstream str;
-  str.imbue(std::locale::classic());
-  const std::streamsize max_digits10 = 2 + std::numeric_limits<double>::digits10;
-  str.precision(max_digits10);
-  str << d;
-  return str.str();
-}
+  uint32_t len = static_cast<uint32_t>(p - buf);
+  trans_->write(reinterpret_cast<const uint8_t*>(buf), len);
+  return result + len;
 }
 
 // Convert the given double to a JSON string, which is either the number,
 // "NaN" or "Infinity" or "-Infinity".
 uint32_t TJSONProtocol::writeJSONDouble(double num) {
   uint32_t result = context_->write(*trans_);
-  std::string val;
+  char buf[kJSONNumberBufferSize + 2];
+  char* p = buf;
 
-  bool special = false;
+  const std::string* special = NULL;
   switch (boost::math::fpclassify(num)) {
   case FP_INFINITE:
     if (boost::math::signbit(num)) {
-      val = kThriftNegativeInfinity;
+      special = &kThriftNegativeInfinity;
     } else {
-      val = kThriftInfinity;
+      special = &kThriftInfinity;
     }
-    special = true;
     break;
   case FP_NAN:
-    val = kThriftNan;
-    special = true;
+    special = &kThriftNan;
     break;
   default:
-    val = doubleToString(num);
     break;
   }
 
   bool escapeNum = special || context_->escapeNum();
   if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+    *p++ = kJSONStringDelimiter;
+  }
+  if (special) {
+    memcpy(p, special->data(), special->size());
+    p += special->size();
+  } else {
+    p += json_write_double(num, p);
   }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
   if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+    *p++ = kJSONStringDelimiter;
   }
-  return result;
+  uint32_t len = static_cast<uint32_t>(p - buf);
+  trans_->write(reinterpret_cast<const uint8_t*>(buf), len);
+  return result + len;
 }
 
 uint32_t TJSONProtocol::writeJSONObjectStart() {
@@ -746,6 +622,26 @@ uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
   uint8_t ch;
   str.clear();
   while (true) {
+    // copy whatever the transport has buffered up to the next quote or
+    // backslash, then handle that character on its own
+    uint32_t avail;
+    const uint8_t* buf = reader_.borrow(avail);
+    if (buf) {
+      uint32_t run = json_scan_string_chars(buf, avail);
+      if (run > 0) {
+        if (!codeunits.empty()) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Missing UTF-16 low surrogate pair.");
+        }
+        str.append(reinterpret_cast<const char*>(buf), run);
+        reader_.consume(run);
+        result += run;
+        if (run == avail) {
+          continue;
+        }
+      }
+    }
+
     ch = reader_.read();
     ++result;
     if (ch == kJSONStringDelimiter) {
@@ -827,8 +723,26 @@ uint32_t TJSONProtocol::readJSONBase64(std::string& str) {
 }
 
 // Reads a sequence of characters, stopping at the first one that is not
-// a valid JSON numeric character.
-uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
+// a valid JSON numeric character, and points [begin, end) at them.  They are
+// left in the transport's buffer when it has them all, else copied to str.
+uint32_t TJSONProtocol::readJSONNumericChars(std::string& str,
+                                             const char*& begin,
+                                             const char*& end) {
+  uint32_t avail;
+  const uint8_t* buf = reader_.borrow(avail);
+  if (buf) {
+    uint32_t len = 0;
+    while (len < avail && isJSONNumeric(buf[len])) {
+      ++len;
+    }
+    if (len < avail) {
+      begin = reinterpret_cast<const char*>(buf);
+      end = begin + len;
+      reader_.consume(len);
+      return len;
+    }
+  }
+
   uint32_t result = 0;
   str.clear();
   while (true) {
@@ -840,22 +754,11 @@ uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
     str += ch;
     ++result;
   }
+  begin = str.data();
+  end = begin + str.size();
   return result;
 }
 
-namespace {
-template <typename T>
-T fromString(const std::string& s) {
-  T t;
-  std::istringstream str(s);
-  str.imbue(std::locale::classic());
-  str >> t;
-  if (str.bad() || !str.eof())
-    throw std::runtime_error(s);
-  return t;
-}
-}
-
 // Reads a sequence of characters and assembles them into a number,
 // returning them via num
 template <typename NumberType>
@@ -865,13 +768,10 @@ uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
   std::string str;
-  result += readJSONNumericChars(str);
-  try {
-    num = fromString<NumberType>(str);
-  } catch (const std::runtime_error&) {
-    throw TProtocolException(TProtocolException::INVALID_DATA,
-                             "Expected numeric value; got \"" + str + "\"");
-  }
+  const char* begin;
+  const char* end;
+  result += readJSONNumericChars(str, begin, end);
+  num = json_to_integer<NumberType>(begin, end);
   if (context_->escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
@@ -897,25 +797,17 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
         throw TProtocolException(TProtocolException::INVALID_DATA,
                                      "Numeric data unexpectedly quoted");
       }
-      try {
-        num = fromString<double>(str);
-      } catch (std::runtime_error e) {
-        throw TProtocolException(TProtocolException::INVALID_DATA,
-                                     "Expected numeric value; got \"" + str + "\"");
-      }
+      num = json_to_double(str.data(), str.data() + str.size());
     }
   } else {
     if (context_->escapeNum()) {
       // This will throw - we should have had a quote if escapeNum == true
       readJSONSyntaxChar(kJSONStringDelimiter);
     }
-    result += readJSONNumericChars(str);
-    try {
-      num = fromString<double>(str);
-    } catch (std::runtime_error e) {
-      throw TProtocolException(TProtocolException::INVALID_DATA,
-                                   "Expected numeric value; got \"" + str + "\"");
-    }
+    const char* begin;
+    const char* end;
+    result += readJSONNumericChars(str, begin, end);
+    num = json_to_double(begin, end);
   }
   return result;
 }
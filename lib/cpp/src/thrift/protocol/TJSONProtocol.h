@@ -105,10 +105,6 @@ private:
 
   void popContext();
 
-  uint32_t writeJSONEscapeChar(uint8_t ch);
-
-  uint32_t writeJSONChar(uint8_t ch);
-
   uint32_t writeJSONString(const std::string& str);
 
   uint32_t writeJSONBase64(const std::string& str);
@@ -134,7 +130,7 @@ private:
 
   uint32_t readJSONBase64(std::string& str);
 
-  uint32_t readJSONNumericChars(std::string& str);
+  uint32_t readJSONNumericChars(std::string& str, const char*& begin, const char*& end);
 
   template <typename NumberType>
   uint32_t readJSONInteger(NumberType& num);
@@ -248,11 +244,14 @@ public:
   class LookaheadReader {
 
   public:
-    LookaheadReader(TTransport& trans) : trans_(&trans), hasData_(false) {}
+    LookaheadReader(TTransport& trans) : trans_(&trans), hasData_(false), borrowed_(false) {}
 
     uint8_t read() {
       if (hasData_) {
         hasData_ = false;
+        if (borrowed_) {
+          trans_->consume(1);
+        }
       } else {
         trans_->readAll(&data_, 1);
       }
@@ -261,15 +260,45 @@ public:
 
     uint8_t peek() {
       if (!hasData_) {
-        trans_->readAll(&data_, 1);
+        // Leave the byte in the transport's buffer when it has one, so that
+        // borrow() still sees it
+        uint32_t len = 1;
+        const uint8_t* buf = trans_->borrow(NULL, &len);
+        borrowed_ = buf != NULL;
+        if (borrowed_) {
+          data_ = buf[0];
+        } else {
+          trans_->readAll(&data_, 1);
+        }
       }
       hasData_ = true;
       return data_;
     }
 
+    /**
+     * Returns the bytes buffered in the transport, starting with the next
+     * one to be read, and sets len to their number.  Returns NULL if the
+     * transport has no buffer to lend, or if peek() had to take the next
+     * byte out of it.
+     */
+    const uint8_t* borrow(uint32_t& len) {
+      if (hasData_ && !borrowed_) {
+        return NULL;
+      }
+      len = 1;
+      return trans_->borrow(NULL, &len);
+    }
+
+    /** Skips len bytes returned by borrow(). */
+    void consume(uint32_t len) {
+      hasData_ = false;
+      trans_->consume(len);
+    }
+
   private:
     TTransport* trans_;
     bool hasData_;
+    bool borrowed_;
     uint8_t data_;
   };
 
@@ -0,0 +1,685 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TJSONUtils.h>
+
+#include <cstring>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define THRIFT_JSON_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+namespace {
+
+const char kDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+const uint64_t kPow10[] = {1ULL,
+                           10ULL,
+                           100ULL,
+                           1000ULL,
+                           10000ULL,
+                           100000ULL,
+                           1000000ULL,
+                           10000000ULL,
+                           100000000ULL,
+                           1000000000ULL,
+                           10000000000ULL,
+                           100000000000ULL,
+                           1000000000000ULL,
+                           10000000000000ULL,
+                           100000000000000ULL,
+                           1000000000000000ULL,
+                           10000000000000000ULL,
+                           100000000000000000ULL,
+                           1000000000000000000ULL,
+                           10000000000000000000ULL};
+
+// Writes the digits of value, most significant first, and returns the count
+uint32_t writeDigits(uint64_t value, char* buf) {
+  char tmp[20];
+  char* p = tmp + sizeof(tmp);
+  while (value >= 100) {
+    const char* pair = kDigitPairs + (value % 100) * 2;
+    value /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (value >= 10) {
+    const char* pair = kDigitPairs + value * 2;
+    *--p = pair[1];
+    *--p = pair[0];
+  } else {
+    *--p = static_cast<char>('0' + value);
+  }
+  uint32_t len = static_cast<uint32_t>(tmp + sizeof(tmp) - p);
+  memcpy(buf, p, len);
+  return len;
+}
+
+/*
+ * Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers", PLDI 2010).  The digits it produces always
+ * read back as the original double.  They are the shortest such digits for
+ * all but about 0.1% of inputs, which get one digit more: Grisu2 works with
+ * a slightly narrowed rounding interval and does not check whether a
+ * shorter candidate would still have been inside the exact one.
+ */
+
+const uint64_t kDpSignificandMask = 0x000FFFFFFFFFFFFFULL;
+const uint64_t kDpHiddenBit = 0x0010000000000000ULL;
+const int kDpExponentBias = 0x3FF + 52;
+const int kDpMinExponent = -kDpExponentBias;
+
+// A 64 bit significand and binary exponent
+struct DiyFp {
+  DiyFp(uint64_t fp, int exp) : f(fp), e(exp) {}
+
+  explicit DiyFp(double d) {
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    int biasedExponent = static_cast<int>((u >> 52) & 0x7FF);
+    uint64_t significand = u & kDpSignificandMask;
+    if (biasedExponent != 0) {
+      f = significand + kDpHiddenBit;
+      e = biasedExponent - kDpExponentBias;
+    } else {
+      f = significand;
+      e = kDpMinExponent + 1;
+    }
+  }
+
+  DiyFp operator-(const DiyFp& rhs) const { return DiyFp(f - rhs.f, e); }
+
+  // The upper 64 bits of the 128 bit product, rounded
+  DiyFp operator*(const DiyFp& rhs) const {
+    const uint64_t M32 = 0xFFFFFFFF;
+    uint64_t a = f >> 32;
+    uint64_t b = f & M32;
+    uint64_t c = rhs.f >> 32;
+    uint64_t d = rhs.f & M32;
+    uint64_t ac = a * c;
+    uint64_t bc = b * c;
+    uint64_t ad = a * d;
+    uint64_t bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1U << 31;
+    return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+  }
+
+  DiyFp normalize() const {
+    DiyFp res = *this;
+    while (!(res.f & (1ULL << 63))) {
+      res.f <<= 1;
+      res.e--;
+    }
+    return res;
+  }
+
+  DiyFp normalizeBoundary() const {
+    DiyFp res = *this;
+    while (!(res.f & (kDpHiddenBit << 1))) {
+      res.f <<= 1;
+      res.e--;
+    }
+    res.f <<= 64 - 52 - 2;
+    res.e -= 64 - 52 - 2;
+    return res;
+  }
+
+  // The boundaries of the interval of values that round to this one
+  void normalizedBoundaries(DiyFp& minus, DiyFp& plus) const {
+    plus = DiyFp((f << 1) + 1, e - 1).normalizeBoundary();
+    minus = (f == kDpHiddenBit) ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+  }
+
+  uint64_t f;
+  int e;
+};
+
+// 10^-348, 10^-340, ..., 10^340, normalized
+const uint64_t kCachedPowersF[] = {
+    UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+    UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+    UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+    UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+    UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+    UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+    UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+    UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+    UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+    UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+    UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+    UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+    UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+    UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+    UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+    UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+    UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+    UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+    UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+    UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+    UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+    UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+    UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+    UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+    UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+    UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+    UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+    UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+    UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),};
+
+const int16_t kCachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,};
+
+// Finds the cached power c = 10^-k such that w * c has a binary exponent
+// in the range Grisu needs
+DiyFp getCachedPower(int e, int& k) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int ik = static_cast<int>(dk);
+  if (dk - ik > 0.0) {
+    ik++;
+  }
+  unsigned index = static_cast<unsigned>((ik >> 3) + 1);
+  k = -(-348 + static_cast<int>(index << 3));
+  return DiyFp(kCachedPowersF[index], kCachedPowersE[index]);
+}
+
+void grisuRound(char* buf, int len, uint64_t delta, uint64_t rest, uint64_t tenKappa,
+                uint64_t wpw) {
+  while (rest < wpw && delta - rest >= tenKappa
+         && (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw)) {
+    buf[len - 1]--;
+    rest += tenKappa;
+  }
+}
+
+int countDecimalDigits(uint32_t n) {
+  int digits = 1;
+  while (digits < 10 && n >= kPow10[digits]) {
+    digits++;
+  }
+  return digits;
+}
+
+void digitGen(const DiyFp& w, const DiyFp& mp, uint64_t delta, char* buf, int& len, int& k) {
+  const DiyFp one(1ULL << -mp.e, mp.e);
+  const DiyFp wpw = mp - w;
+  uint32_t p1 = static_cast<uint32_t>(mp.f >> -one.e);
+  uint64_t p2 = mp.f & (one.f - 1);
+  int kappa = countDecimalDigits(p1);
+  len = 0;
+
+  while (kappa > 0) {
+    uint32_t pow = static_cast<uint32_t>(kPow10[kappa - 1]);
+    uint32_t d = p1 / pow;
+    p1 %= pow;
+    if (d || len) {
+      buf[len++] = static_cast<char>('0' + d);
+    }
+    kappa--;
+    uint64_t tmp = (static_cast<uint64_t>(p1) << -one.e) + p2;
+    if (tmp <= delta) {
+      k += kappa;
+      grisuRound(buf, len, delta, tmp, kPow10[kappa] << -one.e, wpw.f);
+      return;
+    }
+  }
+
+  while (true) {
+    p2 *= 10;
+    delta *= 10;
+    char d = static_cast<char>(p2 >> -one.e);
+    if (d || len) {
+      buf[len++] = static_cast<char>('0' + d);
+    }
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      k += kappa;
+      int index = -kappa;
+      grisuRound(buf, len, delta, p2, one.f, wpw.f * (index < 20 ? kPow10[index] : 0));
+      return;
+    }
+  }
+}
+
+// Writes the digits of a positive value to buf; the value is buf * 10^k
+void grisu2(double value, char* buf, int& len, int& k) {
+  const DiyFp v(value);
+  DiyFp wm(0, 0);
+  DiyFp wp(0, 0);
+  v.normalizedBoundaries(wm, wp);
+
+  const DiyFp c = getCachedPower(wp.e, k);
+  const DiyFp w = v.normalize() * c;
+  DiyFp upper = wp * c;
+  DiyFp lower = wm * c;
+  lower.f++;
+  upper.f--;
+  digitGen(w, upper, upper.f - lower.f, buf, len, k);
+}
+
+uint32_t writeExponent(int exponent, char* buf) {
+  char* p = buf;
+  *p++ = 'e';
+  if (exponent < 0) {
+    *p++ = '-';
+    exponent = -exponent;
+  } else {
+    *p++ = '+';
+  }
+  if (exponent < 10) {
+    *p++ = '0';
+  }
+  p += writeDigits(static_cast<uint64_t>(exponent), p);
+  return static_cast<uint32_t>(p - buf);
+}
+
+bool isDigit(char ch) {
+  return ch >= '0' && ch <= '9';
+}
+
+// Powers of ten that are exact doubles
+const double kExactPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                              1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                              1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// This table describes the handling for the first 0x30 characters
+//  0 : escape using "\u00xx" notation
+//  1 : just output index
+// <other> : escape using "\<other>" notation
+const uint8_t kJSONCharTable[0x30] = {
+    //  0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    'b',
+    't',
+    'n',
+    0,
+    'f',
+    'r',
+    0,
+    0, // 0
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0, // 1
+    1,
+    1,
+    '"',
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1, // 2
+};
+
+// Return the hex character representing the integer val. The value is masked
+// to make sure it is in the correct range.
+uint8_t hexChar(uint8_t val) {
+  val &= 0x0F;
+  if (val < 10) {
+    return val + '0';
+  } else {
+    return val - 10 + 'a';
+  }
+}
+
+template <typename T>
+T fromString(const std::string& s) {
+  T t;
+  std::istringstream str(s);
+  str.imbue(std::locale::classic());
+  str >> t;
+  if (str.bad() || !str.eof())
+    throw std::runtime_error(s);
+  return t;
+}
+
+#ifdef THRIFT_JSON_SSE2
+// Return the index of the lowest set bit of a non-zero mask
+uint32_t lowestBit(int mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, static_cast<unsigned long>(mask));
+  return static_cast<uint32_t>(index);
+#else
+  return static_cast<uint32_t>(__builtin_ctz(static_cast<unsigned int>(mask)));
+#endif
+}
+#endif
+
+// Return the number of leading characters of buf that can be written into a
+// JSON string as they are, ie. up to the first control character, quote or
+// backslash
+uint32_t scanPlainChars(const uint8_t* buf, uint32_t len) {
+  uint32_t i = 0;
+#ifdef THRIFT_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i lastControl = _mm_set1_epi8(0x1f);
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+    // unsigned chunk <= 0x1f, as there is no unsigned byte comparison
+    __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, lastControl), chunk);
+    int mask = _mm_movemask_epi8(_mm_or_si128(
+        control,
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash))));
+    if (mask != 0) {
+      return i + lowestBit(mask);
+    }
+  }
+#endif
+  for (; i < len; ++i) {
+    uint8_t ch = buf[i];
+    if (ch < 0x20 || ch == '"' || ch == '\\') {
+      break;
+    }
+  }
+  return i;
+}
+}
+
+uint32_t json_write_integer(int64_t num, char* buf) {
+  if (num < 0) {
+    buf[0] = '-';
+    // negate in unsigned arithmetic, so that INT64_MIN works
+    return 1 + writeDigits(0 - static_cast<uint64_t>(num), buf + 1);
+  }
+  return writeDigits(static_cast<uint64_t>(num), buf);
+}
+
+uint32_t json_write_double(double num, char* buf) {
+  char* p = buf;
+  if (num < 0 || (num == 0 && 1 / num < 0)) {
+    *p++ = '-';
+    num = -num;
+  }
+  if (num == 0) {
+    *p++ = '0';
+    return static_cast<uint32_t>(p - buf);
+  }
+
+  char digits[20];
+  int len;
+  int k;
+  grisu2(num, digits, len, k);
+
+  // decimal exponent of the first digit; like %g, use positional notation
+  // for exponents from -4 up to the precision
+  int exponent = len + k - 1;
+  if (exponent < -4 || exponent >= 17) {
+    *p++ = digits[0];
+    if (len > 1) {
+      *p++ = '.';
+      memcpy(p, digits + 1, len - 1);
+      p += len - 1;
+    }
+    p += writeExponent(exponent, p);
+  } else if (k >= 0) {
+    memcpy(p, digits, len);
+    p += len;
+    memset(p, '0', k);
+    p += k;
+  } else if (exponent >= 0) {
+    memcpy(p, digits, exponent + 1);
+    p += exponent + 1;
+    *p++ = '.';
+    memcpy(p, digits + exponent + 1, len - exponent - 1);
+    p += len - exponent - 1;
+  } else {
+    *p++ = '0';
+    *p++ = '.';
+    memset(p, '0', -exponent - 1);
+    p += -exponent - 1;
+    memcpy(p, digits, len);
+    p += len;
+  }
+  return static_cast<uint32_t>(p - buf);
+}
+
+bool json_parse_integer(const char* begin,
+                        const char* end,
+                        bool& negative,
+                        uint64_t& magnitude) {
+  negative = false;
+  if (begin != end && (*begin == '-' || *begin == '+')) {
+    negative = *begin == '-';
+    ++begin;
+  }
+  if (begin == end) {
+    return false;
+  }
+  uint64_t value = 0;
+  for (; begin != end; ++begin) {
+    if (!isDigit(*begin)) {
+      return false;
+    }
+    uint64_t digit = static_cast<uint64_t>(*begin - '0');
+    if (value > (0xFFFFFFFFFFFFFFFFULL - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
+  }
+  magnitude = value;
+  return true;
+}
+
+bool json_parse_double_fast(const char* begin, const char* end, double& num) {
+  bool negative = false;
+  if (begin != end && (*begin == '-' || *begin == '+')) {
+    negative = *begin == '-';
+    ++begin;
+  }
+
+  // at most 19 significant digits, so that the mantissa cannot overflow
+  uint64_t mantissa = 0;
+  int significant = 0;
+  int exponent = 0;
+  int digits = 0;
+  for (; begin != end && isDigit(*begin); ++begin, ++digits) {
+    if (mantissa != 0 || *begin != '0') {
+      if (++significant > 19) {
+        return false;
+      }
+      mantissa = mantissa * 10 + (*begin - '0');
+    }
+  }
+  if (begin != end && *begin == '.') {
+    ++begin;
+    for (; begin != end && isDigit(*begin); ++begin, ++digits) {
+      if (mantissa != 0 || *begin != '0') {
+        if (++significant > 19) {
+          return false;
+        }
+        mantissa = mantissa * 10 + (*begin - '0');
+      }
+      --exponent;
+    }
+  }
+  if (digits == 0) {
+    return false;
+  }
+  if (begin != end && (*begin == 'e' || *begin == 'E')) {
+    ++begin;
+    bool negativeExponent = false;
+    if (begin != end && (*begin == '-' || *begin == '+')) {
+      negativeExponent = *begin == '-';
+      ++begin;
+    }
+    if (begin == end) {
+      return false;
+    }
+    int explicitExponent = 0;
+    for (; begin != end; ++begin) {
+      if (!isDigit(*begin) || explicitExponent > 1000) {
+        return false;
+      }
+      explicitExponent = explicitExponent * 10 + (*begin - '0');
+    }
+    exponent += negativeExponent ? -explicitExponent : explicitExponent;
+  }
+  if (begin != end) {
+    return false;
+  }
+
+  // Both the mantissa and the power of ten are exact doubles, so a single,
+  // correctly rounded multiplication or division gives the exact result
+  if (mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) {
+    if (mantissa != 0) {
+      return false;
+    }
+    exponent = 0;
+  }
+  double value = static_cast<double>(mantissa);
+  if (exponent < 0) {
+    value /= kExactPow10[-exponent];
+  } else {
+    value *= kExactPow10[exponent];
+  }
+  num = negative ? -value : value;
+  return true;
+}
+
+double json_to_double(const char* begin, const char* end) {
+  double num;
+  if (json_parse_double_fast(begin, end, num)) {
+    return num;
+  }
+  std::string str(begin, end);
+  try {
+    return fromString<double>(str);
+  } catch (const std::runtime_error&) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Expected numeric value; got \"" + str + "\"");
+  }
+}
+
+uint32_t json_scan_string_chars(const uint8_t* buf, uint32_t len) {
+  uint32_t i = 0;
+#ifdef THRIFT_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+    if (mask != 0) {
+      return i + lowestBit(mask);
+    }
+  }
+#endif
+  for (; i < len; ++i) {
+    if (buf[i] == '"' || buf[i] == '\\') {
+      break;
+    }
+  }
+  return i;
+}
+
+uint32_t json_write_string_chars(transport::TTransport& trans, const uint8_t* buf, uint32_t len) {
+  uint32_t result = 0;
+  while (len > 0) {
+    uint32_t run = scanPlainChars(buf, len);
+    if (run > 0) {
+      trans.write(buf, run);
+      result += run;
+      buf += run;
+      len -= run;
+      if (len == 0) {
+        break;
+      }
+    }
+    uint8_t ch = *buf++;
+    --len;
+    uint8_t outCh = ch == '\\' ? '\\' : kJSONCharTable[ch];
+    if (outCh > 1) {
+      // backslash escaped
+      const uint8_t escaped[2] = {'\\', outCh};
+      trans.write(escaped, 2);
+      result += 2;
+    } else {
+      // other control characters are written as "\u00xx"
+      const uint8_t escaped[6] = {'\\', 'u', '0', '0', hexChar(ch >> 4), hexChar(ch)};
+      trans.write(escaped, 6);
+      result += 6;
+    }
+  }
+  return result;
+}
+}
+}
+} // apache::thrift::protocol
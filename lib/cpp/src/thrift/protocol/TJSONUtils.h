@@ -0,0 +1,102 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TJSONUTILS_H_
+#define _THRIFT_PROTOCOL_TJSONUTILS_H_
+
+#include <thrift/Thrift.h>
+#include <thrift/protocol/TProtocolException.h>
+#include <thrift/transport/TTransport.h>
+
+#include <limits>
+#include <string>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+// Large enough for any number written by the functions below
+static const uint32_t kJSONNumberBufferSize = 32;
+
+// Writes num in decimal to buf, which must hold kJSONNumberBufferSize
+// bytes, and returns the number of characters written (no terminator).
+uint32_t json_write_integer(int64_t num, char* buf);
+
+// Writes a decimal string that reads back as num, in the style of printf's
+// %.17g, to buf, which must hold kJSONNumberBufferSize bytes.  Returns the
+// number of characters written (no terminator).  num must be finite.  The
+// digits are those of Grisu2: nearly always the shortest that round-trip,
+// but about one double in a thousand gets one digit more than needed (e.g.
+// 3.6297582882482457e-200 for 3.629758288248246e-200).
+uint32_t json_write_double(double num, char* buf);
+
+// Parses [begin, end) as an optionally signed decimal integer.  Returns
+// false if the text is not one or its magnitude does not fit in 64 bits.
+bool json_parse_integer(const char* begin,
+                        const char* end,
+                        bool& negative,
+                        uint64_t& magnitude);
+
+// Parses [begin, end) as a JSON number when that can be done exactly with
+// a single floating point operation, which covers numbers of up to 15
+// significant digits with moderate exponents.  Returns false otherwise;
+// the caller must then fall back to a full conversion.
+bool json_parse_double_fast(const char* begin, const char* end, double& num);
+
+// Converts [begin, end) to NumberType.  Throws TProtocolException
+// (INVALID_DATA) if the text is not an integer or does not fit.
+template <typename NumberType>
+NumberType json_to_integer(const char* begin, const char* end) {
+  bool negative;
+  uint64_t magnitude;
+  bool valid = json_parse_integer(begin, end, negative, magnitude);
+  if (valid) {
+    uint64_t max = static_cast<uint64_t>((std::numeric_limits<NumberType>::max)());
+    if (negative && magnitude != 0) {
+      valid = std::numeric_limits<NumberType>::is_signed && magnitude - 1 <= max;
+    } else {
+      valid = magnitude <= max;
+    }
+  }
+  if (!valid) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Expected numeric value; got \"" + std::string(begin, end) + "\"");
+  }
+  return static_cast<NumberType>(negative ? 0 - magnitude : magnitude);
+}
+
+// Converts [begin, end) to a double; exactly representable numbers, by far
+// the most common kind, are converted without a stream.  Throws
+// TProtocolException (INVALID_DATA) if the text is not a number.
+double json_to_double(const char* begin, const char* end);
+
+// Returns the number of leading bytes of buf that can be copied into a
+// string being read as they are, ie. up to the first quote or backslash.
+uint32_t json_scan_string_chars(const uint8_t* buf, uint32_t len);
+
+// Writes len bytes at buf to trans as the contents of a JSON string,
+// without the quotes, escaping characters as appropriate.  Runs of
+// characters that need no escaping are written in one go.  Returns the
+// number of bytes written.
+uint32_t json_write_string_chars(transport::TTransport& trans, const uint8_t* buf, uint32_t len);
+}
+}
+} // apache::thrift::protocol
+
+#endif // #define _THRIFT_PROTOCOL_TJSONUTILS_H_
@@ -0,0 +1,50 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TLazyValue.h>
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+using apache::thrift::transport::TMemoryBuffer;
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+stdcxx::shared_ptr<TProtocol> TLazyValue::getProtocol() const {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(
+      new TMemoryBuffer(reinterpret_cast<uint8_t*>(const_cast<char*>(raw_.data())),
+                        static_cast<uint32_t>(raw_.size())));
+  switch (encoding_) {
+  case T_RAW_BINARY:
+    return stdcxx::shared_ptr<TProtocol>(new TBinaryProtocolT<TMemoryBuffer>(buffer));
+  case T_RAW_BINARY_LE:
+    return stdcxx::shared_ptr<TProtocol>(
+        new TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian>(buffer));
+  case T_RAW_COMPACT:
+    return stdcxx::shared_ptr<TProtocol>(new TCompactProtocolT<TMemoryBuffer>(buffer));
+  default:
+    throw TProtocolException(TProtocolException::INVALID_DATA, "no lazy value to decode");
+  }
+}
+}
+}
+} // apache::thrift::protocol
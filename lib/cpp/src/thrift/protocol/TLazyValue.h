@@ -0,0 +1,107 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TLAZYVALUE_H_
+#define _THRIFT_PROTOCOL_TLAZYVALUE_H_ 1
+
+#include <algorithm>
+#include <string>
+
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/stdcxx.h>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/**
+ * The undecoded value of a field annotated cpp.lazy.
+ *
+ * The generated reader keeps the encoding of the field here, when the
+ * protocol can hand it out, and decodes it on the first access to the
+ * field.  The generated writer puts it back on the wire as it is if the
+ * field was not decoded and the protocol uses the same encoding.
+ *
+ * The field itself is private, so every change to it goes through the
+ * generated mutable_ or __set_ accessor, which drops the kept encoding.
+ * Decoding on first access is not synchronized, even from the const get_
+ * accessor.
+ */
+class TLazyValue {
+public:
+  TLazyValue() : encoding_(T_RAW_NONE) {}
+
+  bool empty() const { return encoding_ == T_RAW_NONE; }
+
+  void clear() {
+    raw_.clear();
+    encoding_ = T_RAW_NONE;
+  }
+
+  /**
+   * Reads a value of the given type.  Returns 0 and stays empty if the
+   * protocol cannot keep it undecoded.
+   */
+  template <class Protocol_>
+  uint32_t read(Protocol_* iprot, TType type) {
+    clear();
+    uint32_t xfer = iprot->readRaw(type, raw_);
+    if (xfer != 0) {
+      encoding_ = iprot->getRawEncoding();
+    }
+    return xfer;
+  }
+
+  /**
+   * Whether write() can put the value on oprot.
+   */
+  template <class Protocol_>
+  bool isWritableTo(Protocol_* oprot) const {
+    return !empty() && encoding_ == oprot->getRawEncoding();
+  }
+
+  template <class Protocol_>
+  uint32_t write(Protocol_* oprot) const {
+    return oprot->writeRaw(raw_);
+  }
+
+  /**
+   * Returns a protocol to decode the value with.  It reads from this object,
+   * which must outlive it and stay unchanged meanwhile.
+   */
+  stdcxx::shared_ptr<TProtocol> getProtocol() const;
+
+  void swap(TLazyValue& other) {
+    raw_.swap(other.raw_);
+    std::swap(encoding_, other.encoding_);
+  }
+
+private:
+  std::string raw_;
+  TRawEncoding encoding_;
+};
+
+inline void swap(TLazyValue& a, TLazyValue& b) {
+  a.swap(b);
+}
+}
+}
+} // apache::thrift::protocol
+
+#endif // #define _THRIFT_PROTOCOL_TLAZYVALUE_H_ 1
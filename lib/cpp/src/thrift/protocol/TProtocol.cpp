@@ -19,6 +19,8 @@
 
 #include <thrift/protocol/TProtocol.h>
 
+#include <cstring>
+
 namespace apache {
 namespace thrift {
 namespace protocol {
@@ -28,6 +30,45 @@ uint32_t TProtocol::skip_virt(TType type) {
   return ::apache::thrift::protocol::skip(*this, type);
 }
 
+uint32_t TProtocol::readRaw_virt(TType type, std::string& raw) {
+  (void)type;
+  (void)raw;
+  return 0;
+}
+
+uint32_t TProtocol::writeRaw_virt(const std::string& raw) {
+  (void)raw;
+  throw TProtocolException(TProtocolException::NOT_IMPLEMENTED,
+                           "this protocol does not support raw values.");
+}
+
+TRawEncoding TProtocol::getRawEncoding_virt() {
+  return T_RAW_NONE;
+}
+
 TProtocolFactory::~TProtocolFactory() {}
 
+bool lookupFieldName(const TFieldName* fields,
+                     size_t count,
+                     const std::string& name,
+                     int16_t& id,
+                     TType& type) {
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int order = strcmp(fields[middle].name, name.c_str());
+    if (order == 0) {
+      id = fields[middle].id;
+      type = fields[middle].type;
+      return true;
+    } else if (order < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return false;
+}
+
 }}} // apache::thrift::protocol
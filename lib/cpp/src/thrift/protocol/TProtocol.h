@@ -207,6 +207,43 @@ enum TMessageType {
 
 static const uint32_t DEFAULT_RECURSION_LIMIT = 64;
 
+/**
+ * Name, id and type of a struct field, as known to generated code.
+ *
+ * Protocols that key fields by name rather than by id, such as
+ * TSimpleJSONProtocol, return the name from readFieldBegin() with a field
+ * type of T_VOID.  The generated readers then look the name up in a table
+ * of these, sorted by name, to find the field's id and type.
+ */
+struct TFieldName {
+  const char* name;
+  int16_t id;
+  TType type;
+};
+
+/**
+ * Looks name up in the count entries at fields, which are sorted by name.
+ * Sets id and type and returns true if it is found; otherwise leaves them
+ * alone, so that the field is skipped as one of type T_VOID.
+ */
+bool lookupFieldName(const TFieldName* fields,
+                     size_t count,
+                     const std::string& name,
+                     int16_t& id,
+                     TType& type);
+
+/**
+ * Encodings that protocols can hand out undecoded values in, for fields
+ * annotated cpp.lazy.  Values can be written back as they are only on a
+ * protocol with the same encoding.
+ */
+enum TRawEncoding {
+  T_RAW_NONE = 0,
+  T_RAW_BINARY = 1,
+  T_RAW_BINARY_LE = 2,
+  T_RAW_COMPACT = 3
+};
+
 /**
  * Abstract class for a thrift protocol driver. These are all the methods that
  * a protocol must implement. Essentially, there must be some way of reading
@@ -550,6 +587,37 @@ public:
   }
   virtual uint32_t skip_virt(TType type);
 
+  /**
+   * Reads a value of the given type without decoding it, and puts its
+   * encoding in raw.  Returns 0 and reads nothing if the protocol cannot,
+   * in which case the caller decodes the value as usual.
+   */
+  uint32_t readRaw(TType type, std::string& raw) {
+    T_VIRTUAL_CALL();
+    return readRaw_virt(type, raw);
+  }
+  virtual uint32_t readRaw_virt(TType type, std::string& raw);
+
+  /**
+   * Writes a value read by readRaw() from a protocol with the same
+   * getRawEncoding().
+   */
+  uint32_t writeRaw(const std::string& raw) {
+    T_VIRTUAL_CALL();
+    return writeRaw_virt(raw);
+  }
+  virtual uint32_t writeRaw_virt(const std::string& raw);
+
+  /**
+   * The encoding of the values readRaw() returns, or T_RAW_NONE if it
+   * returns none.
+   */
+  TRawEncoding getRawEncoding() {
+    T_VIRTUAL_CALL();
+    return getRawEncoding_virt();
+  }
+  virtual TRawEncoding getRawEncoding_virt();
+
   inline stdcxx::shared_ptr<TTransport> getTransport() { return ptrans_; }
 
   // TODO: remove these two calls, they are for backwards
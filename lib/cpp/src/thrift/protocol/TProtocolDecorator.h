@@ -141,6 +141,12 @@ public:
   virtual uint32_t readString_virt(std::string& str) { return protocol->readString(str); }
   virtual uint32_t readBinary_virt(std::string& str) { return protocol->readBinary(str); }
 
+  virtual uint32_t readRaw_virt(TType type, std::string& raw) {
+    return protocol->readRaw(type, raw);
+  }
+  virtual uint32_t writeRaw_virt(const std::string& raw) { return protocol->writeRaw(raw); }
+  virtual TRawEncoding getRawEncoding_virt() { return protocol->getRawEncoding(); }
+
 private:
   shared_ptr<TProtocol> protocol;
 };
@@ -0,0 +1,931 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TSimpleJSONProtocol.h>
+
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/math/special_functions/sign.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <thrift/protocol/TBase64Utils.h>
+#include <thrift/protocol/TJSONUtils.h>
+
+using namespace apache::thrift::transport;
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+static const uint8_t kJSONObjectStart = '{';
+static const uint8_t kJSONObjectEnd = '}';
+static const uint8_t kJSONArrayStart = '[';
+static const uint8_t kJSONArrayEnd = ']';
+static const uint8_t kJSONPairSeparator = ':';
+static const uint8_t kJSONElemSeparator = ',';
+static const uint8_t kJSONBackslash = '\\';
+static const uint8_t kJSONStringDelimiter = '"';
+
+static const char kThriftNan[] = "NaN";
+static const char kThriftInfinity[] = "Infinity";
+static const char kThriftNegativeInfinity[] = "-Infinity";
+
+// Return true if the character ch can be part of a JSON number
+static bool isJSONNumeric(uint8_t ch) {
+  return (ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.' || ch == 'e'
+         || ch == 'E';
+}
+
+static uint8_t hexVal(uint8_t ch) {
+  if (ch >= '0' && ch <= '9') {
+    return ch - '0';
+  } else if (ch >= 'a' && ch <= 'f') {
+    return ch - 'a' + 10;
+  } else if (ch >= 'A' && ch <= 'F') {
+    return ch - 'A' + 10;
+  }
+  throw TProtocolException(TProtocolException::INVALID_DATA,
+                           "Expected hex val ([0-9a-fA-F]); got \'"
+                           + std::string(reinterpret_cast<const char*>(&ch), 1) + "\'.");
+}
+
+// Append the code point cp to str in UTF-8
+static void appendUtf8(std::string& str, uint32_t cp) {
+  if (cp < 0x80) {
+    str += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    str += static_cast<char>(0xc0 | (cp >> 6));
+    str += static_cast<char>(0x80 | (cp & 0x3f));
+  } else if (cp < 0x10000) {
+    str += static_cast<char>(0xe0 | (cp >> 12));
+    str += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    str += static_cast<char>(0x80 | (cp & 0x3f));
+  } else {
+    str += static_cast<char>(0xf0 | (cp >> 18));
+    str += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+    str += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+    str += static_cast<char>(0x80 | (cp & 0x3f));
+  }
+}
+
+TSimpleJSONProtocol::TSimpleJSONProtocol(stdcxx::shared_ptr<TTransport> ptrans)
+  : TVirtualProtocol<TSimpleJSONProtocol>(ptrans),
+    trans_(ptrans.get()),
+    start_(NULL),
+    pos_(NULL),
+    end_(NULL),
+    borrowed_(false),
+    byte_(0),
+    inputBytes_(0) {
+}
+
+TSimpleJSONProtocol::~TSimpleJSONProtocol() {
+}
+
+/**
+ * Writing functions
+ */
+
+// Writes what has to come before the next value in the enclosing container,
+// and tells whether that value is a map key, which has to be a string.
+uint32_t TSimpleJSONProtocol::writeSeparator(bool& key) {
+  key = false;
+  if (writeFrames_.empty()) {
+    return 0;
+  }
+  WriteFrame& frame = writeFrames_.back();
+  switch (frame.context) {
+  case WRITE_LIST:
+    if (frame.count++ == 0) {
+      return 0;
+    }
+    trans_->write(&kJSONElemSeparator, 1);
+    return 1;
+  case WRITE_MAP:
+    key = frame.count % 2 == 0;
+    if (frame.count++ == 0) {
+      return 0;
+    }
+    trans_->write(key ? &kJSONElemSeparator : &kJSONPairSeparator, 1);
+    return 1;
+  default:
+    // writeFieldBegin() has written the key
+    return 0;
+  }
+}
+
+uint32_t TSimpleJSONProtocol::writeContainerBegin(uint8_t ch, WriteContext context) {
+  bool key;
+  uint32_t result = writeSeparator(key);
+  if (key) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Map keys must be strings, numbers or bools in JSON");
+  }
+  trans_->write(&ch, 1);
+  writeFrames_.push_back(WriteFrame(context, 0));
+  return result + 1;
+}
+
+uint32_t TSimpleJSONProtocol::writeContainerEnd(uint8_t ch) {
+  writeFrames_.pop_back();
+  trans_->write(&ch, 1);
+  return 1;
+}
+
+uint32_t TSimpleJSONProtocol::writeQuoted(const char* str, uint32_t len) {
+  trans_->write(&kJSONStringDelimiter, 1);
+  uint32_t result = json_write_string_chars(*trans_, reinterpret_cast<const uint8_t*>(str), len);
+  trans_->write(&kJSONStringDelimiter, 1);
+  return result + 2;
+}
+
+// Writes num as a JSON number, or as a string if it is a map key
+template <typename NumberType>
+uint32_t TSimpleJSONProtocol::writeInteger(NumberType num) {
+  bool key;
+  uint32_t result = writeSeparator(key);
+  char buf[kJSONNumberBufferSize + 2];
+  char* p = buf;
+  if (key) {
+    *p++ = kJSONStringDelimiter;
+  }
+  p += json_write_integer(static_cast<int64_t>(num), p);
+  if (key) {
+    *p++ = kJSONStringDelimiter;
+  }
+  uint32_t len = static_cast<uint32_t>(p - buf);
+  trans_->write(reinterpret_cast<const uint8_t*>(buf), len);
+  return result + len;
+}
+
+uint32_t TSimpleJSONProtocol::writeMessageBegin(const std::string& name,
+                                                const TMessageType messageType,
+                                                const int32_t seqid) {
+  uint32_t result = writeContainerBegin(kJSONArrayStart, WRITE_LIST);
+  result += writeString(name);
+  result += writeInteger(static_cast<int32_t>(messageType));
+  result += writeInteger(seqid);
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::writeMessageEnd() {
+  return writeContainerEnd(kJSONArrayEnd);
+}
+
+uint32_t TSimpleJSONProtocol::writeStructBegin(const char* name) {
+  (void)name;
+  return writeContainerBegin(kJSONObjectStart, WRITE_STRUCT);
+}
+
+uint32_t TSimpleJSONProtocol::writeStructEnd() {
+  return writeContainerEnd(kJSONObjectEnd);
+}
+
+uint32_t TSimpleJSONProtocol::writeFieldBegin(const char* name,
+                                              const TType fieldType,
+                                              const int16_t fieldId) {
+  (void)fieldType;
+  (void)fieldId;
+  uint32_t result = 0;
+  if (writeFrames_.back().count++ > 0) {
+    trans_->write(&kJSONElemSeparator, 1);
+    ++result;
+  }
+  result += writeQuoted(name, static_cast<uint32_t>(strlen(name)));
+  trans_->write(&kJSONPairSeparator, 1);
+  return result + 1;
+}
+
+uint32_t TSimpleJSONProtocol::writeFieldEnd() {
+  return 0;
+}
+
+uint32_t TSimpleJSONProtocol::writeFieldStop() {
+  return 0;
+}
+
+uint32_t TSimpleJSONProtocol::writeMapBegin(const TType keyType,
+                                            const TType valType,
+                                            const uint32_t size) {
+  (void)keyType;
+  (void)valType;
+  (void)size;
+  return writeContainerBegin(kJSONObjectStart, WRITE_MAP);
+}
+
+uint32_t TSimpleJSONProtocol::writeMapEnd() {
+  return writeContainerEnd(kJSONObjectEnd);
+}
+
+uint32_t TSimpleJSONProtocol::writeListBegin(const TType elemType, const uint32_t size) {
+  (void)elemType;
+  (void)size;
+  return writeContainerBegin(kJSONArrayStart, WRITE_LIST);
+}
+
+uint32_t TSimpleJSONProtocol::writeListEnd() {
+  return writeContainerEnd(kJSONArrayEnd);
+}
+
+uint32_t TSimpleJSONProtocol::writeSetBegin(const TType elemType, const uint32_t size) {
+  (void)elemType;
+  (void)size;
+  return writeContainerBegin(kJSONArrayStart, WRITE_LIST);
+}
+
+uint32_t TSimpleJSONProtocol::writeSetEnd() {
+  return writeContainerEnd(kJSONArrayEnd);
+}
+
+uint32_t TSimpleJSONProtocol::writeBool(const bool value) {
+  bool key;
+  uint32_t result = writeSeparator(key);
+  const char* str = value ? "\"true\"" : "\"false\"";
+  uint32_t len = value ? 6 : 7;
+  if (!key) {
+    // without the quotes
+    ++str;
+    len -= 2;
+  }
+  trans_->write(reinterpret_cast<const uint8_t*>(str), len);
+  return result + len;
+}
+
+uint32_t TSimpleJSONProtocol::writeByte(const int8_t byte) {
+  return writeInteger(byte);
+}
+
+uint32_t TSimpleJSONProtocol::writeI16(const int16_t i16) {
+  return writeInteger(i16);
+}
+
+uint32_t TSimpleJSONProtocol::writeI32(const int32_t i32) {
+  return writeInteger(i32);
+}
+
+uint32_t TSimpleJSONProtocol::writeI64(const int64_t i64) {
+  return writeInteger(i64);
+}
+
+// Writes dub as a JSON number, or as a string if it is a map key or has no
+// JSON representation: "NaN", "Infinity" or "-Infinity"
+uint32_t TSimpleJSONProtocol::writeDouble(const double dub) {
+  bool key;
+  uint32_t result = writeSeparator(key);
+  char buf[kJSONNumberBufferSize + 2];
+  char* p = buf;
+
+  const char* special = NULL;
+  switch (boost::math::fpclassify(dub)) {
+  case FP_INFINITE:
+    special = boost::math::signbit(dub) ? kThriftNegativeInfinity : kThriftInfinity;
+    break;
+  case FP_NAN:
+    special = kThriftNan;
+    break;
+  default:
+    break;
+  }
+
+  bool quote = key || special;
+  if (quote) {
+    *p++ = kJSONStringDelimiter;
+  }
+  if (special) {
+    size_t len = strlen(special);
+    memcpy(p, special, len);
+    p += len;
+  } else {
+    p += json_write_double(dub, p);
+  }
+  if (quote) {
+    *p++ = kJSONStringDelimiter;
+  }
+  uint32_t len = static_cast<uint32_t>(p - buf);
+  trans_->write(reinterpret_cast<const uint8_t*>(buf), len);
+  return result + len;
+}
+
+uint32_t TSimpleJSONProtocol::writeString(const std::string& str) {
+  if (str.length() > (std::numeric_limits<uint32_t>::max)())
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  bool key;
+  uint32_t result = writeSeparator(key);
+  return result + writeQuoted(str.data(), static_cast<uint32_t>(str.length()));
+}
+
+uint32_t TSimpleJSONProtocol::writeBinary(const std::string& str) {
+  if (str.length() > (std::numeric_limits<uint32_t>::max)() / 4 * 3 - 2)
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  bool key;
+  uint32_t result = writeSeparator(key);
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(str.data());
+  uint32_t len = static_cast<uint32_t>(str.length());
+  std::string encoded((len + 2) / 3 * 4 + 2, '=');
+  uint8_t* out = reinterpret_cast<uint8_t*>(&encoded[0]);
+  *out++ = kJSONStringDelimiter;
+  while (len >= 3) {
+    base64_encode(bytes, 3, out);
+    bytes += 3;
+    out += 4;
+    len -= 3;
+  }
+  if (len) {
+    // the rest of the group is already padding
+    base64_encode(bytes, len, out);
+  }
+  encoded[encoded.size() - 1] = kJSONStringDelimiter;
+  trans_->write(reinterpret_cast<const uint8_t*>(encoded.data()),
+                static_cast<uint32_t>(encoded.size()));
+  return result + static_cast<uint32_t>(encoded.size());
+}
+
+/**
+ * Parsing
+ */
+
+void TSimpleJSONProtocol::releaseInput() {
+  if (borrowed_) {
+    uint32_t used = static_cast<uint32_t>(pos_ - start_);
+    trans_->consume(used);
+    inputBytes_ += used;
+    borrowed_ = false;
+  }
+  start_ = pos_ = end_ = NULL;
+}
+
+// Makes more input available in [pos_, end_): whatever the transport has
+// buffered, or else one byte read from it.
+void TSimpleJSONProtocol::refillInput() {
+  releaseInput();
+  uint32_t len = 1;
+  const uint8_t* buf = trans_->borrow(NULL, &len);
+  if (buf != NULL && len > 0) {
+    borrowed_ = true;
+    start_ = pos_ = buf;
+    end_ = buf + len;
+  } else {
+    trans_->readAll(&byte_, 1);
+    ++inputBytes_;
+    start_ = pos_ = &byte_;
+    end_ = pos_ + 1;
+  }
+}
+
+uint8_t TSimpleJSONProtocol::readInputByte() {
+  if (pos_ == end_) {
+    refillInput();
+  }
+  return *pos_++;
+}
+
+// Returns the next character that is not white space, without consuming it
+uint8_t TSimpleJSONProtocol::nextToken() {
+  while (true) {
+    if (pos_ == end_) {
+      refillInput();
+    }
+    uint8_t ch = *pos_;
+    if (ch != ' ' && ch != '\n' && ch != '\r' && ch != '\t') {
+      return ch;
+    }
+    ++pos_;
+  }
+}
+
+// Reads the next top level value into values_ and text_, and returns its
+// length in bytes
+uint32_t TSimpleJSONProtocol::parseDocument() {
+  values_.clear();
+  text_.clear();
+  inputBytes_ = 0;
+  if (isJSONNumeric(nextToken())) {
+    releaseInput();
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Cannot read a JSON number at the top level");
+  }
+  try {
+    parseValue(0);
+  } catch (...) {
+    releaseInput();
+    values_.clear();
+    throw;
+  }
+  releaseInput();
+  return inputBytes_;
+}
+
+void TSimpleJSONProtocol::parseValue(uint32_t depth) {
+  if (depth > getRecursionLimit()) {
+    throw TProtocolException(TProtocolException::DEPTH_LIMIT);
+  }
+  uint8_t ch = nextToken();
+  uint32_t index = static_cast<uint32_t>(values_.size());
+  values_.push_back(JSONValue());
+  values_[index].size = 0;
+  values_[index].offset = 0;
+
+  switch (ch) {
+  case kJSONObjectStart:
+  case kJSONArrayStart: {
+    bool object = ch == kJSONObjectStart;
+    uint8_t close = object ? kJSONObjectEnd : kJSONArrayEnd;
+    values_[index].kind = object ? JSON_OBJECT : JSON_ARRAY;
+    ++pos_;
+    uint32_t size = 0;
+    if (nextToken() == close) {
+      ++pos_;
+    } else {
+      while (true) {
+        if (object) {
+          if (nextToken() != kJSONStringDelimiter) {
+            throw TProtocolException(TProtocolException::INVALID_DATA,
+                                     "Expected a string as JSON object key");
+          }
+          parseValue(depth + 1);
+          if (nextToken() != kJSONPairSeparator) {
+            throw TProtocolException(TProtocolException::INVALID_DATA,
+                                     "Expected ':' after JSON object key");
+          }
+          ++pos_;
+          ++size;
+        }
+        parseValue(depth + 1);
+        ++size;
+        ch = nextToken();
+        ++pos_;
+        if (ch == close) {
+          break;
+        }
+        if (ch != kJSONElemSeparator) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Expected ',' or the end of a JSON array or object; got \'"
+                                   + std::string(reinterpret_cast<const char*>(&ch), 1)
+                                   + "\'.");
+        }
+      }
+    }
+    values_[index].size = size;
+    break;
+  }
+  case kJSONStringDelimiter:
+    values_[index].kind = JSON_STRING;
+    parseString(index);
+    break;
+  case 't':
+    values_[index].kind = JSON_TRUE;
+    parseLiteral("true");
+    break;
+  case 'f':
+    values_[index].kind = JSON_FALSE;
+    parseLiteral("false");
+    break;
+  case 'n':
+    values_[index].kind = JSON_NULL;
+    parseLiteral("null");
+    break;
+  default:
+    if (!isJSONNumeric(ch)) {
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "Unexpected character in JSON: \'"
+                               + std::string(reinterpret_cast<const char*>(&ch), 1) + "\'.");
+    }
+    values_[index].kind = JSON_NUMBER;
+    parseNumber(index);
+    break;
+  }
+  values_[index].next = static_cast<uint32_t>(values_.size());
+}
+
+// Unescapes the string at the input into text_, copying runs of characters
+// that need no unescaping straight from the transport's buffer
+void TSimpleJSONProtocol::parseString(uint32_t index) {
+  ++pos_; // opening quote
+  size_t offset = text_.size();
+  uint16_t highSurrogate = 0;
+  while (true) {
+    if (pos_ == end_) {
+      refillInput();
+    }
+    uint32_t run = json_scan_string_chars(pos_, static_cast<uint32_t>(end_ - pos_));
+    if (run > 0) {
+      if (highSurrogate) {
+        throw TProtocolException(TProtocolException::INVALID_DATA,
+                                 "Missing UTF-16 low surrogate pair.");
+      }
+      text_.append(reinterpret_cast<const char*>(pos_), run);
+      pos_ += run;
+      if (pos_ == end_) {
+        continue;
+      }
+    }
+    uint8_t ch = *pos_++;
+    if (ch == kJSONStringDelimiter) {
+      break;
+    }
+    // a backslash
+    ch = readInputByte();
+    if (ch == 'u') {
+      uint16_t unit = parseEscapedCodeUnit();
+      if (unit >= 0xD800 && unit <= 0xDBFF) {
+        if (highSurrogate) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Missing UTF-16 low surrogate pair.");
+        }
+        highSurrogate = unit;
+      } else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+        if (!highSurrogate) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Missing UTF-16 high surrogate pair.");
+        }
+        appendUtf8(text_, 0x10000 + ((highSurrogate - 0xD800) << 10) + (unit - 0xDC00));
+        highSurrogate = 0;
+      } else {
+        if (highSurrogate) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Missing UTF-16 low surrogate pair.");
+        }
+        appendUtf8(text_, unit);
+      }
+      continue;
+    }
+    if (highSurrogate) {
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "Missing UTF-16 low surrogate pair.");
+    }
+    switch (ch) {
+    case '"':
+    case '\\':
+    case '/':
+      break;
+    case 'b':
+      ch = '\b';
+      break;
+    case 'f':
+      ch = '\f';
+      break;
+    case 'n':
+      ch = '\n';
+      break;
+    case 'r':
+      ch = '\r';
+      break;
+    case 't':
+      ch = '\t';
+      break;
+    default:
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "Expected control char, got \'"
+                               + std::string(reinterpret_cast<const char*>(&ch), 1) + "\'.");
+    }
+    text_ += static_cast<char>(ch);
+  }
+  if (highSurrogate) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Missing UTF-16 low surrogate pair.");
+  }
+  if (text_.size() - offset > (std::numeric_limits<uint32_t>::max)()) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  values_[index].offset = static_cast<uint32_t>(offset);
+  values_[index].size = static_cast<uint32_t>(text_.size() - offset);
+}
+
+uint16_t TSimpleJSONProtocol::parseEscapedCodeUnit() {
+  uint16_t unit = 0;
+  for (int i = 0; i < 4; ++i) {
+    unit = static_cast<uint16_t>((unit << 4) | hexVal(readInputByte()));
+  }
+  return unit;
+}
+
+// Copies the characters of the number at the input to text_; they are
+// checked when the number is read
+void TSimpleJSONProtocol::parseNumber(uint32_t index) {
+  size_t offset = text_.size();
+  while (true) {
+    if (pos_ == end_) {
+      refillInput();
+    }
+    if (!isJSONNumeric(*pos_)) {
+      break;
+    }
+    text_ += static_cast<char>(*pos_++);
+  }
+  values_[index].offset = static_cast<uint32_t>(offset);
+  values_[index].size = static_cast<uint32_t>(text_.size() - offset);
+}
+
+void TSimpleJSONProtocol::parseLiteral(const char* literal) {
+  for (const char* p = literal; *p; ++p) {
+    if (readInputByte() != static_cast<uint8_t>(*p)) {
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               std::string("Expected JSON literal ") + literal);
+    }
+  }
+}
+
+/**
+ * Reading functions
+ */
+
+// Returns the index of the next value to read, parsing a new top level value
+// if none is being read, whose length is then added to result
+uint32_t TSimpleJSONProtocol::beginValue(uint32_t& result) {
+  if (readFrames_.empty()) {
+    result += parseDocument();
+    return 0;
+  }
+  ReadFrame& frame = readFrames_.back();
+  if (frame.left == 0) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Read past the end of a JSON array or object");
+  }
+  return frame.cursor;
+}
+
+// Moves past the value at index, which has been read
+void TSimpleJSONProtocol::endValue(uint32_t index) {
+  if (!readFrames_.empty()) {
+    ReadFrame& frame = readFrames_.back();
+    frame.cursor = values_[index].next;
+    --frame.left;
+  }
+}
+
+uint32_t TSimpleJSONProtocol::beginContainer(JSONKind kind, uint32_t& result) {
+  uint32_t index = beginValue(result);
+  const JSONValue& value = values_[index];
+  if (value.kind != kind) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             kind == JSON_OBJECT ? "Expected a JSON object"
+                                                 : "Expected a JSON array");
+  }
+  if (readFrames_.size() >= getRecursionLimit()) {
+    throw TProtocolException(TProtocolException::DEPTH_LIMIT);
+  }
+  readFrames_.push_back(ReadFrame(index, value.size));
+  return index;
+}
+
+void TSimpleJSONProtocol::endContainer() {
+  uint32_t index = readFrames_.back().container;
+  readFrames_.pop_back();
+  endValue(index);
+}
+
+const TSimpleJSONProtocol::JSONValue& TSimpleJSONProtocol::readLeaf(uint32_t& result) {
+  uint32_t index = beginValue(result);
+  endValue(index);
+  return values_[index];
+}
+
+// The type that a value of unknown type most likely has
+TType TSimpleJSONProtocol::guessType(uint32_t index) const {
+  const JSONValue& value = values_[index];
+  switch (value.kind) {
+  case JSON_OBJECT:
+    return T_STRUCT;
+  case JSON_ARRAY:
+    return T_LIST;
+  case JSON_STRING:
+    return T_STRING;
+  case JSON_NUMBER:
+    if (text_.find_first_of(".eE", value.offset) < value.offset + value.size) {
+      return T_DOUBLE;
+    }
+    return T_I64;
+  case JSON_TRUE:
+  case JSON_FALSE:
+    return T_BOOL;
+  default:
+    return T_VOID;
+  }
+}
+
+uint32_t TSimpleJSONProtocol::readMessageBegin(std::string& name,
+                                               TMessageType& messageType,
+                                               int32_t& seqid) {
+  uint32_t result = 0;
+  uint32_t index = beginContainer(JSON_ARRAY, result);
+  if (values_[index].size != 4) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Expected a JSON array of 4 values as message");
+  }
+  readString(name);
+  int32_t type;
+  readI32(type);
+  messageType = static_cast<TMessageType>(type);
+  readI32(seqid);
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::readMessageEnd() {
+  endContainer();
+  return 0;
+}
+
+uint32_t TSimpleJSONProtocol::readStructBegin(std::string& name) {
+  (void)name;
+  uint32_t result = 0;
+  beginContainer(JSON_OBJECT, result);
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::readStructEnd() {
+  endContainer();
+  return 0;
+}
+
+uint32_t TSimpleJSONProtocol::readFieldBegin(std::string& name,
+                                             TType& fieldType,
+                                             int16_t& fieldId) {
+  ReadFrame& frame = readFrames_.back();
+  while (frame.left > 0) {
+    const JSONValue& key = values_[frame.cursor];
+    if (values_[key.next].kind == JSON_NULL) {
+      // same as absent
+      frame.cursor = values_[key.next].next;
+      frame.left -= 2;
+      continue;
+    }
+    name.assign(text_, key.offset, key.size);
+    fieldType = T_VOID;
+    fieldId = 0;
+    frame.cursor = key.next;
+    --frame.left;
+    return 0;
+  }
+  fieldType = T_STOP;
+  return 0;
+}
+
+uint32_t TSimpleJSONProtocol::readFieldEnd() {
+  return 0;
+}
+
+uint32_t TSimpleJSONProtocol::readMapBegin(TType& keyType, TType& valType, uint32_t& size) {
+  uint32_t result = 0;
+  uint32_t index = beginContainer(JSON_OBJECT, result);
+  size = values_[index].size / 2;
+  keyType = T_STRING;
+  valType = size ? guessType(values_[index + 1].next) : T_VOID;
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::readMapEnd() {
+  endContainer();
+  return 0;
+}
+
+uint32_t TSimpleJSONProtocol::readListBegin(TType& elemType, uint32_t& size) {
+  uint32_t result = 0;
+  uint32_t index = beginContainer(JSON_ARRAY, result);
+  size = values_[index].size;
+  elemType = size ? guessType(index + 1) : T_VOID;
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::readListEnd() {
+  endContainer();
+  return 0;
+}
+
+uint32_t TSimpleJSONProtocol::readSetBegin(TType& elemType, uint32_t& size) {
+  return readListBegin(elemType, size);
+}
+
+uint32_t TSimpleJSONProtocol::readSetEnd() {
+  endContainer();
+  return 0;
+}
+
+// Map keys are strings, so bools and numbers are also read from those
+uint32_t TSimpleJSONProtocol::readBool(bool& value) {
+  uint32_t result = 0;
+  const JSONValue& leaf = readLeaf(result);
+  if (leaf.kind == JSON_TRUE || leaf.kind == JSON_FALSE) {
+    value = leaf.kind == JSON_TRUE;
+  } else if (leaf.kind == JSON_STRING && text_.compare(leaf.offset, leaf.size, "true") == 0) {
+    value = true;
+  } else if (leaf.kind == JSON_STRING && text_.compare(leaf.offset, leaf.size, "false") == 0) {
+    value = false;
+  } else {
+    throw TProtocolException(TProtocolException::INVALID_DATA, "Expected a JSON bool");
+  }
+  return result;
+}
+
+template <typename NumberType>
+uint32_t TSimpleJSONProtocol::readInteger(NumberType& num) {
+  uint32_t result = 0;
+  const JSONValue& leaf = readLeaf(result);
+  if (leaf.kind != JSON_NUMBER && leaf.kind != JSON_STRING) {
+    throw TProtocolException(TProtocolException::INVALID_DATA, "Expected a JSON number");
+  }
+  const char* begin = text_.data() + leaf.offset;
+  num = json_to_integer<NumberType>(begin, begin + leaf.size);
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::readByte(int8_t& byte) {
+  return readInteger(byte);
+}
+
+uint32_t TSimpleJSONProtocol::readI16(int16_t& i16) {
+  return readInteger(i16);
+}
+
+uint32_t TSimpleJSONProtocol::readI32(int32_t& i32) {
+  return readInteger(i32);
+}
+
+uint32_t TSimpleJSONProtocol::readI64(int64_t& i64) {
+  return readInteger(i64);
+}
+
+uint32_t TSimpleJSONProtocol::readDouble(double& dub) {
+  uint32_t result = 0;
+  const JSONValue& leaf = readLeaf(result);
+  if (leaf.kind != JSON_NUMBER && leaf.kind != JSON_STRING) {
+    throw TProtocolException(TProtocolException::INVALID_DATA, "Expected a JSON number");
+  }
+  if (leaf.kind == JSON_STRING) {
+    if (text_.compare(leaf.offset, leaf.size, kThriftNan) == 0) {
+      dub = std::numeric_limits<double>::quiet_NaN();
+      return result;
+    } else if (text_.compare(leaf.offset, leaf.size, kThriftInfinity) == 0) {
+      dub = HUGE_VAL;
+      return result;
+    } else if (text_.compare(leaf.offset, leaf.size, kThriftNegativeInfinity) == 0) {
+      dub = -HUGE_VAL;
+      return result;
+    }
+  }
+  const char* begin = text_.data() + leaf.offset;
+  dub = json_to_double(begin, begin + leaf.size);
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::readString(std::string& str) {
+  uint32_t result = 0;
+  const JSONValue& leaf = readLeaf(result);
+  if (leaf.kind != JSON_STRING) {
+    throw TProtocolException(TProtocolException::INVALID_DATA, "Expected a JSON string");
+  }
+  str.assign(text_, leaf.offset, leaf.size);
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::readBinary(std::string& str) {
+  uint32_t result = readString(str);
+  uint8_t* b = reinterpret_cast<uint8_t*>(&str[0]);
+  uint32_t len = static_cast<uint32_t>(str.length());
+  // Ignore padding
+  while (len > 0 && b[len - 1] == '=') {
+    --len;
+  }
+  uint32_t decoded = 0;
+  while (len >= 4) {
+    base64_decode(b, 4);
+    memmove(&str[decoded], b, 3);
+    decoded += 3;
+    b += 4;
+    len -= 4;
+  }
+  if (len > 1) {
+    base64_decode(b, len);
+    memmove(&str[decoded], b, len - 1);
+    decoded += len - 1;
+  }
+  str.resize(decoded);
+  return result;
+}
+
+uint32_t TSimpleJSONProtocol::skip(TType type) {
+  (void)type;
+  uint32_t result = 0;
+  readLeaf(result);
+  return result;
+}
+}
+}
+} // apache::thrift::protocol
@@ -0,0 +1,278 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TSIMPLEJSONPROTOCOL_H_
+#define _THRIFT_PROTOCOL_TSIMPLEJSONPROTOCOL_H_ 1
+
+#include <thrift/protocol/TVirtualProtocol.h>
+
+#include <string>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/**
+ * Plain JSON protocol for Thrift, for talking to programs that know nothing
+ * of Thrift, such as web clients behind a REST gateway.
+ *
+ * Unlike TJSONProtocol, values carry no type information:
+ *
+ * 1. Structs are JSON objects keyed by field name, eg. {"id":1,"name":"x"}.
+ *    Fields that are unknown or null are skipped when reading.
+ *
+ * 2. Integers and doubles are JSON numbers, except for NaN and the
+ *    infinities, which are the strings "NaN", "Infinity" and "-Infinity".
+ *    Bools are true and false.
+ *
+ * 3. Strings are JSON strings.  Binary values are base64 strings, with
+ *    padding; it is optional when reading.
+ *
+ * 4. Lists and sets are JSON arrays.  Maps are JSON objects, so their keys
+ *    must be strings, numbers or bools; the latter two are quoted.
+ *
+ * 5. Messages are JSON arrays of the name, the message type, the sequence
+ *    id and the struct, eg. ["getUser",1,0,{"id":1}].
+ *
+ * Reading relies on the field name tables of the generated code, which it
+ * finds through lookupFieldName(): readFieldBegin() returns the field's name
+ * with a type of T_VOID, and the generated reader resolves it.  Only code
+ * generated with the cpp:simple_json option has these tables; other readers
+ * skip every field.
+ *
+ * The writer streams to the transport.  The reader parses each top level
+ * value (a message, or a struct or container read on its own) in one go
+ * into a flat array of values and an arena of unescaped strings, both
+ * reused from one value to the next, and then hands them out.  The byte
+ * count of the whole value is returned by the read that started it, and 0
+ * by the reads that follow.  Numbers at the top level cannot be read, since
+ * it would take the byte after them to find their end.
+ */
+class TSimpleJSONProtocol : public TVirtualProtocol<TSimpleJSONProtocol> {
+public:
+  TSimpleJSONProtocol(stdcxx::shared_ptr<TTransport> ptrans);
+
+  ~TSimpleJSONProtocol();
+
+  /**
+   * Writing functions.
+   */
+
+  uint32_t writeMessageBegin(const std::string& name,
+                             const TMessageType messageType,
+                             const int32_t seqid);
+
+  uint32_t writeMessageEnd();
+
+  uint32_t writeStructBegin(const char* name);
+
+  uint32_t writeStructEnd();
+
+  uint32_t writeFieldBegin(const char* name, const TType fieldType, const int16_t fieldId);
+
+  uint32_t writeFieldEnd();
+
+  uint32_t writeFieldStop();
+
+  uint32_t writeMapBegin(const TType keyType, const TType valType, const uint32_t size);
+
+  uint32_t writeMapEnd();
+
+  uint32_t writeListBegin(const TType elemType, const uint32_t size);
+
+  uint32_t writeListEnd();
+
+  uint32_t writeSetBegin(const TType elemType, const uint32_t size);
+
+  uint32_t writeSetEnd();
+
+  uint32_t writeBool(const bool value);
+
+  uint32_t writeByte(const int8_t byte);
+
+  uint32_t writeI16(const int16_t i16);
+
+  uint32_t writeI32(const int32_t i32);
+
+  uint32_t writeI64(const int64_t i64);
+
+  uint32_t writeDouble(const double dub);
+
+  uint32_t writeString(const std::string& str);
+
+  uint32_t writeBinary(const std::string& str);
+
+  /**
+   * Reading functions
+   */
+
+  uint32_t readMessageBegin(std::string& name, TMessageType& messageType, int32_t& seqid);
+
+  uint32_t readMessageEnd();
+
+  uint32_t readStructBegin(std::string& name);
+
+  uint32_t readStructEnd();
+
+  uint32_t readFieldBegin(std::string& name, TType& fieldType, int16_t& fieldId);
+
+  uint32_t readFieldEnd();
+
+  uint32_t readMapBegin(TType& keyType, TType& valType, uint32_t& size);
+
+  uint32_t readMapEnd();
+
+  uint32_t readListBegin(TType& elemType, uint32_t& size);
+
+  uint32_t readListEnd();
+
+  uint32_t readSetBegin(TType& elemType, uint32_t& size);
+
+  uint32_t readSetEnd();
+
+  uint32_t readBool(bool& value);
+
+  // Provide the default readBool() implementation for std::vector<bool>
+  using TVirtualProtocol<TSimpleJSONProtocol>::readBool;
+
+  uint32_t readByte(int8_t& byte);
+
+  uint32_t readI16(int16_t& i16);
+
+  uint32_t readI32(int32_t& i32);
+
+  uint32_t readI64(int64_t& i64);
+
+  uint32_t readDouble(double& dub);
+
+  uint32_t readString(std::string& str);
+
+  uint32_t readBinary(std::string& str);
+
+  /**
+   * Skips the next value, whatever type is asked for: the types of unknown
+   * fields are not known.
+   */
+  uint32_t skip(TType type);
+
+private:
+  enum WriteContext { WRITE_STRUCT, WRITE_LIST, WRITE_MAP };
+
+  struct WriteFrame {
+    WriteFrame(WriteContext c, uint32_t n) : context(c), count(n) {}
+    WriteContext context;
+    // values written so far, counting keys and values of maps separately
+    uint32_t count;
+  };
+
+  enum JSONKind {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL
+  };
+
+  struct JSONValue {
+    JSONKind kind;
+    // index of the value after this one and everything in it
+    uint32_t next;
+    // values directly in an array or object, counting keys and values of
+    // objects separately, or length of a string or number in text_
+    uint32_t size;
+    // where a string or number starts in text_
+    uint32_t offset;
+  };
+
+  struct ReadFrame {
+    ReadFrame(uint32_t c, uint32_t n) : container(c), cursor(c + 1), left(n) {}
+    uint32_t container;
+    uint32_t cursor;
+    uint32_t left;
+  };
+
+  // writing
+  uint32_t writeSeparator(bool& key);
+  uint32_t writeContainerBegin(uint8_t ch, WriteContext context);
+  uint32_t writeContainerEnd(uint8_t ch);
+  uint32_t writeQuoted(const char* str, uint32_t len);
+  template <typename NumberType>
+  uint32_t writeInteger(NumberType num);
+
+  // reading the tree of values
+  uint32_t beginValue(uint32_t& result);
+  void endValue(uint32_t index);
+  uint32_t beginContainer(JSONKind kind, uint32_t& result);
+  void endContainer();
+  const JSONValue& readLeaf(uint32_t& result);
+  TType guessType(uint32_t index) const;
+  template <typename NumberType>
+  uint32_t readInteger(NumberType& num);
+
+  // parsing
+  uint32_t parseDocument();
+  void parseValue(uint32_t depth);
+  void parseString(uint32_t index);
+  void parseNumber(uint32_t index);
+  void parseLiteral(const char* literal);
+  uint16_t parseEscapedCodeUnit();
+  uint8_t nextToken();
+  uint8_t readInputByte();
+  void refillInput();
+  void releaseInput();
+
+  TTransport* trans_;
+
+  std::vector<WriteFrame> writeFrames_;
+
+  std::vector<JSONValue> values_;
+  std::string text_;
+  std::vector<ReadFrame> readFrames_;
+
+  // the bytes being parsed: [pos_, end_) is borrowed from the transport, or
+  // is byte_ when the transport has no buffer to lend
+  const uint8_t* start_;
+  const uint8_t* pos_;
+  const uint8_t* end_;
+  bool borrowed_;
+  uint8_t byte_;
+  uint32_t inputBytes_;
+};
+
+/**
+ * Constructs input and output protocol objects given transports.
+ */
+class TSimpleJSONProtocolFactory : public TProtocolFactory {
+public:
+  TSimpleJSONProtocolFactory() {}
+
+  virtual ~TSimpleJSONProtocolFactory() {}
+
+  stdcxx::shared_ptr<TProtocol> getProtocol(stdcxx::shared_ptr<TTransport> trans) {
+    return stdcxx::shared_ptr<TProtocol>(new TSimpleJSONProtocol(trans));
+  }
+};
+}
+}
+} // apache::thrift::protocol
+
+#endif // #define _THRIFT_PROTOCOL_TSIMPLEJSONPROTOCOL_H_ 1
@@ -300,6 +300,12 @@ public:
 
   uint32_t skip(TType type) { return ::apache::thrift::protocol::skip(*this, type); }
 
+  uint32_t readRaw(TType type, std::string& raw) { return TProtocol::readRaw_virt(type, raw); }
+
+  uint32_t writeRaw(const std::string& raw) { return TProtocol::writeRaw_virt(raw); }
+
+  TRawEncoding getRawEncoding() { return TProtocol::getRawEncoding_virt(); }
+
 protected:
   TProtocolDefaults(stdcxx::shared_ptr<TTransport> ptrans) : TProtocol(ptrans) {}
 };
@@ -473,6 +479,18 @@ public:
 
   virtual uint32_t skip_virt(TType type) { return static_cast<Protocol_*>(this)->skip(type); }
 
+  virtual uint32_t readRaw_virt(TType type, std::string& raw) {
+    return static_cast<Protocol_*>(this)->readRaw(type, raw);
+  }
+
+  virtual uint32_t writeRaw_virt(const std::string& raw) {
+    return static_cast<Protocol_*>(this)->writeRaw(raw);
+  }
+
+  virtual TRawEncoding getRawEncoding_virt() {
+    return static_cast<Protocol_*>(this)->getRawEncoding();
+  }
+
   /*
    * Provide a default skip() implementation that uses non-virtual read
    * methods.
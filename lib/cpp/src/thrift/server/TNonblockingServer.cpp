@@ -21,7 +21,9 @@
 
 #include <thrift/server/TNonblockingServer.h>
 #include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Util.h>
 #include <thrift/transport/TSocket.h>
+#include <thrift/transport/TSSLSocket.h>
 #include <thrift/concurrency/PlatformThreadFactory.h>
 #include <thrift/transport/PlatformSocket.h>
 
@@ -82,19 +84,23 @@ using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransportException;
 using stdcxx::shared_ptr;
 
-/// Three states for sockets: recv frame size, recv data, and send mode
-enum TSocketState { SOCKET_RECV_FRAMING, SOCKET_RECV, SOCKET_SEND };
+/// Four states for sockets: TLS handshake, recv frame size, recv data, and send mode
+enum TSocketState { SOCKET_HANDSHAKE, SOCKET_RECV_FRAMING, SOCKET_RECV, SOCKET_SEND };
 
 /**
- * Five states for the nonblocking server:
+ * Seven states for the nonblocking server:
  *  1) initialize
- *  2) read 4 byte frame size
- *  3) read frame of data
- *  4) send back data (if any)
- *  5) force immediate connection close
+ *  2) TLS handshake driven by socket events
+ *  3) TLS handshake running on the handshake thread manager
+ *  4) read 4 byte frame size
+ *  5) read frame of data
+ *  6) send back data (if any)
+ *  7) force immediate connection close
  */
 enum TAppState {
   APP_INIT,
+  APP_HANDSHAKE,
+  APP_WAIT_HANDSHAKE,
   APP_READ_FRAME_SIZE,
   APP_READ_REQUEST,
   APP_WAIT_TASK,
@@ -102,6 +108,9 @@ enum TAppState {
   APP_CLOSE_CONNECTION
 };
 
+/// Outcome of the last TLS handshake step of a connection
+enum THandshakeState { HANDSHAKE_PENDING, HANDSHAKE_DONE, HANDSHAKE_FAILED };
+
 /**
  * Represents a connection that is handled via libevent. This connection
  * essentially encapsulates a socket that has some associated libevent state.
@@ -181,6 +190,18 @@ private:
   /// Thrift call context, if any
   void* connectionContext_;
 
+  /// TLS socket whose handshake has not completed yet, if any
+  stdcxx::shared_ptr<TSSLSocket> handshakeSocket_;
+
+  /// Outcome of the last handshake step
+  THandshakeState handshakeState_;
+
+  /// When the connection was accepted, for handshake latency
+  int64_t handshakeStartUs_;
+
+  /// Time spent inside the handshake so far
+  int64_t handshakeWorkUs_;
+
   /// Go into read mode
   void setRead() { setFlags(EV_READ | EV_PERSIST); }
 
@@ -205,8 +226,15 @@ private:
    */
   void workSocket();
 
+  /**
+   * Advance the TLS handshake without blocking and record its statistics
+   * once it is over.  Runs on the IO thread or on a handshake task.
+   */
+  void handshakeStep();
+
 public:
   class Task;
+  class HandshakeTask;
 
   /// Constructor
   TConnection(stdcxx::shared_ptr<TSocket> socket,
@@ -310,6 +338,25 @@ public:
   void* getConnectionContext() { return connectionContext_; }
 };
 
+class TNonblockingServer::TConnection::HandshakeTask : public Runnable {
+public:
+  HandshakeTask(TConnection* connection) : connection_(connection) {}
+
+  void run() {
+    connection_->handshakeStep();
+
+    // Signal completion back to the libevent thread via a pipe
+    if (!connection_->notifyIOThread()) {
+      GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread, closing.");
+      connection_->close();
+      throw TException("TNonblockingServer::HandshakeTask::run: failed write on notify pipe");
+    }
+  }
+
+private:
+  TConnection* connection_;
+};
+
 class TNonblockingServer::TConnection::Task : public Runnable {
 public:
   Task(stdcxx::shared_ptr<TProcessor> processor,
@@ -408,6 +455,29 @@ void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
 
   // Get the processor
   processor_ = server_->getProcessor(inputProtocol_, outputProtocol_, tSocket_);
+
+  // TLS connections start with a handshake
+  handshakeSocket_ = stdcxx::dynamic_pointer_cast<TSSLSocket>(tSocket_);
+  handshakeState_ = HANDSHAKE_PENDING;
+  handshakeStartUs_ = Util::currentTimeUsec();
+  handshakeWorkUs_ = 0;
+}
+
+void TNonblockingServer::TConnection::handshakeStep() {
+  int64_t start = Util::currentTimeUsec();
+  try {
+    handshakeState_ = handshakeSocket_->handshake() ? HANDSHAKE_DONE : HANDSHAKE_PENDING;
+  } catch (const TTransportException& te) {
+    GlobalOutput.printf("TConnection::handshakeStep(): %s", te.what());
+    handshakeState_ = HANDSHAKE_FAILED;
+  }
+  int64_t now = Util::currentTimeUsec();
+  handshakeWorkUs_ += now - start;
+  if (handshakeState_ != HANDSHAKE_PENDING) {
+    server_->recordHandshake(handshakeState_ == HANDSHAKE_DONE,
+                             static_cast<uint64_t>(now - handshakeStartUs_),
+                             static_cast<uint64_t>(handshakeWorkUs_));
+  }
 }
 
 void TNonblockingServer::TConnection::setSocket(stdcxx::shared_ptr<TSocket> socket) {
@@ -419,6 +489,24 @@ void TNonblockingServer::TConnection::workSocket() {
   uint32_t fetch = 0;
 
   switch (socketState_) {
+  case SOCKET_HANDSHAKE:
+    if (server_->getHandshakeThreadManager()) {
+      // The handshake task owns the socket until it notifies us
+      appState_ = APP_WAIT_HANDSHAKE;
+      setIdle();
+      try {
+        server_->getHandshakeThreadManager()->add(
+            stdcxx::shared_ptr<Runnable>(new HandshakeTask(this)));
+      } catch (TException& tx) {
+        GlobalOutput.printf("TConnection::workSocket(): handshake task: %s", tx.what());
+        close();
+      }
+      return;
+    }
+    handshakeStep();
+    transition();
+    return;
+
   case SOCKET_RECV_FRAMING:
     union {
       uint8_t buf[sizeof(uint32_t)];
@@ -718,6 +806,14 @@ void TNonblockingServer::TConnection::transition() {
     writeBufferPos_ = 0;
     writeBufferSize_ = 0;
 
+    if (handshakeSocket_) {
+      // TLS handshake first; it starts with the client hello
+      socketState_ = SOCKET_HANDSHAKE;
+      appState_ = APP_HANDSHAKE;
+      setRead();
+      return;
+    }
+
     // Into read4 state we go
     socketState_ = SOCKET_RECV_FRAMING;
     appState_ = APP_READ_FRAME_SIZE;
@@ -729,6 +825,33 @@ void TNonblockingServer::TConnection::transition() {
 
     return;
 
+  case APP_HANDSHAKE:
+  case APP_WAIT_HANDSHAKE:
+    if (handshakeState_ == HANDSHAKE_FAILED) {
+      close();
+      return;
+    }
+    if (handshakeState_ == HANDSHAKE_PENDING) {
+      // wait for whichever direction OpenSSL is blocked on
+      appState_ = APP_HANDSHAKE;
+      if (handshakeSocket_->handshakeWantsWrite()) {
+        setWrite();
+      } else {
+        setRead();
+      }
+      return;
+    }
+    handshakeSocket_.reset();
+    appState_ = APP_INIT;
+    transition();
+
+    // The first request may already be decrypted inside the TLS socket, in
+    // which case libevent will not report the socket readable.
+    if (tSocket_->hasPendingDataToRead()) {
+      workSocket();
+    }
+    return;
+
   case APP_READ_FRAME_SIZE:
     readWant_ += 4;
 
@@ -848,6 +971,7 @@ void TNonblockingServer::TConnection::close() {
 
   // release processor and handler
   processor_.reset();
+  handshakeSocket_.reset();
 
   // Give this object back to the server that owns it
   server_->returnConnection(this);
@@ -108,6 +108,22 @@ enum TOverloadAction {
   T_OVERLOAD_DRAIN_TASK_QUEUE ///< Drop some tasks from head of task queue */
 };
 
+/// TLS handshake statistics of a TNonblockingServer.
+struct THandshakeStats {
+  THandshakeStats() : count(0), failures(0), totalUs(0), maxUs(0), workUs(0) {}
+
+  /// Handshakes completed successfully
+  uint64_t count;
+  /// Handshakes that failed
+  uint64_t failures;
+  /// Sum of the latencies from accept to completion, in microseconds
+  uint64_t totalUs;
+  /// Largest latency from accept to completion, in microseconds
+  uint64_t maxUs;
+  /// Time spent inside the handshake (mostly crypto), in microseconds
+  uint64_t workUs;
+};
+
 class TNonblockingIOThread;
 
 class TNonblockingServer : public TServer {
@@ -165,6 +181,12 @@ private:
   /// Is thread pool processing?
   bool threadPoolProcessing_;
 
+  /// For running TLS handshakes off the IO threads, may be NULL
+  stdcxx::shared_ptr<ThreadManager> handshakeThreadManager_;
+
+  /// TLS handshake statistics, protected by connMutex_
+  THandshakeStats handshakeStats_;
+
   // Factory to create the IO threads
   stdcxx::shared_ptr<PlatformThreadFactory> ioThreadFactory_;
 
@@ -384,6 +406,48 @@ public:
 
   stdcxx::shared_ptr<ThreadManager> getThreadManager() { return threadManager_; }
 
+  /**
+   * Run the TLS handshakes of new connections on the given thread manager
+   * instead of the IO thread.  The key exchange of a handshake costs far
+   * more CPU than a typical request, so during a connection storm inline
+   * handshakes stall every other connection served by the same IO thread.
+   * Without a handshake thread manager, handshakes still progress
+   * incrementally on the IO thread as the socket becomes readable or
+   * writable.  Only applies to transports producing TSSLSockets.
+   *
+   * @param threadManager a started thread manager, or NULL to handshake inline
+   */
+  void setHandshakeThreadManager(stdcxx::shared_ptr<ThreadManager> threadManager) {
+    handshakeThreadManager_ = threadManager;
+  }
+
+  stdcxx::shared_ptr<ThreadManager> getHandshakeThreadManager() const {
+    return handshakeThreadManager_;
+  }
+
+  /**
+   * Get a snapshot of the TLS handshake statistics.
+   */
+  THandshakeStats getHandshakeStats() {
+    Guard g(connMutex_);
+    return handshakeStats_;
+  }
+
+  /// Record the outcome of a TLS handshake.
+  void recordHandshake(bool success, uint64_t latencyUs, uint64_t workUs) {
+    Guard g(connMutex_);
+    if (success) {
+      ++handshakeStats_.count;
+      handshakeStats_.totalUs += latencyUs;
+      if (latencyUs > handshakeStats_.maxUs) {
+        handshakeStats_.maxUs = latencyUs;
+      }
+    } else {
+      ++handshakeStats_.failures;
+    }
+    handshakeStats_.workUs += workUs;
+  }
+
   /**
    * Sets the number of IO threads used by this server. Can only be used before
    * the call to serve() and has no effect afterwards.  We always use a
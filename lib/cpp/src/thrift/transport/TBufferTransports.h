@@ -366,6 +366,14 @@ public:
 
   const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len);
 
+  /**
+   * Grows the write buffer to exactly what it takes to add 'len' more bytes
+   * to the current frame, if it is short of that, so that a frame of known
+   * size (such as the serializedSize() of a generated struct) reallocates at
+   * most once.
+   */
+  void reserve(uint32_t len);
+
   stdcxx::shared_ptr<TTransport> getUnderlyingTransport() { return transport_; }
 
   /*
@@ -398,6 +406,9 @@ protected:
    */
   virtual bool readFrame();
 
+  // Move the frame being written to a buffer of 'new_size' bytes.
+  void resizeWriteBuffer(uint32_t new_size);
+
   void initPointers() {
     setReadBuffer(NULL, 0);
     setWriteBuffer(wBuf_.get(), wBufSize_);
@@ -670,6 +681,11 @@ public:
   // that had been provided by getWritePtr().
   void wroteBytes(uint32_t len);
 
+  // Grows the buffer to exactly what it takes to write 'len' more bytes, if
+  // it is short of that, so that writing a value of known size (such as
+  // the serializedSize() of a generated struct) reallocates at most once.
+  void reserve(uint32_t len);
+
   /*
    * TVirtualTransport provides a default implementation of readAll().
    * We want to use the TBufferBase version instead.
@@ -716,6 +732,9 @@ protected:
   // Make sure there's at least 'len' bytes available for writing.
   void ensureCanWrite(uint32_t len);
 
+  // Move the data to a buffer of 'new_size' bytes.
+  void resizeBuffer(uint32_t new_size);
+
   // Compute the position and available data for reading.
   void computeRead(uint32_t len, uint8_t** out_start, uint32_t* out_give);
 
@@ -0,0 +1,145 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/transport/TCrc32c.h>
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define THRIFT_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#define THRIFT_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+namespace {
+
+// reflected Castagnoli polynomial
+const uint32_t CRC32C_POLY = 0x82f63b78;
+
+struct Crc32cTables {
+  Crc32cTables() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+      }
+      table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (int k = 1; k < 8; ++k) {
+        table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+      }
+    }
+  }
+
+  uint32_t table[8][256];
+};
+
+const Crc32cTables tables;
+
+uint32_t crc32cSoftware(uint32_t crc, const uint8_t* p, size_t len) {
+  const uint32_t(*t)[256] = tables.table;
+  while (len >= 8) {
+    uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24));
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+          ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+    p += 8;
+    len -= 8;
+  }
+  while (len-- > 0) {
+    crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(THRIFT_CRC32C_SSE42)
+__attribute__((target("sse4.2"))) uint32_t crc32cHardware(uint32_t crc,
+                                                          const uint8_t* p,
+                                                          size_t len) {
+#if defined(__x86_64__)
+  uint64_t crc64 = crc;
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    p += 8;
+    len -= 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+#endif
+  while (len >= 4) {
+    uint32_t word;
+    memcpy(&word, p, 4);
+    crc = _mm_crc32_u32(crc, word);
+    p += 4;
+    len -= 4;
+  }
+  while (len-- > 0) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+
+bool detectHardware() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(THRIFT_CRC32C_ARM)
+uint32_t crc32cHardware(uint32_t crc, const uint8_t* p, size_t len) {
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    crc = __crc32cd(crc, word);
+    p += 8;
+    len -= 8;
+  }
+  while (len-- > 0) {
+    crc = __crc32cb(crc, *p++);
+  }
+  return crc;
+}
+
+bool detectHardware() {
+  return true;
+}
+#endif
+
+#if defined(THRIFT_CRC32C_SSE42) || defined(THRIFT_CRC32C_ARM)
+const bool useHardware = detectHardware();
+#endif
+}
+
+uint32_t crc32c(const uint8_t* buf, size_t len, uint32_t crc) {
+  crc = ~crc;
+#if defined(THRIFT_CRC32C_SSE42) || defined(THRIFT_CRC32C_ARM)
+  if (useHardware) {
+    return ~crc32cHardware(crc, buf, len);
+  }
+#endif
+  return ~crc32cSoftware(crc, buf, len);
+}
+}
+}
+} // apache::thrift::transport
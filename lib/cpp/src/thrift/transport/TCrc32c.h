@@ -0,0 +1,42 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TCRC32C_H_
+#define _THRIFT_TRANSPORT_TCRC32C_H_ 1
+
+#include <thrift/Thrift.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Computes the CRC32C (Castagnoli) checksum of len bytes at buf.  Uses the
+ * SSE4.2 or ARMv8 CRC instructions when the CPU has them, and a
+ * slicing-by-8 table otherwise.
+ *
+ * To checksum data in pieces, pass the result for the previous pieces as
+ * crc.
+ */
+uint32_t crc32c(const uint8_t* buf, size_t len, uint32_t crc = 0);
+}
+}
+} // apache::thrift::transport
+
+#endif // _THRIFT_TRANSPORT_TCRC32C_H_
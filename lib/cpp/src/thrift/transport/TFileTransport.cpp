@@ -20,10 +20,12 @@
 #include <thrift/thrift-config.h>
 
 #include <thrift/transport/TFileTransport.h>
+#include <thrift/transport/TCrc32c.h>
 #include <thrift/transport/TTransportUtils.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/concurrency/FunctionRunner.h>
 
+#include <boost/scoped_array.hpp>
 #include <boost/version.hpp>
 #if (BOOST_VERSION >= 105700)
 #include <boost/move/unique_ptr.hpp>
@@ -78,6 +80,15 @@ TFileTransport::TFileTransport(string path, bool readOnly)
     readTimeout_(NO_TAIL_READ_TIMEOUT),
     chunkSize_(DEFAULT_CHUNK_SIZE),
     eventBufferSize_(DEFAULT_EVENT_BUFFER_SIZE),
+    eventBufferCount_(DEFAULT_EVENT_BUFFER_COUNT),
+    writeBuffSize_(DEFAULT_WRITE_BUFF_SIZE),
+    writeBuff_(NULL),
+    dataSyncOnly_(false),
+    indexInterval_(0),
+    indexFd_(-1),
+    eventsSinceIndex_(0),
+    lastIndexedChunk_(-1),
+    checksumEvents_(false),
     flushMaxUs_(DEFAULT_FLUSH_MAX_US),
     flushMaxBytes_(DEFAULT_FLUSH_MAX_BYTES),
     maxEventSize_(DEFAULT_MAX_EVENT_SIZE),
@@ -98,6 +109,7 @@ TFileTransport::TFileTransport(string path, bool readOnly)
     offset_(0),
     lastBadChunk_(0),
     numCorruptedEventsInChunk_(0),
+    sawChecksums_(false),
     readOnly_(readOnly) {
   threadFactory_.setDetached(false);
   openLogFile();
@@ -156,6 +168,26 @@ TFileTransport::~TFileTransport() {
     enqueueBuffer_ = NULL;
   }
 
+  while (!fullBuffers_.empty()) {
+    delete fullBuffers_.front();
+    fullBuffers_.pop_front();
+  }
+
+  while (!freeBuffers_.empty()) {
+    delete freeBuffers_.back();
+    freeBuffers_.pop_back();
+  }
+
+  if (writeBuff_) {
+    delete[] writeBuff_;
+    writeBuff_ = NULL;
+  }
+
+  if (indexFd_ >= 0) {
+    ::THRIFT_CLOSE(indexFd_);
+    indexFd_ = -1;
+  }
+
   if (readBuff_) {
     delete[] readBuff_;
     readBuff_ = NULL;
@@ -183,14 +215,19 @@ bool TFileTransport::initBufferAndWriteThread() {
     return false;
   }
 
+  dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
+  enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
+  for (uint32_t i = 2; i < eventBufferCount_; ++i) {
+    freeBuffers_.push_back(new TFileTransportBuffer(eventBufferSize_));
+  }
+  writeBuff_ = new uint8_t[writeBuffSize_];
+
   if (!writerThread_.get()) {
     writerThread_ = threadFactory_.newThread(
         apache::thrift::concurrency::FunctionRunner::create(startWriterThread, this));
     writerThread_->start();
   }
 
-  dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
-  enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
   bufferAndThreadInitialized_ = true;
 
   return true;
@@ -229,14 +266,25 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
     return;
   }
 
-  unique_ptr<eventInfo, uniqueDeleter<eventInfo> > toEnqueue(new eventInfo());
-  toEnqueue->eventBuff_ = new uint8_t[(sizeof(uint8_t) * eventLen) + 4];
+  if (eventLen & CHECKSUMMED_EVENT) {
+    T_ERROR("msg size is too large: %u", eventLen);
+    return;
+  }
 
-  // first 4 bytes is the event length
-  memcpy(toEnqueue->eventBuff_, (void*)(&eventLen), 4);
+  uint32_t headerLen = checksumEvents_ ? 8 : 4;
+  unique_ptr<eventInfo, uniqueDeleter<eventInfo> > toEnqueue(new eventInfo());
+  toEnqueue->eventBuff_ = new uint8_t[(sizeof(uint8_t) * eventLen) + headerLen];
+
+  // first 4 bytes is the event length, followed by the checksum if enabled
+  uint32_t sizeWord = checksumEvents_ ? (eventLen | CHECKSUMMED_EVENT) : eventLen;
+  memcpy(toEnqueue->eventBuff_, (void*)(&sizeWord), 4);
+  if (checksumEvents_) {
+    uint32_t crc = crc32c(buf, eventLen);
+    memcpy(toEnqueue->eventBuff_ + 4, (void*)(&crc), 4);
+  }
   // actual event contents
-  memcpy(toEnqueue->eventBuff_ + 4, buf, eventLen);
-  toEnqueue->eventSize_ = eventLen + 4;
+  memcpy(toEnqueue->eventBuff_ + headerLen, buf, eventLen);
+  toEnqueue->eventSize_ = eventLen + headerLen;
 
   // lock mutex
   Guard g(mutex_);
@@ -248,9 +296,16 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
     }
   }
 
-  // Can't enqueue while buffer is full
+  // Move on to a free buffer when this one is full; block only when the
+  // writer thread has fallen behind on the whole ring
   while (enqueueBuffer_->isFull()) {
-    notFull_.wait();
+    if (freeBuffers_.empty()) {
+      notFull_.wait();
+    } else {
+      fullBuffers_.push_back(enqueueBuffer_);
+      enqueueBuffer_ = freeBuffers_.back();
+      freeBuffers_.pop_back();
+    }
   }
 
   // We shouldn't be trying to enqueue new data while a forced flush is
@@ -274,16 +329,9 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
 }
 
 bool TFileTransport::swapEventBuffers(struct timeval* deadline) {
-  bool swap;
   Guard g(mutex_);
 
-  if (!enqueueBuffer_->isEmpty()) {
-    swap = true;
-  } else if (closing_) {
-    // even though there is no data to write,
-    // return immediately if the transport is closing
-    swap = false;
-  } else {
+  if (fullBuffers_.empty() && enqueueBuffer_->isEmpty() && !closing_) {
     if (deadline != NULL) {
       // if we were handed a deadline time struct, do a timed wait
       notEmpty_.waitForTime(deadline);
@@ -291,22 +339,129 @@ bool TFileTransport::swapEventBuffers(struct timeval* deadline) {
       // just wait until the buffer gets an item
       notEmpty_.wait();
     }
-
-    // could be empty if we timed out
-    swap = enqueueBuffer_->isEmpty();
   }
 
-  if (swap) {
+  // dequeueBuffer_ has been written out and reset by now
+  if (!fullBuffers_.empty()) {
+    freeBuffers_.push_back(dequeueBuffer_);
+    dequeueBuffer_ = fullBuffers_.front();
+    fullBuffers_.pop_front();
+  } else if (!enqueueBuffer_->isEmpty()) {
     TFileTransportBuffer* temp = enqueueBuffer_;
     enqueueBuffer_ = dequeueBuffer_;
     dequeueBuffer_ = temp;
+  } else {
+    // nothing to write, either because we timed out or the transport is closing
+    return false;
+  }
+
+  notFull_.notify();
+  return true;
+}
+
+bool TFileTransport::writeFully(int fd, const uint8_t* buf, uint32_t len) {
+  while (len > 0) {
+    int rv = static_cast<int>(::THRIFT_WRITE(fd, buf, len));
+    if (rv == -1) {
+      if (THRIFT_ERRNO == THRIFT_EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += rv;
+    len -= rv;
   }
+  return true;
+}
 
-  if (swap) {
-    notFull_.notify();
+bool TFileTransport::bufferWrite(const uint8_t* buf, uint32_t len, uint32_t& pending) {
+  if (pending + len > writeBuffSize_) {
+    uint32_t have = pending;
+    pending = 0;
+    if (!writeFully(fd_, writeBuff_, have)) {
+      return false;
+    }
+    if (len > writeBuffSize_) {
+      return writeFully(fd_, buf, len);
+    }
+  }
+  memcpy(writeBuff_ + pending, buf, len);
+  pending += len;
+  return true;
+}
+
+void TFileTransport::openIndexFile() {
+#ifndef _WIN32
+  mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+  int flags = O_RDWR | O_CREAT;
+#else
+  int mode = _S_IREAD | _S_IWRITE;
+  int flags = _O_RDWR | _O_CREAT | _O_BINARY;
+#endif
+  indexFd_ = ::THRIFT_OPEN(getIndexPath(filename_).c_str(), flags, mode);
+  if (indexFd_ == -1) {
+    GlobalOutput.perror("TFileTransport: openIndexFile() ", THRIFT_ERRNO);
+    return;
   }
 
-  return swap;
+  // drop the entries for events that were truncated away
+  TFileIndexEntry entry;
+  off_t keep = 0;
+  uint64_t last = 0;
+  while (::THRIFT_READ(indexFd_, &entry, sizeof(entry)) == sizeof(entry)) {
+    if (entry.offset >= static_cast<uint64_t>(offset_) || (keep > 0 && entry.offset <= last)) {
+      break;
+    }
+    last = entry.offset;
+    keep += sizeof(entry);
+  }
+  if (0 != THRIFT_FTRUNCATE(indexFd_, keep) || -1 == THRIFT_LSEEK(indexFd_, keep, SEEK_SET)) {
+    GlobalOutput.perror("TFileTransport: openIndexFile() truncate ", THRIFT_ERRNO);
+    ::THRIFT_CLOSE(indexFd_);
+    indexFd_ = -1;
+  }
+}
+
+void TFileTransport::indexEvent(int64_t timeUs) {
+  if (indexFd_ < 0) {
+    return;
+  }
+  int64_t chunk = chunkSize_ ? offset_ / chunkSize_ : 0;
+  if (eventsSinceIndex_ > 0 && eventsSinceIndex_ < indexInterval_ && chunk == lastIndexedChunk_) {
+    ++eventsSinceIndex_;
+    return;
+  }
+  TFileIndexEntry entry;
+  entry.offset = offset_;
+  entry.timeUs = timeUs;
+  indexPending_.push_back(entry);
+  eventsSinceIndex_ = 1;
+  lastIndexedChunk_ = chunk;
+}
+
+void TFileTransport::writeIndex() {
+  if (indexPending_.empty()) {
+    return;
+  }
+  // the index is only a hint for readers, so losing it is not fatal
+  if (!writeFully(indexFd_,
+                  reinterpret_cast<const uint8_t*>(&indexPending_[0]),
+                  static_cast<uint32_t>(indexPending_.size() * sizeof(TFileIndexEntry)))) {
+    GlobalOutput.perror("TFileTransport: error while writing the index ", THRIFT_ERRNO);
+    ::THRIFT_CLOSE(indexFd_);
+    indexFd_ = -1;
+  }
+  indexPending_.clear();
+}
+
+void TFileTransport::syncFile() {
+#if defined(HAVE_FDATASYNC) && !defined(__APPLE__)
+  if (dataSyncOnly_) {
+    ::fdatasync(fd_);
+    return;
+  }
+#endif
+  ::THRIFT_FSYNC(fd_);
 }
 
 void TFileTransport::writerThread() {
@@ -332,6 +487,9 @@ void TFileTransport::writerThread() {
       offset_ += readState_.lastDispatchPtr_;
       if (0 == THRIFT_FTRUNCATE(fd_, offset_)) {
         readState_.resetAllValues();
+        if (indexInterval_ > 0) {
+          openIndexFile();
+        }
       } else {
         int errno_copy = THRIFT_ERRNO;
         GlobalOutput.perror("TFileTransport: writerThread() truncate ", errno_copy);
@@ -357,8 +515,13 @@ void TFileTransport::writerThread() {
       }
 
       // Try to empty buffers before exit
-      if (enqueueBuffer_->isEmpty() && dequeueBuffer_->isEmpty()) {
-        ::THRIFT_FSYNC(fd_);
+      bool drained;
+      {
+        Guard g(mutex_);
+        drained = enqueueBuffer_->isEmpty() && dequeueBuffer_->isEmpty() && fullBuffers_.empty();
+      }
+      if (drained) {
+        syncFile();
         if (-1 == ::THRIFT_CLOSE(fd_)) {
           int errno_copy = THRIFT_ERRNO;
           GlobalOutput.perror("TFileTransport: writerThread() ::close() ", errno_copy);
@@ -371,6 +534,11 @@ void TFileTransport::writerThread() {
     }
 
     if (swapEventBuffers(&ts_next_flush)) {
+      // Events are gathered in writeBuff_ and written out together; offset_
+      // already counts the pending bytes.
+      uint32_t pending = 0;
+      struct timeval batchTime;
+      THRIFT_GETTIMEOFDAY(&batchTime, NULL);
       eventInfo* outEvent;
       while (NULL != (outEvent = dequeueBuffer_->getNext())) {
         // Remove an event from the buffer and write it out to disk. If there is any IO error, for
@@ -396,6 +564,8 @@ void TFileTransport::writerThread() {
           try {
             openLogFile();
             seekToEnd();
+            pending = 0;
+            indexPending_.clear();
             unflushed = 0;
             hasIOError = false;
             T_LOG_OPER(
@@ -430,14 +600,22 @@ void TFileTransport::writerThread() {
 
           // if adding this event will cross a chunk boundary, pad the chunk with zeros
           if (chunk1 != chunk2) {
-            // refetch the offset to keep in sync
+            // write out what is pending, then refetch the offset to keep in sync
+            uint32_t have = pending;
+            pending = 0;
+            if (!writeFully(fd_, writeBuff_, have)) {
+              int errno_copy = THRIFT_ERRNO;
+              GlobalOutput.perror("TFileTransport: error while writing events ", errno_copy);
+              hasIOError = true;
+              continue;
+            }
             offset_ = THRIFT_LSEEK(fd_, 0, SEEK_CUR);
             int32_t padding = (int32_t)((offset_ / chunkSize_ + 1) * chunkSize_ - offset_);
 
             uint8_t* zeros = new uint8_t[padding];
             memset(zeros, '\0', padding);
             boost::scoped_array<uint8_t> array(zeros);
-            if (-1 == ::write(fd_, zeros, padding)) {
+            if (!writeFully(fd_, zeros, padding)) {
               int errno_copy = THRIFT_ERRNO;
               GlobalOutput.perror("TFileTransport: writerThread() error while padding zeros ",
                                   errno_copy);
@@ -449,9 +627,10 @@ void TFileTransport::writerThread() {
           }
         }
 
-        // write the dequeued event to the file
+        // add the dequeued event to the pending batch
         if (outEvent->eventSize_ > 0) {
-          if (-1 == ::THRIFT_WRITE(fd_, outEvent->eventBuff_, outEvent->eventSize_)) {
+          indexEvent(batchTime.tv_sec * static_cast<int64_t>(1000000) + batchTime.tv_usec);
+          if (!bufferWrite(outEvent->eventBuff_, outEvent->eventSize_, pending)) {
             int errno_copy = THRIFT_ERRNO;
             GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
             hasIOError = true;
@@ -461,6 +640,17 @@ void TFileTransport::writerThread() {
           offset_ += outEvent->eventSize_;
         }
       }
+      if (pending > 0 && !writeFully(fd_, writeBuff_, pending)) {
+        int errno_copy = THRIFT_ERRNO;
+        GlobalOutput.perror("TFileTransport: error while writing events ", errno_copy);
+        hasIOError = true;
+      }
+      if (hasIOError) {
+        // some of the indexed events may not have made it to the file
+        indexPending_.clear();
+      } else {
+        writeIndex();
+      }
       dequeueBuffer_->reset();
     }
 
@@ -478,16 +668,15 @@ void TFileTransport::writerThread() {
     {
       Guard g(mutex_);
       if (forceFlush_) {
-        if (!enqueueBuffer_->isEmpty()) {
+        if (!enqueueBuffer_->isEmpty() || !fullBuffers_.empty()) {
           // If forceFlush_ is true, we need to flush all available data.
-          // If enqueueBuffer_ is not empty, go back to the start of the loop to
+          // If any buffer still holds events, go back to the start of the loop to
           // write it out.
           //
           // We know the main thread is waiting on forceFlush_ to be cleared,
-          // so no new events will be added to enqueueBuffer_ until we clear
-          // forceFlush_.  Therefore the next time around the loop enqueueBuffer_
-          // is guaranteed to be empty.  (I.e., we're guaranteed to make progress
-          // and clear forceFlush_ the next time around the loop.)
+          // so no new events will be added until we clear forceFlush_.
+          // Every time around the loop takes one buffer off the ring, so we are
+          // guaranteed to make progress and eventually clear forceFlush_.
           continue;
         }
         forced_flush = true;
@@ -515,8 +704,9 @@ void TFileTransport::writerThread() {
     }
 
     if (flush) {
-      // sync (force flush) file to disk
-      THRIFT_FSYNC(fd_);
+      // sync (force flush) file to disk.  Producers keep filling the other
+      // buffers of the ring meanwhile.
+      syncFile();
       unflushed = 0;
       getNextFlushTime(&ts_next_flush);
 
@@ -526,6 +716,7 @@ void TFileTransport::writerThread() {
         forceFlush_ = false;
         assert(enqueueBuffer_->isEmpty());
         assert(dequeueBuffer_->isEmpty());
+        assert(fullBuffers_.empty());
         flushed_.notifyAll();
       }
     }
@@ -691,6 +882,13 @@ eventInfo* TFileTransport::readEvent() {
           }
           readState_.event_ = new eventInfo();
           readState_.event_->eventSize_ = readState_.getEventSize();
+          readState_.eventStart_ = offset_ + readState_.bufferPtr_ - 4;
+          if (readState_.event_->eventSize_ & CHECKSUMMED_EVENT) {
+            // the checksum is read as the first 4 bytes of the event
+            readState_.checksummed_ = true;
+            readState_.event_->eventSize_ = (readState_.event_->eventSize_ & ~CHECKSUMMED_EVENT) + 4;
+            sawChecksums_ = true;
+          }
 
           // check if the event is corrupted and perform recovery if required
           if (isEventCorrupted()) {
@@ -719,9 +917,15 @@ eventInfo* TFileTransport::readEvent() {
 
         // check if the event has been read in full
         if (readState_.event_->eventBuffPos_ == readState_.event_->eventSize_) {
+          if (readState_.checksummed_ && !isChecksumValid(readState_.event_)) {
+            performRecovery();
+            // start from the top
+            break;
+          }
+
           // set the completed event to the current event
           eventInfo* completeEvent = readState_.event_;
-          completeEvent->eventBuffPos_ = 0;
+          completeEvent->eventBuffPos_ = readState_.checksummed_ ? 4 : 0;
 
           readState_.event_ = NULL;
           readState_.resetState(readState_.bufferPtr_);
@@ -762,6 +966,18 @@ bool TFileTransport::isEventCorrupted() {
   return false;
 }
 
+bool TFileTransport::isChecksumValid(const eventInfo* event) {
+  uint32_t crc;
+  memcpy(&crc, event->eventBuff_, 4);
+  if (crc32c(event->eventBuff_ + 4, event->eventSize_ - 4) == crc) {
+    return true;
+  }
+  T_ERROR("Read corrupt event. Checksum mismatch. Event size:%u  Offset:%lu",
+          event->eventSize_ - 4,
+          static_cast<unsigned long>(readState_.eventStart_));
+  return false;
+}
+
 void TFileTransport::performRecovery() {
   // perform some kickass recovery
   uint32_t curChunk = getCurChunk();
@@ -778,6 +994,12 @@ void TFileTransport::performRecovery() {
     seekToChunk(curChunk);
   } else {
 
+    // with checksums, the next intact event in the chunk can be told apart
+    // from garbage, so only the damaged event needs to be skipped
+    if (sawChecksums_ && resyncAfter(readState_.eventStart_)) {
+      return;
+    }
+
     // just skip ahead to the next chunk if we not already at the last chunk
     if (curChunk != (getNumChunks() - 1)) {
       seekToChunk(curChunk + 1);
@@ -804,6 +1026,67 @@ void TFileTransport::performRecovery() {
   }
 }
 
+bool TFileTransport::resyncAfter(off_t offset) {
+  off_t from = offset + 1;
+  off_t end = (from / chunkSize_ + 1) * chunkSize_;
+  off_t pos = ::THRIFT_LSEEK(fd_, 0, SEEK_CUR);
+  off_t fileEnd = ::THRIFT_LSEEK(fd_, 0, SEEK_END);
+  if (pos == -1 || fileEnd == -1) {
+    return false;
+  }
+  if (fileEnd < end) {
+    end = fileEnd;
+  }
+
+  uint32_t len = 0;
+  boost::scoped_array<uint8_t> buf;
+  if (end - from >= 8 && ::THRIFT_LSEEK(fd_, from, SEEK_SET) == from) {
+    buf.reset(new uint8_t[static_cast<size_t>(end - from)]);
+    while (len < end - from) {
+      int got = static_cast<int>(
+          ::THRIFT_READ(fd_, buf.get() + len, static_cast<uint32_t>(end - from - len)));
+      if (got <= 0) {
+        break;
+      }
+      len += got;
+    }
+  }
+
+  // look for a size word with the checksum flag whose event matches its
+  // checksum; sizes no event can have are ruled out before paying for one
+  for (uint32_t i = 0; len >= 8 && i <= len - 8; ++i) {
+    uint32_t sizeWord, crc;
+    memcpy(&sizeWord, buf.get() + i, 4);
+    if (!(sizeWord & CHECKSUMMED_EVENT)) {
+      continue;
+    }
+    uint32_t size = sizeWord & ~CHECKSUMMED_EVENT;
+    if (size == 0 || (maxEventSize_ > 0 && size > maxEventSize_) || size > len - i - 8) {
+      continue;
+    }
+    memcpy(&crc, buf.get() + i + 4, 4);
+    if (crc32c(buf.get() + i + 8, size) != crc) {
+      continue;
+    }
+
+    T_ERROR("Resynchronized after corrupt event at offset %lu at offset %lu",
+            static_cast<unsigned long>(offset),
+            static_cast<unsigned long>(from + i));
+    offset_ = ::THRIFT_LSEEK(fd_, from + i, SEEK_SET);
+    readState_.resetAllValues();
+    currentEvent_ = NULL;
+    if (offset_ == -1) {
+      GlobalOutput("TFileTransport: lseek error in resyncAfter");
+      throw TTransportException("TFileTransport: lseek error in resyncAfter");
+    }
+    return true;
+  }
+
+  // leave the file where the read buffer left it
+  ::THRIFT_LSEEK(fd_, pos, SEEK_SET);
+  return false;
+}
+
 void TFileTransport::seekToChunk(int32_t chunk) {
   if (fd_ <= 0) {
     throw TTransportException("File not open");
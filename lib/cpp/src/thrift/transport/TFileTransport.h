@@ -24,8 +24,10 @@
 #include <thrift/Thrift.h>
 #include <thrift/TProcessor.h>
 
+#include <deque>
 #include <string>
 #include <stdio.h>
+#include <vector>
 
 #include <boost/atomic.hpp>
 #include <thrift/stdcxx.h>
@@ -74,10 +76,16 @@ typedef struct readState {
   // last successful dispatch point
   int32_t lastDispatchPtr_;
 
+  // file offset of the event being read, and whether it carries a checksum
+  off_t eventStart_;
+  bool checksummed_;
+
   void resetState(uint32_t lastDispatchPtr) {
     readingSize_ = true;
     eventSizeBuffPos_ = 0;
     lastDispatchPtr_ = lastDispatchPtr;
+    eventStart_ = 0;
+    checksummed_ = false;
   }
 
   void resetAllValues() {
@@ -108,6 +116,17 @@ typedef struct readState {
 
 } readState;
 
+/**
+ * Entry of the sidecar index that TFileTransport writes when an index
+ * interval is set: the offset of an event in the log file and the time, in
+ * microseconds since the epoch, at which it was written.  Stored in native
+ * byte order, like the event sizes in the log itself.
+ */
+struct TFileIndexEntry {
+  uint64_t offset;
+  int64_t timeUs;
+};
+
 /**
  * TFileTransportBuffer - buffer class used by TFileTransport for queueing up events
  * to be written to disk.  Should be used in the following way:
@@ -228,6 +247,77 @@ public:
 
   uint32_t getEventBufferSize() { return eventBufferSize_; }
 
+  /**
+   * Number of event buffers in the ring between writers and the writer
+   * thread (at least 2).  While the writer thread is busy writing or
+   * syncing one buffer, producers keep filling the others, so a larger
+   * ring absorbs longer fsync stalls before write() has to block.
+   */
+  void setEventBufferCount(uint32_t bufferCount) {
+    if (bufferAndThreadInitialized_) {
+      GlobalOutput("Cannot change the buffer count after writer thread started");
+      return;
+    }
+    eventBufferCount_ = bufferCount < 2 ? 2 : bufferCount;
+  }
+  uint32_t getEventBufferCount() { return eventBufferCount_; }
+
+  /**
+   * Size of the staging buffer in which the writer thread gathers
+   * consecutive events, so that a whole batch goes to the file in one
+   * write() call instead of one call per event.
+   */
+  void setWriteBuffSize(uint32_t writeBuffSize) {
+    if (bufferAndThreadInitialized_) {
+      GlobalOutput("Cannot change the write buffer size after writer thread started");
+      return;
+    }
+    if (writeBuffSize) {
+      writeBuffSize_ = writeBuffSize;
+    }
+  }
+  uint32_t getWriteBuffSize() { return writeBuffSize_; }
+
+  /**
+   * Use fdatasync() instead of fsync() where the platform has it, which
+   * skips flushing metadata such as the modification time.
+   */
+  void setDataSyncOnly(bool dataSyncOnly) { dataSyncOnly_ = dataSyncOnly; }
+  bool getDataSyncOnly() { return dataSyncOnly_; }
+
+  /**
+   * Write a sidecar index next to the log (see getIndexPath) with the
+   * offset and time of every eventsPerEntry-th event and of the first
+   * event of each chunk.  0, the default, writes no index.
+   * TMappedFileTransport uses it to seek by offset or time.
+   */
+  void setIndexInterval(uint32_t eventsPerEntry) {
+    if (bufferAndThreadInitialized_) {
+      GlobalOutput("Cannot change the index interval after writer thread started");
+      return;
+    }
+    indexInterval_ = eventsPerEntry;
+  }
+  uint32_t getIndexInterval() { return indexInterval_; }
+
+  static std::string getIndexPath(const std::string& path) { return path + ".idx"; }
+
+  /**
+   * Bit set in the size word of an event that is followed by a CRC32C of
+   * its contents.  Event sizes never reach it, since they are bounded by
+   * the chunk size.
+   */
+  static const uint32_t CHECKSUMMED_EVENT = 0x80000000;
+
+  /**
+   * Write a CRC32C of every event after its size, so that readers can tell
+   * a damaged event from a good one and, on corruption, resume at the next
+   * intact event instead of the next chunk.  Logs with checksummed events
+   * cannot be read by versions of TFileTransport that predate them.
+   */
+  void setChecksumEvents(bool checksumEvents) { checksumEvents_ = checksumEvents; }
+  bool getChecksumEvents() { return checksumEvents_; }
+
   void setFlushMaxUs(uint32_t flushMaxUs) {
     if (flushMaxUs) {
       flushMaxUs_ = flushMaxUs;
@@ -278,13 +368,21 @@ private:
     return NULL;
   }
   void writerThread();
+  bool writeFully(int fd, const uint8_t* buf, uint32_t len);
+  bool bufferWrite(const uint8_t* buf, uint32_t len, uint32_t& pending);
+  void syncFile();
+  void openIndexFile();
+  void indexEvent(int64_t timeUs);
+  void writeIndex();
 
   // helper functions for reading from a file
   eventInfo* readEvent();
 
   // event corruption-related functions
   bool isEventCorrupted();
+  bool isChecksumValid(const eventInfo* event);
   void performRecovery();
+  bool resyncAfter(off_t offset);
 
   // Utility functions
   void openLogFile();
@@ -309,6 +407,28 @@ private:
   uint32_t eventBufferSize_;
   static const uint32_t DEFAULT_EVENT_BUFFER_SIZE = 10000;
 
+  // number of event buffers
+  uint32_t eventBufferCount_;
+  static const uint32_t DEFAULT_EVENT_BUFFER_COUNT = 4;
+
+  // size of the writer thread's staging buffer
+  uint32_t writeBuffSize_;
+  static const uint32_t DEFAULT_WRITE_BUFF_SIZE = 1 * 1024 * 1024;
+  uint8_t* writeBuff_;
+
+  // sync with fdatasync() rather than fsync()
+  bool dataSyncOnly_;
+
+  // sidecar index, written by the writer thread
+  uint32_t indexInterval_;
+  int indexFd_;
+  uint32_t eventsSinceIndex_;
+  int64_t lastIndexedChunk_;
+  std::vector<TFileIndexEntry> indexPending_;
+
+  // write a CRC32C with every event
+  bool checksumEvents_;
+
   // max number of microseconds that can pass without flushing
   uint32_t flushMaxUs_;
   static const uint32_t DEFAULT_FLUSH_MAX_US = 3000000;
@@ -342,9 +462,13 @@ private:
   stdcxx::shared_ptr<apache::thrift::concurrency::Thread> writerThread_;
 
   // buffers to hold data before it is flushed. Each element of the buffer stores a msg that
-  // needs to be written to the file.  The buffers are swapped by the writer thread.
+  // needs to be written to the file.  Producers fill enqueueBuffer_ and, when it is full, queue
+  // it on fullBuffers_ and take a free one; the writer thread drains fullBuffers_ in order, then
+  // swaps out enqueueBuffer_ itself.
   TFileTransportBuffer* dequeueBuffer_;
   TFileTransportBuffer* enqueueBuffer_;
+  std::deque<TFileTransportBuffer*> fullBuffers_;
+  std::vector<TFileTransportBuffer*> freeBuffers_;
 
   // conditions used to block when the buffer is full or empty
   Monitor notFull_, notEmpty_;
@@ -371,6 +495,9 @@ private:
   uint32_t lastBadChunk_;
   uint32_t numCorruptedEventsInChunk_;
 
+  // whether the reader has come across checksummed events
+  bool sawChecksums_;
+
   bool readOnly_;
 };
 
@@ -381,6 +508,7 @@ public:
 };
 
 // wrapper class to process events from a file containing thrift events
+// (TParallelFileProcessor replays them on several threads)
 class TFileProcessor {
 public:
   /**
@@ -24,11 +24,22 @@
 #include <thrift/protocol/TCompactProtocol.h>
 #include <thrift/stdcxx.h>
 
+#include <algorithm>
 #include <limits>
+#include <set>
 #include <utility>
 #include <string>
 #include <string.h>
 #include <zlib.h>
+#ifdef HAVE_LZ4_H
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD_H
+#include <zstd.h>
+#endif
+#ifdef HAVE_SNAPPY_C_H
+#include <snappy-c.h>
+#endif
 
 using std::map;
 using std::string;
@@ -49,6 +60,22 @@ uint32_t THeaderTransport::readSlow(uint8_t* buf, uint32_t len) {
     return transport_->read(buf, len);
   }
 
+  if (decoder_) {
+    // Hand over the rest of the current window, then decode the next one.
+    uint32_t have = static_cast<uint32_t>(rBound_ - rBase_);
+    if (have > 0) {
+      memcpy(buf, rBase_, have);
+      setReadBuffer(uBuf_.get(), 0);
+      return have;
+    }
+    if (refillStreamWindow()) {
+      uint32_t give = (std::min)(len, static_cast<uint32_t>(rBound_ - rBase_));
+      memcpy(buf, rBase_, give);
+      rBase_ += give;
+      return give;
+    }
+  }
+
   return TFramedTransport::readSlow(buf, len);
 }
 
@@ -70,6 +97,9 @@ void THeaderTransport::ensureReadBuffer(uint32_t sz) {
 }
 
 bool THeaderTransport::readFrame() {
+  // Drop whatever is left of a streamed frame.
+  endStream();
+
   // szN is network byte order of sz
   uint32_t szN;
   uint32_t sz;
@@ -195,6 +225,7 @@ void THeaderTransport::readString(uint8_t*& ptr,
 
 void THeaderTransport::readHeaderFormat(uint16_t headerSize, uint32_t sz) {
   readTrans_.clear();   // Clear out any previous transforms.
+  readDict_.reset();
   readHeaders_.clear(); // Clear out any previous headers.
 
   // skip over already processed magic(4), seqId(4), headerSize(2)
@@ -216,10 +247,16 @@ void THeaderTransport::readHeaderFormat(uint16_t headerSize, uint32_t sz) {
   int16_t numTransforms;
   ptr += readVarint16(ptr, &numTransforms, headerBoundary);
 
-  // For now all transforms consist of only the ID, not data.
+  // Transforms are only an ID, except dictionary transforms which are
+  // followed by the dictionary ID.
   for (int i = 0; i < numTransforms; i++) {
     int32_t transId;
     ptr += readVarint32(ptr, &transId, headerBoundary);
+    if (isDictionaryTransform(static_cast<uint16_t>(transId))) {
+      int32_t dictId;
+      ptr += readVarint32(ptr, &dictId, headerBoundary);
+      readDict_ = findDictionary(static_cast<uint32_t>(dictId));
+    }
 
     readTrans_.push_back(transId);
   }
@@ -257,118 +294,855 @@ void THeaderTransport::readHeaderFormat(uint16_t headerSize, uint32_t sz) {
     }
   }
 
+  // Answer in kind unless told not to or the application chose its own
+  // transforms: reply with whichever of the peer's transforms this build
+  // supports.  Frames the peer left untransformed (e.g. below its size
+  // threshold) keep the previous choice.
+  if (echoTransforms_ && !explicitTransforms_ && !readTrans_.empty()) {
+    writeTrans_.clear();
+    for (vector<uint16_t>::const_iterator it = readTrans_.begin(); it != readTrans_.end(); ++it) {
+      if (isTransformSupported(*it)) {
+        writeTrans_.push_back(*it);
+      }
+    }
+    if (readDict_) {
+      writeDict_ = readDict_;
+    }
+  }
+
   // Untransform the data section.  rBuf will contain result.
   untransform(data, safe_numeric_cast<uint32_t>(static_cast<ptrdiff_t>(sz) - (data - rBuf_.get())));
 }
 
-void THeaderTransport::untransform(uint8_t* ptr, uint32_t sz) {
-  // Update the transform buffer size if needed
-  resizeTransformBuffer();
+namespace {
 
-  for (vector<uint16_t>::const_iterator it = readTrans_.begin(); it != readTrans_.end(); ++it) {
-    const uint16_t transId = *it;
+typedef boost::scoped_array<uint8_t> ByteArray;
 
-    if (transId == ZLIB_TRANSFORM) {
-      z_stream stream;
-      int err;
-
-      stream.next_in = ptr;
-      stream.avail_in = sz;
-
-      // Setting these to 0 means use the default free/alloc functions
-      stream.zalloc = (alloc_func)0;
-      stream.zfree = (free_func)0;
-      stream.opaque = (voidpf)0;
-      err = inflateInit(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflateInit");
+/**
+ * Makes buf hold at least needed bytes, keeping the first used bytes.
+ * The buffer comes from pool when one is given.
+ */
+void growBuffer(THeaderBufferPool* pool,
+                ByteArray& buf,
+                uint32_t& bufSize,
+                uint32_t used,
+                uint32_t needed) {
+  if (needed <= bufSize) {
+    return;
+  }
+  ByteArray newBuf;
+  uint32_t newSize = 0;
+  if (pool) {
+    pool->acquire(needed, newBuf, newSize);
+  } else {
+    newBuf.reset(new uint8_t[needed]);
+    newSize = needed;
+  }
+  if (used > 0) {
+    memcpy(newBuf.get(), buf.get(), used);
+  }
+  buf.swap(newBuf);
+  std::swap(bufSize, newSize);
+  if (pool) {
+    pool->release(newBuf, newSize);
+  }
+}
+
+void throwUntransform(const char* message) {
+  throw TApplicationException(TApplicationException::MISSING_RESULT, message);
+}
+
+void checkUncompressedSize(uint64_t sz, uint32_t maxFrameSize) {
+  if (sz > maxFrameSize) {
+    throwUntransform("Uncompressed header frame is too large");
+  }
+}
+
+uint32_t zlibCompress(THeaderBufferPool* pool,
+                      const uint8_t* in,
+                      uint32_t sz,
+                      ByteArray& out,
+                      uint32_t& outSize,
+                      const THeaderDictionary* dict = NULL) {
+  z_stream stream;
+  stream.zalloc = (alloc_func)0;
+  stream.zfree = (free_func)0;
+  stream.opaque = (voidpf)0;
+  if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while zlib deflateInit");
+  }
+  if (dict
+      && deflateSetDictionary(&stream,
+                              reinterpret_cast<const Bytef*>(dict->getData().data()),
+                              static_cast<uInt>(dict->getData().size()))
+             != Z_OK) {
+    deflateEnd(&stream);
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while zlib deflateSetDictionary");
+  }
+  uint32_t bound = static_cast<uint32_t>(deflateBound(&stream, sz));
+  growBuffer(pool, out, outSize, 0, bound);
+
+  stream.next_in = const_cast<uint8_t*>(in);
+  stream.avail_in = sz;
+  stream.next_out = out.get();
+  stream.avail_out = outSize;
+  int err = deflate(&stream, Z_FINISH);
+  uint32_t written = static_cast<uint32_t>(stream.total_out);
+  if (deflateEnd(&stream) != Z_OK || err != Z_STREAM_END) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while zlib deflate");
+  }
+  return written;
+}
+
+/**
+ * Supplies the dictionary a zlib stream asked for with Z_NEED_DICT.  zlib
+ * checks that it is the dictionary the stream was compressed with.
+ */
+void zlibSetDictionary(z_stream& stream, const THeaderDictionary* dict) {
+  if (!dict
+      || inflateSetDictionary(&stream,
+                              reinterpret_cast<const Bytef*>(dict->getData().data()),
+                              static_cast<uInt>(dict->getData().size()))
+             != Z_OK) {
+    throwUntransform("zlib frame needs a different dictionary");
+  }
+}
+
+uint32_t zlibUncompress(THeaderBufferPool* pool,
+                        const uint8_t* in,
+                        uint32_t sz,
+                        ByteArray& out,
+                        uint32_t& outSize,
+                        uint32_t maxFrameSize,
+                        const THeaderDictionary* dict = NULL) {
+  z_stream stream;
+  stream.zalloc = (alloc_func)0;
+  stream.zfree = (free_func)0;
+  stream.opaque = (voidpf)0;
+  stream.next_in = const_cast<uint8_t*>(in);
+  stream.avail_in = sz;
+  if (inflateInit(&stream) != Z_OK) {
+    throwUntransform("Error while zlib inflateInit");
+  }
+
+  // zlib does not record the uncompressed size, so grow the output buffer
+  // geometrically until the stream ends.
+  growBuffer(pool, out, outSize, 0, static_cast<uint32_t>((std::min)(
+                                 (std::max)(static_cast<uint64_t>(sz) * 4, static_cast<uint64_t>(1024)),
+                                 static_cast<uint64_t>(maxFrameSize))));
+  int err = Z_OK;
+  while (err == Z_OK) {
+    uint32_t used = static_cast<uint32_t>(stream.total_out);
+    if (used == outSize) {
+      checkUncompressedSize(static_cast<uint64_t>(outSize) + 1, maxFrameSize);
+      growBuffer(pool, out, outSize, used, static_cast<uint32_t>((std::min)(
+                                         static_cast<uint64_t>(outSize) * 2,
+                                         static_cast<uint64_t>(maxFrameSize))));
+    }
+    stream.next_out = out.get() + used;
+    stream.avail_out = outSize - used;
+    err = inflate(&stream, Z_NO_FLUSH);
+    if (err == Z_NEED_DICT) {
+      zlibSetDictionary(stream, dict);
+      err = Z_OK;
+      continue;
+    }
+    if (err == Z_BUF_ERROR && stream.avail_out != 0) {
+      break; // truncated input
+    }
+    if (err == Z_BUF_ERROR) {
+      err = Z_OK;
+    }
+  }
+  uint32_t written = static_cast<uint32_t>(stream.total_out);
+  inflateEnd(&stream);
+  if (err != Z_STREAM_END) {
+    throwUntransform("Error while zlib inflate");
+  }
+  return written;
+}
+
+#ifdef HAVE_LZ4_H
+uint32_t lz4Compress(THeaderBufferPool* pool,
+                     const uint8_t* in,
+                     uint32_t sz,
+                     ByteArray& out,
+                     uint32_t& outSize) {
+  int bound = LZ4_compressBound(static_cast<int>(sz));
+  if (bound <= 0) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Frame is too large for lz4");
+  }
+  growBuffer(pool, out, outSize, 0, static_cast<uint32_t>(bound) + 4);
+  uint32_t szN = htonl(sz);
+  memcpy(out.get(), &szN, sizeof(szN));
+  int written = LZ4_compress_default(reinterpret_cast<const char*>(in),
+                                     reinterpret_cast<char*>(out.get() + 4),
+                                     static_cast<int>(sz),
+                                     bound);
+  if (written <= 0) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while lz4 compress");
+  }
+  return static_cast<uint32_t>(written) + 4;
+}
+
+uint32_t lz4Uncompress(THeaderBufferPool* pool,
+                       const uint8_t* in,
+                       uint32_t sz,
+                       ByteArray& out,
+                       uint32_t& outSize,
+                       uint32_t maxFrameSize) {
+  uint32_t lenN;
+  if (sz < sizeof(lenN)) {
+    throwUntransform("Truncated lz4 frame");
+  }
+  memcpy(&lenN, in, sizeof(lenN));
+  uint32_t len = ntohl(lenN);
+  checkUncompressedSize(len, maxFrameSize);
+  growBuffer(pool, out, outSize, 0, len);
+  int read = LZ4_decompress_safe(reinterpret_cast<const char*>(in + 4),
+                                 reinterpret_cast<char*>(out.get()),
+                                 static_cast<int>(sz - 4),
+                                 static_cast<int>(len));
+  if (read < 0 || static_cast<uint32_t>(read) != len) {
+    throwUntransform("Error while lz4 decompress");
+  }
+  return len;
+}
+#endif
+
+#ifdef HAVE_ZSTD_H
+uint32_t zstdCompress(THeaderBufferPool* pool,
+                      const uint8_t* in,
+                      uint32_t sz,
+                      ByteArray& out,
+                      uint32_t& outSize,
+                      const THeaderDictionary* dict = NULL) {
+  growBuffer(pool, out, outSize, 0, static_cast<uint32_t>(ZSTD_compressBound(sz)));
+  size_t written;
+  if (dict) {
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    if (cctx == NULL) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Error while zstd createCCtx");
+    }
+    written = ZSTD_compress_usingCDict(cctx,
+                                       out.get(),
+                                       outSize,
+                                       in,
+                                       sz,
+                                       static_cast<const ZSTD_CDict*>(
+                                           dict->getZstdCompressDict()));
+    ZSTD_freeCCtx(cctx);
+  } else {
+    written = ZSTD_compress(out.get(), outSize, in, sz, ZSTD_CLEVEL_DEFAULT);
+  }
+  if (ZSTD_isError(written)) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while zstd compress");
+  }
+  return static_cast<uint32_t>(written);
+}
+
+uint32_t zstdUncompress(THeaderBufferPool* pool,
+                        const uint8_t* in,
+                        uint32_t sz,
+                        ByteArray& out,
+                        uint32_t& outSize,
+                        uint32_t maxFrameSize,
+                        const THeaderDictionary* dict = NULL) {
+  unsigned long long len = ZSTD_getFrameContentSize(in, sz);
+  if (len == ZSTD_CONTENTSIZE_ERROR || len == ZSTD_CONTENTSIZE_UNKNOWN) {
+    throwUntransform("Invalid zstd frame");
+  }
+  checkUncompressedSize(len, maxFrameSize);
+  growBuffer(pool, out, outSize, 0, static_cast<uint32_t>(len));
+  size_t read;
+  if (dict) {
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (dctx == NULL) {
+      throwUntransform("Error while zstd createDCtx");
+    }
+    read = ZSTD_decompress_usingDDict(dctx,
+                                      out.get(),
+                                      static_cast<size_t>(len),
+                                      in,
+                                      sz,
+                                      static_cast<const ZSTD_DDict*>(
+                                          dict->getZstdDecompressDict()));
+    ZSTD_freeDCtx(dctx);
+  } else {
+    read = ZSTD_decompress(out.get(), static_cast<size_t>(len), in, sz);
+  }
+  if (ZSTD_isError(read) || read != len) {
+    throwUntransform("Error while zstd decompress");
+  }
+  return static_cast<uint32_t>(read);
+}
+#endif
+
+#ifdef HAVE_SNAPPY_C_H
+uint32_t snappyCompress(THeaderBufferPool* pool,
+                        const uint8_t* in,
+                        uint32_t sz,
+                        ByteArray& out,
+                        uint32_t& outSize) {
+  growBuffer(pool, out, outSize, 0, static_cast<uint32_t>(snappy_max_compressed_length(sz)));
+  size_t written = outSize;
+  if (snappy_compress(reinterpret_cast<const char*>(in),
+                      sz,
+                      reinterpret_cast<char*>(out.get()),
+                      &written) != SNAPPY_OK) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Error while snappy compress");
+  }
+  return static_cast<uint32_t>(written);
+}
+
+uint32_t snappyUncompress(THeaderBufferPool* pool,
+                          const uint8_t* in,
+                          uint32_t sz,
+                          ByteArray& out,
+                          uint32_t& outSize,
+                          uint32_t maxFrameSize) {
+  size_t len;
+  if (snappy_uncompressed_length(reinterpret_cast<const char*>(in), sz, &len) != SNAPPY_OK) {
+    throwUntransform("Invalid snappy frame");
+  }
+  checkUncompressedSize(len, maxFrameSize);
+  growBuffer(pool, out, outSize, 0, static_cast<uint32_t>(len));
+  if (snappy_uncompress(reinterpret_cast<const char*>(in),
+                        sz,
+                        reinterpret_cast<char*>(out.get()),
+                        &len) != SNAPPY_OK) {
+    throwUntransform("Error while snappy decompress");
+  }
+  return static_cast<uint32_t>(len);
+}
+#endif
+}
+
+/**
+ * Incrementally decompresses one frame whose compressed bytes stay in the
+ * read buffer until the frame has been consumed.
+ */
+class THeaderStreamDecoder {
+public:
+  explicit THeaderStreamDecoder(uint32_t maxSize) : maxSize_(maxSize), total_(0), finished_(false) {}
+  virtual ~THeaderStreamDecoder() {}
+
+  /**
+   * Decodes up to len bytes into out.  Returns 0 once the stream has ended,
+   * and throws if the input is corrupt or truncated.
+   */
+  uint32_t decode(uint8_t* out, uint32_t len) {
+    if (finished_) {
+      return 0;
+    }
+    uint32_t got = 0;
+    while (got == 0 && !finished_) {
+      got = decodeSome(out, len);
+    }
+    total_ += got;
+    checkUncompressedSize(total_, maxSize_);
+    return got;
+  }
+
+  bool finished() const { return finished_; }
+  uint64_t total() const { return total_; }
+
+protected:
+  virtual uint32_t decodeSome(uint8_t* out, uint32_t len) = 0;
+
+  uint32_t maxSize_;
+  uint64_t total_;
+  bool finished_;
+};
+
+namespace {
+
+class TZlibStreamDecoder : public THeaderStreamDecoder {
+public:
+  TZlibStreamDecoder(const uint8_t* in,
+                     uint32_t sz,
+                     uint32_t maxSize,
+                     const THeaderDictionary* dict = NULL)
+    : THeaderStreamDecoder(maxSize), dict_(dict) {
+    stream_.zalloc = (alloc_func)0;
+    stream_.zfree = (free_func)0;
+    stream_.opaque = (voidpf)0;
+    stream_.next_in = const_cast<uint8_t*>(in);
+    stream_.avail_in = sz;
+    if (inflateInit(&stream_) != Z_OK) {
+      throwUntransform("Error while zlib inflateInit");
+    }
+  }
+
+  virtual ~TZlibStreamDecoder() { inflateEnd(&stream_); }
+
+protected:
+  virtual uint32_t decodeSome(uint8_t* out, uint32_t len) {
+    stream_.next_out = out;
+    stream_.avail_out = len;
+    int err = inflate(&stream_, Z_NO_FLUSH);
+    if (err == Z_NEED_DICT) {
+      zlibSetDictionary(stream_, dict_);
+      err = inflate(&stream_, Z_NO_FLUSH);
+    }
+    if (err == Z_STREAM_END) {
+      finished_ = true;
+    } else if (err != Z_OK) {
+      // includes Z_BUF_ERROR: no progress is possible on truncated input
+      throwUntransform("Error while zlib inflate");
+    }
+    return len - stream_.avail_out;
+  }
+
+private:
+  z_stream stream_;
+  const THeaderDictionary* dict_;
+};
+
+#ifdef HAVE_ZSTD_H
+class TZstdStreamDecoder : public THeaderStreamDecoder {
+public:
+  TZstdStreamDecoder(const uint8_t* in,
+                     uint32_t sz,
+                     uint32_t maxSize,
+                     const THeaderDictionary* dict = NULL)
+    : THeaderStreamDecoder(maxSize), stream_(ZSTD_createDStream()) {
+    if (stream_ == NULL || ZSTD_isError(ZSTD_initDStream(stream_))
+        || (dict && ZSTD_isError(ZSTD_DCtx_refDDict(stream_,
+                                                     static_cast<const ZSTD_DDict*>(
+                                                         dict->getZstdDecompressDict()))))) {
+      ZSTD_freeDStream(stream_);
+      throwUntransform("Error while zstd initDStream");
+    }
+    in_.src = in;
+    in_.size = sz;
+    in_.pos = 0;
+  }
+
+  virtual ~TZstdStreamDecoder() { ZSTD_freeDStream(stream_); }
+
+protected:
+  virtual uint32_t decodeSome(uint8_t* out, uint32_t len) {
+    ZSTD_outBuffer output = {out, len, 0};
+    while (output.pos < output.size) {
+      size_t inPos = in_.pos;
+      size_t outPos = output.pos;
+      size_t ret = ZSTD_decompressStream(stream_, &output, &in_);
+      if (ZSTD_isError(ret)) {
+        throwUntransform("Error while zstd decompress");
       }
-      stream.next_out = tBuf_.get();
-      stream.avail_out = tBufSize_;
-      err = inflate(&stream, Z_FINISH);
-      if (err != Z_STREAM_END || stream.avail_out == 0) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflate");
+      if (ret == 0) {
+        finished_ = true;
+        break;
       }
-      sz = stream.total_out;
+      if (in_.pos == inPos && output.pos == outPos) {
+        throwUntransform("Truncated zstd frame");
+      }
+    }
+    return static_cast<uint32_t>(output.pos);
+  }
+
+private:
+  ZSTD_DStream* stream_;
+  ZSTD_inBuffer in_;
+};
+#endif
+}
 
-      err = inflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflateEnd");
+THeaderBufferPool::THeaderBufferPool(size_t maxBuffers, uint32_t maxBufferSize)
+  : maxBuffers_(maxBuffers), maxBufferSize_(maxBufferSize) {
+}
+
+THeaderBufferPool::~THeaderBufferPool() {
+  for (std::multimap<uint32_t, ByteArray*>::iterator it = free_.begin(); it != free_.end(); ++it) {
+    delete it->second;
+  }
+}
+
+void THeaderBufferPool::acquire(uint32_t minSize, ByteArray& buf, uint32_t& size) {
+  ByteArray found;
+  uint32_t foundSize = 0;
+  {
+    concurrency::Guard g(mutex_);
+    if (buf) {
+      release_(buf, size);
+    }
+    // best fit: the smallest idle buffer that is large enough
+    std::multimap<uint32_t, ByteArray*>::iterator it = free_.lower_bound(minSize);
+    if (it != free_.end()) {
+      foundSize = it->first;
+      found.swap(*it->second);
+      delete it->second;
+      free_.erase(it);
+    }
+  }
+  if (!found) {
+    found.reset(new uint8_t[minSize]);
+    foundSize = minSize;
+  }
+  buf.swap(found);
+  size = foundSize;
+}
+
+void THeaderBufferPool::release(ByteArray& buf, uint32_t& size) {
+  if (buf) {
+    concurrency::Guard g(mutex_);
+    release_(buf, size);
+  }
+  buf.reset();
+  size = 0;
+}
+
+void THeaderBufferPool::release_(ByteArray& buf, uint32_t size) {
+  if (free_.size() >= maxBuffers_ || size > maxBufferSize_) {
+    buf.reset();
+    return;
+  }
+  ByteArray* idle = new ByteArray();
+  idle->swap(buf);
+  free_.insert(std::make_pair(size, idle));
+}
+
+size_t THeaderBufferPool::size() const {
+  concurrency::Guard g(mutex_);
+  return free_.size();
+}
+
+THeaderDictionary::THeaderDictionary(uint32_t id, const std::string& data)
+  : id_(id), data_(data), zstdCompressDict_(NULL), zstdDecompressDict_(NULL) {
+  if (data_.empty()) {
+    throw TTransportException(TTransportException::BAD_ARGS, "THeaderDictionary: empty dictionary");
+  }
+#ifdef HAVE_ZSTD_H
+  zstdCompressDict_ = ZSTD_createCDict(data_.data(), data_.size(), ZSTD_CLEVEL_DEFAULT);
+  zstdDecompressDict_ = ZSTD_createDDict(data_.data(), data_.size());
+  if (zstdCompressDict_ == NULL || zstdDecompressDict_ == NULL) {
+    ZSTD_freeCDict(static_cast<ZSTD_CDict*>(zstdCompressDict_));
+    ZSTD_freeDDict(static_cast<ZSTD_DDict*>(zstdDecompressDict_));
+    throw TTransportException(TTransportException::INTERNAL_ERROR,
+                              "THeaderDictionary: error while creating zstd dictionary");
+  }
+#endif
+}
+
+THeaderDictionary::~THeaderDictionary() {
+#ifdef HAVE_ZSTD_H
+  ZSTD_freeCDict(static_cast<ZSTD_CDict*>(zstdCompressDict_));
+  ZSTD_freeDDict(static_cast<ZSTD_DDict*>(zstdDecompressDict_));
+#endif
+}
+
+namespace {
+
+// length of the byte sequences whose frequency the trainer counts
+const size_t TRAIN_GRAM_SIZE = 8;
+
+bool compareSegments(const std::pair<uint64_t, string>& a, const std::pair<uint64_t, string>& b) {
+  return a.first > b.first;
+}
+}
+
+string THeaderDictionary::train(const vector<string>& samples, size_t maxSize) {
+  // Count how many samples contain each gram.
+  map<string, uint32_t> grams;
+  for (vector<string>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+    std::set<string> seen;
+    for (size_t i = 0; i + TRAIN_GRAM_SIZE <= it->size(); ++i) {
+      string gram = it->substr(i, TRAIN_GRAM_SIZE);
+      if (seen.insert(gram).second) {
+        ++grams[gram];
+      }
+    }
+  }
+
+  // Segments are the maximal runs of common grams in each sample; a
+  // segment is worth its length times how often its grams occur.
+  uint32_t minCount = (std::max)(static_cast<uint32_t>(2),
+                                 static_cast<uint32_t>(samples.size() / 100));
+  map<string, uint64_t> segments;
+  for (vector<string>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+    size_t start = 0;
+    uint64_t score = 0;
+    for (size_t i = 0; i + TRAIN_GRAM_SIZE <= it->size() + 1; ++i) {
+      uint32_t count = 0;
+      if (i + TRAIN_GRAM_SIZE <= it->size()) {
+        count = grams[it->substr(i, TRAIN_GRAM_SIZE)];
+      }
+      if (count >= minCount) {
+        if (score == 0) {
+          start = i;
+        }
+        score += count;
+      } else if (score > 0) {
+        string segment = it->substr(start, i - 1 - start + TRAIN_GRAM_SIZE);
+        uint64_t& best = segments[segment];
+        best = (std::max)(best, score);
+        score = 0;
       }
+    }
+  }
+
+  vector<std::pair<uint64_t, string> > ranked;
+  for (map<string, uint64_t>::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+    ranked.push_back(std::make_pair(it->second, it->first));
+  }
+  std::stable_sort(ranked.begin(), ranked.end(), compareSegments);
+
+  // Take the best segments not already covered, then lay them out with
+  // the best one last.
+  vector<string> chosen;
+  string covered;
+  size_t total = 0;
+  for (size_t i = 0; i < ranked.size() && total < maxSize; ++i) {
+    const string& segment = ranked[i].second;
+    if (covered.find(segment) != string::npos) {
+      continue;
+    }
+    chosen.push_back(segment);
+    covered += segment;
+    total += segment.size();
+  }
+
+  string dict;
+  for (vector<string>::reverse_iterator it = chosen.rbegin(); it != chosen.rend(); ++it) {
+    dict += *it;
+  }
+  if (dict.empty()) {
+    // nothing is shared between samples; the most recent ones are the
+    // best guess at what comes next
+    for (vector<string>::const_reverse_iterator it = samples.rbegin();
+         it != samples.rend() && dict.size() < maxSize;
+         ++it) {
+      dict = *it + dict;
+    }
+  }
+  if (dict.size() > maxSize) {
+    dict.erase(0, dict.size() - maxSize);
+  }
+  return dict;
+}
+
+THeaderTransport::~THeaderTransport() {
+}
+
+bool THeaderTransport::refillStreamWindow() {
+  uint32_t got = decoder_->decode(uBuf_.get(), uBufSize_);
+  if (got == 0) {
+    endStream();
+    return false;
+  }
+  setReadBuffer(uBuf_.get(), got);
+  return true;
+}
+
+void THeaderTransport::endStream() {
+  if (!decoder_) {
+    return;
+  }
+  decoder_.reset();
+  setReadBuffer(rBuf_.get(), 0);
+  if (pool_) {
+    pool_->release(uBuf_, uBufSize_);
+  }
+}
+
+uint32_t THeaderTransport::readEnd() {
+  if (decoder_) {
+    // include framing bytes, as TFramedTransport does
+    uint32_t bytesRead = static_cast<uint32_t>(decoder_->total() + sizeof(uint32_t));
+    // give the window back as soon as the frame has been consumed
+    if (rBase_ == rBound_ && decoder_->finished()) {
+      endStream();
+    }
+    return bytesRead;
+  }
+  return TFramedTransport::readEnd();
+}
+
+bool THeaderTransport::isTransformSupported(uint16_t transId) {
+  switch (transId) {
+  case ZLIB_TRANSFORM:
+  case ZLIB_DICT_TRANSFORM:
+#ifdef HAVE_LZ4_H
+  case LZ4_TRANSFORM:
+#endif
+#ifdef HAVE_ZSTD_H
+  case ZSTD_TRANSFORM:
+  case ZSTD_DICT_TRANSFORM:
+#endif
+#ifdef HAVE_SNAPPY_C_H
+  case SNAPPY_TRANSFORM:
+#endif
+    return true;
+  default:
+    return false;
+  }
+}
+
+void THeaderTransport::setTransform(uint16_t transId) {
+  if (!isTransformSupported(transId)) {
+    throw TTransportException(TTransportException::BAD_ARGS, "Unsupported header transform");
+  }
+  writeTrans_.push_back(transId);
+  explicitTransforms_ = true;
+}
+
+void THeaderTransport::clearTransforms() {
+  writeTrans_.clear();
+  explicitTransforms_ = true;
+}
+
+void THeaderTransport::addDictionary(const shared_ptr<THeaderDictionary>& dict) {
+  dictionaries_[dict->getId()] = dict;
+}
+
+void THeaderTransport::setWriteDictionary(const shared_ptr<THeaderDictionary>& dict) {
+  addDictionary(dict);
+  writeDict_ = dict;
+}
+
+shared_ptr<THeaderDictionary> THeaderTransport::findDictionary(uint32_t id) const {
+  std::map<uint32_t, shared_ptr<THeaderDictionary> >::const_iterator it = dictionaries_.find(id);
+  if (it == dictionaries_.end()) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Header frame uses an unknown dictionary");
+  }
+  return it->second;
+}
+
+const THeaderDictionary& THeaderTransport::requireWriteDictionary() const {
+  if (!writeDict_) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Dictionary transform needs a write dictionary");
+  }
+  return *writeDict_;
+}
+
+void THeaderTransport::untransform(uint8_t* ptr, uint32_t sz) {
+  const THeaderDictionary* dict = readDict_.get();
+  if (readTrans_.size() == 1) {
+    if (readTrans_[0] == ZLIB_TRANSFORM) {
+      decoder_.reset(new TZlibStreamDecoder(ptr, sz, MAX_FRAME_SIZE));
+    } else if (readTrans_[0] == ZLIB_DICT_TRANSFORM) {
+      decoder_.reset(new TZlibStreamDecoder(ptr, sz, MAX_FRAME_SIZE, dict));
+#ifdef HAVE_ZSTD_H
+    } else if (readTrans_[0] == ZSTD_TRANSFORM) {
+      decoder_.reset(new TZstdStreamDecoder(ptr, sz, MAX_FRAME_SIZE));
+    } else if (readTrans_[0] == ZSTD_DICT_TRANSFORM) {
+      decoder_.reset(new TZstdStreamDecoder(ptr, sz, MAX_FRAME_SIZE, dict));
+#endif
+    }
+  }
+  if (decoder_) {
+    growBuffer(pool_.get(), uBuf_, uBufSize_, 0, STREAM_WINDOW_SIZE);
+    refillStreamWindow();
+    return;
+  }
+
+  for (vector<uint16_t>::const_iterator it = readTrans_.begin(); it != readTrans_.end(); ++it) {
+    const uint16_t transId = *it;
 
-      memcpy(ptr, tBuf_.get(), sz);
+    // Each step decompresses into uBuf_, which then becomes the read buffer.
+    if (transId == ZLIB_TRANSFORM) {
+      sz = zlibUncompress(pool_.get(), ptr, sz, uBuf_, uBufSize_, MAX_FRAME_SIZE);
+    } else if (transId == ZLIB_DICT_TRANSFORM) {
+      sz = zlibUncompress(pool_.get(), ptr, sz, uBuf_, uBufSize_, MAX_FRAME_SIZE, dict);
+#ifdef HAVE_LZ4_H
+    } else if (transId == LZ4_TRANSFORM) {
+      sz = lz4Uncompress(pool_.get(), ptr, sz, uBuf_, uBufSize_, MAX_FRAME_SIZE);
+#endif
+#ifdef HAVE_ZSTD_H
+    } else if (transId == ZSTD_TRANSFORM) {
+      sz = zstdUncompress(pool_.get(), ptr, sz, uBuf_, uBufSize_, MAX_FRAME_SIZE);
+    } else if (transId == ZSTD_DICT_TRANSFORM) {
+      sz = zstdUncompress(pool_.get(), ptr, sz, uBuf_, uBufSize_, MAX_FRAME_SIZE, dict);
+#endif
+#ifdef HAVE_SNAPPY_C_H
+    } else if (transId == SNAPPY_TRANSFORM) {
+      sz = snappyUncompress(pool_.get(), ptr, sz, uBuf_, uBufSize_, MAX_FRAME_SIZE);
+#endif
     } else {
       throw TApplicationException(TApplicationException::MISSING_RESULT, "Unknown transform");
     }
+
+    rBuf_.swap(uBuf_);
+    std::swap(rBufSize_, uBufSize_);
+    ptr = rBuf_.get();
   }
 
+  if (pool_) {
+    pool_->release(uBuf_, uBufSize_);
+  }
   setReadBuffer(ptr, sz);
 }
 
 /**
  * We may have updated the wBuf size, update the tBuf size to match.
- * Should be called in transform.
  *
  * The buffer should be slightly larger than write buffer size due to
  * compression transforms (that may slightly grow on small frame sizes)
  */
 void THeaderTransport::resizeTransformBuffer(uint32_t additionalSize) {
-  if (tBufSize_ < wBufSize_ + DEFAULT_BUFFER_SIZE) {
-    uint32_t new_size = wBufSize_ + DEFAULT_BUFFER_SIZE + additionalSize;
-    uint8_t* new_buf = new uint8_t[new_size];
-    tBuf_.reset(new_buf);
-    tBufSize_ = new_size;
+  ensureTransformBuffer(wBufSize_ + DEFAULT_BUFFER_SIZE + additionalSize);
+}
+
+void THeaderTransport::ensureTransformBuffer(uint32_t sz) {
+  if (tBufSize_ >= sz) {
+    return;
+  }
+  if (pool_) {
+    pool_->acquire(sz, tBuf_, tBufSize_);
+  } else {
+    tBuf_.reset(new uint8_t[sz]);
+    tBufSize_ = sz;
   }
 }
 
 void THeaderTransport::transform(uint8_t* ptr, uint32_t sz) {
-  // Update the transform buffer size if needed
-  resizeTransformBuffer();
+  appliedTrans_.clear();
+  if (sz < minCompressSize_) {
+    wBase_ = ptr + sz;
+    return;
+  }
 
   for (vector<uint16_t>::const_iterator it = writeTrans_.begin(); it != writeTrans_.end(); ++it) {
     const uint16_t transId = *it;
 
+    // Each step compresses into tBuf_, which then becomes the write buffer.
     if (transId == ZLIB_TRANSFORM) {
-      z_stream stream;
-      int err;
-
-      stream.next_in = ptr;
-      stream.avail_in = sz;
-
-      stream.zalloc = (alloc_func)0;
-      stream.zfree = (free_func)0;
-      stream.opaque = (voidpf)0;
-      err = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateInit");
-      }
-      uint32_t tbuf_size = 0;
-      while (err == Z_OK) {
-        resizeTransformBuffer(tbuf_size);
-
-        stream.next_out = tBuf_.get();
-        stream.avail_out = tBufSize_;
-        err = deflate(&stream, Z_FINISH);
-        tbuf_size += DEFAULT_BUFFER_SIZE;
-      }
-      sz = stream.total_out;
-
-      err = deflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateEnd");
-      }
-
-      memcpy(ptr, tBuf_.get(), sz);
+      sz = zlibCompress(pool_.get(), ptr, sz, tBuf_, tBufSize_);
+    } else if (transId == ZLIB_DICT_TRANSFORM) {
+      sz = zlibCompress(pool_.get(), ptr, sz, tBuf_, tBufSize_, &requireWriteDictionary());
+#ifdef HAVE_LZ4_H
+    } else if (transId == LZ4_TRANSFORM) {
+      sz = lz4Compress(pool_.get(), ptr, sz, tBuf_, tBufSize_);
+#endif
+#ifdef HAVE_ZSTD_H
+    } else if (transId == ZSTD_TRANSFORM) {
+      sz = zstdCompress(pool_.get(), ptr, sz, tBuf_, tBufSize_);
+    } else if (transId == ZSTD_DICT_TRANSFORM) {
+      sz = zstdCompress(pool_.get(), ptr, sz, tBuf_, tBufSize_, &requireWriteDictionary());
+#endif
+#ifdef HAVE_SNAPPY_C_H
+    } else if (transId == SNAPPY_TRANSFORM) {
+      sz = snappyCompress(pool_.get(), ptr, sz, tBuf_, tBufSize_);
+#endif
     } else {
       throw TTransportException(TTransportException::CORRUPTED_DATA, "Unknown transform");
     }
+
+    wBuf_.swap(tBuf_);
+    std::swap(wBufSize_, tBufSize_);
+    ptr = wBuf_.get();
+    appliedTrans_.push_back(transId);
   }
 
+  setWriteBuffer(wBuf_.get(), wBufSize_);
   wBase_ = wBuf_.get() + sz;
 }
 
@@ -437,23 +1211,20 @@ void THeaderTransport::flush() {
   if (clientType == THRIFT_HEADER_CLIENT_TYPE) {
     // header size will need to be updated at the end because of varints.
     // Make it big enough here for max varint size, plus 4 for padding.
-    uint32_t headerSize = (2 + getNumTransforms()) * THRIFT_MAX_VARINT32_BYTES + 4;
+    uint32_t numTransforms = safe_numeric_cast<uint32_t>(appliedTrans_.size());
+    // (a dictionary transform takes a second varint for its dictionary id)
+    uint32_t headerSize = (2 + 2 * numTransforms) * THRIFT_MAX_VARINT32_BYTES + 4;
     // add approximate size of info headers
     headerSize += getMaxWriteHeadersSize();
 
-    // Pkt size
-    uint32_t maxSzHbo = headerSize + haveBytes // thrift header + payload
-                        + 10;                  // common header section
+    // The header is built in tBuf_; the payload is written straight from
+    // the write buffer.
+    ensureTransformBuffer(headerSize + 14); // frame size + common header section
     uint8_t* pkt = tBuf_.get();
     uint8_t* headerStart;
     uint8_t* headerSizePtr;
     uint8_t* pktStart = pkt;
 
-    if (maxSzHbo > tBufSize_) {
-      throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                "Attempting to header frame that is too large");
-    }
-
     uint32_t szHbo;
     uint32_t szNbo;
     uint16_t headerSizeN;
@@ -475,11 +1246,15 @@ void THeaderTransport::flush() {
     headerStart = pkt;
 
     pkt += writeVarint32(protoId, pkt);
-    pkt += writeVarint32(getNumTransforms(), pkt);
+    pkt += writeVarint32(numTransforms, pkt);
 
     // For now, each transform is only the ID, no following data.
-    for (vector<uint16_t>::const_iterator it = writeTrans_.begin(); it != writeTrans_.end(); ++it) {
+    for (vector<uint16_t>::const_iterator it = appliedTrans_.begin(); it != appliedTrans_.end();
+         ++it) {
       pkt += writeVarint32(*it, pkt);
+      if (isDictionaryTransform(*it)) {
+        pkt += writeVarint32(static_cast<int32_t>(writeDict_->getId()), pkt);
+      }
     }
 
     // write info headers
@@ -540,6 +1315,17 @@ void THeaderTransport::flush() {
 
   // Flush the underlying transport.
   outTransport_->flush();
+
+  // A transform leaves the (usually smaller) compressed buffer as the write
+  // buffer; take the larger one back so the next frame does not regrow it.
+  if (tBufSize_ > wBufSize_) {
+    wBuf_.swap(tBuf_);
+    std::swap(wBufSize_, tBufSize_);
+    setWriteBuffer(wBuf_.get(), wBufSize_);
+  }
+  if (pool_) {
+    pool_->release(tBuf_, tBufSize_);
+  }
 }
 
 /**
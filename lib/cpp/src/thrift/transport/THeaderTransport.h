@@ -35,6 +35,7 @@
 
 #include <boost/scoped_array.hpp>
 #include <thrift/stdcxx.h>
+#include <thrift/concurrency/Mutex.h>
 
 #include <thrift/protocol/TProtocolTypes.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -56,6 +57,84 @@ namespace transport {
 
 using apache::thrift::protocol::T_COMPACT_PROTOCOL;
 
+/**
+ * A pool of byte buffers shared by header transports, so that the scratch
+ * space used by compression transforms is recycled across connections
+ * instead of being allocated per frame and per connection.
+ *
+ * Buffers larger than maxBufferSize are freed rather than pooled, and at
+ * most maxBuffers idle buffers are kept.
+ */
+class THeaderBufferPool {
+public:
+  explicit THeaderBufferPool(size_t maxBuffers = 64, uint32_t maxBufferSize = 16 * 1024 * 1024);
+  ~THeaderBufferPool();
+
+  /**
+   * Replaces buf with a buffer of at least minSize bytes, returning the
+   * buffer buf held before (if any) to the pool.  Contents are undefined.
+   */
+  void acquire(uint32_t minSize, boost::scoped_array<uint8_t>& buf, uint32_t& size);
+
+  /** Returns buf to the pool, leaving it empty. */
+  void release(boost::scoped_array<uint8_t>& buf, uint32_t& size);
+
+  /** Number of idle buffers in the pool. */
+  size_t size() const;
+
+private:
+  void release_(boost::scoped_array<uint8_t>& buf, uint32_t size); /* requires mutex_ */
+
+  size_t maxBuffers_;
+  uint32_t maxBufferSize_;
+
+  mutable apache::thrift::concurrency::Mutex mutex_;
+  std::multimap<uint32_t, boost::scoped_array<uint8_t>*> free_; // keyed by size
+};
+
+/**
+ * A compression dictionary shared by both ends of a connection, used by
+ * the ZLIB_DICT and ZSTD_DICT header transforms.  Small messages compress
+ * poorly from an empty window; priming the compressor with content typical
+ * of the traffic lets even a 200 byte message refer back to it.
+ *
+ * The id is sent in the frame header so the reader can select the same
+ * dictionary, and must be agreed out of band.  Dictionaries are immutable
+ * and may be shared by any number of transports.
+ */
+class THeaderDictionary {
+public:
+  THeaderDictionary(uint32_t id, const std::string& data);
+  ~THeaderDictionary();
+
+  uint32_t getId() const { return id_; }
+  const std::string& getData() const { return data_; }
+
+  /** Prepared zstd dictionaries, or NULL when built without zstd. */
+  const void* getZstdCompressDict() const { return zstdCompressDict_; }
+  const void* getZstdDecompressDict() const { return zstdDecompressDict_; }
+
+  /**
+   * Builds dictionary content of at most maxSize bytes from sample
+   * messages.  The dictionary is made of the byte sequences that occur in
+   * the most samples, the most common ones last, where a compressor can
+   * reach them with the shortest distances.  The result suits both zlib
+   * and zstd.
+   */
+  static std::string train(const std::vector<std::string>& samples, size_t maxSize = 16 * 1024);
+
+private:
+  THeaderDictionary(const THeaderDictionary&);
+  THeaderDictionary& operator=(const THeaderDictionary&);
+
+  uint32_t id_;
+  std::string data_;
+  void* zstdCompressDict_;
+  void* zstdDecompressDict_;
+};
+
+class THeaderStreamDecoder;
+
 /**
  * Header transport. All writes go into an in-memory buffer until flush is
  * called, at which point the transport writes the length of the entire
@@ -73,6 +152,7 @@ class THeaderTransport : public TVirtualTransport<THeaderTransport, TFramedTrans
 public:
   static const int DEFAULT_BUFFER_SIZE = 512u;
   static const int THRIFT_MAX_VARINT32_BYTES = 5;
+  static const uint32_t STREAM_WINDOW_SIZE = 64 * 1024;
 
   /// Use default buffer sizes.
   explicit THeaderTransport(const stdcxx::shared_ptr<TTransport>& transport)
@@ -82,8 +162,13 @@ public:
       clientType(THRIFT_HEADER_CLIENT_TYPE),
       seqId(0),
       flags(0),
+      minCompressSize_(0),
+      explicitTransforms_(false),
+      echoTransforms_(true),
       tBufSize_(0),
-      tBuf_(NULL) {
+      tBuf_(NULL),
+      uBufSize_(0),
+      uBuf_(NULL) {
     if (!transport_) throw std::invalid_argument("transport is empty");
     initBuffers();
   }
@@ -96,16 +181,32 @@ public:
       clientType(THRIFT_HEADER_CLIENT_TYPE),
       seqId(0),
       flags(0),
+      minCompressSize_(0),
+      explicitTransforms_(false),
+      echoTransforms_(true),
       tBufSize_(0),
-      tBuf_(NULL) {
+      tBuf_(NULL),
+      uBufSize_(0),
+      uBuf_(NULL) {
     if (!transport_) throw std::invalid_argument("inTransport is empty");
     if (!outTransport_) throw std::invalid_argument("outTransport is empty");
     initBuffers();
   }
 
+  virtual ~THeaderTransport();
+
   virtual uint32_t readSlow(uint8_t* buf, uint32_t len);
   virtual void flush();
 
+  uint32_t readEnd();
+
+  /**
+   * Takes transform scratch buffers from pool instead of keeping them
+   * allocated for the lifetime of the transport.
+   */
+  void setBufferPool(const stdcxx::shared_ptr<THeaderBufferPool>& pool) { pool_ = pool; }
+  stdcxx::shared_ptr<THeaderBufferPool> getBufferPool() const { return pool_; }
+
   void resizeTransformBuffer(uint32_t additionalSize = 0);
 
   uint16_t getProtocolId() const;
@@ -126,6 +227,10 @@ public:
    * On conclusion of function, setReadBuffer is called with the
    * untransformed data.
    *
+   * A frame compressed only with zlib or zstd is decompressed lazily, one
+   * STREAM_WINDOW_SIZE window at a time, as the protocol reads it; the
+   * whole uncompressed frame is never held in memory.
+   *
    * @param ptr ptr to data
    * @param size of data
    */
@@ -134,7 +239,9 @@ public:
   /**
    * Transform the data based on our write transform flags
    * At conclusion of function the write buffer is set to the
-   * transformed data.
+   * transformed data.  Payloads smaller than the minimum compress size
+   * are left as they are, and only the transforms actually applied are
+   * listed in the frame header.
    *
    * @param ptr Ptr to data to transform
    * @param sz Size of data buffer
@@ -145,7 +252,53 @@ public:
     return safe_numeric_cast<uint16_t>(writeTrans_.size());
   }
 
-  void setTransform(uint16_t transId) { writeTrans_.push_back(transId); }
+  /**
+   * Adds a transform to apply to outgoing frames.  Throws
+   * TTransportException if this build does not support the transform.
+   *
+   * Once a transform has been set explicitly, the transport no longer
+   * echoes the transforms of the frames it reads (see readHeaderFormat).
+   */
+  void setTransform(uint16_t transId);
+
+  /** Removes every write transform and disables transform echoing. */
+  void clearTransforms();
+
+  /**
+   * Makes the transport answer in kind: until a transform is set
+   * explicitly, each frame read switches the write transforms to those of
+   * its transforms this build supports.  On by default, so a server
+   * compresses responses for the clients that compress their requests.  A
+   * client that must never compress, whatever its server sends, turns it
+   * off.
+   */
+  void setEchoTransforms(bool echo) { echoTransforms_ = echo; }
+  bool getEchoTransforms() const { return echoTransforms_; }
+
+  /**
+   * Makes dict available to frames read with a dictionary transform.
+   */
+  void addDictionary(const stdcxx::shared_ptr<THeaderDictionary>& dict);
+
+  /**
+   * Selects the dictionary used by the ZLIB_DICT and ZSTD_DICT write
+   * transforms, and adds it for reading.
+   */
+  void setWriteDictionary(const stdcxx::shared_ptr<THeaderDictionary>& dict);
+  stdcxx::shared_ptr<THeaderDictionary> getWriteDictionary() const { return writeDict_; }
+
+  /** Transforms listed in the header of the last frame read. */
+  const std::vector<uint16_t>& getReadTransforms() const { return readTrans_; }
+
+  /**
+   * Payloads smaller than this many bytes are sent untransformed; small
+   * messages rarely shrink enough to pay for the compression work.
+   */
+  void setMinCompressSize(uint32_t minCompressSize) { minCompressSize_ = minCompressSize; }
+  uint32_t getMinCompressSize() const { return minCompressSize_; }
+
+  /** Returns true if this build can apply and undo the given transform. */
+  static bool isTransformSupported(uint16_t transId);
 
   // Info headers
 
@@ -165,10 +318,25 @@ public:
   int32_t getSequenceNumber() const { return seqId; }
   void setSequenceNumber(int32_t seqId) { this->seqId = seqId; }
 
+  /**
+   * Transform ids match the other header transport implementations.
+   * LZ4 frames carry the uncompressed length as a 4 byte big endian prefix.
+   * The dictionary transforms are followed in the header by the varint32
+   * id of the THeaderDictionary they were compressed with.
+   */
   enum TRANSFORMS {
     ZLIB_TRANSFORM = 0x01,
+    SNAPPY_TRANSFORM = 0x03,
+    ZSTD_TRANSFORM = 0x05,
+    LZ4_TRANSFORM = 0x06,
+    ZLIB_DICT_TRANSFORM = 0x07,
+    ZSTD_DICT_TRANSFORM = 0x08,
   };
 
+  static bool isDictionaryTransform(uint16_t transId) {
+    return transId == ZLIB_DICT_TRANSFORM || transId == ZSTD_DICT_TRANSFORM;
+  }
+
 protected:
   /**
    * Reads a frame of input from the underlying stream.
@@ -202,6 +370,21 @@ protected:
 
   std::vector<uint16_t> readTrans_;
   std::vector<uint16_t> writeTrans_;
+  // transforms applied to the frame being flushed
+  std::vector<uint16_t> appliedTrans_;
+  uint32_t minCompressSize_;
+  bool explicitTransforms_;
+  bool echoTransforms_;
+
+  // dictionaries known to this transport, by id
+  std::map<uint32_t, stdcxx::shared_ptr<THeaderDictionary> > dictionaries_;
+  stdcxx::shared_ptr<THeaderDictionary> writeDict_;
+  // dictionary named by the last frame read, if any
+  stdcxx::shared_ptr<THeaderDictionary> readDict_;
+
+  /** Looks up a dictionary named in a frame header; throws if unknown. */
+  stdcxx::shared_ptr<THeaderDictionary> findDictionary(uint32_t id) const;
+  const THeaderDictionary& requireWriteDictionary() const;
 
   // Map to use for headers
   StringToStringMap readHeaders_;
@@ -220,9 +403,26 @@ protected:
     };
   };
 
-  // Buffers to use for transform processing
+  // Buffers to use for transform processing.  A transform writes into
+  // tBuf_ (uBuf_ when reading), which is then swapped with the write (read)
+  // buffer, so the result never has to be copied back.
   uint32_t tBufSize_;
   boost::scoped_array<uint8_t> tBuf_;
+  uint32_t uBufSize_;
+  boost::scoped_array<uint8_t> uBuf_;
+
+  /** Grows tBuf_ to at least sz bytes, discarding its contents. */
+  void ensureTransformBuffer(uint32_t sz);
+
+  /**
+   * Decodes the next window of a streamed frame into uBuf_ and makes it
+   * the read buffer.  Returns false once the frame is exhausted.
+   */
+  bool refillStreamWindow();
+  void endStream();
+
+  stdcxx::shared_ptr<THeaderStreamDecoder> decoder_;
+  stdcxx::shared_ptr<THeaderBufferPool> pool_;
 
   void readString(uint8_t*& ptr, /* out */ std::string& str, uint8_t const* headerBoundary);
 
@@ -258,7 +458,14 @@ protected:
  */
 class THeaderTransportFactory : public TTransportFactory {
 public:
-  THeaderTransportFactory() {}
+  THeaderTransportFactory() : echoTransforms_(true) {}
+
+  /**
+   * Every transport created by this factory shares pool for its
+   * transform buffers.
+   */
+  explicit THeaderTransportFactory(const stdcxx::shared_ptr<THeaderBufferPool>& pool)
+    : pool_(pool), echoTransforms_(true) {}
 
   virtual ~THeaderTransportFactory() {}
 
@@ -266,8 +473,35 @@ public:
    * Wraps the transport into a header one.
    */
   virtual stdcxx::shared_ptr<TTransport> getTransport(stdcxx::shared_ptr<TTransport> trans) {
-    return stdcxx::shared_ptr<TTransport>(new THeaderTransport(trans));
+    THeaderTransport* header = new THeaderTransport(trans);
+    header->setBufferPool(pool_);
+    header->setEchoTransforms(echoTransforms_);
+    for (std::vector<stdcxx::shared_ptr<THeaderDictionary> >::const_iterator it
+         = dictionaries_.begin();
+         it != dictionaries_.end();
+         ++it) {
+      header->addDictionary(*it);
+    }
+    if (writeDict_) {
+      header->setWriteDictionary(writeDict_);
+    }
+    return stdcxx::shared_ptr<TTransport>(header);
   }
+
+  /** Dictionaries added to every transport created from now on. */
+  void addDictionary(const stdcxx::shared_ptr<THeaderDictionary>& dict) {
+    dictionaries_.push_back(dict);
+  }
+  void setWriteDictionary(const stdcxx::shared_ptr<THeaderDictionary>& dict) { writeDict_ = dict; }
+
+  /** See THeaderTransport::setEchoTransforms. */
+  void setEchoTransforms(bool echo) { echoTransforms_ = echo; }
+
+private:
+  stdcxx::shared_ptr<THeaderBufferPool> pool_;
+  std::vector<stdcxx::shared_ptr<THeaderDictionary> > dictionaries_;
+  stdcxx::shared_ptr<THeaderDictionary> writeDict_;
+  bool echoTransforms_;
 };
 }
 }
@@ -0,0 +1,537 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/transport/THpack.h>
+#include <thrift/transport/TTransportException.h>
+
+#include <cstring>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+namespace {
+
+struct StaticEntry {
+  const char* name;
+  const char* value;
+};
+
+// RFC 7541 Appendix A
+const StaticEntry STATIC_TABLE[] = {{":authority", ""},
+                                    {":method", "GET"},
+                                    {":method", "POST"},
+                                    {":path", "/"},
+                                    {":path", "/index.html"},
+                                    {":scheme", "http"},
+                                    {":scheme", "https"},
+                                    {":status", "200"},
+                                    {":status", "204"},
+                                    {":status", "206"},
+                                    {":status", "304"},
+                                    {":status", "400"},
+                                    {":status", "404"},
+                                    {":status", "500"},
+                                    {"accept-charset", ""},
+                                    {"accept-encoding", "gzip, deflate"},
+                                    {"accept-language", ""},
+                                    {"accept-ranges", ""},
+                                    {"accept", ""},
+                                    {"access-control-allow-origin", ""},
+                                    {"age", ""},
+                                    {"allow", ""},
+                                    {"authorization", ""},
+                                    {"cache-control", ""},
+                                    {"content-disposition", ""},
+                                    {"content-encoding", ""},
+                                    {"content-language", ""},
+                                    {"content-length", ""},
+                                    {"content-location", ""},
+                                    {"content-range", ""},
+                                    {"content-type", ""},
+                                    {"cookie", ""},
+                                    {"date", ""},
+                                    {"etag", ""},
+                                    {"expect", ""},
+                                    {"expires", ""},
+                                    {"from", ""},
+                                    {"host", ""},
+                                    {"if-match", ""},
+                                    {"if-modified-since", ""},
+                                    {"if-none-match", ""},
+                                    {"if-range", ""},
+                                    {"if-unmodified-since", ""},
+                                    {"last-modified", ""},
+                                    {"link", ""},
+                                    {"location", ""},
+                                    {"max-forwards", ""},
+                                    {"proxy-authenticate", ""},
+                                    {"proxy-authorization", ""},
+                                    {"range", ""},
+                                    {"referer", ""},
+                                    {"refresh", ""},
+                                    {"retry-after", ""},
+                                    {"server", ""},
+                                    {"set-cookie", ""},
+                                    {"strict-transport-security", ""},
+                                    {"transfer-encoding", ""},
+                                    {"user-agent", ""},
+                                    {"vary", ""},
+                                    {"via", ""},
+                                    {"www-authenticate", ""}};
+
+const uint32_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+// Per-entry overhead counted against the table size (RFC 7541 4.1)
+const uint32_t ENTRY_OVERHEAD = 32;
+
+struct HuffmanCode {
+  uint32_t code;
+  uint8_t bits;
+};
+
+// RFC 7541 Appendix B; symbol 256 is EOS
+const HuffmanCode HUFFMAN_CODES[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28},
+    {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24},
+    {0x3ffffffc, 30}, {0xfffffe9, 28}, {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28},
+    {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28}, {0xffffff4, 28},
+    {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8},
+    {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7},
+    {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7},
+    {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7},
+    {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15},
+    {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5},
+    {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20},
+    {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22},
+    {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22},
+    {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23},
+    {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22},
+    {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23},
+    {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20},
+    {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26},
+    {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26},
+    {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20},
+    {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24},
+    {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26},
+    {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+};
+
+/**
+ * Huffman decoder that consumes four bits at a time.  States are the
+ * internal nodes of the code tree; each one has a transition per nibble
+ * that says where decoding continues and which symbol, if any, was
+ * completed on the way.
+ */
+class HuffmanDecoder {
+public:
+  enum { EMIT = 1, FAIL = 2 };
+
+  struct Transition {
+    uint16_t state;
+    uint8_t flags;
+    uint8_t symbol;
+  };
+
+  HuffmanDecoder() {
+    // build the code tree: node 0 is the root, leaves hold symbol + 1 in leaf
+    Node root = {{0, 0}, 0, 0, true};
+    nodes_.push_back(root);
+    for (uint32_t sym = 0; sym < 257; ++sym) {
+      uint32_t node = 0;
+      for (int bit = HUFFMAN_CODES[sym].bits - 1; bit >= 0; --bit) {
+        int b = (HUFFMAN_CODES[sym].code >> bit) & 1;
+        if (nodes_[node].child[b] == 0) {
+          Node child = {{0, 0},
+                        0,
+                        static_cast<uint8_t>(nodes_[node].depth + 1),
+                        nodes_[node].allOnes && b == 1};
+          nodes_.push_back(child);
+          nodes_[node].child[b] = static_cast<uint16_t>(nodes_.size() - 1);
+        }
+        node = nodes_[node].child[b];
+      }
+      nodes_[node].leaf = static_cast<uint16_t>(sym + 1);
+    }
+
+    // number the internal nodes as states
+    states_.assign(nodes_.size(), 0);
+    uint16_t numStates = 0;
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      if (!nodes_[i].leaf) {
+        states_[i] = numStates++;
+        nodeOf_.push_back(static_cast<uint16_t>(i));
+      }
+    }
+
+    transitions_.resize(numStates * 16);
+    accept_.resize(numStates);
+    for (uint16_t state = 0; state < numStates; ++state) {
+      const Node& n = nodes_[nodeOf_[state]];
+      // padding is a prefix of EOS (all ones) of at most 7 bits
+      accept_[state] = state == 0 || (n.allOnes && n.depth <= 7);
+      for (int nibble = 0; nibble < 16; ++nibble) {
+        Transition& t = transitions_[state * 16 + nibble];
+        t.flags = 0;
+        t.symbol = 0;
+        uint16_t node = nodeOf_[state];
+        for (int bit = 3; bit >= 0; --bit) {
+          node = nodes_[node].child[(nibble >> bit) & 1];
+          if (nodes_[node].leaf) {
+            if (nodes_[node].leaf == 257) {
+              t.flags |= FAIL;
+            } else {
+              t.flags |= EMIT;
+              t.symbol = static_cast<uint8_t>(nodes_[node].leaf - 1);
+            }
+            node = 0;
+          }
+        }
+        t.state = states_[node];
+      }
+    }
+  }
+
+  const Transition& next(uint16_t state, uint8_t nibble) const {
+    return transitions_[state * 16 + nibble];
+  }
+  bool accepts(uint16_t state) const { return accept_[state]; }
+
+private:
+  struct Node {
+    uint16_t child[2];
+    uint16_t leaf;
+    uint8_t depth;
+    bool allOnes;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<uint16_t> states_;
+  std::vector<uint16_t> nodeOf_;
+  std::vector<Transition> transitions_;
+  std::vector<bool> accept_;
+};
+
+const HuffmanDecoder huffmanDecoder;
+
+struct StaticHeaders {
+  StaticHeaders() {
+    for (uint32_t i = 0; i < STATIC_TABLE_SIZE; ++i) {
+      headers.push_back(THpackHeader(STATIC_TABLE[i].name, STATIC_TABLE[i].value));
+    }
+  }
+  std::vector<THpackHeader> headers;
+};
+
+const StaticHeaders staticHeaders;
+
+void corrupt(const char* message) {
+  throw TTransportException(TTransportException::CORRUPTED_DATA,
+                            std::string("HPACK: ") + message);
+}
+
+void encodeInteger(uint32_t value, uint8_t prefixBits, uint8_t firstByte, std::string& out) {
+  uint32_t max = (1u << prefixBits) - 1;
+  if (value < max) {
+    out.push_back(static_cast<char>(firstByte | value));
+    return;
+  }
+  out.push_back(static_cast<char>(firstByte | max));
+  value -= max;
+  while (value >= 128) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+uint32_t decodeInteger(const uint8_t*& p, const uint8_t* end, uint8_t prefixBits) {
+  uint32_t max = (1u << prefixBits) - 1;
+  uint32_t value = *p++ & max;
+  if (value < max) {
+    return value;
+  }
+  for (uint32_t shift = 0;; shift += 7) {
+    if (p == end) {
+      corrupt("truncated integer");
+    }
+    if (shift > 28) {
+      corrupt("integer too large");
+    }
+    uint8_t b = *p++;
+    uint64_t next = value + (static_cast<uint64_t>(b & 0x7f) << shift);
+    if (next > 0xffffffffu) {
+      corrupt("integer too large");
+    }
+    value = static_cast<uint32_t>(next);
+    if (!(b & 0x80)) {
+      return value;
+    }
+  }
+}
+
+void encodeString(const std::string& s, std::string& out) {
+  uint32_t huffmanLength = hpackHuffmanEncodedLength(s);
+  if (huffmanLength < s.size()) {
+    encodeInteger(huffmanLength, 7, 0x80, out);
+    hpackHuffmanEncode(s, out);
+  } else {
+    encodeInteger(static_cast<uint32_t>(s.size()), 7, 0, out);
+    out.append(s);
+  }
+}
+
+void decodeString(const uint8_t*& p, const uint8_t* end, std::string& out) {
+  if (p == end) {
+    corrupt("truncated string");
+  }
+  bool huffman = (*p & 0x80) != 0;
+  uint32_t len = decodeInteger(p, end, 7);
+  if (len > static_cast<uint32_t>(end - p)) {
+    corrupt("truncated string");
+  }
+  if (huffman) {
+    out.clear();
+    hpackHuffmanDecode(p, len, out);
+  } else {
+    out.assign(reinterpret_cast<const char*>(p), len);
+  }
+  p += len;
+}
+
+uint32_t entrySize(const THpackHeader& header) {
+  return static_cast<uint32_t>(header.first.size() + header.second.size()) + ENTRY_OVERHEAD;
+}
+}
+
+void hpackHuffmanEncode(const std::string& in, std::string& out) {
+  uint64_t bits = 0;
+  uint32_t numBits = 0;
+  for (size_t i = 0; i < in.size(); ++i) {
+    const HuffmanCode& code = HUFFMAN_CODES[static_cast<uint8_t>(in[i])];
+    bits = (bits << code.bits) | code.code;
+    numBits += code.bits;
+    while (numBits >= 8) {
+      numBits -= 8;
+      out.push_back(static_cast<char>(bits >> numBits));
+    }
+  }
+  if (numBits > 0) {
+    // pad with the most significant bits of EOS, which are all ones
+    out.push_back(static_cast<char>((bits << (8 - numBits)) | (0xff >> numBits)));
+  }
+}
+
+uint32_t hpackHuffmanEncodedLength(const std::string& in) {
+  uint64_t numBits = 0;
+  for (size_t i = 0; i < in.size(); ++i) {
+    numBits += HUFFMAN_CODES[static_cast<uint8_t>(in[i])].bits;
+  }
+  return static_cast<uint32_t>((numBits + 7) / 8);
+}
+
+void hpackHuffmanDecode(const uint8_t* in, uint32_t len, std::string& out) {
+  uint16_t state = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    for (int shift = 4; shift >= 0; shift -= 4) {
+      const HuffmanDecoder::Transition& t
+          = huffmanDecoder.next(state, static_cast<uint8_t>((in[i] >> shift) & 0xf));
+      if (t.flags & HuffmanDecoder::FAIL) {
+        corrupt("EOS in Huffman string");
+      }
+      if (t.flags & HuffmanDecoder::EMIT) {
+        out.push_back(static_cast<char>(t.symbol));
+      }
+      state = t.state;
+    }
+  }
+  if (!huffmanDecoder.accepts(state)) {
+    corrupt("bad Huffman padding");
+  }
+}
+
+THpackTable::THpackTable(uint32_t maxSize) : size_(0), maxSize_(maxSize) {
+}
+
+const THpackHeader* THpackTable::get(uint32_t index) const {
+  if (index == 0) {
+    return NULL;
+  }
+  if (index <= STATIC_TABLE_SIZE) {
+    return &staticHeaders.headers[index - 1];
+  }
+  index -= STATIC_TABLE_SIZE + 1;
+  return index < entries_.size() ? &entries_[index] : NULL;
+}
+
+int32_t THpackTable::find(const THpackHeader& header) const {
+  int32_t nameMatch = 0;
+  for (uint32_t i = 0; i < STATIC_TABLE_SIZE; ++i) {
+    const THpackHeader& entry = staticHeaders.headers[i];
+    if (entry.first == header.first) {
+      if (entry.second == header.second) {
+        return static_cast<int32_t>(i + 1);
+      }
+      if (!nameMatch) {
+        nameMatch = -static_cast<int32_t>(i + 1);
+      }
+    }
+  }
+  for (uint32_t i = 0; i < entries_.size(); ++i) {
+    const THpackHeader& entry = entries_[i];
+    if (entry.first == header.first) {
+      if (entry.second == header.second) {
+        return static_cast<int32_t>(STATIC_TABLE_SIZE + i + 1);
+      }
+      if (!nameMatch) {
+        nameMatch = -static_cast<int32_t>(STATIC_TABLE_SIZE + i + 1);
+      }
+    }
+  }
+  return nameMatch;
+}
+
+void THpackTable::add(const THpackHeader& header) {
+  uint32_t size = entrySize(header);
+  if (size > maxSize_) {
+    // an entry larger than the table empties it (RFC 7541 4.4)
+    evict(0);
+    return;
+  }
+  evict(maxSize_ - size);
+  entries_.push_front(header);
+  size_ += size;
+}
+
+void THpackTable::setMaxSize(uint32_t maxSize) {
+  maxSize_ = maxSize;
+  evict(maxSize);
+}
+
+void THpackTable::evict(uint32_t maxSize) {
+  while (size_ > maxSize) {
+    size_ -= entrySize(entries_.back());
+    entries_.pop_back();
+  }
+}
+
+void THpackEncoder::setMaxTableSize(uint32_t maxSize) {
+  if (maxSize > DEFAULT_TABLE_SIZE) {
+    maxSize = DEFAULT_TABLE_SIZE;
+  }
+  if (maxSize != table_.getMaxSize()) {
+    table_.setMaxSize(maxSize);
+    pendingSizeUpdate_ = true;
+  }
+}
+
+void THpackEncoder::encode(const THpackHeaders& headers, std::string& out) {
+  if (pendingSizeUpdate_) {
+    encodeInteger(table_.getMaxSize(), 5, 0x20, out);
+    pendingSizeUpdate_ = false;
+  }
+  for (THpackHeaders::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+    int32_t index = table_.find(*it);
+    if (index > 0) {
+      // indexed header field
+      encodeInteger(static_cast<uint32_t>(index), 7, 0x80, out);
+      continue;
+    }
+
+    if (it->first == "content-length") {
+      // literal without indexing
+      encodeInteger(static_cast<uint32_t>(-index), 4, 0x00, out);
+    } else {
+      // literal with incremental indexing
+      encodeInteger(static_cast<uint32_t>(-index), 6, 0x40, out);
+      table_.add(*it);
+    }
+    if (index == 0) {
+      encodeString(it->first, out);
+    }
+    encodeString(it->second, out);
+  }
+}
+
+void THpackDecoder::decode(const uint8_t* block, uint32_t len, THpackHeaders& headers) {
+  const uint8_t* p = block;
+  const uint8_t* end = block + len;
+  bool first = true;
+  while (p < end) {
+    uint8_t b = *p;
+    if (b & 0x80) {
+      // indexed header field
+      const THpackHeader* header = table_.get(decodeInteger(p, end, 7));
+      if (!header) {
+        corrupt("bad index");
+      }
+      headers.push_back(*header);
+    } else if ((b & 0xe0) == 0x20) {
+      // dynamic table size update, only at the start of a block
+      uint32_t size = decodeInteger(p, end, 5);
+      if (!first || size > settingsTableSize_) {
+        corrupt("bad table size update");
+      }
+      table_.setMaxSize(size);
+      continue;
+    } else {
+      // literal: with incremental indexing (01), without (0000) or never indexed (0001)
+      bool indexed = (b & 0xc0) == 0x40;
+      uint32_t nameIndex = decodeInteger(p, end, indexed ? 6 : 4);
+      THpackHeader header;
+      if (nameIndex) {
+        const THpackHeader* name = table_.get(nameIndex);
+        if (!name) {
+          corrupt("bad index");
+        }
+        header.first = name->first;
+      } else {
+        decodeString(p, end, header.first);
+      }
+      decodeString(p, end, header.second);
+      if (indexed) {
+        table_.add(header);
+      }
+      headers.push_back(header);
+    }
+    first = false;
+  }
+}
+}
+}
+} // apache::thrift::transport
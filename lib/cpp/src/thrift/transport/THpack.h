@@ -0,0 +1,115 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_THPACK_H_
+#define _THRIFT_TRANSPORT_THPACK_H_ 1
+
+#include <thrift/Thrift.h>
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/** An HTTP/2 header field: lower case name and value. */
+typedef std::pair<std::string, std::string> THpackHeader;
+typedef std::vector<THpackHeader> THpackHeaders;
+
+/**
+ * Dynamic table of HPACK (RFC 7541), shared by the encoder and decoder.
+ */
+class THpackTable {
+public:
+  explicit THpackTable(uint32_t maxSize);
+
+  /** Looks up a 1-based index into the static and then the dynamic table. */
+  const THpackHeader* get(uint32_t index) const;
+
+  /**
+   * Finds header in the tables.  Returns the index of an entry with the
+   * same name and value, or else the negated index of one with the same
+   * name, or else 0.
+   */
+  int32_t find(const THpackHeader& header) const;
+
+  void add(const THpackHeader& header);
+  void setMaxSize(uint32_t maxSize);
+  uint32_t getMaxSize() const { return maxSize_; }
+
+private:
+  void evict(uint32_t maxSize);
+
+  std::deque<THpackHeader> entries_;
+  uint32_t size_;
+  uint32_t maxSize_;
+};
+
+/**
+ * Encodes header lists into HPACK header blocks.  Fields are added to the
+ * dynamic table, so that headers repeated from one request to the next
+ * (the path, the content type, the user agent...) shrink to a byte or two,
+ * except for content-length, which rarely repeats.
+ */
+class THpackEncoder {
+public:
+  THpackEncoder() : table_(DEFAULT_TABLE_SIZE), pendingSizeUpdate_(false) {}
+
+  /** Applies the peer's SETTINGS_HEADER_TABLE_SIZE from the next block on. */
+  void setMaxTableSize(uint32_t maxSize);
+
+  /** Appends the header block for headers to out. */
+  void encode(const THpackHeaders& headers, std::string& out);
+
+  static const uint32_t DEFAULT_TABLE_SIZE = 4096;
+
+private:
+  THpackTable table_;
+  bool pendingSizeUpdate_;
+};
+
+/**
+ * Decodes HPACK header blocks.  Throws TTransportException(CORRUPTED_DATA)
+ * on a malformed block, after which the decoder is out of step with its
+ * peer and the connection has to be dropped.
+ */
+class THpackDecoder {
+public:
+  explicit THpackDecoder(uint32_t maxTableSize = THpackEncoder::DEFAULT_TABLE_SIZE)
+    : table_(maxTableSize), settingsTableSize_(maxTableSize) {}
+
+  void decode(const uint8_t* block, uint32_t len, THpackHeaders& headers);
+
+private:
+  THpackTable table_;
+  uint32_t settingsTableSize_;
+};
+
+/** Huffman coding of HPACK string literals, exposed for testing. */
+void hpackHuffmanEncode(const std::string& in, std::string& out);
+uint32_t hpackHuffmanEncodedLength(const std::string& in);
+void hpackHuffmanDecode(const uint8_t* in, uint32_t len, std::string& out);
+}
+}
+} // apache::thrift::transport
+
+#endif // _THRIFT_TRANSPORT_THPACK_H_
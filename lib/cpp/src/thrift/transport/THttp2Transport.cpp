@@ -0,0 +1,1253 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/config.h>
+#include <thrift/transport/THttp2Transport.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/concurrency/FunctionRunner.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using apache::thrift::concurrency::FunctionRunner;
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Synchronized;
+using apache::thrift::protocol::TProtocol;
+using stdcxx::shared_ptr;
+
+namespace {
+
+const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const uint32_t PREFACE_LEN = sizeof(PREFACE) - 1;
+
+const uint32_t FRAME_HEADER_LEN = 9;
+// we never raise SETTINGS_MAX_FRAME_SIZE above its initial value
+const uint32_t MAX_FRAME_SIZE = 16384;
+const uint32_t DEFAULT_WINDOW = 65535;
+const uint32_t MAX_WINDOW = 0x7fffffff;
+
+enum FrameType {
+  DATA = 0x0,
+  HEADERS = 0x1,
+  PRIORITY = 0x2,
+  RST_STREAM = 0x3,
+  SETTINGS = 0x4,
+  PUSH_PROMISE = 0x5,
+  PING = 0x6,
+  GOAWAY = 0x7,
+  WINDOW_UPDATE = 0x8,
+  CONTINUATION = 0x9
+};
+
+enum FrameFlags {
+  END_STREAM = 0x1,
+  ACK = 0x1,
+  END_HEADERS = 0x4,
+  PADDED = 0x8,
+  PRIORITY_FLAG = 0x20
+};
+
+enum Setting {
+  HEADER_TABLE_SIZE = 0x1,
+  ENABLE_PUSH = 0x2,
+  MAX_CONCURRENT_STREAMS = 0x3,
+  INITIAL_WINDOW_SIZE = 0x4,
+  MAX_FRAME_SIZE_SETTING = 0x5,
+  MAX_HEADER_LIST_SIZE = 0x6
+};
+
+const uint32_t NO_ERROR = 0x0;
+const uint32_t INTERNAL_ERROR = 0x2;
+const uint32_t REFUSED_STREAM = 0x7;
+const uint32_t CANCEL = 0x8;
+
+uint32_t get32(const uint8_t* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void put32(std::string& out, uint32_t value) {
+  out.push_back(static_cast<char>(value >> 24));
+  out.push_back(static_cast<char>(value >> 16));
+  out.push_back(static_cast<char>(value >> 8));
+  out.push_back(static_cast<char>(value));
+}
+
+void putFrameHeader(std::string& out, uint32_t len, uint8_t type, uint8_t flags, int32_t stream) {
+  out.push_back(static_cast<char>(len >> 16));
+  out.push_back(static_cast<char>(len >> 8));
+  out.push_back(static_cast<char>(len));
+  out.push_back(static_cast<char>(type));
+  out.push_back(static_cast<char>(flags));
+  put32(out, static_cast<uint32_t>(stream));
+}
+
+std::string windowUpdateFrame(int32_t stream, uint32_t increment) {
+  std::string frame;
+  putFrameHeader(frame, 4, WINDOW_UPDATE, 0, stream);
+  put32(frame, increment);
+  return frame;
+}
+
+std::string resetFrame(int32_t stream, uint32_t error) {
+  std::string frame;
+  putFrameHeader(frame, 4, RST_STREAM, 0, stream);
+  put32(frame, error);
+  return frame;
+}
+
+void putSetting(std::string& out, uint16_t id, uint32_t value) {
+  out.push_back(static_cast<char>(id >> 8));
+  out.push_back(static_cast<char>(id));
+  put32(out, value);
+}
+
+void corrupt(const char* message) {
+  throw TTransportException(TTransportException::CORRUPTED_DATA,
+                            std::string("HTTP/2: ") + message);
+}
+}
+
+THttp2Connection::THttp2Connection(shared_ptr<TTransport> transport, Role role)
+  : transport_(transport),
+    input_(new TBufferedTransport(transport)),
+    role_(role),
+    maxConcurrentStreams_(DEFAULT_MAX_CONCURRENT_STREAMS),
+    maxHeaderListSize_(DEFAULT_MAX_HEADER_LIST_SIZE),
+    maxMessageSize_(DEFAULT_MAX_MESSAGE_SIZE),
+    headerStream_(0),
+    headerEndStream_(false),
+    expectContinuation_(false),
+    opened_(false),
+    connectionSendWindow_(DEFAULT_WINDOW),
+    connectionRecvWindow_(CONNECTION_WINDOW),
+    connectionRecvUnacked_(0),
+    windowVersion_(0),
+    peerInitialWindow_(DEFAULT_WINDOW),
+    peerMaxFrameSize_(MAX_FRAME_SIZE),
+    peerMaxStreams_(0xffffffff),
+    peerHeaderTableSize_(THpackEncoder::DEFAULT_TABLE_SIZE),
+    activeStreams_(0),
+    nextStreamId_(1),
+    lastPeerStreamId_(0),
+    unanswered_(0),
+    framesRead_(0),
+    reading_(false),
+    goAway_(false),
+    closed_(false) {
+  threadFactory_.setDetached(false);
+}
+
+THttp2Connection::~THttp2Connection() {
+  try {
+    close();
+  } catch (...) {
+    // nothing to do
+  }
+  for (std::map<int32_t, Stream*>::iterator it = streams_.begin(); it != streams_.end(); ++it) {
+    delete it->second;
+  }
+}
+
+void THttp2Connection::open() {
+  {
+    Guard g(writeMutex_);
+    if (opened_) {
+      return;
+    }
+    if (!transport_->isOpen()) {
+      transport_->open();
+    }
+    if (role_ == SERVER) {
+      uint8_t preface[PREFACE_LEN];
+      input_->readAll(preface, PREFACE_LEN);
+      if (memcmp(preface, PREFACE, PREFACE_LEN) != 0) {
+        corrupt("bad connection preface");
+      }
+    } else {
+      out_.append(PREFACE, PREFACE_LEN);
+    }
+
+    // our settings, and a connection window to match the stream windows
+    std::string settings;
+    if (role_ == CLIENT) {
+      putSetting(settings, ENABLE_PUSH, 0);
+    } else {
+      putSetting(settings, MAX_CONCURRENT_STREAMS, maxConcurrentStreams_);
+    }
+    putSetting(settings, INITIAL_WINDOW_SIZE, STREAM_WINDOW);
+    putSetting(settings, MAX_HEADER_LIST_SIZE, maxHeaderListSize_);
+    appendFrame(SETTINGS,
+                0,
+                0,
+                reinterpret_cast<const uint8_t*>(settings.data()),
+                static_cast<uint32_t>(settings.size()));
+    out_.append(windowUpdateFrame(0, CONNECTION_WINDOW - DEFAULT_WINDOW));
+    writeOutLocked();
+    opened_ = true;
+  }
+
+  if (role_ == CLIENT) {
+    readerThread_ = threadFactory_.newThread(
+        FunctionRunner::create(stdcxx::bind(&THttp2Connection::readerLoop, this)));
+    readerThread_->start();
+  }
+}
+
+bool THttp2Connection::isOpen() {
+  Synchronized s(monitor_);
+  return !closed_ && error_.empty() && transport_->isOpen();
+}
+
+void THttp2Connection::close() {
+  bool failed;
+  {
+    Synchronized s(monitor_);
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+    failed = !error_.empty();
+    monitor_.notifyAll();
+  }
+
+  // say goodbye, unless the peer is gone or a writer is stuck on the transport
+  if (!failed && writeMutex_.trylock()) {
+    try {
+      if (opened_ && transport_->isOpen()) {
+        std::string payload;
+        put32(payload, static_cast<uint32_t>(lastPeerStreamId_));
+        put32(payload, NO_ERROR);
+        appendFrame(GOAWAY,
+                    0,
+                    0,
+                    reinterpret_cast<const uint8_t*>(payload.data()),
+                    static_cast<uint32_t>(payload.size()));
+        writeOutLocked();
+      }
+    } catch (TTransportException&) {
+      // the connection is going away anyway
+    }
+    writeMutex_.unlock();
+  }
+
+  transport_->close();
+  if (readerThread_) {
+    readerThread_->join();
+    readerThread_.reset();
+  }
+}
+
+void THttp2Connection::readerLoop() {
+  try {
+    while (processFrame()) {
+    }
+    Synchronized s(monitor_);
+    fail("connection closed by peer");
+  } catch (TException& te) {
+    Synchronized s(monitor_);
+    fail(te.what());
+  }
+}
+
+bool THttp2Connection::processFrame() {
+  uint8_t header[FRAME_HEADER_LEN];
+  if (input_->read(header, 1) == 0) {
+    // clean end of the connection, between frames
+    return false;
+  }
+  input_->readAll(header + 1, FRAME_HEADER_LEN - 1);
+
+  uint32_t len = (header[0] << 16) | (header[1] << 8) | header[2];
+  uint8_t type = header[3];
+  uint8_t flags = header[4];
+  int32_t streamId = static_cast<int32_t>(get32(header + 5) & 0x7fffffff);
+  if (len > MAX_FRAME_SIZE) {
+    corrupt("frame too large");
+  }
+  frame_.resize(len);
+  if (len > 0) {
+    input_->readAll(reinterpret_cast<uint8_t*>(&frame_[0]), len);
+  }
+  const uint8_t* payload = reinterpret_cast<const uint8_t*>(frame_.data());
+
+  if (expectContinuation_ && (type != CONTINUATION || streamId != headerStream_)) {
+    corrupt("expected CONTINUATION");
+  }
+
+  switch (type) {
+  case DATA:
+    handleData(flags, streamId, payload, len);
+    break;
+  case HEADERS:
+    handleHeaders(flags, streamId, payload, len);
+    break;
+  case CONTINUATION:
+    if (!expectContinuation_) {
+      corrupt("unexpected CONTINUATION");
+    }
+    appendHeaderBlock(payload, len);
+    if (flags & END_HEADERS) {
+      expectContinuation_ = false;
+      finishHeaders();
+    }
+    break;
+  case RST_STREAM:
+    if (len != 4 || streamId == 0) {
+      corrupt("bad RST_STREAM");
+    }
+    handleReset(streamId);
+    break;
+  case SETTINGS:
+    if (streamId != 0) {
+      corrupt("SETTINGS on a stream");
+    }
+    handleSettings(flags, payload, len);
+    break;
+  case PING:
+    if (len != 8 || streamId != 0) {
+      corrupt("bad PING");
+    }
+    if (!(flags & ACK)) {
+      std::string pong;
+      putFrameHeader(pong, 8, PING, ACK, 0);
+      pong.append(frame_);
+      writeControl(pong);
+    }
+    break;
+  case GOAWAY:
+    if (len < 8 || streamId != 0) {
+      corrupt("bad GOAWAY");
+    }
+    handleGoAway(payload, len);
+    break;
+  case WINDOW_UPDATE:
+    if (len != 4) {
+      corrupt("bad WINDOW_UPDATE");
+    }
+    handleWindowUpdate(streamId, payload, len);
+    break;
+  case PUSH_PROMISE:
+    corrupt("PUSH_PROMISE while push is disabled");
+    break;
+  default:
+    // PRIORITY and unknown frame types are ignored
+    break;
+  }
+  return true;
+}
+
+void THttp2Connection::readFrameShared(uint64_t framesSeen) {
+  // on the server side, the serving thread and threads answering calls
+  // all need frames read; one reads while the others wait for its frame
+  {
+    Synchronized s(monitor_);
+    if (closed_ || !error_.empty()) {
+      return;
+    }
+    if (reading_) {
+      while (reading_ && framesRead_ == framesSeen && !closed_ && error_.empty()) {
+        monitor_.wait();
+      }
+      return;
+    }
+    reading_ = true;
+  }
+
+  bool more;
+  try {
+    more = processFrame();
+  } catch (TException& te) {
+    Synchronized s(monitor_);
+    reading_ = false;
+    fail(te.what());
+    throw;
+  }
+  Synchronized s(monitor_);
+  reading_ = false;
+  ++framesRead_;
+  if (!more) {
+    fail("connection closed by peer");
+  }
+  monitor_.notifyAll();
+}
+
+void THttp2Connection::handleHeaders(uint8_t flags,
+                                     int32_t streamId,
+                                     const uint8_t* payload,
+                                     uint32_t len) {
+  if (streamId == 0) {
+    corrupt("HEADERS on stream 0");
+  }
+  uint32_t begin = 0;
+  uint32_t padding = 0;
+  if (flags & PADDED) {
+    if (len < 1) {
+      corrupt("bad padding");
+    }
+    padding = payload[0];
+    begin = 1;
+  }
+  if (flags & PRIORITY_FLAG) {
+    begin += 5;
+  }
+  if (begin + padding > len) {
+    corrupt("bad padding");
+  }
+
+  headerBlock_.clear();
+  appendHeaderBlock(payload + begin, len - begin - padding);
+  headerStream_ = streamId;
+  headerEndStream_ = (flags & END_STREAM) != 0;
+  if (flags & END_HEADERS) {
+    finishHeaders();
+  } else {
+    expectContinuation_ = true;
+  }
+}
+
+void THttp2Connection::appendHeaderBlock(const uint8_t* fragment, uint32_t len) {
+  // the block is no larger than the list it decodes to, near enough
+  if (len > maxHeaderListSize_ - (std::min)(maxHeaderListSize_,
+                                            static_cast<uint32_t>(headerBlock_.size()))) {
+    corrupt("header block too large");
+  }
+  headerBlock_.append(reinterpret_cast<const char*>(fragment), len);
+}
+
+void THttp2Connection::finishHeaders() {
+  // every block goes through the decoder to keep its table in step
+  THpackHeaders headers;
+  decoder_.decode(reinterpret_cast<const uint8_t*>(headerBlock_.data()),
+                  static_cast<uint32_t>(headerBlock_.size()),
+                  headers);
+  uint64_t listSize = 0;
+  for (THpackHeaders::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+    listSize += it->first.size() + it->second.size() + 32;
+  }
+  if (listSize > maxHeaderListSize_) {
+    corrupt("header list too large");
+  }
+
+  {
+    Synchronized s(monitor_);
+    Stream* stream = findStream(headerStream_);
+    if (role_ == SERVER) {
+      if (!stream) {
+        if (headerStream_ % 2 == 0 || headerStream_ <= lastPeerStreamId_) {
+          corrupt("bad stream identifier");
+        }
+        lastPeerStreamId_ = headerStream_;
+        if (streams_.size() < maxConcurrentStreams_) {
+          stream = new Stream(peerInitialWindow_);
+          streams_[headerStream_] = stream;
+        } else {
+          // over the limit we advertised
+          pendingControl_.append(resetFrame(headerStream_, REFUSED_STREAM));
+        }
+      }
+    } else if (stream && stream->status == 0) {
+      for (THpackHeaders::const_iterator it = headers.begin(); it != headers.end(); ++it) {
+        if (it->first == ":status") {
+          stream->status = atoi(it->second.c_str());
+        }
+      }
+      if (stream->status >= 100 && stream->status < 200) {
+        // informational; the final response follows
+        stream->status = 0;
+      }
+    }
+    if (stream && headerEndStream_) {
+      finishStream(headerStream_, stream);
+    }
+  }
+  flushPendingControl();
+}
+
+void THttp2Connection::handleData(uint8_t flags,
+                                  int32_t streamId,
+                                  const uint8_t* payload,
+                                  uint32_t len) {
+  if (streamId == 0) {
+    corrupt("DATA on stream 0");
+  }
+  uint32_t begin = 0;
+  uint32_t padding = 0;
+  if (flags & PADDED) {
+    if (len < 1 || payload[0] >= len) {
+      corrupt("bad padding");
+    }
+    padding = payload[0];
+    begin = 1;
+  }
+
+  {
+    // the whole frame, padding included, counts against the windows
+    Synchronized s(monitor_);
+    connectionRecvWindow_ -= len;
+    if (connectionRecvWindow_ < 0) {
+      corrupt("connection flow control window exceeded");
+    }
+    Stream* stream = findStream(streamId);
+    if (!stream || stream->remoteClosed) {
+      // nobody is going to take these bytes
+      creditConnection(len);
+    } else {
+      stream->recvWindow -= len;
+      if (stream->recvWindow < 0) {
+        corrupt("stream flow control window exceeded");
+      }
+      stream->received += len;
+      if (stream->received > maxMessageSize_) {
+        creditConnection(len);
+        refuseStream(streamId, stream, CANCEL);
+      } else {
+        // padding is used up now, the body once it is taken
+        creditConnection(begin + padding);
+        stream->body.append(reinterpret_cast<const char*>(payload) + begin, len - begin - padding);
+        if (flags & END_STREAM) {
+          finishStream(streamId, stream);
+        } else {
+          creditStream(streamId, stream);
+        }
+      }
+    }
+  }
+  flushPendingControl();
+}
+
+void THttp2Connection::handleSettings(uint8_t flags, const uint8_t* payload, uint32_t len) {
+  if (flags & ACK) {
+    if (len != 0) {
+      corrupt("bad SETTINGS acknowledgement");
+    }
+    return;
+  }
+  if (len % 6 != 0) {
+    corrupt("bad SETTINGS");
+  }
+
+  {
+    Synchronized s(monitor_);
+    for (uint32_t i = 0; i < len; i += 6) {
+      uint16_t id = static_cast<uint16_t>((payload[i] << 8) | payload[i + 1]);
+      uint32_t value = get32(payload + i + 2);
+      switch (id) {
+      case HEADER_TABLE_SIZE:
+        peerHeaderTableSize_ = value;
+        break;
+      case MAX_CONCURRENT_STREAMS:
+        peerMaxStreams_ = value;
+        break;
+      case INITIAL_WINDOW_SIZE: {
+        if (value > MAX_WINDOW) {
+          corrupt("bad SETTINGS_INITIAL_WINDOW_SIZE");
+        }
+        int64_t delta = static_cast<int64_t>(value) - peerInitialWindow_;
+        for (std::map<int32_t, Stream*>::iterator it = streams_.begin(); it != streams_.end();
+             ++it) {
+          it->second->sendWindow += delta;
+        }
+        peerInitialWindow_ = value;
+        break;
+      }
+      case MAX_FRAME_SIZE_SETTING:
+        if (value < MAX_FRAME_SIZE || value > 0xffffff) {
+          corrupt("bad SETTINGS_MAX_FRAME_SIZE");
+        }
+        peerMaxFrameSize_ = value;
+        break;
+      default:
+        break;
+      }
+    }
+    ++windowVersion_;
+    monitor_.notifyAll();
+  }
+
+  std::string ack;
+  putFrameHeader(ack, 0, SETTINGS, ACK, 0);
+  writeControl(ack);
+}
+
+void THttp2Connection::handleWindowUpdate(int32_t streamId, const uint8_t* payload, uint32_t len) {
+  (void)len;
+  uint32_t increment = get32(payload) & 0x7fffffff;
+  if (increment == 0) {
+    corrupt("empty WINDOW_UPDATE");
+  }
+  Synchronized s(monitor_);
+  if (streamId == 0) {
+    connectionSendWindow_ += increment;
+  } else {
+    Stream* stream = findStream(streamId);
+    if (stream) {
+      stream->sendWindow += increment;
+    }
+  }
+  ++windowVersion_;
+  monitor_.notifyAll();
+}
+
+void THttp2Connection::handleReset(int32_t streamId) {
+  Synchronized s(monitor_);
+  Stream* stream = findStream(streamId);
+  if (!stream) {
+    return;
+  }
+  stream->reset = true;
+  if (!stream->remoteClosed) {
+    if (role_ == SERVER) {
+      // never handed out; forget it
+      eraseStream(streamId);
+      return;
+    }
+    finishStream(streamId, stream);
+  }
+  ++windowVersion_;
+  monitor_.notifyAll();
+}
+
+void THttp2Connection::handleGoAway(const uint8_t* payload, uint32_t len) {
+  (void)len;
+  int32_t lastStreamId = static_cast<int32_t>(get32(payload) & 0x7fffffff);
+  Synchronized s(monitor_);
+  goAway_ = true;
+  if (role_ == CLIENT) {
+    // streams after the last one the server took are never answered
+    for (std::map<int32_t, Stream*>::iterator it = streams_.upper_bound(lastStreamId);
+         it != streams_.end();) {
+      int32_t id = it->first;
+      Stream* stream = it->second;
+      ++it;
+      if (!stream->remoteClosed) {
+        stream->reset = true;
+        finishStream(id, stream);
+      }
+    }
+  }
+  monitor_.notifyAll();
+}
+
+THttp2Connection::Stream* THttp2Connection::findStream(int32_t streamId) {
+  std::map<int32_t, Stream*>::iterator it = streams_.find(streamId);
+  return it == streams_.end() ? NULL : it->second;
+}
+
+void THttp2Connection::eraseStream(int32_t streamId) {
+  std::map<int32_t, Stream*>::iterator it = streams_.find(streamId);
+  if (it != streams_.end()) {
+    // a body nobody took gives its share of the window back
+    creditConnection(static_cast<uint32_t>(it->second->body.size()));
+    delete it->second;
+    streams_.erase(it);
+  }
+}
+
+void THttp2Connection::finishStream(int32_t streamId, Stream* stream) {
+  stream->remoteClosed = true;
+  if (role_ == SERVER) {
+    ready_.push_back(streamId);
+  } else {
+    --activeStreams_;
+    if (stream->abandoned) {
+      eraseStream(streamId);
+    }
+  }
+  monitor_.notifyAll();
+}
+
+void THttp2Connection::refuseStream(int32_t streamId, Stream* stream, uint32_t error) {
+  pendingControl_.append(resetFrame(streamId, error));
+  if (role_ == SERVER) {
+    // never handed out; forget it
+    eraseStream(streamId);
+  } else {
+    stream->reset = true;
+    finishStream(streamId, stream);
+  }
+}
+
+void THttp2Connection::creditConnection(uint32_t consumed) {
+  connectionRecvUnacked_ += consumed;
+  if (connectionRecvUnacked_ >= CONNECTION_WINDOW / 2) {
+    pendingControl_.append(windowUpdateFrame(0, connectionRecvUnacked_));
+    connectionRecvWindow_ += connectionRecvUnacked_;
+    connectionRecvUnacked_ = 0;
+  }
+}
+
+void THttp2Connection::creditStream(int32_t streamId, Stream* stream) {
+  // A body is only taken whole, so the stream window is given back as the
+  // data arrives; what the stream holds is bounded by maxMessageSize_
+  // instead, beyond which it gets no more window.
+  if (stream->recvWindow > STREAM_WINDOW / 2) {
+    return;
+  }
+  int64_t streamWindow = STREAM_WINDOW;
+  int64_t left = (std::max)(static_cast<int64_t>(maxMessageSize_), streamWindow)
+                 - static_cast<int64_t>(stream->received);
+  int64_t window = (std::min)(streamWindow, left);
+  if (window > stream->recvWindow) {
+    pendingControl_.append(
+        windowUpdateFrame(streamId, static_cast<uint32_t>(window - stream->recvWindow)));
+    stream->recvWindow = window;
+  }
+}
+
+void THttp2Connection::answered(int32_t streamId) {
+  // streams handed out to be answered only go away here
+  if (findStream(streamId)) {
+    eraseStream(streamId);
+    --unanswered_;
+    monitor_.notifyAll();
+  }
+}
+
+void THttp2Connection::checkUsable() {
+  if (closed_) {
+    throw TTransportException(TTransportException::NOT_OPEN, "HTTP/2 connection closed");
+  }
+  if (!error_.empty()) {
+    throw TTransportException(TTransportException::NOT_OPEN, error_);
+  }
+}
+
+void THttp2Connection::fail(const std::string& error) {
+  if (error_.empty()) {
+    error_ = "HTTP/2 connection failed: " + error;
+  }
+  monitor_.notifyAll();
+}
+
+void THttp2Connection::appendFrame(uint8_t type,
+                                   uint8_t flags,
+                                   int32_t streamId,
+                                   const uint8_t* payload,
+                                   uint32_t len) {
+  putFrameHeader(out_, len, type, flags, streamId);
+  out_.append(reinterpret_cast<const char*>(payload), len);
+}
+
+void THttp2Connection::appendHeaders(int32_t streamId,
+                                     const THpackHeaders& headers,
+                                     bool endStream) {
+  uint32_t maxFrameSize;
+  {
+    Synchronized s(monitor_);
+    encoder_.setMaxTableSize(peerHeaderTableSize_);
+    maxFrameSize = peerMaxFrameSize_;
+  }
+  std::string block;
+  encoder_.encode(headers, block);
+
+  // HEADERS, then CONTINUATION frames if the block does not fit
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(block.data());
+  uint32_t left = static_cast<uint32_t>(block.size());
+  uint8_t type = HEADERS;
+  uint8_t flags = endStream ? END_STREAM : 0;
+  do {
+    uint32_t n = (std::min)(left, maxFrameSize);
+    left -= n;
+    appendFrame(type, flags | (left == 0 ? END_HEADERS : 0), streamId, p, n);
+    p += n;
+    type = CONTINUATION;
+    flags = 0;
+  } while (left > 0);
+}
+
+uint32_t THttp2Connection::appendData(int32_t streamId,
+                                      const uint8_t* body,
+                                      uint32_t len,
+                                      bool& done) {
+  uint32_t sent = 0;
+  done = false;
+  while (sent < len) {
+    uint32_t n;
+    {
+      Synchronized s(monitor_);
+      checkUsable();
+      Stream* stream = findStream(streamId);
+      if (!stream || stream->reset) {
+        // the peer is not interested any more
+        done = true;
+        return len;
+      }
+      int64_t window = (std::min)(connectionSendWindow_, stream->sendWindow);
+      if (window <= 0) {
+        break;
+      }
+      n = static_cast<uint32_t>((std::min)(static_cast<int64_t>(len - sent), window));
+      n = (std::min)(n, peerMaxFrameSize_);
+      connectionSendWindow_ -= n;
+      stream->sendWindow -= n;
+    }
+    appendFrame(DATA, sent + n == len ? END_STREAM : 0, streamId, body + sent, n);
+    sent += n;
+  }
+  done = sent == len;
+  return sent;
+}
+
+void THttp2Connection::writeOutLocked() {
+  {
+    Synchronized s(monitor_);
+    if (!pendingControl_.empty()) {
+      out_.append(pendingControl_);
+      pendingControl_.clear();
+    }
+  }
+  if (out_.empty()) {
+    return;
+  }
+  try {
+    transport_->write(reinterpret_cast<const uint8_t*>(out_.data()),
+                      static_cast<uint32_t>(out_.size()));
+    transport_->flush();
+  } catch (TTransportException& te) {
+    out_.clear();
+    Synchronized s(monitor_);
+    fail(te.what());
+    throw;
+  }
+  out_.clear();
+}
+
+void THttp2Connection::writeControl(const std::string& frame) {
+  {
+    Synchronized s(monitor_);
+    pendingControl_.append(frame);
+  }
+  flushPendingControl();
+}
+
+void THttp2Connection::flushPendingControl() {
+  // whoever holds writeMutex_ sends pending frames along with its own;
+  // it checks again once it lets go, in case more came in meanwhile
+  while (true) {
+    {
+      Synchronized s(monitor_);
+      if (pendingControl_.empty()) {
+        return;
+      }
+    }
+    if (!writeMutex_.trylock()) {
+      return;
+    }
+    try {
+      writeOutLocked();
+    } catch (...) {
+      writeMutex_.unlock();
+      throw;
+    }
+    writeMutex_.unlock();
+  }
+}
+
+void THttp2Connection::waitForWindow(uint64_t windowVersion) {
+  if (role_ == SERVER) {
+    // there is no reader thread; read frames until the window moves
+    uint64_t framesSeen;
+    {
+      Synchronized s(monitor_);
+      if (windowVersion_ != windowVersion) {
+        return;
+      }
+      checkUsable();
+      framesSeen = framesRead_;
+    }
+    readFrameShared(framesSeen);
+    return;
+  }
+  Synchronized s(monitor_);
+  while (windowVersion_ == windowVersion) {
+    checkUsable();
+    monitor_.wait();
+  }
+}
+
+void THttp2Connection::sendRest(int32_t streamId,
+                                const uint8_t* body,
+                                uint32_t len,
+                                uint32_t sent) {
+  flushPendingControl();
+  bool done = sent == len;
+  while (!done) {
+    uint64_t windowVersion;
+    {
+      Synchronized s(monitor_);
+      windowVersion = windowVersion_;
+    }
+    {
+      Guard g(writeMutex_);
+      sent += appendData(streamId, body + sent, len - sent, done);
+      writeOutLocked();
+    }
+    flushPendingControl();
+    if (!done) {
+      waitForWindow(windowVersion);
+    }
+  }
+}
+
+int32_t THttp2Connection::sendRequest(const std::string& authority,
+                                      const std::string& path,
+                                      const uint8_t* body,
+                                      uint32_t len) {
+  {
+    Synchronized s(monitor_);
+    while (true) {
+      checkUsable();
+      if (goAway_) {
+        throw TTransportException(TTransportException::NOT_OPEN, "HTTP/2 connection going away");
+      }
+      if (activeStreams_ < peerMaxStreams_) {
+        break;
+      }
+      monitor_.wait();
+    }
+    ++activeStreams_;
+  }
+
+  THpackHeaders headers;
+  headers.push_back(THpackHeader(":method", "POST"));
+  headers.push_back(THpackHeader(":scheme", "http"));
+  headers.push_back(THpackHeader(":authority", authority));
+  headers.push_back(THpackHeader(":path", path));
+  headers.push_back(THpackHeader("content-type", "application/x-thrift"));
+  headers.push_back(THpackHeader("accept", "application/x-thrift"));
+  headers.push_back(THpackHeader("user-agent", "Thrift/" PACKAGE_VERSION " (C++/THttp2Client)"));
+
+  int32_t streamId;
+  uint32_t sent;
+  {
+    // streams have to be opened in order, so the identifier is taken
+    // while holding writeMutex_
+    Guard g(writeMutex_);
+    {
+      Synchronized s(monitor_);
+      streamId = nextStreamId_;
+      nextStreamId_ += 2;
+      streams_[streamId] = new Stream(peerInitialWindow_);
+    }
+    char length[16];
+    sprintf(length, "%u", len);
+    headers.push_back(THpackHeader("content-length", length));
+    appendHeaders(streamId, headers, len == 0);
+    bool done;
+    sent = appendData(streamId, body, len, done);
+    writeOutLocked();
+  }
+  sendRest(streamId, body, len, sent);
+  return streamId;
+}
+
+void THttp2Connection::receiveResponse(int32_t streamId, std::string& body) {
+  bool reset;
+  int status;
+  {
+    Synchronized s(monitor_);
+    Stream* stream;
+    while (true) {
+      stream = findStream(streamId);
+      if (!stream) {
+        throw TTransportException(TTransportException::BAD_ARGS, "HTTP/2: no such stream");
+      }
+      if (stream->remoteClosed) {
+        break;
+      }
+      checkUsable();
+      monitor_.wait();
+    }
+
+    reset = stream->reset;
+    status = stream->status;
+    creditConnection(static_cast<uint32_t>(stream->body.size()));
+    body.swap(stream->body);
+    stream->body.clear();
+    eraseStream(streamId);
+  }
+  flushPendingControl();
+  if (reset) {
+    throw TTransportException(TTransportException::END_OF_FILE, "HTTP/2 stream reset by peer");
+  }
+  if (status != 200) {
+    char message[64];
+    sprintf(message, "Bad Status: %d", status);
+    throw TTransportException(message);
+  }
+}
+
+void THttp2Connection::abandonStream(int32_t streamId) {
+  {
+    Synchronized s(monitor_);
+    Stream* stream = findStream(streamId);
+    if (!stream) {
+      return;
+    }
+    if (stream->remoteClosed) {
+      eraseStream(streamId);
+    } else {
+      stream->abandoned = true;
+    }
+  }
+  flushPendingControl();
+}
+
+int32_t THttp2Connection::receiveRequest(std::string& body) {
+  open();
+  while (true) {
+    int32_t taken = 0;
+    uint64_t framesSeen;
+    {
+      Synchronized s(monitor_);
+      while (!ready_.empty() && taken == 0) {
+        int32_t streamId = ready_.front();
+        ready_.pop_front();
+        Stream* stream = findStream(streamId);
+        if (!stream || stream->reset) {
+          eraseStream(streamId);
+          continue;
+        }
+        creditConnection(static_cast<uint32_t>(stream->body.size()));
+        body.swap(stream->body);
+        stream->body.clear();
+        ++unanswered_;
+        taken = streamId;
+      }
+      if (taken == 0 && (closed_ || !error_.empty())) {
+        return 0;
+      }
+      framesSeen = framesRead_;
+    }
+    flushPendingControl();
+    if (taken != 0) {
+      return taken;
+    }
+    readFrameShared(framesSeen);
+  }
+}
+
+void THttp2Connection::resetStream(int32_t streamId) {
+  bool send;
+  {
+    Synchronized s(monitor_);
+    Stream* stream = findStream(streamId);
+    send = stream && !stream->reset;
+    answered(streamId);
+  }
+  if (send) {
+    writeControl(resetFrame(streamId, INTERNAL_ERROR));
+  }
+}
+
+void THttp2Connection::waitForAnswers() {
+  Synchronized s(monitor_);
+  while (unanswered_ > 0) {
+    monitor_.wait();
+  }
+}
+
+void THttp2Connection::sendResponse(int32_t streamId, const uint8_t* body, uint32_t len) {
+  try {
+    writeResponse(streamId, body, len);
+  } catch (...) {
+    Synchronized s(monitor_);
+    answered(streamId);
+    throw;
+  }
+  {
+    Synchronized s(monitor_);
+    answered(streamId);
+  }
+  flushPendingControl();
+}
+
+void THttp2Connection::writeResponse(int32_t streamId, const uint8_t* body, uint32_t len) {
+  THpackHeaders headers;
+  headers.push_back(THpackHeader(":status", "200"));
+  headers.push_back(THpackHeader("content-type", "application/x-thrift"));
+  char length[16];
+  sprintf(length, "%u", len);
+  headers.push_back(THpackHeader("content-length", length));
+
+  uint32_t sent;
+  {
+    Guard g(writeMutex_);
+    {
+      Synchronized s(monitor_);
+      Stream* stream = findStream(streamId);
+      if (!stream || stream->reset) {
+        return;
+      }
+    }
+    appendHeaders(streamId, headers, len == 0);
+    bool done;
+    sent = appendData(streamId, body, len, done);
+    writeOutLocked();
+  }
+  sendRest(streamId, body, len, sent);
+}
+
+THttp2Client::THttp2Client(shared_ptr<THttp2Connection> connection,
+                           const std::string& host,
+                           const std::string& path)
+  : connection_(connection), ownConnection_(false), host_(host), path_(path), stream_(0) {
+}
+
+THttp2Client::THttp2Client(const std::string& host, int port, const std::string& path)
+  : connection_(new THttp2Connection(shared_ptr<TTransport>(new TSocket(host, port)),
+                                     THttp2Connection::CLIENT)),
+    ownConnection_(true),
+    host_(host),
+    path_(path),
+    stream_(0) {
+}
+
+THttp2Client::~THttp2Client() {
+  try {
+    close();
+  } catch (...) {
+    // nothing to do
+  }
+}
+
+void THttp2Client::close() {
+  if (stream_) {
+    connection_->abandonStream(stream_);
+    stream_ = 0;
+  }
+  if (ownConnection_) {
+    connection_->close();
+  }
+}
+
+uint32_t THttp2Client::read(uint8_t* buf, uint32_t len) {
+  if (readBuffer_.available_read() == 0) {
+    if (stream_ == 0) {
+      return 0;
+    }
+    int32_t stream = stream_;
+    stream_ = 0;
+    connection_->receiveResponse(stream, body_);
+    readBuffer_.resetBuffer(reinterpret_cast<uint8_t*>(&body_[0]),
+                            static_cast<uint32_t>(body_.size()),
+                            TMemoryBuffer::OBSERVE);
+  }
+  return readBuffer_.read(buf, len);
+}
+
+void THttp2Client::flush() {
+  uint8_t* buf;
+  uint32_t len;
+  writeBuffer_.getBuffer(&buf, &len);
+
+  // the response to a oneway call never gets read
+  if (stream_) {
+    connection_->abandonStream(stream_);
+    stream_ = 0;
+  }
+  readBuffer_.resetBuffer();
+  try {
+    stream_ = connection_->sendRequest(host_, path_, buf, len);
+  } catch (...) {
+    writeBuffer_.resetBuffer();
+    throw;
+  }
+  writeBuffer_.resetBuffer();
+}
+
+THttp2Server::THttp2Server(shared_ptr<TTransport> transport)
+  : connection_(new THttp2Connection(transport, THttp2Connection::SERVER)),
+    stream_(0),
+    answered_(true) {
+}
+
+THttp2Server::~THttp2Server() {
+}
+
+bool THttp2Server::nextRequest() {
+  // a oneway call gets an empty response, which closes its stream
+  if (!answered_) {
+    answered_ = true;
+    connection_->sendResponse(stream_, NULL, 0);
+  }
+  stream_ = connection_->receiveRequest(body_);
+  if (stream_ == 0) {
+    return false;
+  }
+  answered_ = false;
+  readBuffer_.resetBuffer(reinterpret_cast<uint8_t*>(&body_[0]),
+                          static_cast<uint32_t>(body_.size()),
+                          TMemoryBuffer::OBSERVE);
+  return true;
+}
+
+bool THttp2Server::peek() {
+  return readBuffer_.available_read() > 0 || nextRequest();
+}
+
+uint32_t THttp2Server::read(uint8_t* buf, uint32_t len) {
+  if (readBuffer_.available_read() == 0 && !nextRequest()) {
+    return 0;
+  }
+  return readBuffer_.read(buf, len);
+}
+
+void THttp2Server::flush() {
+  uint8_t* buf;
+  uint32_t len;
+  writeBuffer_.getBuffer(&buf, &len);
+  if (!answered_) {
+    answered_ = true;
+    try {
+      connection_->sendResponse(stream_, buf, len);
+    } catch (...) {
+      writeBuffer_.resetBuffer();
+      throw;
+    }
+  }
+  writeBuffer_.resetBuffer();
+}
+
+shared_ptr<TProtocol> THttp2ServerProtocolFactory::getProtocol(shared_ptr<TTransport> trans) {
+  shared_ptr<THttp2Server> server(new THttp2Server(trans));
+  server->getConnection()->setMaxConcurrentStreams(maxConcurrentStreams_);
+  server->getConnection()->setMaxHeaderListSize(maxHeaderListSize_);
+  server->getConnection()->setMaxMessageSize(maxMessageSize_);
+  return protocolFactory_->getProtocol(server);
+}
+
+shared_ptr<TProtocol> THttp2ServerProtocolFactory::getProtocol(shared_ptr<TTransport> inTrans,
+                                                               shared_ptr<TTransport> outTrans) {
+  if (inTrans != outTrans) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "THttp2ServerProtocolFactory: input and output must be the same "
+                              "transport");
+  }
+  return getProtocol(inTrans);
+}
+}
+}
+} // apache::thrift::transport
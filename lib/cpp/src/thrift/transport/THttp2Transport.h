@@ -0,0 +1,391 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_THTTP2TRANSPORT_H_
+#define _THRIFT_TRANSPORT_THTTP2TRANSPORT_H_ 1
+
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/Thread.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THpack.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+#include <deque>
+#include <map>
+#include <string>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * One HTTP/2 connection (RFC 7540, cleartext with prior knowledge) over a
+ * transport such as a TSocket.  Each Thrift call is a stream: a POST whose
+ * body is the serialized request, answered by a 200 whose body is the
+ * response.  Headers are compressed with HPACK.
+ *
+ * On the client side, any number of THttp2Client transports, used from
+ * different threads, can share a connection; their calls are in flight at
+ * the same time and a background thread hands each response to the
+ * client waiting for it.  On the server side, THttp2Server reads the
+ * connection from the serving thread, and THttp2ConcurrentProcessor lets
+ * it run the calls of several streams at once.
+ *
+ * What the peer may send is bounded: the number of streams it may have
+ * open and the size of a header list are advertised in our SETTINGS, and
+ * a stream whose body grows past the maximum message size is reset.  The
+ * connection window is given back only as bodies are taken, so the bytes
+ * a connection holds stay within CONNECTION_WINDOW.
+ *
+ * The underlying transport must not have a receive timeout, since a
+ * timeout in the middle of a frame cannot be recovered from.
+ */
+class THttp2Connection {
+public:
+  enum Role { CLIENT, SERVER };
+
+  THttp2Connection(stdcxx::shared_ptr<TTransport> transport, Role role);
+  ~THttp2Connection();
+
+  /**
+   * Opens the transport if needed and exchanges the connection preface and
+   * settings.  Does nothing if the connection is already open.
+   */
+  void open();
+  bool isOpen();
+  void close();
+
+  /**
+   * Starts a POST to path with body on a new stream and returns the
+   * stream, once the part of the body that flow control allows has been
+   * sent.
+   */
+  int32_t sendRequest(const std::string& authority,
+                      const std::string& path,
+                      const uint8_t* body,
+                      uint32_t len);
+
+  /** Waits for the response on stream and returns its body. */
+  void receiveResponse(int32_t stream, std::string& body);
+
+  /** Drops the response to stream, whenever it arrives. */
+  void abandonStream(int32_t stream);
+
+  /**
+   * Server side: waits for the next complete request and returns its
+   * stream, or 0 when the client has closed the connection.
+   */
+  int32_t receiveRequest(std::string& body);
+
+  /** Server side: answers stream with a 200 and body. */
+  void sendResponse(int32_t stream, const uint8_t* body, uint32_t len);
+
+  /** Server side: resets stream instead of answering it, after a failed call. */
+  void resetStream(int32_t stream);
+
+  /**
+   * Server side: waits until every request that receiveRequest() handed
+   * out has been answered or reset.
+   */
+  void waitForAnswers();
+
+  /**
+   * Streams the peer may have open at once; more are refused.  Applies to
+   * the server side, and is to be set before open().
+   */
+  void setMaxConcurrentStreams(uint32_t maxConcurrentStreams) {
+    maxConcurrentStreams_ = maxConcurrentStreams;
+  }
+  uint32_t getMaxConcurrentStreams() const { return maxConcurrentStreams_; }
+
+  /**
+   * Largest header list, as RFC 7540 counts its size, that the peer may
+   * send; a larger one fails the connection.  To be set before open().
+   */
+  void setMaxHeaderListSize(uint32_t maxHeaderListSize) { maxHeaderListSize_ = maxHeaderListSize; }
+  uint32_t getMaxHeaderListSize() const { return maxHeaderListSize_; }
+
+  /**
+   * Largest body the peer may send on a stream; a stream that sends more
+   * is reset.  Bodies are only taken whole, so keep the open streams times
+   * this within CONNECTION_WINDOW, or streams that are all part way through
+   * can use up the connection window between them.
+   */
+  void setMaxMessageSize(uint32_t maxMessageSize) { maxMessageSize_ = maxMessageSize; }
+  uint32_t getMaxMessageSize() const { return maxMessageSize_; }
+
+  /** Window advertised for each stream and for the connection. */
+  static const uint32_t STREAM_WINDOW = 16 * 1024 * 1024;
+  static const uint32_t CONNECTION_WINDOW = 256 * 1024 * 1024;
+
+  static const uint32_t DEFAULT_MAX_CONCURRENT_STREAMS = 16;
+  static const uint32_t DEFAULT_MAX_HEADER_LIST_SIZE = 16 * 1024;
+  static const uint32_t DEFAULT_MAX_MESSAGE_SIZE = STREAM_WINDOW;
+
+private:
+  struct Stream {
+    explicit Stream(int64_t window)
+      : sendWindow(window),
+        recvWindow(STREAM_WINDOW),
+        received(0),
+        status(0),
+        remoteClosed(false),
+        reset(false),
+        abandoned(false) {}
+    std::string body;
+    int64_t sendWindow;
+    int64_t recvWindow;
+    uint64_t received;
+    int status;
+    bool remoteClosed;
+    bool reset;
+    bool abandoned;
+  };
+
+  void readerLoop();
+
+  // reading side
+  bool processFrame();
+  void readFrameShared(uint64_t framesSeen);
+  void handleHeaders(uint8_t flags, int32_t streamId, const uint8_t* payload, uint32_t len);
+  void appendHeaderBlock(const uint8_t* fragment, uint32_t len);
+  void finishHeaders();
+  void handleData(uint8_t flags, int32_t streamId, const uint8_t* payload, uint32_t len);
+  void handleSettings(uint8_t flags, const uint8_t* payload, uint32_t len);
+  void handleWindowUpdate(int32_t streamId, const uint8_t* payload, uint32_t len);
+  void handleReset(int32_t streamId);
+  void handleGoAway(const uint8_t* payload, uint32_t len);
+
+  // writing side; the Locked functions require writeMutex_
+  void appendFrame(uint8_t type, uint8_t flags, int32_t streamId, const uint8_t* payload,
+                   uint32_t len);
+  void appendHeaders(int32_t streamId, const THpackHeaders& headers, bool endStream);
+  uint32_t appendData(int32_t streamId, const uint8_t* body, uint32_t len, bool& done);
+  void writeOutLocked();
+  void sendRest(int32_t streamId, const uint8_t* body, uint32_t len, uint32_t sent);
+  void writeResponse(int32_t streamId, const uint8_t* body, uint32_t len);
+  void writeControl(const std::string& frame);
+  void flushPendingControl();
+  void waitForWindow(uint64_t windowVersion);
+
+  // require monitor_
+  Stream* findStream(int32_t streamId);
+  void eraseStream(int32_t streamId);
+  void finishStream(int32_t streamId, Stream* stream);
+  void refuseStream(int32_t streamId, Stream* stream, uint32_t error);
+  void creditConnection(uint32_t consumed);
+  void creditStream(int32_t streamId, Stream* stream);
+  void answered(int32_t streamId);
+  void checkUsable();
+  void fail(const std::string& error);
+
+  stdcxx::shared_ptr<TTransport> transport_;
+  stdcxx::shared_ptr<TBufferedTransport> input_;
+  Role role_;
+
+  // limits on the peer, set before open()
+  uint32_t maxConcurrentStreams_;
+  uint32_t maxHeaderListSize_;
+  uint32_t maxMessageSize_;
+
+  apache::thrift::concurrency::PlatformThreadFactory threadFactory_;
+  stdcxx::shared_ptr<apache::thrift::concurrency::Thread> readerThread_;
+
+  // used by the reading thread only; on the server side, by whichever
+  // thread holds reading_
+  THpackDecoder decoder_;
+  std::string frame_;
+  std::string headerBlock_;
+  int32_t headerStream_;
+  bool headerEndStream_;
+  bool expectContinuation_;
+
+  // Mutex held to write to the transport; frames are gathered in out_
+  apache::thrift::concurrency::Mutex writeMutex_;
+  // begin writeMutex_ protected members
+  THpackEncoder encoder_;
+  std::string out_;
+  bool opened_;
+  // end writeMutex_ protected members
+
+  apache::thrift::concurrency::Monitor monitor_;
+  // begin monitor_ protected members
+  std::map<int32_t, Stream*> streams_;
+  std::deque<int32_t> ready_;
+  std::string pendingControl_;
+  int64_t connectionSendWindow_;
+  int64_t connectionRecvWindow_;
+  uint32_t connectionRecvUnacked_;
+  uint64_t windowVersion_;
+  uint32_t peerInitialWindow_;
+  uint32_t peerMaxFrameSize_;
+  uint32_t peerMaxStreams_;
+  uint32_t peerHeaderTableSize_;
+  uint32_t activeStreams_;
+  int32_t nextStreamId_;
+  int32_t lastPeerStreamId_;
+  uint32_t unanswered_;
+  uint64_t framesRead_;
+  bool reading_;
+  bool goAway_;
+  bool closed_;
+  std::string error_;
+  // end monitor_ protected members
+};
+
+/**
+ * Client transport for one Thrift client on an HTTP/2 connection.  Every
+ * flush() sends the buffered request on a new stream; reads wait for its
+ * response.  Clients that share a connection make calls concurrently.
+ */
+class THttp2Client : public TVirtualTransport<THttp2Client> {
+public:
+  THttp2Client(stdcxx::shared_ptr<THttp2Connection> connection,
+               const std::string& host,
+               const std::string& path);
+
+  /** Opens a connection of its own to host:port. */
+  THttp2Client(const std::string& host, int port, const std::string& path);
+
+  virtual ~THttp2Client();
+
+  void open() { connection_->open(); }
+  bool isOpen() { return connection_->isOpen(); }
+  void close();
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len) { return readBuffer_.borrow(buf, len); }
+  void consume(uint32_t len) { readBuffer_.consume(len); }
+  void write(const uint8_t* buf, uint32_t len) { writeBuffer_.write(buf, len); }
+  void flush();
+
+private:
+  stdcxx::shared_ptr<THttp2Connection> connection_;
+  bool ownConnection_;
+  std::string host_;
+  std::string path_;
+  int32_t stream_;
+  std::string body_;
+  TMemoryBuffer readBuffer_;
+  TMemoryBuffer writeBuffer_;
+};
+
+/**
+ * Server transport for an HTTP/2 connection accepted by a server such as
+ * TThreadedServer, made by THttp2ServerProtocolFactory.  Requests are read
+ * in the order they complete and answered one at a time, while the client
+ * may have many streams open, unless the server's processor is a
+ * THttp2ConcurrentProcessor.
+ */
+class THttp2Server : public TVirtualTransport<THttp2Server> {
+public:
+  explicit THttp2Server(stdcxx::shared_ptr<TTransport> transport);
+  virtual ~THttp2Server();
+
+  void open() {}
+  bool isOpen() { return connection_->isOpen(); }
+  bool peek();
+  void close() { connection_->close(); }
+
+  stdcxx::shared_ptr<THttp2Connection> getConnection() { return connection_; }
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len) { return readBuffer_.borrow(buf, len); }
+  void consume(uint32_t len) { readBuffer_.consume(len); }
+  void write(const uint8_t* buf, uint32_t len) { writeBuffer_.write(buf, len); }
+  void flush();
+
+private:
+  bool nextRequest();
+
+  stdcxx::shared_ptr<THttp2Connection> connection_;
+  int32_t stream_;
+  bool answered_;
+  std::string body_;
+  TMemoryBuffer readBuffer_;
+  TMemoryBuffer writeBuffer_;
+};
+
+/**
+ * Makes the protocols a server uses on each connection it accepts, over a
+ * THttp2Server of the connection's own:
+ *
+ *   TThreadedServer server(processor, serverSocket,
+ *                          stdcxx::make_shared<TTransportFactory>(),
+ *                          stdcxx::make_shared<THttp2ServerProtocolFactory>(
+ *                              stdcxx::make_shared<TBinaryProtocolFactory>()));
+ *   // one protocol for input and output, as with THeaderProtocol
+ *   server.setOutputProtocolFactory(stdcxx::shared_ptr<TProtocolFactory>());
+ *
+ * Input and output are the same HTTP/2 connection, so the server has to ask
+ * for both protocols in one getProtocol(in, out) call, as the servers built
+ * on TServerFramework (TSimpleServer, TThreadedServer, TThreadPoolServer) do
+ * once their output protocol factory is cleared.  The transport factory must
+ * leave the accepted transport as it is.
+ *
+ * Only those blocking servers can serve HTTP/2.  TNonblockingServer reads
+ * its own framing off the socket, and TEvhttpServer speaks HTTP/1.1
+ * through libevent; neither hands the connection over to a transport.
+ */
+class THttp2ServerProtocolFactory : public protocol::TProtocolFactory {
+public:
+  /**
+   * @param protocolFactory protocol the request and response bodies are
+   *                        serialized with
+   */
+  explicit THttp2ServerProtocolFactory(
+      stdcxx::shared_ptr<protocol::TProtocolFactory> protocolFactory)
+    : protocolFactory_(protocolFactory),
+      maxConcurrentStreams_(THttp2Connection::DEFAULT_MAX_CONCURRENT_STREAMS),
+      maxHeaderListSize_(THttp2Connection::DEFAULT_MAX_HEADER_LIST_SIZE),
+      maxMessageSize_(THttp2Connection::DEFAULT_MAX_MESSAGE_SIZE) {}
+  virtual ~THttp2ServerProtocolFactory() {}
+
+  /** Limits for the connections made from now on; see THttp2Connection. */
+  void setMaxConcurrentStreams(uint32_t maxConcurrentStreams) {
+    maxConcurrentStreams_ = maxConcurrentStreams;
+  }
+  void setMaxHeaderListSize(uint32_t maxHeaderListSize) { maxHeaderListSize_ = maxHeaderListSize; }
+  void setMaxMessageSize(uint32_t maxMessageSize) { maxMessageSize_ = maxMessageSize; }
+
+  /** A protocol that reads and answers the requests of trans. */
+  virtual stdcxx::shared_ptr<protocol::TProtocol> getProtocol(stdcxx::shared_ptr<TTransport> trans);
+
+  /**
+   * The same, for servers that pass the input and output transports of a
+   * connection separately; they have to be the same transport.
+   */
+  virtual stdcxx::shared_ptr<protocol::TProtocol> getProtocol(
+      stdcxx::shared_ptr<TTransport> inTrans,
+      stdcxx::shared_ptr<TTransport> outTrans);
+
+private:
+  stdcxx::shared_ptr<protocol::TProtocolFactory> protocolFactory_;
+  uint32_t maxConcurrentStreams_;
+  uint32_t maxHeaderListSize_;
+  uint32_t maxMessageSize_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // _THRIFT_TRANSPORT_THTTP2TRANSPORT_H_
@@ -60,7 +60,7 @@ void THttpClient::parseHeader(char* header) {
     }
   } else if (boost::istarts_with(header, "Content-Length")) {
     chunked_ = false;
-    contentLength_ = atoi(value);
+    contentLength_ = parseContentLength(value);
   }
 }
 
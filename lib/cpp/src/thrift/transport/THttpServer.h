@@ -22,6 +22,8 @@
 
 #include <thrift/transport/THttpTransport.h>
 
+#include <ctime>
+
 namespace apache {
 namespace thrift {
 namespace transport {
@@ -39,6 +41,16 @@ protected:
   virtual void parseHeader(char* header);
   virtual bool parseStatusLine(char* status);
   std::string getTimeRFC1123();
+
+private:
+  const std::string& getCachedTimeRFC1123();
+
+  // Date header of the responses sent in the current second
+  time_t dateTime_;
+  std::string date_;
+
+  // reused to build each response
+  std::string response_;
 };
 
 /**
@@ -17,6 +17,8 @@
  * under the License.
  */
 
+#include <algorithm>
+#include <limits>
 #include <sstream>
 
 #include <thrift/transport/THttpTransport.h>
@@ -30,6 +32,7 @@ namespace transport {
 // Yeah, yeah, hacky to put these here, I know.
 const char* THttpTransport::CRLF = "\r\n";
 const int THttpTransport::CRLF_LEN = 2;
+const uint32_t THttpTransport::CONTENT_READ_SIZE = 64 * 1024;
 
 THttpTransport::THttpTransport(stdcxx::shared_ptr<TTransport> transport)
   : transport_(transport),
@@ -39,6 +42,7 @@ THttpTransport::THttpTransport(stdcxx::shared_ptr<TTransport> transport)
     chunkedDone_(false),
     chunkSize_(0),
     contentLength_(0),
+    maxMessageSize_(DEFAULT_MAX_MESSAGE_SIZE),
     httpBuf_(NULL),
     httpPos_(0),
     httpBufLen_(0),
@@ -85,7 +89,9 @@ uint32_t THttpTransport::readMoreData() {
   uint32_t size;
 
   if (httpPos_ == httpBufLen_) {
-    // Get more data!
+    // Get more data, from the head of the buffer so that it never grows
+    // for a line that would have fit
+    shift();
     refill();
   }
 
@@ -123,7 +129,7 @@ void THttpTransport::readChunkedFooters() {
   // End of data, read footer lines until a blank one appears
   while (true) {
     char* line = readLine();
-    if (strlen(line) == 0) {
+    if (*line == '\0') {
       chunkedDone_ = true;
       break;
     }
@@ -131,55 +137,99 @@ void THttpTransport::readChunkedFooters() {
 }
 
 uint32_t THttpTransport::parseChunkSize(char* line) {
-  char* semi = strchr(line, ';');
-  if (semi != NULL) {
-    *semi = '\0';
-  }
+  // hex digits, up to a chunk extension (;) or the end of the line
   uint32_t size = 0;
-  sscanf(line, "%x", &size);
+  for (const char* p = line;; ++p) {
+    uint32_t digit;
+    if (*p >= '0' && *p <= '9') {
+      digit = *p - '0';
+    } else if (*p >= 'a' && *p <= 'f') {
+      digit = *p - 'a' + 10;
+    } else if (*p >= 'A' && *p <= 'F') {
+      digit = *p - 'A' + 10;
+    } else {
+      break;
+    }
+    if (size > ((std::numeric_limits<uint32_t>::max)() >> 4)) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Chunk size too large");
+    }
+    size = (size << 4) | digit;
+  }
+  if (size > maxMessageSize_) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Chunk size exceeds the maximum message size");
+  }
   return size;
 }
 
+uint32_t THttpTransport::parseContentLength(const char* value) {
+  // decimal digits only, so a sign or garbage is an error rather than
+  // whatever atoi() would have made of it
+  while (*value == ' ' || *value == '\t') {
+    ++value;
+  }
+  const char* p = value;
+  uint64_t length = 0;
+  for (; *p >= '0' && *p <= '9'; ++p) {
+    length = length * 10 + (*p - '0');
+    if (length > maxMessageSize_) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Content-Length exceeds the maximum message size");
+    }
+  }
+  while (*p == ' ' || *p == '\t') {
+    ++p;
+  }
+  if (p == value || *p != '\0') {
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Bad Content-Length");
+  }
+  return static_cast<uint32_t>(length);
+}
+
 uint32_t THttpTransport::readContent(uint32_t size) {
-  uint32_t need = size;
+  // Hand over whatever arrived along with the headers
+  uint32_t give = httpBufLen_ - httpPos_;
+  if (size < give) {
+    give = size;
+  }
+  readBuffer_.write((uint8_t*)(httpBuf_ + httpPos_), give);
+  httpPos_ += give;
+
+  // and read the rest straight into the buffer the protocol reads from,
+  // rather than through httpBuf_.  Reading no further than the content
+  // leaves a pipelined request on the transport.  The buffer grows a piece
+  // at a time, so a large length costs memory only as the bytes arrive.
+  uint32_t need = size - give;
   while (need > 0) {
-    uint32_t avail = httpBufLen_ - httpPos_;
-    if (avail == 0) {
-      // We have given all the data, reset position to head of the buffer
-      httpPos_ = 0;
-      httpBufLen_ = 0;
-      refill();
-
-      // Now have available however much we read
-      avail = httpBufLen_;
-    }
-    uint32_t give = avail;
-    if (need < give) {
-      give = need;
-    }
-    readBuffer_.write((uint8_t*)(httpBuf_ + httpPos_), give);
-    httpPos_ += give;
-    need -= give;
+    uint32_t piece = (std::min)(need, CONTENT_READ_SIZE);
+    transport_->readAll(readBuffer_.getWritePtr(piece), piece);
+    readBuffer_.wroteBytes(piece);
+    need -= piece;
   }
   return size;
 }
 
 char* THttpTransport::readLine() {
+  // bytes after httpPos_ already known not to hold the end of the line
+  uint32_t scanned = 0;
   while (true) {
-    char* eol = NULL;
-
-    eol = strstr(httpBuf_ + httpPos_, CRLF);
+    char* eol = static_cast<char*>(
+        memchr(httpBuf_ + httpPos_ + scanned, '\n', httpBufLen_ - httpPos_ - scanned));
 
-    // No CRLF yet?
+    // No end of line yet?
     if (eol == NULL) {
       // Shift whatever we have now to front and refill
+      scanned = httpBufLen_ - httpPos_;
       shift();
       refill();
     } else {
-      // Return pointer to next line
-      *eol = '\0';
+      // Return pointer to next line, without its CRLF (or bare LF)
       char* line = httpBuf_ + httpPos_;
-      httpPos_ = static_cast<uint32_t>((eol - httpBuf_) + CRLF_LEN);
+      httpPos_ = static_cast<uint32_t>((eol - httpBuf_) + 1);
+      if (eol > line && *(eol - 1) == '\r') {
+        --eol;
+      }
+      *eol = '\0';
       return line;
     }
   }
@@ -233,7 +283,7 @@ void THttpTransport::readHeaders() {
   while (true) {
     char* line = readLine();
 
-    if (strlen(line) == 0) {
+    if (*line == '\0') {
       if (finished) {
         readHeaders_ = false;
         return;
@@ -58,6 +58,16 @@ public:
 
   virtual const std::string getOrigin();
 
+  /**
+   * Largest Content-Length or chunk size accepted from the peer. A larger
+   * value fails the read with CORRUPTED_DATA before any of the body is read.
+   */
+  void setMaxMessageSize(uint32_t maxMessageSize) { maxMessageSize_ = maxMessageSize; }
+
+  uint32_t getMaxMessageSize() const { return maxMessageSize_; }
+
+  static const uint32_t DEFAULT_MAX_MESSAGE_SIZE = 256 * 1024 * 1024;
+
 protected:
   stdcxx::shared_ptr<TTransport> transport_;
   std::string origin_;
@@ -70,6 +80,7 @@ protected:
   bool chunkedDone_;
   uint32_t chunkSize_;
   uint32_t contentLength_;
+  uint32_t maxMessageSize_;
 
   char* httpBuf_;
   uint32_t httpPos_;
@@ -88,6 +99,7 @@ protected:
   uint32_t readChunked();
   void readChunkedFooters();
   uint32_t parseChunkSize(char* line);
+  uint32_t parseContentLength(const char* value);
 
   uint32_t readContent(uint32_t size);
 
@@ -96,6 +108,7 @@ protected:
 
   static const char* CRLF;
   static const int CRLF_LEN;
+  static const uint32_t CONTENT_READ_SIZE;
 };
 }
 }
@@ -0,0 +1,383 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/transport/TMappedFileTransport.h>
+#include <thrift/transport/TCrc32c.h>
+#include <thrift/transport/PlatformSocket.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+namespace {
+
+struct EntryOffsetLess {
+  bool operator()(uint64_t offset, const TFileIndexEntry& entry) const {
+    return offset < entry.offset;
+  }
+};
+
+struct EntryTimeLess {
+  bool operator()(int64_t timeUs, const TFileIndexEntry& entry) const {
+    return timeUs < entry.timeUs;
+  }
+};
+}
+
+TMappedFileTransport::TMappedFileTransport(const std::string& path)
+  : path_(path),
+    fd_(-1),
+    map_(NULL),
+    mapSize_(0),
+    chunkSize_(DEFAULT_CHUNK_SIZE),
+    readTimeout_(TFileTransport::NO_TAIL_READ_TIMEOUT),
+    eofSleepTime_(DEFAULT_EOF_SLEEP_TIME_US),
+    maxEventSize_(DEFAULT_MAX_EVENT_SIZE),
+    next_(0),
+    event_(0),
+    eventPos_(0),
+    eventEnd_(0) {
+  fd_ = ::THRIFT_OPEN(path_.c_str(), O_RDONLY);
+  if (fd_ == -1) {
+    int errno_copy = THRIFT_ERRNO;
+    GlobalOutput.perror("TMappedFileTransport: open() file: " + path_, errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, path_, errno_copy);
+  }
+  try {
+    remap();
+  } catch (...) {
+    ::THRIFT_CLOSE(fd_);
+    throw;
+  }
+}
+
+TMappedFileTransport::~TMappedFileTransport() {
+  if (map_) {
+    munmap(map_, mapSize_);
+  }
+  ::THRIFT_CLOSE(fd_);
+}
+
+bool TMappedFileTransport::remap() {
+  struct THRIFT_STAT st;
+  if (::THRIFT_FSTAT(fd_, &st) == -1) {
+    int errno_copy = THRIFT_ERRNO;
+    throw TTransportException(TTransportException::UNKNOWN,
+                              "TMappedFileTransport: fstat() failed",
+                              errno_copy);
+  }
+  uint64_t size = static_cast<uint64_t>(st.st_size);
+  if (size <= mapSize_) {
+    return false;
+  }
+
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (map == MAP_FAILED) {
+    int errno_copy = THRIFT_ERRNO;
+    throw TTransportException(TTransportException::UNKNOWN,
+                              "TMappedFileTransport: mmap() failed",
+                              errno_copy);
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise(map, size, MADV_SEQUENTIAL);
+#endif
+  if (map_) {
+    munmap(map_, mapSize_);
+  }
+  map_ = static_cast<uint8_t*>(map);
+  mapSize_ = size;
+  return true;
+}
+
+bool TMappedFileTransport::parseEvent(uint64_t& pos, uint32_t& header, uint32_t& size) {
+  while (pos + 4 <= mapSize_) {
+    uint64_t chunkEnd = (pos / chunkSize_ + 1) * chunkSize_;
+    if (pos + 4 > chunkEnd) {
+      // an event size never straddles a chunk boundary
+      pos = chunkEnd;
+      continue;
+    }
+
+    memcpy(&size, map_ + pos, 4);
+    if (size == 0) {
+      // padding runs up to the end of the chunk
+      pos = chunkEnd;
+      continue;
+    }
+    header = 4;
+    if (size & TFileTransport::CHECKSUMMED_EVENT) {
+      header = 8;
+      size &= ~TFileTransport::CHECKSUMMED_EVENT;
+    }
+    if (size > chunkSize_ - header || pos + header + size > chunkEnd
+        || (maxEventSize_ > 0 && size > maxEventSize_)) {
+      T_ERROR("TMappedFileTransport: corrupt event at offset %lu", static_cast<unsigned long>(pos));
+      pos = resync(pos, chunkEnd);
+      continue;
+    }
+    // an event at the end of the file may still be in the middle of being written
+    if (pos + header + size > mapSize_) {
+      return false;
+    }
+    if (header == 8) {
+      uint32_t crc;
+      memcpy(&crc, map_ + pos + 4, 4);
+      if (crc32c(map_ + pos + 8, size) != crc) {
+        T_ERROR("TMappedFileTransport: checksum mismatch at offset %lu",
+                static_cast<unsigned long>(pos));
+        pos = resync(pos, chunkEnd);
+        continue;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+uint64_t TMappedFileTransport::resync(uint64_t pos, uint64_t chunkEnd) {
+  // only a checksummed event can be told apart from garbage; without one
+  // the rest of the chunk is skipped.  Sizes no event can have are ruled
+  // out before paying for a checksum.
+  uint64_t end = std::min(chunkEnd, mapSize_);
+  for (uint64_t i = pos + 1; i + 8 <= end; ++i) {
+    uint32_t size, crc;
+    memcpy(&size, map_ + i, 4);
+    if (!(size & TFileTransport::CHECKSUMMED_EVENT)) {
+      continue;
+    }
+    size &= ~TFileTransport::CHECKSUMMED_EVENT;
+    if (size == 0 || (maxEventSize_ > 0 && size > maxEventSize_) || size > end - i - 8) {
+      continue;
+    }
+    memcpy(&crc, map_ + i + 4, 4);
+    if (crc32c(map_ + i + 8, size) == crc) {
+      return i;
+    }
+  }
+  return chunkEnd;
+}
+
+bool TMappedFileTransport::advance() {
+  int readTries = 0;
+  while (true) {
+    uint32_t header, size;
+    if (parseEvent(next_, header, size)) {
+      event_ = next_;
+      eventPos_ = event_ + header;
+      eventEnd_ = eventPos_ + size;
+      next_ = eventEnd_;
+      return true;
+    }
+
+    if (remap()) {
+      continue;
+    }
+    if (readTimeout_ == TFileTransport::TAIL_READ_TIMEOUT) {
+      THRIFT_SLEEP_USEC(eofSleepTime_);
+      continue;
+    }
+    if (readTimeout_ > 0 && readTries++ == 0) {
+      THRIFT_SLEEP_USEC(readTimeout_ * 1000);
+      continue;
+    }
+    return false;
+  }
+}
+
+bool TMappedFileTransport::peek() {
+  return eventPos_ < eventEnd_ || advance();
+}
+
+uint32_t TMappedFileTransport::read(uint8_t* buf, uint32_t len) {
+  if (eventPos_ == eventEnd_ && !advance()) {
+    return 0;
+  }
+  uint32_t give = static_cast<uint32_t>(std::min<uint64_t>(len, eventEnd_ - eventPos_));
+  memcpy(buf, map_ + eventPos_, give);
+  eventPos_ += give;
+  return give;
+}
+
+uint32_t TMappedFileTransport::readAll(uint8_t* buf, uint32_t len) {
+  uint32_t have = 0;
+  while (have < len) {
+    uint32_t get = read(buf + have, len - have);
+    if (get == 0) {
+      throw TEOFException();
+    }
+    have += get;
+  }
+  return have;
+}
+
+const uint8_t* TMappedFileTransport::borrow(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  uint64_t remaining = eventEnd_ - eventPos_;
+  if (remaining == 0 || remaining < *len) {
+    return NULL;
+  }
+  *len = static_cast<uint32_t>(remaining);
+  return map_ + eventPos_;
+}
+
+void TMappedFileTransport::consume(uint32_t len) {
+  if (len > eventEnd_ - eventPos_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "consume did not follow a borrow.");
+  }
+  eventPos_ += len;
+}
+
+bool TMappedFileTransport::nextEvent(const uint8_t*& data, uint32_t& size) {
+  eventPos_ = eventEnd_;
+  if (!advance()) {
+    return false;
+  }
+  data = map_ + eventPos_;
+  size = static_cast<uint32_t>(eventEnd_ - eventPos_);
+  eventPos_ = eventEnd_;
+  return true;
+}
+
+bool TMappedFileTransport::nextEvent(TMemoryBuffer& membuf) {
+  const uint8_t* data;
+  uint32_t size;
+  if (!nextEvent(data, size)) {
+    return false;
+  }
+  // OBSERVE never writes to the buffer
+  membuf.resetBuffer(const_cast<uint8_t*>(data), size, TMemoryBuffer::OBSERVE);
+  return true;
+}
+
+uint64_t TMappedFileTransport::getOffset() {
+  return eventPos_ < eventEnd_ ? event_ : next_;
+}
+
+uint64_t TMappedFileTransport::skipTo(uint64_t offset, uint64_t from) {
+  uint64_t pos = from;
+  uint32_t header, size;
+  while (parseEvent(pos, header, size) && pos < offset) {
+    pos += header + size;
+  }
+  return pos;
+}
+
+void TMappedFileTransport::seekToOffset(uint64_t offset) {
+  remap();
+  uint64_t from = offset / chunkSize_ * chunkSize_;
+  std::vector<TFileIndexEntry>::const_iterator it
+      = std::upper_bound(index_.begin(), index_.end(), offset, EntryOffsetLess());
+  if (it != index_.begin() && (it - 1)->offset >= from) {
+    from = (it - 1)->offset;
+  }
+  next_ = skipTo(offset, from);
+  eventPos_ = eventEnd_ = 0;
+}
+
+void TMappedFileTransport::seekToTime(int64_t timeUs) {
+  if (index_.empty()) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TMappedFileTransport: seekToTime() requires an index");
+  }
+  std::vector<TFileIndexEntry>::const_iterator it
+      = std::upper_bound(index_.begin(), index_.end(), timeUs, EntryTimeLess());
+  next_ = (it == index_.begin()) ? 0 : (it - 1)->offset;
+  eventPos_ = eventEnd_ = 0;
+}
+
+bool TMappedFileTransport::loadIndex() {
+  index_.clear();
+  FILE* file = fopen(TFileTransport::getIndexPath(path_).c_str(), "rb");
+  if (!file) {
+    return false;
+  }
+  remap();
+
+  TFileIndexEntry entry;
+  while (fread(&entry, sizeof(entry), 1, file) == 1) {
+    if (!index_.empty() && entry.offset <= index_.back().offset) {
+      continue;
+    }
+    uint64_t pos = entry.offset;
+    uint32_t header, size;
+    if (pos % chunkSize_ + 4 <= chunkSize_ && parseEvent(pos, header, size)
+        && pos == entry.offset) {
+      index_.push_back(entry);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+uint32_t TMappedFileTransport::getNumChunks() {
+  struct THRIFT_STAT st;
+  if (::THRIFT_FSTAT(fd_, &st) == -1 || st.st_size <= 0) {
+    return 0;
+  }
+  return static_cast<uint32_t>((st.st_size - 1) / chunkSize_ + 1);
+}
+
+uint32_t TMappedFileTransport::getCurChunk() {
+  return static_cast<uint32_t>(getOffset() / chunkSize_);
+}
+
+void TMappedFileTransport::seekToChunk(int32_t chunk) {
+  int32_t numChunks = getNumChunks();
+  if (numChunks == 0) {
+    return;
+  }
+
+  // negative indicates reverse seek (from the end)
+  if (chunk < 0) {
+    chunk += numChunks;
+  }
+  if (chunk < 0) {
+    chunk = 0;
+  }
+  if (chunk >= numChunks) {
+    seekToEnd();
+    return;
+  }
+
+  remap();
+  next_ = static_cast<uint64_t>(chunk) * chunkSize_;
+  eventPos_ = eventEnd_ = 0;
+}
+
+void TMappedFileTransport::seekToEnd() {
+  remap();
+  uint64_t lastChunk = mapSize_ > 0 ? (mapSize_ - 1) / chunkSize_ : 0;
+  next_ = skipTo(mapSize_, lastChunk * chunkSize_);
+  eventPos_ = eventEnd_ = 0;
+}
+}
+}
+} // apache::thrift::transport
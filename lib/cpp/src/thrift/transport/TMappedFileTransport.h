@@ -0,0 +1,175 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_
+#define _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_ 1
+
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TFileTransport.h>
+
+#include <string>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Read-only reader for log files written by TFileTransport, which maps the
+ * file into memory instead of copying it through a read buffer.
+ *
+ * Events can be read like from a TFileTransport (one read() never crosses
+ * an event boundary), borrowed by protocols without a copy, or taken whole
+ * with nextEvent(), which points at the event inside the mapping:
+ *
+ *   shared_ptr<TMemoryBuffer> event(new TMemoryBuffer());
+ *   TBinaryProtocol protocol(event);
+ *   while (reader.nextEvent(*event)) {
+ *     processor->process(&protocol, ...);
+ *   }
+ *
+ * Event memory stays valid until the reader is destroyed or has to remap a
+ * file that grew while tailing it, which only happens when a read reaches
+ * the end of the mapped data.
+ *
+ * If TFileTransport wrote a sidecar index (see
+ * TFileTransport::setIndexInterval), loadIndex() reads it so that
+ * seekToOffset() and seekToTime() start from a known event instead of a
+ * chunk boundary.
+ *
+ * Checksummed events (see TFileTransport::setChecksumEvents) are verified
+ * as they are read; a damaged event is skipped up to the next intact one.
+ */
+class TMappedFileTransport : public TFileReaderTransport {
+public:
+  explicit TMappedFileTransport(const std::string& path);
+  ~TMappedFileTransport();
+
+  bool isOpen() { return true; }
+  bool peek();
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+  uint32_t readAll(uint8_t* buf, uint32_t len);
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len);
+  void consume(uint32_t len);
+
+  /**
+   * Skips whatever is left of the current event and points data and size
+   * at the next one.  Returns false if there is none (see setReadTimeout).
+   */
+  bool nextEvent(const uint8_t*& data, uint32_t& size);
+
+  /** Same, but makes membuf observe the event. */
+  bool nextEvent(TMemoryBuffer& membuf);
+
+  /** Offset in the file of the event that will be read next. */
+  uint64_t getOffset();
+
+  /** Offset in the file of the event read or returned last. */
+  uint64_t getEventOffset() const { return event_; }
+
+  /** Positions the reader at the first event starting at or after offset. */
+  void seekToOffset(uint64_t offset);
+
+  /**
+   * Positions the reader at the last indexed event written at or before
+   * timeUs (microseconds since the epoch), or at the start of the file.
+   * Events between two index entries have no timestamp of their own, so
+   * the result is as precise as the writer's index interval.  Requires an
+   * index.
+   */
+  void seekToTime(int64_t timeUs);
+
+  /**
+   * Loads the index written next to the log file.  Returns false if there
+   * is none; entries that do not point at an event in the file are dropped.
+   */
+  bool loadIndex();
+  size_t getIndexSize() const { return index_.size(); }
+  const std::vector<TFileIndexEntry>& getIndex() const { return index_; }
+
+  // TFileReaderTransport
+  int32_t getReadTimeout() { return readTimeout_; }
+  void setReadTimeout(int32_t readTimeout) { readTimeout_ = readTimeout; }
+  uint32_t getNumChunks();
+  uint32_t getCurChunk();
+  void seekToChunk(int32_t chunk);
+  void seekToEnd();
+
+  void setChunkSize(uint32_t chunkSize) {
+    if (chunkSize) {
+      chunkSize_ = chunkSize;
+    }
+  }
+  uint32_t getChunkSize() { return chunkSize_; }
+
+  void setEofSleepTimeUs(uint32_t eofSleepTime) {
+    if (eofSleepTime) {
+      eofSleepTime_ = eofSleepTime;
+    }
+  }
+  uint32_t getEofSleepTimeUs() { return eofSleepTime_; }
+
+  /**
+   * Events larger than this are treated as corrupt, as with
+   * TFileTransport::setMaxEventSize; 0 means no limit but the chunk size.
+   */
+  void setMaxEventSize(uint32_t maxEventSize) { maxEventSize_ = maxEventSize; }
+  uint32_t getMaxEventSize() { return maxEventSize_; }
+
+  virtual uint32_t read_virt(uint8_t* buf, uint32_t len) { return this->read(buf, len); }
+  virtual uint32_t readAll_virt(uint8_t* buf, uint32_t len) { return this->readAll(buf, len); }
+  virtual const uint8_t* borrow_virt(uint8_t* buf, uint32_t* len) {
+    return this->borrow(buf, len);
+  }
+  virtual void consume_virt(uint32_t len) { this->consume(len); }
+
+private:
+  bool parseEvent(uint64_t& pos, uint32_t& header, uint32_t& size);
+  uint64_t resync(uint64_t pos, uint64_t chunkEnd);
+  bool advance();
+  bool remap();
+  uint64_t skipTo(uint64_t offset, uint64_t from);
+
+  std::string path_;
+  int fd_;
+  uint8_t* map_;
+  uint64_t mapSize_;
+
+  uint32_t chunkSize_;
+  static const uint32_t DEFAULT_CHUNK_SIZE = 16 * 1024 * 1024;
+  int32_t readTimeout_;
+  uint32_t eofSleepTime_;
+  static const uint32_t DEFAULT_EOF_SLEEP_TIME_US = 500 * 1000;
+  uint32_t maxEventSize_;
+  static const uint32_t DEFAULT_MAX_EVENT_SIZE = 0;
+
+  // the current event is [event_, eventEnd_) with the read position at eventPos_
+  uint64_t next_;
+  uint64_t event_;
+  uint64_t eventPos_;
+  uint64_t eventEnd_;
+
+  std::vector<TFileIndexEntry> index_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_
@@ -0,0 +1,281 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/transport/TParallelFileProcessor.h>
+
+#include <thrift/concurrency/FunctionRunner.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TMappedFileTransport.h>
+#include <thrift/transport/TTransportUtils.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using apache::thrift::concurrency::FunctionRunner;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using stdcxx::shared_ptr;
+
+/**
+ * Finishes a task however it ends, so that process() does not wait for it
+ * forever.  A task that ends without emptying its lane drops the lane's
+ * events as failed and gives the lane back, so that the reader does not
+ * wait for room in it forever either.
+ */
+class TParallelFileProcessor::TaskGuard {
+public:
+  TaskGuard(TParallelFileProcessor* owner, size_t lane = NO_LANE)
+    : processed(0), failed(0), owner_(owner), lane_(lane) {}
+
+  ~TaskGuard() {
+    if (lane_ != NO_LANE) {
+      failed += owner_->dropLane(lane_);
+    }
+    owner_->finishTask(processed, failed);
+  }
+
+  /** The lane is empty and no longer scheduled. */
+  void releaseLane() { lane_ = NO_LANE; }
+
+  uint64_t processed;
+  uint64_t failed;
+
+private:
+  static const size_t NO_LANE = static_cast<size_t>(-1);
+
+  TParallelFileProcessor* owner_;
+  size_t lane_;
+};
+
+TParallelFileProcessor::TParallelFileProcessor(shared_ptr<TProcessor> processor,
+                                               shared_ptr<TProtocolFactory> protocolFactory,
+                                               shared_ptr<ThreadManager> threadManager)
+  : processor_(processor),
+    protocolFactory_(protocolFactory),
+    threadManager_(threadManager),
+    chunkSize_(DEFAULT_CHUNK_SIZE),
+    numLanes_(0),
+    maxPendingEvents_(DEFAULT_MAX_PENDING_EVENTS),
+    outstanding_(0),
+    processed_(0),
+    failed_(0),
+    pending_(0) {
+}
+
+void TParallelFileProcessor::setKeyFunction(const KeyFunction& keyFunction, uint32_t numLanes) {
+  keyFunction_ = keyFunction;
+  numLanes_ = numLanes;
+}
+
+uint64_t TParallelFileProcessor::getFailedCount() const {
+  Synchronized s(monitor_);
+  return failed_;
+}
+
+uint64_t TParallelFileProcessor::process(const std::string& path) {
+  {
+    Synchronized s(monitor_);
+    processed_ = 0;
+    failed_ = 0;
+  }
+  if (keyFunction_) {
+    return processByKey(path);
+  }
+
+  uint32_t numChunks;
+  {
+    TMappedFileTransport reader(path);
+    reader.setChunkSize(chunkSize_);
+    numChunks = reader.getNumChunks();
+  }
+  for (uint32_t chunk = 0; chunk < numChunks; ++chunk) {
+    runTask(FunctionRunner::create(
+        stdcxx::bind(&TParallelFileProcessor::processChunk, this, path, chunk)));
+  }
+  waitForTasks();
+
+  Synchronized s(monitor_);
+  return processed_;
+}
+
+uint64_t TParallelFileProcessor::processByKey(const std::string& path) {
+  size_t numLanes = numLanes_ ? numLanes_ : threadManager_->workerCount();
+  {
+    Synchronized s(monitor_);
+    lanes_.assign(numLanes > 0 ? numLanes : 1, Lane());
+    pending_ = 0;
+  }
+
+  try {
+    TMappedFileTransport reader(path);
+    reader.setChunkSize(chunkSize_);
+    const uint8_t* data;
+    uint32_t size;
+    while (reader.nextEvent(data, size)) {
+      size_t lane = static_cast<size_t>(keyFunction_(data, size) % lanes_.size());
+      std::string event(reinterpret_cast<const char*>(data), size);
+
+      bool schedule = false;
+      {
+        Synchronized s(monitor_);
+        while (pending_ >= maxPendingEvents_) {
+          monitor_.wait();
+        }
+        lanes_[lane].events.push_back(std::string());
+        lanes_[lane].events.back().swap(event);
+        ++pending_;
+        if (!lanes_[lane].scheduled) {
+          lanes_[lane].scheduled = true;
+          schedule = true;
+        }
+      }
+      if (schedule) {
+        runTask(FunctionRunner::create(
+            stdcxx::bind(&TParallelFileProcessor::processLane, this, lane)));
+      }
+    }
+  } catch (...) {
+    waitForTasks();
+    throw;
+  }
+  waitForTasks();
+
+  Synchronized s(monitor_);
+  return processed_;
+}
+
+void TParallelFileProcessor::processChunk(std::string path, uint32_t chunk) {
+  TaskGuard guard(this);
+  try {
+    TMappedFileTransport reader(path);
+    reader.setChunkSize(chunkSize_);
+    reader.seekToChunk(chunk);
+
+    shared_ptr<TMemoryBuffer> event(new TMemoryBuffer());
+    shared_ptr<TProtocol> in = protocolFactory_->getProtocol(event);
+    shared_ptr<TProtocol> out
+        = protocolFactory_->getProtocol(shared_ptr<TTransport>(new TNullTransport()));
+    while (reader.nextEvent(*event) && reader.getEventOffset() / chunkSize_ == chunk) {
+      if (processEvent(in, out)) {
+        ++guard.processed;
+      } else {
+        ++guard.failed;
+      }
+    }
+  } catch (const std::exception& e) {
+    GlobalOutput.printf("TParallelFileProcessor: chunk %u: %s", chunk, e.what());
+  }
+}
+
+void TParallelFileProcessor::processLane(size_t lane) {
+  TaskGuard guard(this, lane);
+  shared_ptr<TMemoryBuffer> event(new TMemoryBuffer());
+  shared_ptr<TProtocol> in = protocolFactory_->getProtocol(event);
+  shared_ptr<TProtocol> out
+      = protocolFactory_->getProtocol(shared_ptr<TTransport>(new TNullTransport()));
+
+  std::string data;
+  while (true) {
+    {
+      Synchronized s(monitor_);
+      Lane& l = lanes_[lane];
+      if (l.events.empty()) {
+        // from here on the reader schedules the lane again
+        l.scheduled = false;
+        guard.releaseLane();
+        break;
+      }
+      data.swap(l.events.front());
+      l.events.pop_front();
+      if (pending_-- == maxPendingEvents_) {
+        monitor_.notifyAll();
+      }
+    }
+
+    event->resetBuffer(reinterpret_cast<uint8_t*>(&data[0]),
+                       static_cast<uint32_t>(data.size()),
+                       TMemoryBuffer::OBSERVE);
+    if (processEvent(in, out)) {
+      ++guard.processed;
+    } else {
+      ++guard.failed;
+    }
+  }
+}
+
+bool TParallelFileProcessor::processEvent(const shared_ptr<TProtocol>& in,
+                                          const shared_ptr<TProtocol>& out) {
+  try {
+    return processor_->process(in, out, NULL);
+  } catch (const std::exception& e) {
+    // generated processors read their arguments outside their try blocks,
+    // so a corrupt event can throw bad_alloc or length_error as well
+    GlobalOutput.printf("TParallelFileProcessor: %s", e.what());
+    return false;
+  } catch (...) {
+    GlobalOutput("TParallelFileProcessor: unknown exception");
+    return false;
+  }
+}
+
+void TParallelFileProcessor::runTask(const shared_ptr<Runnable>& task) {
+  {
+    Synchronized s(monitor_);
+    ++outstanding_;
+  }
+  try {
+    threadManager_->add(task);
+  } catch (...) {
+    finishTask(0, 0);
+    throw;
+  }
+}
+
+void TParallelFileProcessor::finishTask(uint64_t processed, uint64_t failed) {
+  Synchronized s(monitor_);
+  processed_ += processed;
+  failed_ += failed;
+  --outstanding_;
+  monitor_.notifyAll();
+}
+
+uint64_t TParallelFileProcessor::dropLane(size_t lane) {
+  Synchronized s(monitor_);
+  Lane& l = lanes_[lane];
+  uint64_t dropped = l.events.size();
+  pending_ -= static_cast<uint32_t>(dropped);
+  l.events.clear();
+  l.scheduled = false;
+  monitor_.notifyAll();
+  return dropped;
+}
+
+void TParallelFileProcessor::waitForTasks() {
+  Synchronized s(monitor_);
+  while (outstanding_ > 0) {
+    monitor_.wait();
+  }
+}
+}
+}
+} // apache::thrift::transport
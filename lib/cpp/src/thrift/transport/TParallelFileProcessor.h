@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TPARALLELFILEPROCESSOR_H_
+#define _THRIFT_TRANSPORT_TPARALLELFILEPROCESSOR_H_ 1
+
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/stdcxx.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Replays a log written by TFileTransport through a processor on the
+ * threads of a ThreadManager, rather than one event at a time like
+ * TFileProcessor.
+ *
+ * By default every chunk of the file is a separate task: chunks never
+ * share an event, so each task maps the file (see TMappedFileTransport)
+ * and processes the events of its chunk on its own.  Events are then
+ * processed in no particular order.
+ *
+ * With a key function, events are instead read in file order and handed
+ * to numLanes lanes by key; each lane is processed by at most one thread
+ * at a time, so events with the same key are processed in the order they
+ * were logged.
+ *
+ * The processor (and its handler) is called from several threads at once.
+ * Its responses are discarded.  An event it throws on, whatever it throws,
+ * counts as failed.
+ */
+class TParallelFileProcessor {
+public:
+  /** Returns the ordering key of an event. */
+  typedef stdcxx::function<uint64_t(const uint8_t* event, uint32_t size)> KeyFunction;
+
+  /**
+   * @param processor processes log-file events
+   * @param protocolFactory protocol the events were written with
+   * @param threadManager started thread manager to run on
+   */
+  TParallelFileProcessor(stdcxx::shared_ptr<TProcessor> processor,
+                         stdcxx::shared_ptr<protocol::TProtocolFactory> protocolFactory,
+                         stdcxx::shared_ptr<concurrency::ThreadManager> threadManager);
+
+  /** Chunk size the log was written with (TFileTransport::setChunkSize). */
+  void setChunkSize(uint32_t chunkSize) {
+    if (chunkSize) {
+      chunkSize_ = chunkSize;
+    }
+  }
+  uint32_t getChunkSize() const { return chunkSize_; }
+
+  /**
+   * Keeps events with equal keys in order.  numLanes defaults to the
+   * number of workers of the thread manager.
+   */
+  void setKeyFunction(const KeyFunction& keyFunction, uint32_t numLanes = 0);
+
+  /** Most events read ahead of the lanes when ordering by key. */
+  void setMaxPendingEvents(uint32_t maxPendingEvents) {
+    if (maxPendingEvents) {
+      maxPendingEvents_ = maxPendingEvents;
+    }
+  }
+
+  /**
+   * Processes every event of the log at path and returns once all of them
+   * have been processed.  Returns the number of events processed
+   * successfully.
+   */
+  uint64_t process(const std::string& path);
+
+  /** Number of events the processor failed on during the last process(). */
+  uint64_t getFailedCount() const;
+
+private:
+  struct Lane {
+    Lane() : scheduled(false) {}
+    std::deque<std::string> events;
+    bool scheduled;
+  };
+
+  class TaskGuard;
+
+  void processChunk(std::string path, uint32_t chunk);
+  void processLane(size_t lane);
+  bool processEvent(const stdcxx::shared_ptr<protocol::TProtocol>& in,
+                    const stdcxx::shared_ptr<protocol::TProtocol>& out);
+  void runTask(const stdcxx::shared_ptr<concurrency::Runnable>& task);
+  void finishTask(uint64_t processed, uint64_t failed);
+  uint64_t dropLane(size_t lane);
+  void waitForTasks();
+  uint64_t processByKey(const std::string& path);
+
+  stdcxx::shared_ptr<TProcessor> processor_;
+  stdcxx::shared_ptr<protocol::TProtocolFactory> protocolFactory_;
+  stdcxx::shared_ptr<concurrency::ThreadManager> threadManager_;
+  uint32_t chunkSize_;
+  static const uint32_t DEFAULT_CHUNK_SIZE = 16 * 1024 * 1024;
+  KeyFunction keyFunction_;
+  uint32_t numLanes_;
+  uint32_t maxPendingEvents_;
+  static const uint32_t DEFAULT_MAX_PENDING_EVENTS = 10000;
+
+  mutable concurrency::Monitor monitor_;
+  // begin monitor_ protected members
+  uint32_t outstanding_;
+  uint64_t processed_;
+  uint64_t failed_;
+  uint32_t pending_;
+  std::vector<Lane> lanes_;
+  // end monitor_ protected members
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // _THRIFT_TRANSPORT_TPARALLELFILEPROCESSOR_H_
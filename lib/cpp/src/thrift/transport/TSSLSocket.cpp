@@ -45,14 +45,25 @@
 #include <openssl/engine.h>
 #endif
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+#include <openssl/core_names.h>
+#endif
 #include <thrift/concurrency/Mutex.h>
 #include <thrift/transport/TSSLSocket.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/TToString.h>
 
+// every OpenSSL 3 defines SSL_OP_ENABLE_KTLS, whether or not it was built
+// with kernel TLS; without it the option is accepted and does nothing
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define THRIFT_OPENSSL_KTLS 1
+#endif
+
 using namespace apache::thrift::concurrency;
 using std::string;
 
@@ -157,6 +168,19 @@ void cleanupOpenSSL() {
   mutexes.reset();
 }
 
+// ex_data slots linking OpenSSL callbacks back to thrift objects
+static Mutex exDataMutex;
+static int sslSocketIndex = -1;
+static int ctxTicketKeysIndex = -1;
+
+static void initializeExData() {
+  Guard guard(exDataMutex);
+  if (sslSocketIndex < 0) {
+    sslSocketIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+    ctxTicketKeysIndex = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+  }
+}
+
 static void buildErrors(string& message, int errno_copy = 0, int sslerrno = 0);
 static bool matchName(const char* host, const char* pattern, int size);
 static char uppercase(char c);
@@ -262,8 +286,11 @@ bool TSSLSocket::hasPendingDataToRead() {
 
 void TSSLSocket::init() {
   handshakeCompleted_ = false;
+  handshakeWantWrite_ = false;
   readRetryCount_ = 0;
   eventSafe_ = false;
+  ktlsSend_ = false;
+  ktlsRecv_ = false;
 }
 
 bool TSSLSocket::isOpen() {
@@ -375,6 +402,8 @@ void TSSLSocket::close() {
     SSL_free(ssl_);
     ssl_ = NULL;
     handshakeCompleted_ = false;
+    ktlsSend_ = false;
+    ktlsRecv_ = false;
     ERR_remove_state(0);
   }
   TSocket::close();
@@ -390,6 +419,10 @@ uint32_t TSSLSocket::read(uint8_t* buf, uint32_t len) {
   initializeHandshake();
   if (!checkHandshake())
     throw TTransportException(TTransportException::UNKNOWN, "retry again");
+  uint32_t got;
+  if (ktlsRecv_ && readKernelTLS(buf, len, got)) {
+    return got;
+  }
   int32_t bytes = 0;
   while (readRetryCount_ < maxRecvRetries_) {
     bytes = SSL_read(ssl_, buf, len);
@@ -457,6 +490,10 @@ void TSSLSocket::write(const uint8_t* buf, uint32_t len) {
   initializeHandshake();
   if (!checkHandshake())
     return;
+  if (ktlsSend_) {
+    writeKernelTLS(buf, len, false);
+    return;
+  }
   // loop in case SSL_MODE_ENABLE_PARTIAL_WRITE is set in SSL_CTX.
   uint32_t written = 0;
   while (written < len) {
@@ -501,6 +538,9 @@ uint32_t TSSLSocket::write_partial(const uint8_t* buf, uint32_t len) {
   initializeHandshake();
   if (!checkHandshake())
     return 0;
+  if (ktlsSend_) {
+    return writeKernelTLS(buf, len, true);
+  }
   // loop in case SSL_MODE_ENABLE_PARTIAL_WRITE is set in SSL_CTX.
   uint32_t written = 0;
   while (written < len) {
@@ -536,6 +576,66 @@ uint32_t TSSLSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return written;
 }
 
+/*
+ * The kernel owns the record layer once the keys are installed, so
+ * application data moves with plain recv().  Anything else (alerts,
+ * post-handshake messages) makes recv() fail with EIO and is left on the
+ * socket for SSL_read(), which collects it with recvmsg() and a cmsg.
+*/
+bool TSSLSocket::readKernelTLS(uint8_t* buf, uint32_t len, uint32_t& got) {
+  if (SSL_pending(ssl_) > 0) {
+    // records decrypted by OpenSSL before the keys moved to the kernel
+    return false;
+  }
+  while (true) {
+    int rc = static_cast<int>(recv(socket_, reinterpret_cast<char*>(buf), len, 0));
+    if (rc >= 0) {
+      readRetryCount_ = 0;
+      got = static_cast<uint32_t>(rc);
+      return true;
+    }
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    if (errno_copy == EIO) {
+      return false;
+    }
+    if (errno_copy != THRIFT_EINTR && errno_copy != THRIFT_EAGAIN) {
+      GlobalOutput.perror("TSSLSocket::read recv() ", errno_copy);
+      throw TTransportException(TTransportException::UNKNOWN, "recv()", errno_copy);
+    }
+    if (++readRetryCount_ >= maxRecvRetries_) {
+      throw TTransportException(TTransportException::INTERNAL_ERROR, "too much recv retries");
+    }
+    if (errno_copy == THRIFT_EINTR) {
+      continue;
+    }
+    if (isLibeventSafe()) {
+      throw TTransportException(TTransportException::UNKNOWN, "retry again");
+    }
+    if (waitForEvent(true) == TSSL_DATA) {
+      readRetryCount_--;
+    }
+  }
+}
+
+uint32_t TSSLSocket::writeKernelTLS(const uint8_t* buf, uint32_t len, bool partial) {
+  uint32_t written = 0;
+  while (written < len) {
+    uint32_t bytes = TSocket::write_partial(&buf[written], len - written);
+    if (bytes == 0) {
+      if (isLibeventSafe()) {
+        return written;
+      }
+      waitForEvent(false);
+      continue;
+    }
+    written += bytes;
+    if (partial) {
+      break;
+    }
+  }
+  return written;
+}
+
 void TSSLSocket::flush() {
   // Don't throw exception if not open. Thrift servers close socket twice.
   if (ssl_ == NULL) {
@@ -569,6 +669,23 @@ void TSSLSocket::initializeHandshakeParams() {
   ssl_ = ctx_->createSSL();
 
   SSL_set_fd(ssl_, static_cast<int>(socket_));
+  if (sessionCache_ && !server()) {
+    SSL_set_ex_data(ssl_, sslSocketIndex, this);
+    sessionCache_->resume(sessionKey(), ssl_);
+  }
+}
+
+bool TSSLSocket::isSessionReused() const {
+  return ssl_ != NULL && SSL_session_reused(ssl_);
+}
+
+string TSSLSocket::sessionKey() {
+  return getHost() + ":" + to_string(getPort());
+}
+
+bool TSSLSocket::handshake() {
+  initializeHandshake();
+  return checkHandshake();
 }
 
 bool TSSLSocket::checkHandshake() {
@@ -605,6 +722,7 @@ void TSSLSocket::initializeHandshake() {
           case SSL_ERROR_WANT_READ:
           case SSL_ERROR_WANT_WRITE:
             if (isLibeventSafe()) {
+              handshakeWantWrite_ = (error == SSL_ERROR_WANT_WRITE);
               return;
             }
             else {
@@ -637,6 +755,7 @@ void TSSLSocket::initializeHandshake() {
           case SSL_ERROR_WANT_READ:
           case SSL_ERROR_WANT_WRITE:
             if (isLibeventSafe()) {
+              handshakeWantWrite_ = (error == SSL_ERROR_WANT_WRITE);
               return;
             }
             else {
@@ -657,6 +776,12 @@ void TSSLSocket::initializeHandshake() {
     throw TSSLException(fname + ": " + errors);
   }
   authorize();
+#ifdef THRIFT_OPENSSL_KTLS
+  if (SSL_get_options(ssl_) & SSL_OP_ENABLE_KTLS) {
+    ktlsSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+    ktlsRecv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+  }
+#endif
   handshakeCompleted_ = true;
 }
 
@@ -892,6 +1017,7 @@ stdcxx::shared_ptr<TSSLSocket> TSSLSocketFactory::createSocket(const string& hos
 
 void TSSLSocketFactory::setup(stdcxx::shared_ptr<TSSLSocket> ssl) {
   ssl->server(server());
+  ssl->sessionCache(sessionCache_);
   if (access_ == NULL && !server()) {
     access_ = stdcxx::shared_ptr<AccessManager>(new DefaultClientAccessManager);
   }
@@ -922,6 +1048,126 @@ void TSSLSocketFactory::authenticate(bool required) {
   SSL_CTX_set_verify(ctx_->get(), mode, NULL);
 }
 
+bool TSSLSocketFactory::isKernelTLSAvailable() {
+#ifdef THRIFT_OPENSSL_KTLS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void TSSLSocketFactory::kernelTLS(bool enable) {
+#ifdef THRIFT_OPENSSL_KTLS
+  if (enable) {
+    SSL_CTX_set_options(ctx_->get(), SSL_OP_ENABLE_KTLS);
+  } else {
+    SSL_CTX_clear_options(ctx_->get(), SSL_OP_ENABLE_KTLS);
+  }
+#else
+  if (enable) {
+    throw TSSLException("kernelTLS: OpenSSL was built without kernel TLS support");
+  }
+#endif
+}
+
+void TSSLSocketFactory::sessionCache(stdcxx::shared_ptr<TSSLSessionCache> cache) {
+  initializeExData();
+  sessionCache_ = cache;
+  if (cache) {
+    // sessions are looked up by host:port in our cache, not by OpenSSL
+    SSL_CTX_set_session_cache_mode(ctx_->get(),
+                                   SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx_->get(), newSessionCallback);
+  } else {
+    SSL_CTX_sess_set_new_cb(ctx_->get(), NULL);
+  }
+}
+
+int TSSLSocketFactory::newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+  TSSLSocket* socket = static_cast<TSSLSocket*>(SSL_get_ex_data(ssl, sslSocketIndex));
+  if (socket == NULL || !socket->sessionCache_) {
+    return 0;
+  }
+  socket->sessionCache_->store(socket->sessionKey(), session);
+  return 1; // the cache owns the session reference now
+}
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+static int ticketKeyCallback(SSL* ssl,
+                             unsigned char* name,
+                             unsigned char* iv,
+                             EVP_CIPHER_CTX* cipher,
+                             EVP_MAC_CTX* mac,
+                             int enc) {
+#else
+static int ticketKeyCallback(SSL* ssl,
+                             unsigned char* name,
+                             unsigned char* iv,
+                             EVP_CIPHER_CTX* cipher,
+                             HMAC_CTX* mac,
+                             int enc) {
+#endif
+  TSSLTicketKeys* keys = static_cast<TSSLTicketKeys*>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ctxTicketKeysIndex));
+  if (keys == NULL) {
+    return -1;
+  }
+  TSSLTicketKeys::Key key;
+  int rc = 1;
+  if (enc) {
+    keys->current(key);
+    if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+      return -1;
+    }
+    memcpy(name, key.name, TSSLTicketKeys::NAME_SIZE);
+    EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aes, iv);
+  } else {
+    rc = keys->find(name, key);
+    if (rc == 0) {
+      return 0; // unknown or retired key: fall back to a full handshake
+    }
+#ifdef TLS1_3_VERSION
+    // a TLS 1.3 client uses each ticket once, so it needs a new one to
+    // resume again
+    if (SSL_version(ssl) >= TLS1_3_VERSION) {
+      rc = 2;
+    }
+#endif
+    EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aes, iv);
+  }
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+  OSSL_PARAM params[2];
+  params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0);
+  params[1] = OSSL_PARAM_construct_end();
+  if (EVP_MAC_init(mac, key.hmac, TSSLTicketKeys::HMAC_SIZE, params) != 1) {
+    return -1;
+  }
+#else
+  HMAC_Init_ex(mac, key.hmac, TSSLTicketKeys::HMAC_SIZE, EVP_sha256(), NULL);
+#endif
+  return rc;
+}
+
+void TSSLSocketFactory::ticketKeys(stdcxx::shared_ptr<TSSLTicketKeys> keys) {
+  initializeExData();
+  ticketKeys_ = keys;
+  SSL_CTX_set_ex_data(ctx_->get(), ctxTicketKeysIndex, keys.get());
+  if (keys) {
+    // resumption needs a session id context once clients are authenticated
+    static const unsigned char sidContext[] = "thrift";
+    SSL_CTX_set_session_id_context(ctx_->get(), sidContext, sizeof(sidContext) - 1);
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx_->get(), ticketKeyCallback);
+  } else {
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx_->get(), NULL);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx_->get(), ticketKeyCallback);
+  } else {
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx_->get(), NULL);
+#endif
+  }
+}
+
 void TSSLSocketFactory::loadCertificate(const char* path, const char* format) {
   if (path == NULL || format == NULL) {
     throw TTransportException(TTransportException::BAD_ARGS,
@@ -989,6 +1235,125 @@ int TSSLSocketFactory::passwordCallback(char* password, int size, int, void* dat
   return length;
 }
 
+// TSSLSessionCache implementation
+TSSLSessionCache::TSSLSessionCache(size_t capacity) : capacity_(capacity ? capacity : 1) {
+}
+
+TSSLSessionCache::~TSSLSessionCache() {
+  clear();
+}
+
+bool TSSLSessionCache::resume(const string& key, SSL* ssl) {
+  Guard guard(mutex_);
+  SessionMap::iterator it = sessions_.find(key);
+  if (it == sessions_.end()) {
+    return false;
+  }
+  lru_.splice(lru_.begin(), lru_, it->second.second);
+  // SSL_set_session takes its own reference, so the entry stays valid
+  return SSL_set_session(ssl, it->second.first) == 1;
+}
+
+void TSSLSessionCache::store(const string& key, SSL_SESSION* session) {
+  Guard guard(mutex_);
+  SessionMap::iterator it = sessions_.find(key);
+  if (it != sessions_.end()) {
+    SSL_SESSION_free(it->second.first);
+    it->second.first = session;
+    lru_.splice(lru_.begin(), lru_, it->second.second);
+    return;
+  }
+  if (sessions_.size() >= capacity_) {
+    SessionMap::iterator oldest = sessions_.find(lru_.back());
+    SSL_SESSION_free(oldest->second.first);
+    sessions_.erase(oldest);
+    lru_.pop_back();
+  }
+  lru_.push_front(key);
+  sessions_[key] = std::make_pair(session, lru_.begin());
+}
+
+void TSSLSessionCache::remove(const string& key) {
+  Guard guard(mutex_);
+  SessionMap::iterator it = sessions_.find(key);
+  if (it != sessions_.end()) {
+    SSL_SESSION_free(it->second.first);
+    lru_.erase(it->second.second);
+    sessions_.erase(it);
+  }
+}
+
+void TSSLSessionCache::clear() {
+  Guard guard(mutex_);
+  for (SessionMap::iterator it = sessions_.begin(); it != sessions_.end(); ++it) {
+    SSL_SESSION_free(it->second.first);
+  }
+  sessions_.clear();
+  lru_.clear();
+}
+
+size_t TSSLSessionCache::size() const {
+  Guard guard(mutex_);
+  return sessions_.size();
+}
+
+// TSSLTicketKeys implementation
+TSSLTicketKeys::TSSLTicketKeys(size_t maxKeys) : maxKeys_(maxKeys ? maxKeys : 1) {
+  rotate();
+}
+
+void TSSLTicketKeys::rotate() {
+  unsigned char material[KEY_SIZE];
+  if (RAND_bytes(material, KEY_SIZE) != 1) {
+    string errors;
+    buildErrors(errors);
+    throw TSSLException("RAND_bytes: " + errors);
+  }
+  rotate(string(reinterpret_cast<char*>(material), KEY_SIZE));
+  OPENSSL_cleanse(material, KEY_SIZE);
+}
+
+void TSSLTicketKeys::rotate(const string& material) {
+  if (material.size() != KEY_SIZE) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TSSLTicketKeys::rotate: key material must be KEY_SIZE bytes");
+  }
+  Key key;
+  const char* p = material.data();
+  memcpy(key.name, p, NAME_SIZE);
+  memcpy(key.hmac, p + NAME_SIZE, HMAC_SIZE);
+  memcpy(key.aes, p + NAME_SIZE + HMAC_SIZE, AES_SIZE);
+
+  Guard guard(mutex_);
+  keys_.insert(keys_.begin(), key);
+  if (keys_.size() > maxKeys_) {
+    OPENSSL_cleanse(&keys_.back(), sizeof(Key));
+    keys_.pop_back();
+  }
+  OPENSSL_cleanse(&key, sizeof(Key));
+}
+
+size_t TSSLTicketKeys::size() const {
+  Guard guard(mutex_);
+  return keys_.size();
+}
+
+void TSSLTicketKeys::current(Key& key) const {
+  Guard guard(mutex_);
+  key = keys_.front();
+}
+
+int TSSLTicketKeys::find(const unsigned char* name, Key& key) const {
+  Guard guard(mutex_);
+  for (size_t i = 0; i < keys_.size(); ++i) {
+    if (memcmp(keys_[i].name, name, NAME_SIZE) == 0) {
+      key = keys_[i];
+      return i == 0 ? 1 : 2;
+    }
+  }
+  return 0;
+}
+
 // extract error messages from error queue
 void buildErrors(string& errors, int errno_copy, int sslerrno) {
   unsigned long errorCode;
@@ -24,7 +24,10 @@
 #include <thrift/transport/TSocket.h>
 
 #include <openssl/ssl.h>
+#include <list>
+#include <map>
 #include <string>
+#include <vector>
 #include <thrift/concurrency/Mutex.h>
 #include <thrift/stdcxx.h>
 
@@ -34,6 +37,8 @@ namespace transport {
 
 class AccessManager;
 class SSLContext;
+class TSSLSessionCache;
+class TSSLTicketKeys;
 
 enum SSLProtocol {
   SSLTLS  = 0,  // Supports SSLv2 and SSLv3 handshake but only negotiates at TLSv1_0 or later.
@@ -107,6 +112,34 @@ public:
    * Determines whether SSL Socket is libevent safe or not.
    */
   bool isLibeventSafe() const { return eventSafe_; }
+  /**
+   * Advance the SSL handshake of a libevent safe socket as far as possible
+   * without blocking.
+   *
+   * @return true once the handshake has completed
+   * @throw TSSLException if the handshake failed
+   */
+  bool handshake();
+  /**
+   * Determine whether an unfinished handshake is waiting for the socket to
+   * become writable rather than readable.
+   */
+  bool handshakeWantsWrite() const { return handshakeWantWrite_; }
+  /**
+   * Determine whether the kernel encrypts outgoing records for this socket.
+   * Only meaningful once the handshake has completed.  When true the socket
+   * descriptor may be handed to sendfile() or writev() directly.
+   */
+  bool isKernelTLSSend() const { return ktlsSend_; }
+  /**
+   * Determine whether the kernel decrypts incoming records for this socket.
+   */
+  bool isKernelTLSRecv() const { return ktlsRecv_; }
+  /**
+   * Determine whether the handshake resumed a previous session instead of
+   * performing a full key exchange.
+   */
+  bool isSessionReused() const;
 
 protected:
   /**
@@ -168,17 +201,43 @@ protected:
    *         TSSL_DATA  if data is available on the socket.
    */
   unsigned int waitForEvent(bool wantRead);
+  /**
+   * Read through a kernel TLS socket with recv(); returns false if the next
+   * record is not application data and must be consumed by SSL_read().
+   */
+  bool readKernelTLS(uint8_t* buf, uint32_t len, uint32_t& got);
+  /**
+   * Write through a kernel TLS socket with send().
+   */
+  uint32_t writeKernelTLS(const uint8_t* buf, uint32_t len, bool partial);
+
+  /**
+   * Set the cache used to resume client sessions with this socket's peer.
+   * Only TSSLSocketFactory::sessionCache() sets it, since that is what
+   * installs the callback storing new sessions; see there.
+   *
+   * @param cache  Cache shared by the sockets of a TSSLSocketFactory
+   */
+  void sessionCache(stdcxx::shared_ptr<TSSLSessionCache> cache) { sessionCache_ = cache; }
+  /**
+   * Key of this socket's peer in the session cache.
+   */
+  std::string sessionKey();
 
   bool server_;
   SSL* ssl_;
   stdcxx::shared_ptr<SSLContext> ctx_;
   stdcxx::shared_ptr<AccessManager> access_;
+  stdcxx::shared_ptr<TSSLSessionCache> sessionCache_;
   friend class TSSLSocketFactory;
 
 private:
   bool handshakeCompleted_;
+  bool handshakeWantWrite_;
   int readRetryCount_;
   bool eventSafe_;
+  bool ktlsSend_;
+  bool ktlsRecv_;
 
   void init();
 };
@@ -255,6 +314,41 @@ public:
    * @param required Require peer to present valid certificate if true
    */
   virtual void authenticate(bool required);
+  /**
+   * Enable/Disable kernel TLS offload.  After the handshake OpenSSL installs
+   * the session keys into the socket (TLS_TX/TLS_RX) and TSSLSocket then
+   * reads and writes with plain recv()/send(), leaving record encryption to
+   * the kernel.  Requires OpenSSL 3.0 built with ktls (see
+   * isKernelTLSAvailable) and the Linux "tls" module; if the kernel refuses
+   * a cipher or direction that direction silently stays in userspace.
+   *
+   * @param enable Offload record encryption to the kernel if true
+   * @throw TSSLException if enable is true and OpenSSL was built without
+   *        kernel TLS support (OPENSSL_NO_KTLS)
+   */
+  virtual void kernelTLS(bool enable);
+  /**
+   * Whether the OpenSSL this was built against supports kernel TLS, i.e.
+   * whether kernelTLS(true) can succeed.  The kernel may still decline it.
+   */
+  static bool isKernelTLSAvailable();
+  /**
+   * Cache client sessions so that reconnecting to the same host:port
+   * resumes the previous session (an abbreviated handshake without
+   * certificate verification or asymmetric crypto).  The cache may be
+   * shared between factories.
+   *
+   * @param cache  Session cache, or an empty pointer to disable caching
+   */
+  virtual void sessionCache(stdcxx::shared_ptr<TSSLSessionCache> cache);
+  /**
+   * Issue stateless session tickets encrypted with the given keys.  Every
+   * server behind the same address should share the keys so that a client
+   * may resume against any of them, e.g. after a rolling restart.
+   *
+   * @param keys  Ticket keys, or an empty pointer to disable tickets
+   */
+  virtual void ticketKeys(stdcxx::shared_ptr<TSSLTicketKeys> keys);
   /**
    * Load server certificate.
    *
@@ -320,11 +414,14 @@ protected:
 private:
   bool server_;
   stdcxx::shared_ptr<AccessManager> access_;
+  stdcxx::shared_ptr<TSSLSessionCache> sessionCache_;
+  stdcxx::shared_ptr<TSSLTicketKeys> ticketKeys_;
   static concurrency::Mutex mutex_;
   static uint64_t count_;
   static bool manualOpenSSLInitialization_;
   void setup(stdcxx::shared_ptr<TSSLSocket> ssl);
   static int passwordCallback(char* password, int size, int, void* data);
+  static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
 };
 
 /**
@@ -358,6 +455,105 @@ private:
   SSL_CTX* ctx_;
 };
 
+/**
+ * Client side TLS sessions, keyed by "host:port".  A socket created by a
+ * TSSLSocketFactory with a session cache offers the cached session when it
+ * connects, and stores every session (or TLS 1.3 ticket) the server issues.
+ * The least recently used entry is evicted once capacity is reached.
+ */
+class TSSLSessionCache {
+public:
+  TSSLSessionCache(size_t capacity = 1024);
+  virtual ~TSSLSessionCache();
+
+  /**
+   * Offer the session cached for key on ssl, before the handshake starts.
+   *
+   * @return true if a session was found
+   */
+  bool resume(const std::string& key, SSL* ssl);
+  /**
+   * Store a session for key, replacing any previous one.  Takes ownership
+   * of the session reference.
+   */
+  void store(const std::string& key, SSL_SESSION* session);
+  /**
+   * Forget the session cached for key.
+   */
+  void remove(const std::string& key);
+  void clear();
+  size_t size() const;
+
+private:
+  typedef std::list<std::string> LruList;
+  typedef std::map<std::string, std::pair<SSL_SESSION*, LruList::iterator> > SessionMap;
+
+  size_t capacity_;
+  mutable concurrency::Mutex mutex_;
+  // begin mutex_ protected members
+  SessionMap sessions_;
+  LruList lru_; // most recently used first
+  // end mutex_ protected members
+};
+
+/**
+ * Server side session ticket keys.  New tickets are encrypted with the
+ * current key; tickets made with one of the previous keys are still
+ * accepted (and replaced with a ticket under the current key) until the
+ * key falls out of the rotation.  A freshly constructed instance holds one
+ * random key, which is fine for a single server.  A fleet should
+ * distribute the same key material to every server and rotate() it
+ * periodically.
+ */
+class TSSLTicketKeys {
+public:
+  enum {
+    NAME_SIZE = 16,
+    HMAC_SIZE = 32,
+    AES_SIZE = 32,
+    /** Size of the key material: name | HMAC-SHA256 secret | AES-256 key. */
+    KEY_SIZE = NAME_SIZE + HMAC_SIZE + AES_SIZE
+  };
+
+  /**
+   * @param maxKeys Number of keys (current plus previous) to accept
+   */
+  TSSLTicketKeys(size_t maxKeys = 3);
+
+  /**
+   * Make a new random key current.
+   */
+  void rotate();
+  /**
+   * Make the given KEY_SIZE bytes of key material current.
+   */
+  void rotate(const std::string& key);
+  size_t size() const;
+
+  struct Key {
+    unsigned char name[NAME_SIZE];
+    unsigned char hmac[HMAC_SIZE];
+    unsigned char aes[AES_SIZE];
+  };
+
+  /**
+   * Copy the key new tickets are encrypted with.
+   */
+  void current(Key& key) const;
+  /**
+   * Find the key a ticket was encrypted with.
+   *
+   * @return 0 if unknown, 1 if it is the current key, 2 if it is a
+   *         previous key and the ticket should be renewed
+   */
+  int find(const unsigned char* name, Key& key) const;
+
+private:
+  size_t maxKeys_;
+  mutable concurrency::Mutex mutex_;
+  std::vector<Key> keys_; // current key first
+};
+
 /**
  * Callback interface for access control. It's meant to verify the remote host.
  * It's constructed when application starts and set to TSSLSocketFactory
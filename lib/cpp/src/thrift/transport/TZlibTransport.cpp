@@ -21,6 +21,7 @@
 #include <cstring>
 #include <algorithm>
 #include <thrift/transport/TZlibTransport.h>
+#include <thrift/concurrency/Util.h>
 
 using std::string;
 
@@ -28,8 +29,135 @@ namespace apache {
 namespace thrift {
 namespace transport {
 
+using apache::thrift::concurrency::Guard;
+
+namespace {
+
+z_stream* newStream() {
+  z_stream* stream = new z_stream;
+  stream->zalloc = Z_NULL;
+  stream->zfree = Z_NULL;
+  stream->opaque = Z_NULL;
+  stream->next_in = Z_NULL;
+  stream->avail_in = 0;
+  return stream;
+}
+}
+
+TZlibStreamPool::~TZlibStreamPool() {
+  for (std::vector<z_stream*>::iterator it = inflaters_.begin(); it != inflaters_.end(); ++it) {
+    inflateEnd(*it);
+    delete *it;
+  }
+  for (std::map<int, std::vector<z_stream*> >::iterator level = deflaters_.begin();
+       level != deflaters_.end();
+       ++level) {
+    for (std::vector<z_stream*>::iterator it = level->second.begin(); it != level->second.end();
+         ++it) {
+      deflateEnd(*it);
+      delete *it;
+    }
+  }
+}
+
+z_stream* TZlibStreamPool::acquireInflate() {
+  {
+    Guard g(mutex_);
+    if (!inflaters_.empty()) {
+      z_stream* stream = inflaters_.back();
+      inflaters_.pop_back();
+      return stream;
+    }
+  }
+  z_stream* stream = newStream();
+  int rv = inflateInit(stream);
+  if (rv != Z_OK) {
+    TZlibTransportException ex(rv, stream->msg);
+    delete stream;
+    throw ex;
+  }
+  return stream;
+}
+
+z_stream* TZlibStreamPool::acquireDeflate(int compLevel) {
+  {
+    Guard g(mutex_);
+    std::vector<z_stream*>& idle = deflaters_[compLevel];
+    if (!idle.empty()) {
+      z_stream* stream = idle.back();
+      idle.pop_back();
+      return stream;
+    }
+  }
+  z_stream* stream = newStream();
+  int rv = deflateInit(stream, compLevel);
+  if (rv != Z_OK) {
+    TZlibTransportException ex(rv, stream->msg);
+    delete stream;
+    throw ex;
+  }
+  return stream;
+}
+
+void TZlibStreamPool::releaseInflate(z_stream* stream) {
+  // reset outside the lock; a stream that cannot be reset is not reused
+  if (inflateReset(stream) == Z_OK) {
+    Guard g(mutex_);
+    if (inflaters_.size() < maxIdle_) {
+      inflaters_.push_back(stream);
+      return;
+    }
+  }
+  inflateEnd(stream);
+  delete stream;
+}
+
+void TZlibStreamPool::releaseDeflate(z_stream* stream, int compLevel) {
+  if (deflateReset(stream) == Z_OK) {
+    Guard g(mutex_);
+    std::vector<z_stream*>& idle = deflaters_[compLevel];
+    if (idle.size() < maxIdle_) {
+      idle.push_back(stream);
+      return;
+    }
+  }
+  deflateEnd(stream);
+  delete stream;
+}
+
+size_t TZlibStreamPool::size() const {
+  Guard g(mutex_);
+  size_t idle = inflaters_.size();
+  for (std::map<int, std::vector<z_stream*> >::const_iterator level = deflaters_.begin();
+       level != deflaters_.end();
+       ++level) {
+    idle += level->second.size();
+  }
+  return idle;
+}
+
 // Don't call this outside of the constructor.
 void TZlibTransport::initZlib() {
+  if (stream_pool_) {
+    rstream_ = stream_pool_->acquireInflate();
+    try {
+      wstream_ = stream_pool_->acquireDeflate(comp_level_);
+    } catch (...) {
+      stream_pool_->releaseInflate(rstream_);
+      throw;
+    }
+
+    rstream_->next_in = crbuf_;
+    wstream_->next_in = uwbuf_;
+    rstream_->next_out = urbuf_;
+    wstream_->next_out = cwbuf_;
+    rstream_->avail_in = 0;
+    wstream_->avail_in = 0;
+    rstream_->avail_out = urbuf_size_;
+    wstream_->avail_out = cwbuf_size_;
+    return;
+  }
+
   int rv;
   bool r_init = false;
   try {
@@ -88,6 +216,26 @@ inline void TZlibTransport::checkZlibRvNothrow(int status, const char* message)
 }
 
 TZlibTransport::~TZlibTransport() {
+  if (pending_flushes_ > 0 && !output_finished_) {
+    try {
+      flushNow();
+    } catch (const std::exception& e) {
+      string output = string("TZlibTransport: batched messages lost in destructor: ") + e.what();
+      GlobalOutput(output.c_str());
+    }
+  }
+
+  if (stream_pool_) {
+    // Unflushed data is discarded, as below.
+    stream_pool_->releaseInflate(rstream_);
+    stream_pool_->releaseDeflate(wstream_, comp_level_);
+    delete[] urbuf_;
+    delete[] crbuf_;
+    delete[] uwbuf_;
+    delete[] cwbuf_;
+    return;
+  }
+
   int rv;
   rv = inflateEnd(rstream_);
   checkZlibRvNothrow(rv, rstream_->msg);
@@ -255,7 +403,64 @@ void TZlibTransport::flush() {
     throw TTransportException(TTransportException::BAD_ARGS, "flush() called after finish()");
   }
 
-  flushToTransport(Z_FULL_FLUSH);
+  if (++pending_flushes_ < flush_batch_) {
+    if (flush_max_delay_ == 0) {
+      return;
+    }
+    int64_t now = apache::thrift::concurrency::Util::monotonicTimeTicks(1000);
+    if (pending_flushes_ == 1) {
+      first_pending_ms_ = now;
+    }
+    if (now - first_pending_ms_ < flush_max_delay_) {
+      return;
+    }
+  }
+  flushNow();
+}
+
+void TZlibTransport::close() {
+  try {
+    if (pending_flushes_ > 0 && !output_finished_) {
+      flushNow();
+    }
+  } catch (...) {
+    transport_->close();
+    throw;
+  }
+  transport_->close();
+}
+
+void TZlibTransport::flushNow() {
+  if (output_finished_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "flush() called after finish()");
+  }
+
+  pending_flushes_ = 0;
+  flushToTransport(flush_mode_);
+}
+
+void TZlibTransport::checkFlushMode(int flush_mode) {
+  if (flush_mode != Z_FULL_FLUSH && flush_mode != Z_SYNC_FLUSH) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TZlibTransport: flush mode must be Z_FULL_FLUSH or Z_SYNC_FLUSH");
+  }
+}
+
+void TZlibTransport::checkFlushBatch(uint32_t messages) {
+  if (messages == 0) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TZlibTransport: flush batch must be at least 1");
+  }
+}
+
+void TZlibTransport::setFlushMode(int flush_mode) {
+  checkFlushMode(flush_mode);
+  flush_mode_ = flush_mode;
+}
+
+void TZlibTransport::setFlushBatch(uint32_t messages) {
+  checkFlushBatch(messages);
+  flush_batch_ = messages;
 }
 
 void TZlibTransport::finish() {
@@ -263,6 +468,7 @@ void TZlibTransport::finish() {
     throw TTransportException(TTransportException::BAD_ARGS, "finish() called more than once");
   }
 
+  pending_flushes_ = 0;
   flushToTransport(Z_FINISH);
 }
 
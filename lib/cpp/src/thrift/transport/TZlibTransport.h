@@ -20,9 +20,12 @@
 #ifndef _THRIFT_TRANSPORT_TZLIBTRANSPORT_H_
 #define _THRIFT_TRANSPORT_TZLIBTRANSPORT_H_ 1
 
+#include <thrift/concurrency/Mutex.h>
 #include <thrift/transport/TTransport.h>
 #include <thrift/transport/TVirtualTransport.h>
 #include <thrift/TToString.h>
+#include <map>
+#include <vector>
 #include <zlib.h>
 
 struct z_stream_s;
@@ -60,6 +63,39 @@ public:
   std::string zlib_msg_;
 };
 
+/**
+ * Keeps initialized zlib streams for reuse by TZlibTransports.  deflateInit
+ * allocates a few hundred kilobytes of state, which dominates the cost of a
+ * short-lived transport (e.g. one per request); a pooled stream is only
+ * reset before it is handed out again.
+ *
+ * At most maxIdle streams of each kind are kept; the rest are freed.
+ */
+class TZlibStreamPool {
+public:
+  explicit TZlibStreamPool(size_t maxIdle = 64) : maxIdle_(maxIdle) {}
+  ~TZlibStreamPool();
+
+  /** Returns a stream ready for inflate(). */
+  struct z_stream_s* acquireInflate();
+
+  /** Returns a stream ready for deflate() at compression level compLevel. */
+  struct z_stream_s* acquireDeflate(int compLevel);
+
+  void releaseInflate(struct z_stream_s* stream);
+  void releaseDeflate(struct z_stream_s* stream, int compLevel);
+
+  /** Number of idle streams in the pool. */
+  size_t size() const;
+
+private:
+  size_t maxIdle_;
+
+  mutable apache::thrift::concurrency::Mutex mutex_;
+  std::vector<struct z_stream_s*> inflaters_;
+  std::map<int, std::vector<struct z_stream_s*> > deflaters_; // keyed by level
+};
+
 /**
  * This transport uses zlib to compress on write and decompress on read
  *
@@ -77,13 +113,16 @@ public:
    * @param uwbuf_size   Uncompressed buffer size for writing.
    * @param cwbuf_size   Compressed buffer size for writing.
    * @param comp_level   Compression level (0=none[fast], 6=default, 9=max[slow]).
+   * @param stream_pool  Pool to take the zlib streams from, if any.
    */
   TZlibTransport(stdcxx::shared_ptr<TTransport> transport,
                  int urbuf_size = DEFAULT_URBUF_SIZE,
                  int crbuf_size = DEFAULT_CRBUF_SIZE,
                  int uwbuf_size = DEFAULT_UWBUF_SIZE,
                  int cwbuf_size = DEFAULT_CWBUF_SIZE,
-                 int16_t comp_level = Z_DEFAULT_COMPRESSION)
+                 int16_t comp_level = Z_DEFAULT_COMPRESSION,
+                 stdcxx::shared_ptr<TZlibStreamPool> stream_pool
+                 = stdcxx::shared_ptr<TZlibStreamPool>())
     : transport_(transport),
       urpos_(0),
       uwpos_(0),
@@ -99,7 +138,13 @@ public:
       cwbuf_(NULL),
       rstream_(NULL),
       wstream_(NULL),
-      comp_level_(comp_level) {
+      comp_level_(comp_level),
+      stream_pool_(stream_pool),
+      flush_mode_(Z_FULL_FLUSH),
+      flush_batch_(1),
+      flush_max_delay_(0),
+      pending_flushes_(0),
+      first_pending_ms_(0) {
     if (uwbuf_size_ < MIN_DIRECT_DEFLATE_SIZE) {
       // Have to copy this into a local because of a linking issue.
       int minimum = MIN_DIRECT_DEFLATE_SIZE;
@@ -135,6 +180,8 @@ public:
    * Warning: Destroying a TZlibTransport object may discard any written but
    * unflushed data.  You must explicitly call flush() or finish() to ensure
    * that data is actually written and flushed to the underlying transport.
+   * Messages that flush() held back for a batch are flushed here, as a best
+   * effort: a failure is logged, not thrown.
    */
   ~TZlibTransport();
 
@@ -143,14 +190,58 @@ public:
 
   void open() { transport_->open(); }
 
-  void close() { transport_->close(); }
+  /** Flushes the messages held back for a batch, then closes. */
+  void close();
 
   uint32_t read(uint8_t* buf, uint32_t len);
 
   void write(const uint8_t* buf, uint32_t len);
 
+  /**
+   * Ends the current message.  Depending on the flush batch, this either
+   * pushes everything written so far to the underlying transport, or
+   * only counts the message and leaves it for a later flush.
+   */
   void flush();
 
+  /** Pushes everything written so far out, whatever the flush batch. */
+  void flushNow();
+
+  /**
+   * Selects how flush() ends a message: Z_FULL_FLUSH (the default) makes
+   * each flushed block decodable on its own, while Z_SYNC_FLUSH keeps the
+   * compression history, which compresses runs of small messages much
+   * better.
+   */
+  void setFlushMode(int flush_mode);
+  int getFlushMode() const { return flush_mode_; }
+
+  /**
+   * Combines this many flush() calls into one flush of the underlying
+   * transport, so that the sync marker and the write are paid once per
+   * batch.  Only suitable when the peer does not wait for each message
+   * (e.g. oneway calls or logging); a request/response client would wait
+   * forever for a reply to a request that was never sent.
+   *
+   * Batching delays delivery: held-back messages go out when the batch
+   * fills, on flushNow() or close(), or when the transport is destroyed.
+   */
+  void setFlushBatch(uint32_t messages);
+  uint32_t getFlushBatch() const { return flush_batch_; }
+
+  /**
+   * Also ends a batch at the first flush() that comes this many
+   * milliseconds or more after the oldest message held back; 0 (the
+   * default) sets no limit.  There is no timer: a writer that goes quiet
+   * with messages held back must call flushNow() or close() to send them.
+   */
+  void setFlushMaxDelay(uint32_t milliseconds) { flush_max_delay_ = milliseconds; }
+  uint32_t getFlushMaxDelay() const { return flush_max_delay_; }
+
+  /** Throw TTransportException(BAD_ARGS) unless the setting is valid. */
+  static void checkFlushMode(int flush_mode);
+  static void checkFlushBatch(uint32_t messages);
+
   /**
    * Finalize the zlib stream.
    *
@@ -219,6 +310,13 @@ protected:
   struct z_stream_s* wstream_;
 
   const int comp_level_;
+
+  stdcxx::shared_ptr<TZlibStreamPool> stream_pool_;
+  int flush_mode_;
+  uint32_t flush_batch_;
+  uint32_t flush_max_delay_;
+  uint32_t pending_flushes_;
+  int64_t first_pending_ms_;
 };
 
 /**
@@ -227,13 +325,54 @@ protected:
  */
 class TZlibTransportFactory : public TTransportFactory {
 public:
-  TZlibTransportFactory() {}
+  TZlibTransportFactory() : flush_mode_(Z_FULL_FLUSH), flush_batch_(1), flush_max_delay_(0) {}
+
+  /**
+   * Transports created by this factory share the zlib streams in
+   * stream_pool, so creating one per connection or per request does not
+   * have to initialize zlib each time.
+   */
+  explicit TZlibTransportFactory(stdcxx::shared_ptr<TZlibStreamPool> stream_pool)
+    : stream_pool_(stream_pool),
+      flush_mode_(Z_FULL_FLUSH),
+      flush_batch_(1),
+      flush_max_delay_(0) {}
 
   virtual ~TZlibTransportFactory() {}
 
   virtual stdcxx::shared_ptr<TTransport> getTransport(stdcxx::shared_ptr<TTransport> trans) {
-    return stdcxx::shared_ptr<TTransport>(new TZlibTransport(trans));
+    TZlibTransport* zlib = new TZlibTransport(trans,
+                                              TZlibTransport::DEFAULT_URBUF_SIZE,
+                                              TZlibTransport::DEFAULT_CRBUF_SIZE,
+                                              TZlibTransport::DEFAULT_UWBUF_SIZE,
+                                              TZlibTransport::DEFAULT_CWBUF_SIZE,
+                                              Z_DEFAULT_COMPRESSION,
+                                              stream_pool_);
+    zlib->setFlushMode(flush_mode_);
+    zlib->setFlushBatch(flush_batch_);
+    zlib->setFlushMaxDelay(flush_max_delay_);
+    return stdcxx::shared_ptr<TTransport>(zlib);
   }
+
+  /**
+   * Applied to every transport created from now on.  Invalid values throw
+   * here, as they do on TZlibTransport.
+   */
+  void setFlushMode(int flush_mode) {
+    TZlibTransport::checkFlushMode(flush_mode);
+    flush_mode_ = flush_mode;
+  }
+  void setFlushBatch(uint32_t messages) {
+    TZlibTransport::checkFlushBatch(messages);
+    flush_batch_ = messages;
+  }
+  void setFlushMaxDelay(uint32_t milliseconds) { flush_max_delay_ = milliseconds; }
+
+private:
+  stdcxx::shared_ptr<TZlibStreamPool> stream_pool_;
+  int flush_mode_;
+  uint32_t flush_batch_;
+  uint32_t flush_max_delay_;
 };
 }
 }
@@ -17,228 +17,481 @@
  * under the License.
  */
 
+/*
+ * Serialization benchmarks.
+ *
+ * Every combination of protocol, data shape and operation is a benchmark.
+ * Each write or read is of one whole message holding a struct of the shape,
+ * over a TMemoryBuffer, so that framing protocols pay for their frames.  A
+ * benchmark is warmed up, calibrated to run for at least --min-time-ms per
+ * repetition, and then repeated --repetitions times; it reports the median,
+ * minimum, mean and standard deviation of the time per operation, the bytes
+ * per message and the heap allocations per operation.
+ *
+ * Usage: Benchmark [--quick] [--json] [--filter=substring]
+ *                  [--repetitions=n] [--min-time-ms=n]
+ *
+ * --json prints one JSON document instead of a table, for tracking results
+ * from run to run; --quick makes a short smoke test of it all.
+ */
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
-#include <iostream>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
 #include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/protocol/TCompactProtocol.h"
+#include "thrift/protocol/TJSONProtocol.h"
+#ifdef BENCHMARK_HEADER_PROTOCOL
+#include "thrift/protocol/THeaderProtocol.h"
+#endif
 #include "thrift/stdcxx.h"
+#include "thrift/transport/PlatformSocket.h"
 #include "thrift/transport/TBufferTransports.h"
 #include "gen-cpp/DebugProtoTest_types.h"
-
-#ifdef HAVE_SYS_TIME_H
-#include <sys/time.h>
+#include "gen-cpp/Recursive_types.h"
+
+using namespace thrift::test::debug;
+using namespace apache::thrift::protocol;
+using apache::thrift::stdcxx::shared_ptr;
+using apache::thrift::transport::TMemoryBuffer;
+
+#if __cplusplus >= 201103L
+#define BENCHMARK_THROW_BAD_ALLOC
+#define BENCHMARK_NO_THROW noexcept
+#else
+#define BENCHMARK_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define BENCHMARK_NO_THROW throw()
 #endif
 
-class Timer {
-public:
-  timeval vStart;
+// Counts heap allocations, for allocations per operation
+static uint64_t allocations = 0;
 
-  Timer() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
-  void start() { THRIFT_GETTIMEOFDAY(&vStart, 0); }
-
-  double frame() {
-    timeval vEnd;
-    THRIFT_GETTIMEOFDAY(&vEnd, 0);
-    double dstart = vStart.tv_sec + ((double)vStart.tv_usec / 1000000.0);
-    double dend = vEnd.tv_sec + ((double)vEnd.tv_usec / 1000000.0);
-    return dend - dstart;
+void* operator new(size_t size) BENCHMARK_THROW_BAD_ALLOC {
+  ++allocations;
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == NULL) {
+    throw std::bad_alloc();
   }
-};
+  return p;
+}
 
-int main() {
-  using namespace thrift::test::debug;
-  using namespace apache::thrift::transport;
-  using namespace apache::thrift::protocol;
-  using std::cout;
-  using std::endl;
+void* operator new[](size_t size) BENCHMARK_THROW_BAD_ALLOC {
+  return operator new(size);
+}
 
-  OneOfEach ooe;
-  ooe.im_true = true;
-  ooe.im_false = false;
-  ooe.a_bite = 0x7f;
-  ooe.integer16 = 27000;
-  ooe.integer32 = 1 << 24;
-  ooe.integer64 = (uint64_t)6000 * 1000 * 1000;
-  ooe.double_precision = M_PI;
-  ooe.some_characters = "JSON THIS! \"\1";
-  ooe.zomg_unicode = "\xd7\n\a\t";
-  ooe.base64 = "\1\2\3\255";
+void operator delete(void* p) BENCHMARK_NO_THROW {
+  free(p);
+}
+
+void operator delete[](void* p) BENCHMARK_NO_THROW {
+  free(p);
+}
 
-  int num = 100000;
-  apache::thrift::stdcxx::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer(num*1000));
+static int64_t nowNsec() {
+#ifdef CLOCK_MONOTONIC
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+  struct timeval now;
+  THRIFT_GETTIMEOFDAY(&now, NULL);
+  return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_usec * 1000;
+#endif
+}
 
-  uint8_t* data = NULL;
-  uint32_t datasize = 0;
+/**
+ * Runs one benchmark some number of times.
+ */
+class Runner {
+public:
+  virtual ~Runner() {}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
+  virtual void run(uint64_t iterations) = 0;
 
-    for (int i = 0; i < num; i++) {
-      ooe.write(&prot);
-    }
-    elapsed = timer.frame();
-    cout << "Write big endian: " << num / (1000 * elapsed) << " kHz" << endl;
-  }
+  // the size of the message written or read
+  virtual uint32_t getMessageSize() = 0;
+};
 
-  buf->getBuffer(&data, &datasize);
+template <typename Protocol_, typename Struct_>
+static void writeMessage(Protocol_& proto, const Struct_& value) {
+  proto.writeMessageBegin("benchmark", T_CALL, 0);
+  value.write(&proto);
+  proto.writeMessageEnd();
+  proto.getTransport()->writeEnd();
+  proto.getTransport()->flush();
+}
 
-  {
-    apache::thrift::stdcxx::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
-    OneOfEach ooe2;
-    double elapsed = 0.0;
-    Timer timer;
+template <typename Protocol_, typename Struct_>
+class WriteRunner : public Runner {
+public:
+  WriteRunner(const Struct_& value)
+    : value_(value), buffer_(new TMemoryBuffer()), proto_(buffer_) {}
 
-    for (int i = 0; i < num; i++) {
-      ooe2.read(&prot);
+  void run(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+      buffer_->resetBuffer();
+      writeMessage(proto_, value_);
     }
-    elapsed = timer.frame();
-    cout << " Read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
   }
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
-
-    for (int i = 0; i < num; i++) {
-      ooe.write(&prot);
-    }
-    elapsed = timer.frame();
-    cout << "Write little endian: " << num / (1000 * elapsed) << " kHz" << endl;
+  uint32_t getMessageSize() {
+    buffer_->resetBuffer();
+    writeMessage(proto_, value_);
+    return buffer_->available_read();
   }
 
-  {
-    OneOfEach ooe2;
-    apache::thrift::stdcxx::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf2);
-    double elapsed = 0.0;
-    Timer timer;
+private:
+  Struct_ value_;
+  shared_ptr<TMemoryBuffer> buffer_;
+  Protocol_ proto_;
+};
 
-    for (int i = 0; i < num; i++) {
-      ooe2.read(&prot);
-    }
-    elapsed = timer.frame();
-    cout << " Read little endian: " << num / (1000 * elapsed) << " kHz" << endl;
+template <typename Protocol_, typename Struct_>
+class ReadRunner : public Runner {
+public:
+  ReadRunner(const Struct_& value) : buffer_(new TMemoryBuffer()), proto_(buffer_) {
+    writeMessage(proto_, value);
+    message_ = buffer_->getBufferAsString();
   }
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
-
-    for (int i = 0; i < num; i++) {
-      ooe.write(&prot);
+  void run(uint64_t iterations) {
+    std::string name;
+    TMessageType type;
+    int32_t seqid;
+    for (uint64_t i = 0; i < iterations; ++i) {
+      buffer_->resetBuffer(reinterpret_cast<uint8_t*>(const_cast<char*>(message_.data())),
+                           static_cast<uint32_t>(message_.size()));
+      Struct_ value;
+      proto_.readMessageBegin(name, type, seqid);
+      value.read(&proto_);
+      proto_.readMessageEnd();
+      proto_.getTransport()->readEnd();
     }
-    elapsed = timer.frame();
-    cout << "Write big endian: " << num / (1000 * elapsed) << " kHz" << endl;
   }
 
-  {
-    apache::thrift::stdcxx::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
-    OneOfEach ooe2;
-    double elapsed = 0.0;
-    Timer timer;
+  uint32_t getMessageSize() { return static_cast<uint32_t>(message_.size()); }
 
-    for (int i = 0; i < num; i++) {
-      ooe2.read(&prot);
-    }
-    elapsed = timer.frame();
-    cout << " Read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+private:
+  shared_ptr<TMemoryBuffer> buffer_;
+  Protocol_ proto_;
+  std::string message_;
+};
+
+/**
+ * Makes Runners for one protocol.
+ */
+class ProtocolBench {
+public:
+  virtual ~ProtocolBench() {}
+
+  virtual Runner* newWriter(const Bonk& value) = 0;
+  virtual Runner* newWriter(const OneOfEach& value) = 0;
+  virtual Runner* newWriter(const RecList& value) = 0;
+  virtual Runner* newWriter(const RecTree& value) = 0;
+  virtual Runner* newWriter(const ListDoublePerf& value) = 0;
+  virtual Runner* newWriter(const SingleMapTestStruct& value) = 0;
+
+  virtual Runner* newReader(const Bonk& value) = 0;
+  virtual Runner* newReader(const OneOfEach& value) = 0;
+  virtual Runner* newReader(const RecList& value) = 0;
+  virtual Runner* newReader(const RecTree& value) = 0;
+  virtual Runner* newReader(const ListDoublePerf& value) = 0;
+  virtual Runner* newReader(const SingleMapTestStruct& value) = 0;
+};
+
+template <typename Protocol_>
+class ProtocolBenchT : public ProtocolBench {
+public:
+  Runner* newWriter(const Bonk& value) { return new WriteRunner<Protocol_, Bonk>(value); }
+  Runner* newWriter(const OneOfEach& value) {
+    return new WriteRunner<Protocol_, OneOfEach>(value);
+  }
+  Runner* newWriter(const RecList& value) { return new WriteRunner<Protocol_, RecList>(value); }
+  Runner* newWriter(const RecTree& value) { return new WriteRunner<Protocol_, RecTree>(value); }
+  Runner* newWriter(const ListDoublePerf& value) {
+    return new WriteRunner<Protocol_, ListDoublePerf>(value);
+  }
+  Runner* newWriter(const SingleMapTestStruct& value) {
+    return new WriteRunner<Protocol_, SingleMapTestStruct>(value);
   }
 
+  Runner* newReader(const Bonk& value) { return new ReadRunner<Protocol_, Bonk>(value); }
+  Runner* newReader(const OneOfEach& value) { return new ReadRunner<Protocol_, OneOfEach>(value); }
+  Runner* newReader(const RecList& value) { return new ReadRunner<Protocol_, RecList>(value); }
+  Runner* newReader(const RecTree& value) { return new ReadRunner<Protocol_, RecTree>(value); }
+  Runner* newReader(const ListDoublePerf& value) {
+    return new ReadRunner<Protocol_, ListDoublePerf>(value);
+  }
+  Runner* newReader(const SingleMapTestStruct& value) {
+    return new ReadRunner<Protocol_, SingleMapTestStruct>(value);
+  }
+};
 
-  data = NULL;
-  datasize = 0;
-  num = 10000000;
+struct Benchmark {
+  std::string name;
+  std::string protocol;
+  std::string shape;
+  std::string op;
+  Runner* runner;
+};
 
-  ListDoublePerf listDoublePerf;
-  listDoublePerf.field.reserve(num);
-  for (int x = 0; x < num; ++x)
-    listDoublePerf.field.push_back(double(x));
+static std::vector<Benchmark> benchmarks;
+
+template <typename Struct_>
+static void addShape(const std::string& protocol,
+                     ProtocolBench& bench,
+                     const std::string& shape,
+                     const Struct_& value) {
+  Benchmark benchmark;
+  benchmark.protocol = protocol;
+  benchmark.shape = shape;
+
+  benchmark.op = "write";
+  benchmark.name = protocol + "/" + shape + "/write";
+  benchmark.runner = bench.newWriter(value);
+  benchmarks.push_back(benchmark);
+
+  benchmark.op = "read";
+  benchmark.name = protocol + "/" + shape + "/read";
+  benchmark.runner = bench.newReader(value);
+  benchmarks.push_back(benchmark);
+}
 
-  buf.reset(new TMemoryBuffer(num * 100));
+static OneOfEach makeOneOfEach() {
+  OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.im_false = false;
+  ooe.a_bite = 0x7f;
+  ooe.integer16 = 27000;
+  ooe.integer32 = 1 << 24;
+  ooe.integer64 = (uint64_t)6000 * 1000 * 1000;
+  ooe.double_precision = M_PI;
+  ooe.some_characters = "JSON THIS! \"\1";
+  ooe.zomg_unicode = "\xd7\n\a\t";
+  ooe.base64 = "\1\2\3\255";
+  return ooe;
+}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
+static RecTree makeTree(int depth) {
+  RecTree tree;
+  tree.item = static_cast<int16_t>(depth);
+  if (depth > 1) {
+    tree.children.push_back(makeTree(depth - 1));
+    tree.children.push_back(makeTree(depth - 1));
+  }
+  return tree;
+}
 
-    listDoublePerf.write(&prot);
-    elapsed = timer.frame();
-    cout << "Double write big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+static void addProtocol(const std::string& protocol, ProtocolBench& bench) {
+  Bonk tiny;
+  tiny.type = 7;
+  tiny.message = "ok";
+  addShape(protocol, bench, "tiny", tiny);
+
+  addShape(protocol, bench, "oneofeach", makeOneOfEach());
+
+  Bonk string;
+  string.type = 7;
+  string.message.assign(256 * 1024, 'x');
+  addShape(protocol, bench, "string256k", string);
+
+  // within the default recursion limit of 64
+  RecList list;
+  RecList* item = &list;
+  for (int16_t i = 0; i < 50; ++i) {
+    item->item = i;
+    item->nextitem.reset(new RecList());
+    item = item->nextitem.get();
   }
+  addShape(protocol, bench, "reclist50", list);
 
-  buf->getBuffer(&data, &datasize);
+  addShape(protocol, bench, "rectree1023", makeTree(10));
 
-  {
-    apache::thrift::stdcxx::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
-    ListDoublePerf listDoublePerf2;
-    double elapsed = 0.0;
-    Timer timer;
+  ListDoublePerf doubles;
+  for (int i = 0; i < 100000; ++i) {
+    doubles.field.push_back(i * M_PI);
+  }
+  addShape(protocol, bench, "doubles100k", doubles);
 
-    listDoublePerf2.read(&prot);
-    elapsed = timer.frame();
-    cout << " Double read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+  SingleMapTestStruct map;
+  for (int32_t i = 0; i < 10000; ++i) {
+    map.i32_map[i * 7919] = i;
   }
+  addShape(protocol, bench, "map10k", map);
+}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
+struct Result {
+  uint64_t iterations;
+  std::vector<double> nsPerOp;
+  double median;
+  double min;
+  double mean;
+  double stddev;
+  uint32_t bytesPerOp;
+  double allocsPerOp;
+};
 
-    listDoublePerf.write(&prot);
-    elapsed = timer.frame();
-    cout << "Double write little endian: " << num / (1000 * elapsed) << " kHz" << endl;
-  }
+static double elapsedNsec(Runner& runner, uint64_t iterations) {
+  int64_t start = nowNsec();
+  runner.run(iterations);
+  return static_cast<double>(nowNsec() - start);
+}
 
-  {
-    ListDoublePerf listDoublePerf2;
-    apache::thrift::stdcxx::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf2);
-    double elapsed = 0.0;
-    Timer timer;
+static Result measure(Runner& runner, int repetitions, int64_t minTimeMs) {
+  Result result;
+  double minTimeNs = static_cast<double>(minTimeMs) * 1000000.0;
+
+  // warm up while finding how many iterations last minTimeMs
+  uint64_t iterations = 1;
+  double elapsed = elapsedNsec(runner, iterations);
+  while (elapsed < minTimeNs) {
+    double scale = elapsed > 0.0 ? minTimeNs / elapsed * 1.2 : 10.0;
+    iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::min(scale, 10.0)) + 1;
+    elapsed = elapsedNsec(runner, iterations);
+  }
+  result.iterations = iterations;
 
-    listDoublePerf2.read(&prot);
-    elapsed = timer.frame();
-    cout << " Double read little endian: " << num / (1000 * elapsed) << " kHz" << endl;
+  uint64_t allocationsBefore = allocations;
+  for (int i = 0; i < repetitions; ++i) {
+    result.nsPerOp.push_back(elapsedNsec(runner, iterations) / iterations);
+  }
+  result.allocsPerOp = static_cast<double>(allocations - allocationsBefore)
+                       / (static_cast<double>(iterations) * repetitions);
+
+  std::vector<double> sorted(result.nsPerOp);
+  std::sort(sorted.begin(), sorted.end());
+  size_t middle = sorted.size() / 2;
+  result.median = sorted.size() % 2 == 1 ? sorted[middle]
+                                         : (sorted[middle - 1] + sorted[middle]) / 2.0;
+  result.min = sorted.front();
+  double sum = 0.0;
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    sum += sorted[i];
   }
+  result.mean = sum / sorted.size();
+  double squares = 0.0;
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    squares += (sorted[i] - result.mean) * (sorted[i] - result.mean);
+  }
+  result.stddev = sorted.size() > 1 ? sqrt(squares / (sorted.size() - 1)) : 0.0;
+  result.bytesPerOp = runner.getMessageSize();
+  return result;
+}
+
+static void printTableHeader() {
+  std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(14)
+            << "median ns/op" << std::setw(14) << "min ns/op" << std::setw(8) << "cv%"
+            << std::setw(12) << "bytes/op" << std::setw(12) << "allocs/op" << std::setw(12)
+            << "MB/s" << std::endl;
+}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
+static void printTableRow(const Benchmark& benchmark, const Result& result) {
+  double cv = result.mean > 0.0 ? result.stddev / result.mean * 100.0 : 0.0;
+  double mbPerSec = result.median > 0.0 ? result.bytesPerOp / result.median * 1000.0 : 0.0;
+  std::cout << std::left << std::setw(32) << benchmark.name << std::right << std::fixed
+            << std::setprecision(1) << std::setw(14) << result.median << std::setw(14)
+            << result.min << std::setw(8) << cv << std::setw(12) << result.bytesPerOp
+            << std::setw(12) << result.allocsPerOp << std::setw(12) << mbPerSec << std::endl;
+}
 
-    listDoublePerf.write(&prot);
-    elapsed = timer.frame();
-    cout << "Double write big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+static void printJSON(const Benchmark& benchmark, const Result& result, bool first) {
+  std::cout << (first ? "\n" : ",\n") << std::fixed << std::setprecision(3) << "  {\"name\":\""
+            << benchmark.name << "\",\"protocol\":\"" << benchmark.protocol << "\",\"shape\":\""
+            << benchmark.shape << "\",\"op\":\"" << benchmark.op
+            << "\",\"iterations\":" << result.iterations
+            << ",\"repetitions\":" << result.nsPerOp.size() << ",\"ns_per_op\":{\"median\":"
+            << result.median << ",\"min\":" << result.min << ",\"mean\":" << result.mean
+            << ",\"stddev\":" << result.stddev << ",\"samples\":[";
+  for (size_t i = 0; i < result.nsPerOp.size(); ++i) {
+    std::cout << (i == 0 ? "" : ",") << result.nsPerOp[i];
   }
+  std::cout << "]},\"bytes_per_op\":" << result.bytesPerOp
+            << ",\"allocs_per_op\":" << result.allocsPerOp << "}";
+}
 
-  {
-    apache::thrift::stdcxx::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
-    ListDoublePerf listDoublePerf2;
-    double elapsed = 0.0;
-    Timer timer;
+static bool parseFlag(const char* arg, const char* flag, const char** value) {
+  size_t length = strlen(flag);
+  if (strncmp(arg, flag, length) != 0 || arg[length] != '=') {
+    return false;
+  }
+  *value = arg + length + 1;
+  return true;
+}
 
-    listDoublePerf2.read(&prot);
-    elapsed = timer.frame();
-    cout << " Double read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+int main(int argc, char** argv) {
+  bool json = false;
+  std::string filter;
+  int repetitions = 10;
+  int64_t minTimeMs = 50;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* value;
+    if (strcmp(argv[i], "--json") == 0) {
+      json = true;
+    } else if (strcmp(argv[i], "--quick") == 0) {
+      repetitions = 3;
+      minTimeMs = 1;
+    } else if (parseFlag(argv[i], "--filter", &value)) {
+      filter = value;
+    } else if (parseFlag(argv[i], "--repetitions", &value) && atoi(value) > 0) {
+      repetitions = atoi(value);
+    } else if (parseFlag(argv[i], "--min-time-ms", &value) && atoi(value) >= 0) {
+      minTimeMs = atoi(value);
+    } else {
+      std::cerr << "Usage: " << argv[0] << " [--quick] [--json] [--filter=substring]"
+                << " [--repetitions=n] [--min-time-ms=n]" << std::endl;
+      return 1;
+    }
   }
 
+  ProtocolBenchT<TBinaryProtocolT<TMemoryBuffer> > binary;
+  ProtocolBenchT<TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> > binaryLE;
+  ProtocolBenchT<TCompactProtocolT<TMemoryBuffer> > compact;
+  ProtocolBenchT<TJSONProtocol> json_;
+  addProtocol("binary", binary);
+  addProtocol("binary_le", binaryLE);
+  addProtocol("compact", compact);
+  addProtocol("json", json_);
+#ifdef BENCHMARK_HEADER_PROTOCOL
+  ProtocolBenchT<THeaderProtocol> header;
+  addProtocol("header", header);
+#endif
+
+  if (json) {
+    std::cout << "{\"benchmarks\":[";
+  } else {
+    printTableHeader();
+  }
+  bool first = true;
+  for (size_t i = 0; i < benchmarks.size(); ++i) {
+    if (benchmarks[i].name.find(filter) != std::string::npos) {
+      Result result = measure(*benchmarks[i].runner, repetitions, minTimeMs);
+      if (json) {
+        printJSON(benchmarks[i], result, first);
+      } else {
+        printTableRow(benchmarks[i], result);
+      }
+      first = false;
+    }
+    delete benchmarks[i].runner;
+  }
+  if (json) {
+    std::cout << "\n]}" << std::endl;
+  }
 
   return 0;
 }
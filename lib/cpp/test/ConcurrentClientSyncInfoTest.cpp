@@ -0,0 +1,290 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE ConcurrentClientSyncInfoTest
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/async/TConcurrentClientSyncInfo.h>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/Thread.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TTransportException.h>
+
+#include <algorithm>
+#include <boost/atomic.hpp>
+#include <limits>
+#include <vector>
+
+using apache::thrift::async::TConcurrentClientSyncInfo;
+using apache::thrift::async::TConcurrentRecvSentry;
+using apache::thrift::async::TConcurrentSendSentry;
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::PlatformThreadFactory;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::protocol::T_REPLY;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::stdcxx::shared_ptr;
+using apache::thrift::transport::TTransportException;
+
+namespace {
+
+// what a generated recv_ does once its reply has been read
+void finishCall(TConcurrentClientSyncInfo& sync, int32_t seqid) {
+  TConcurrentRecvSentry sentry(&sync, seqid);
+  sentry.commit();
+}
+
+int32_t nextSeqId(int32_t seqid) {
+  return static_cast<int32_t>(static_cast<uint32_t>(seqid) + 1);
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_seqid_wraparound) {
+  TConcurrentClientSyncInfo sync(4);
+  int32_t last = sync.generateSeqId();
+  finishCall(sync, last);
+  bool wrapped = false;
+  for (int i = 0; i < 40; ++i) {
+    int32_t seqid = sync.generateSeqId();
+    BOOST_CHECK_EQUAL(nextSeqId(last), seqid);
+    wrapped = wrapped || seqid < last;
+    finishCall(sync, seqid);
+    last = seqid;
+  }
+  BOOST_CHECK(wrapped);
+}
+
+namespace {
+
+// claims a seqid, waiting for a slot if need be
+class SeqIdClaimer : public Runnable {
+public:
+  explicit SeqIdClaimer(TConcurrentClientSyncInfo& sync)
+    : sync_(sync), seqid(0), claimed(false), dead(false) {}
+
+  void run() {
+    try {
+      seqid = sync_.generateSeqId();
+      claimed = true;
+    } catch (const TTransportException&) {
+      dead = true;
+    }
+  }
+
+private:
+  TConcurrentClientSyncInfo& sync_;
+
+public:
+  int32_t seqid;
+  boost::atomic<bool> claimed;
+  boost::atomic<bool> dead;
+};
+}
+
+BOOST_AUTO_TEST_CASE(test_waits_for_a_free_slot) {
+  TConcurrentClientSyncInfo sync(4);
+  std::vector<int32_t> outstanding;
+  for (int i = 0; i < 4; ++i) {
+    outstanding.push_back(sync.generateSeqId());
+  }
+
+  // every slot is held, so the next call waits for one to be freed
+  PlatformThreadFactory factory(false);
+  shared_ptr<SeqIdClaimer> claimer(new SeqIdClaimer(sync));
+  shared_ptr<Thread> thread = factory.newThread(claimer);
+  thread->start();
+  THRIFT_SLEEP_USEC(50000);
+  BOOST_CHECK(!claimer->claimed);
+  finishCall(sync, outstanding[2]);
+  thread->join();
+  BOOST_REQUIRE(claimer->claimed);
+  BOOST_CHECK_EQUAL(outstanding[2] & 3, claimer->seqid & 3);
+
+  // a slot held by a long running call is skipped, not reused
+  finishCall(sync, outstanding[0]);
+  finishCall(sync, outstanding[1]);
+  int32_t after = sync.generateSeqId();
+  BOOST_CHECK((after & 3) != (outstanding[3] & 3));
+  BOOST_CHECK((after & 3) != (claimer->seqid & 3));
+}
+
+BOOST_AUTO_TEST_CASE(test_dead_connection_wakes_slot_waiters) {
+  TConcurrentClientSyncInfo sync(2);
+  sync.generateSeqId();
+  sync.generateSeqId();
+
+  PlatformThreadFactory factory(false);
+  shared_ptr<SeqIdClaimer> claimer(new SeqIdClaimer(sync));
+  shared_ptr<Thread> thread = factory.newThread(claimer);
+  thread->start();
+  THRIFT_SLEEP_USEC(50000);
+  {
+    // a send that fails without committing kills the connection
+    TConcurrentSendSentry sentry(&sync);
+  }
+  thread->join();
+  BOOST_CHECK(claimer->dead);
+  BOOST_CHECK(!claimer->claimed);
+}
+
+namespace {
+
+const int SLOTS = 8;
+const int CLAIMERS = 16;
+const int CLAIMS = 5000;
+
+// Claims seqids from more threads than there are slots, holding each for a
+// moment, and checks that no two outstanding calls ever share a slot.
+class Claimer : public Runnable {
+public:
+  Claimer(TConcurrentClientSyncInfo& sync,
+          Mutex& mutex,
+          std::vector<int32_t>& owners,
+          int& held,
+          int& maxHeld)
+    : sync_(sync),
+      mutex_(mutex),
+      owners_(owners),
+      held_(held),
+      maxHeld_(maxHeld),
+      collisions(0),
+      claims(0) {}
+
+  void run() {
+    for (int i = 0; i < CLAIMS; ++i) {
+      int32_t seqid = sync_.generateSeqId();
+      size_t slot = static_cast<uint32_t>(seqid) % SLOTS;
+      {
+        Guard g(mutex_);
+        if (owners_[slot] != 0) {
+          ++collisions;
+        }
+        owners_[slot] = 1;
+        maxHeld_ = (std::max)(maxHeld_, ++held_);
+      }
+      ++claims;
+      if (i % 16 == 0) {
+        THRIFT_SLEEP_USEC(100);
+      }
+      {
+        Guard g(mutex_);
+        owners_[slot] = 0;
+        --held_;
+      }
+      finishCall(sync_, seqid);
+    }
+  }
+
+private:
+  TConcurrentClientSyncInfo& sync_;
+  Mutex& mutex_;
+  std::vector<int32_t>& owners_;
+  int& held_;
+  int& maxHeld_;
+
+public:
+  int collisions;
+  int claims;
+};
+}
+
+BOOST_AUTO_TEST_CASE(test_concurrent_claims) {
+  TConcurrentClientSyncInfo sync(SLOTS);
+  Mutex mutex;
+  std::vector<int32_t> owners(SLOTS, 0);
+  int held = 0;
+  int maxHeld = 0;
+  PlatformThreadFactory factory(false);
+  std::vector<shared_ptr<Claimer> > claimers;
+  std::vector<shared_ptr<Thread> > threads;
+  for (int i = 0; i < CLAIMERS; ++i) {
+    claimers.push_back(shared_ptr<Claimer>(new Claimer(sync, mutex, owners, held, maxHeld)));
+    threads.push_back(factory.newThread(claimers.back()));
+    threads.back()->start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->join();
+    BOOST_CHECK_EQUAL(0, claimers[i]->collisions);
+    // every call got a slot in the end, by reusing ones the others freed
+    BOOST_CHECK_EQUAL(CLAIMS, claimers[i]->claims);
+  }
+  // the threads outnumber the slots, so every slot was held at once
+  BOOST_CHECK_EQUAL(SLOTS, maxHeld);
+
+  // every slot was given back
+  std::vector<int32_t> outstanding;
+  for (int i = 0; i < SLOTS; ++i) {
+    outstanding.push_back(sync.generateSeqId());
+  }
+  for (int i = 0; i < SLOTS; ++i) {
+    finishCall(sync, outstanding[i]);
+  }
+}
+
+namespace {
+
+// waits for its reply the way a generated recv_ does when another thread
+// holds the input protocol
+class Waiter : public Runnable {
+public:
+  Waiter(TConcurrentClientSyncInfo& sync, int32_t seqid) : sync_(sync), seqid_(seqid), got(0) {}
+
+  void run() {
+    TConcurrentRecvSentry sentry(&sync_, seqid_);
+    std::string fname;
+    TMessageType mtype;
+    int32_t rseqid;
+    while (!sync_.getPending(fname, mtype, rseqid)) {
+      sync_.waitForWork(seqid_);
+    }
+    got = rseqid;
+    sentry.commit();
+  }
+
+private:
+  TConcurrentClientSyncInfo& sync_;
+  int32_t seqid_;
+
+public:
+  int32_t got;
+};
+}
+
+BOOST_AUTO_TEST_CASE(test_reply_handoff) {
+  TConcurrentClientSyncInfo sync(4);
+  int32_t mine = sync.generateSeqId();
+  int32_t theirs = sync.generateSeqId();
+
+  PlatformThreadFactory factory(false);
+  shared_ptr<Waiter> waiter(new Waiter(sync, theirs));
+  shared_ptr<Thread> thread = factory.newThread(waiter);
+  {
+    TConcurrentRecvSentry sentry(&sync, mine);
+    thread->start();
+    // hand the waiter the reply this thread "read", then wait for our own
+    sync.updatePending("method", T_REPLY, theirs);
+    sync.waitForWork(mine);
+    sentry.commit();
+  }
+  thread->join();
+  BOOST_CHECK_EQUAL(theirs, waiter->got);
+}
@@ -0,0 +1,432 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/processor/THttp2ConcurrentProcessor.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/server/TThreadedServer.h>
+#include <thrift/transport/THpack.h>
+#include <thrift/transport/THttp2Transport.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TSocket.h>
+#include <thrift/stdcxx.h>
+#include "gen-cpp/OneWayService.h"
+
+BOOST_AUTO_TEST_SUITE(Http2Test)
+
+using namespace apache::thrift;
+using apache::thrift::concurrency::Monitor;
+using apache::thrift::concurrency::PlatformThreadFactory;
+using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::processor::THttp2ConcurrentProcessor;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::server::TServerEventHandler;
+using apache::thrift::server::TThreadedServer;
+using apache::thrift::transport::THpackDecoder;
+using apache::thrift::transport::THpackEncoder;
+using apache::thrift::transport::THpackHeader;
+using apache::thrift::transport::THpackHeaders;
+using apache::thrift::transport::THttp2Client;
+using apache::thrift::transport::THttp2Connection;
+using apache::thrift::transport::THttp2ServerProtocolFactory;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::transport::TTransportFactory;
+using apache::thrift::stdcxx::shared_ptr;
+
+namespace {
+
+std::string fromHex(const char* hex) {
+  std::string out;
+  for (; hex[0] && hex[1]; hex += 2) {
+    unsigned value;
+    sscanf(hex, "%2x", &value);
+    out.push_back(static_cast<char>(value));
+  }
+  return out;
+}
+
+void decode(THpackDecoder& decoder, const std::string& block, THpackHeaders& headers) {
+  headers.clear();
+  decoder.decode(reinterpret_cast<const uint8_t*>(block.data()),
+                 static_cast<uint32_t>(block.size()),
+                 headers);
+}
+
+class CountingHandler : public onewaytest::OneWayServiceIf {
+public:
+  explicit CountingHandler(Monitor& monitor, int& oneWayCalls)
+    : monitor_(monitor), oneWayCalls_(oneWayCalls) {}
+
+  void roundTripRPC() {}
+  void oneWayRPC() {
+    Synchronized s(monitor_);
+    ++oneWayCalls_;
+    monitor_.notifyAll();
+  }
+
+private:
+  Monitor& monitor_;
+  int& oneWayCalls_;
+};
+
+/**
+ * Holds each round trip until a oneway call has come in.
+ */
+class WaitingHandler : public onewaytest::OneWayServiceIf {
+public:
+  WaitingHandler() : oneWayCalls_(0), released_(0) {}
+
+  void roundTripRPC() {
+    Synchronized s(monitor_);
+    while (oneWayCalls_ == 0) {
+      if (monitor_.waitForTimeRelative(5000) != 0) {
+        return;
+      }
+    }
+    ++released_;
+  }
+  void oneWayRPC() {
+    Synchronized s(monitor_);
+    ++oneWayCalls_;
+    monitor_.notifyAll();
+  }
+  int released() {
+    Synchronized s(monitor_);
+    return released_;
+  }
+
+private:
+  Monitor monitor_;
+  int oneWayCalls_;
+  int released_;
+};
+
+class ReadyHandler : public TServerEventHandler, public Monitor {
+public:
+  ReadyHandler() : listening_(false) {}
+  virtual void preServe() {
+    Synchronized s(*this);
+    listening_ = true;
+    notifyAll();
+  }
+  void waitForListening() {
+    Synchronized s(*this);
+    while (!listening_) {
+      wait();
+    }
+  }
+
+private:
+  bool listening_;
+};
+
+void callMany(shared_ptr<THttp2Connection> connection, int calls, int* failures) {
+  shared_ptr<TTransport> transport(new THttp2Client(connection, "localhost", "/service"));
+  onewaytest::OneWayServiceClient client(
+      shared_ptr<TProtocol>(new TBinaryProtocol(transport)));
+  try {
+    for (int i = 0; i < calls; ++i) {
+      client.oneWayRPC();
+      client.roundTripRPC();
+    }
+  } catch (TException&) {
+    ++*failures;
+  }
+}
+
+void roundTrip(shared_ptr<THttp2Connection> connection) {
+  shared_ptr<TTransport> transport(new THttp2Client(connection, "localhost", "/service"));
+  onewaytest::OneWayServiceClient client(
+      shared_ptr<TProtocol>(new TBinaryProtocol(transport)));
+  client.roundTripRPC();
+}
+
+void echoRequests(shared_ptr<TServerSocket> serverSocket,
+                  uint32_t maxHeaderListSize,
+                  uint32_t maxMessageSize) {
+  shared_ptr<TTransport> accepted = serverSocket->accept();
+  THttp2Connection connection(accepted, THttp2Connection::SERVER);
+  connection.setMaxHeaderListSize(maxHeaderListSize);
+  connection.setMaxMessageSize(maxMessageSize);
+  std::string body;
+  int32_t stream;
+  try {
+    while ((stream = connection.receiveRequest(body)) != 0) {
+      connection.sendResponse(stream, reinterpret_cast<const uint8_t*>(body.data()),
+                              static_cast<uint32_t>(body.size()));
+    }
+  } catch (TTransportException&) {
+    // the connection failed; the client sees it closed
+  }
+}
+
+void echoRequests(shared_ptr<TServerSocket> serverSocket) {
+  echoRequests(serverSocket,
+               THttp2Connection::DEFAULT_MAX_HEADER_LIST_SIZE,
+               THttp2Connection::DEFAULT_MAX_MESSAGE_SIZE);
+}
+}
+
+BOOST_AUTO_TEST_CASE(Hpack_Rfc7541Examples) {
+  std::string huffman;
+  apache::thrift::transport::hpackHuffmanEncode("www.example.com", huffman);
+  BOOST_CHECK(huffman == fromHex("f1e3c2e5f23a6ba0ab90f4ff"));
+
+  // C.4: requests with Huffman coding, sharing one dynamic table
+  THpackDecoder decoder;
+  THpackHeaders headers;
+  decode(decoder, fromHex("828684418cf1e3c2e5f23a6ba0ab90f4ff"), headers);
+  BOOST_REQUIRE_EQUAL(4u, headers.size());
+  BOOST_CHECK(headers[0] == THpackHeader(":method", "GET"));
+  BOOST_CHECK(headers[3] == THpackHeader(":authority", "www.example.com"));
+
+  decode(decoder, fromHex("828684be5886a8eb10649cbf"), headers);
+  BOOST_REQUIRE_EQUAL(5u, headers.size());
+  BOOST_CHECK(headers[3] == THpackHeader(":authority", "www.example.com"));
+  BOOST_CHECK(headers[4] == THpackHeader("cache-control", "no-cache"));
+
+  decode(decoder, fromHex("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"), headers);
+  BOOST_REQUIRE_EQUAL(5u, headers.size());
+  BOOST_CHECK(headers[2] == THpackHeader(":path", "/index.html"));
+  BOOST_CHECK(headers[4] == THpackHeader("custom-key", "custom-value"));
+
+  BOOST_CHECK_THROW(decode(decoder, fromHex("ff"), headers), TException);
+}
+
+BOOST_AUTO_TEST_CASE(Hpack_RepeatedHeadersShrink) {
+  THpackEncoder encoder;
+  THpackDecoder decoder;
+  THpackHeaders headers;
+  headers.push_back(THpackHeader(":method", "POST"));
+  headers.push_back(THpackHeader(":path", "/service"));
+  headers.push_back(THpackHeader("user-agent", "Thrift/1.0"));
+  headers.push_back(THpackHeader("content-length", "123"));
+
+  std::string first;
+  std::string second;
+  encoder.encode(headers, first);
+  encoder.encode(headers, second);
+  BOOST_CHECK_LT(second.size(), first.size());
+
+  THpackHeaders decoded;
+  decode(decoder, first, decoded);
+  BOOST_CHECK(decoded == headers);
+  decode(decoder, second, decoded);
+  BOOST_CHECK(decoded == headers);
+}
+
+BOOST_AUTO_TEST_CASE(Http2_ConcurrentCallsOnOneConnection) {
+  Monitor monitor;
+  int oneWayCalls = 0;
+  shared_ptr<TServerSocket> serverSocket(new TServerSocket("localhost", 0));
+  TThreadedServer server(shared_ptr<onewaytest::OneWayServiceProcessor>(
+                             new onewaytest::OneWayServiceProcessor(
+                                 shared_ptr<CountingHandler>(
+                                     new CountingHandler(monitor, oneWayCalls)))),
+                         serverSocket,
+                         shared_ptr<TTransportFactory>(new TTransportFactory()),
+                         shared_ptr<THttp2ServerProtocolFactory>(new THttp2ServerProtocolFactory(
+                             shared_ptr<TBinaryProtocolFactory>(new TBinaryProtocolFactory()))));
+  server.setOutputProtocolFactory(shared_ptr<TProtocolFactory>());
+  shared_ptr<ReadyHandler> ready(new ReadyHandler());
+  server.setServerEventHandler(ready);
+  boost::thread serverThread(&TThreadedServer::serve, &server);
+  ready->waitForListening();
+
+  shared_ptr<THttp2Connection> connection(
+      new THttp2Connection(shared_ptr<TTransport>(new TSocket("localhost", serverSocket->getPort())),
+                           THttp2Connection::CLIENT));
+  connection->open();
+
+  const int threads = 4;
+  const int calls = 50;
+  int failures[threads] = {0};
+  std::vector<boost::thread*> clients;
+  for (int i = 0; i < threads; ++i) {
+    clients.push_back(new boost::thread(&callMany, connection, calls, &failures[i]));
+  }
+  for (int i = 0; i < threads; ++i) {
+    clients[i]->join();
+    delete clients[i];
+    BOOST_CHECK_EQUAL(0, failures[i]);
+  }
+
+  {
+    // a oneway call may still be in the server's hands after the last reply
+    Synchronized s(monitor);
+    while (oneWayCalls < threads * calls) {
+      BOOST_REQUIRE(monitor.waitForTimeRelative(5000) == 0);
+    }
+  }
+  connection->close();
+  BOOST_CHECK(!connection->isOpen());
+
+  server.stop();
+  serverThread.join();
+}
+
+BOOST_AUTO_TEST_CASE(Http2_LargeBodiesAreFlowControlled) {
+  shared_ptr<TServerSocket> serverSocket(new TServerSocket("localhost", 0));
+  serverSocket->listen();
+  boost::thread serverThread(static_cast<void (*)(shared_ptr<TServerSocket>)>(&echoRequests),
+                             serverSocket);
+
+  THttp2Connection connection(shared_ptr<TTransport>(
+                                  new TSocket("localhost", serverSocket->getPort())),
+                              THttp2Connection::CLIENT);
+  connection.open();
+
+  // larger than the initial 64KB windows, before the peer's settings arrive
+  std::string request(300 * 1024, 'x');
+  for (size_t i = 0; i < request.size(); i += 997) {
+    request[i] = static_cast<char>(i);
+  }
+  int32_t first = connection.sendRequest("localhost", "/echo",
+                                         reinterpret_cast<const uint8_t*>(request.data()),
+                                         static_cast<uint32_t>(request.size()));
+  int32_t second = connection.sendRequest("localhost", "/echo", NULL, 0);
+  BOOST_CHECK_NE(first, second);
+
+  std::string response;
+  connection.receiveResponse(second, response);
+  BOOST_CHECK(response.empty());
+  connection.receiveResponse(first, response);
+  BOOST_CHECK(response == request);
+
+  connection.close();
+  serverThread.join();
+  serverSocket->close();
+}
+
+BOOST_AUTO_TEST_CASE(Http2_StreamsAreServedConcurrently) {
+  // the round trip only returns once the oneway call behind it has run
+  shared_ptr<WaitingHandler> handler(new WaitingHandler());
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+  threadManager->start();
+  shared_ptr<TBinaryProtocolFactory> protocolFactory(new TBinaryProtocolFactory());
+  shared_ptr<TServerSocket> serverSocket(new TServerSocket("localhost", 0));
+  TThreadedServer server(shared_ptr<THttp2ConcurrentProcessor>(new THttp2ConcurrentProcessor(
+                             shared_ptr<onewaytest::OneWayServiceProcessor>(
+                                 new onewaytest::OneWayServiceProcessor(handler)),
+                             protocolFactory,
+                             threadManager)),
+                         serverSocket,
+                         shared_ptr<TTransportFactory>(new TTransportFactory()),
+                         shared_ptr<THttp2ServerProtocolFactory>(
+                             new THttp2ServerProtocolFactory(protocolFactory)));
+  server.setOutputProtocolFactory(shared_ptr<TProtocolFactory>());
+  shared_ptr<ReadyHandler> ready(new ReadyHandler());
+  server.setServerEventHandler(ready);
+  boost::thread serverThread(&TThreadedServer::serve, &server);
+  ready->waitForListening();
+
+  shared_ptr<THttp2Connection> connection(
+      new THttp2Connection(shared_ptr<TTransport>(new TSocket("localhost", serverSocket->getPort())),
+                           THttp2Connection::CLIENT));
+  connection->open();
+  boost::thread waiting(&roundTrip, connection);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+  shared_ptr<TTransport> transport(new THttp2Client(connection, "localhost", "/service"));
+  onewaytest::OneWayServiceClient client(
+      shared_ptr<TProtocol>(new TBinaryProtocol(transport)));
+  client.oneWayRPC();
+  client.roundTripRPC();
+  waiting.join();
+  BOOST_CHECK_EQUAL(2, handler->released());
+
+  connection->close();
+  server.stop();
+  serverThread.join();
+  threadManager->stop();
+}
+
+BOOST_AUTO_TEST_CASE(Http2_OversizedBodyResetsItsStream) {
+  shared_ptr<TServerSocket> serverSocket(new TServerSocket("localhost", 0));
+  serverSocket->listen();
+  boost::thread serverThread(
+      static_cast<void (*)(shared_ptr<TServerSocket>, uint32_t, uint32_t)>(&echoRequests),
+      serverSocket,
+      THttp2Connection::DEFAULT_MAX_HEADER_LIST_SIZE,
+      1000);
+
+  THttp2Connection connection(shared_ptr<TTransport>(
+                                  new TSocket("localhost", serverSocket->getPort())),
+                              THttp2Connection::CLIENT);
+  connection.open();
+
+  std::string request(5000, 'x');
+  int32_t stream = connection.sendRequest("localhost", "/echo",
+                                          reinterpret_cast<const uint8_t*>(request.data()),
+                                          static_cast<uint32_t>(request.size()));
+  std::string response;
+  BOOST_CHECK_THROW(connection.receiveResponse(stream, response), TTransportException);
+
+  // the connection carries on
+  request.resize(1000);
+  stream = connection.sendRequest("localhost", "/echo",
+                                  reinterpret_cast<const uint8_t*>(request.data()),
+                                  static_cast<uint32_t>(request.size()));
+  connection.receiveResponse(stream, response);
+  BOOST_CHECK(response == request);
+
+  connection.close();
+  serverThread.join();
+  serverSocket->close();
+}
+
+BOOST_AUTO_TEST_CASE(Http2_LargeHeaderListFailsTheConnection) {
+  shared_ptr<TServerSocket> serverSocket(new TServerSocket("localhost", 0));
+  serverSocket->listen();
+  boost::thread serverThread(
+      static_cast<void (*)(shared_ptr<TServerSocket>, uint32_t, uint32_t)>(&echoRequests),
+      serverSocket,
+      100,
+      THttp2Connection::DEFAULT_MAX_MESSAGE_SIZE);
+
+  THttp2Connection connection(shared_ptr<TTransport>(
+                                  new TSocket("localhost", serverSocket->getPort())),
+                              THttp2Connection::CLIENT);
+  connection.open();
+
+  std::string response;
+  int32_t stream = connection.sendRequest("localhost", "/echo", NULL, 0);
+  BOOST_CHECK_THROW(connection.receiveResponse(stream, response), TTransportException);
+  BOOST_CHECK(!connection.isOpen());
+
+  connection.close();
+  serverThread.join();
+  serverSocket->close();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
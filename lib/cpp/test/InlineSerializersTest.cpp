@@ -0,0 +1,155 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/stdcxx.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/InlineSerializersTest_types.h"
+
+#define BOOST_TEST_MODULE InlineSerializersTest
+#include <boost/test/unit_test.hpp>
+
+using namespace inlinetest;
+using namespace apache::thrift;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TLEBinaryProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+
+static Everything makeEverything() {
+  Everything e;
+  e.on = true;
+  e.small = -3;
+  e.medium = -30000;
+  e.large = 1 << 30;
+  e.huge = -(1LL << 50);
+  e.real = -2.5;
+  e.color = Color::BLUE;
+  e.name = "inline";
+  e.blob = std::string("\0\1\2", 3);
+  e.__set_flag(false);
+  Point p;
+  p.x = 1;
+  p.y = -1;
+  e.points.push_back(p);
+  e.points.push_back(p);
+  e.counts["a"] = 1;
+  e.counts["b"] = -1;
+  e.origin.x = 7;
+  e.bools.insert(true);
+  e.__set_path(e.points);
+  e.__set_late("late");
+  e.far = 1234567890123LL;
+  e.needed = 5;
+  return e;
+}
+
+// The generic templates, through the virtual interface
+template <typename Protocol>
+static std::string writeGeneric(const Everything& e) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol proto(buffer);
+  TProtocol* generic = &proto;
+  e.write(generic);
+  return buffer->getBufferAsString();
+}
+
+template <typename Protocol>
+static std::string writeInline(const Everything& e) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol proto(buffer);
+  uint32_t xfer = e.write(&proto);
+  std::string bytes(buffer->getBufferAsString());
+  BOOST_CHECK_EQUAL(bytes.size(), xfer);
+  return bytes;
+}
+
+template <typename Protocol>
+static void checkProtocol() {
+  Everything e(makeEverything());
+  BOOST_CHECK(writeGeneric<Protocol>(e) == writeInline<Protocol>(e));
+
+  Everything sparse;
+  sparse.needed = -1;
+  BOOST_CHECK(writeGeneric<Protocol>(sparse) == writeInline<Protocol>(sparse));
+
+  // through a transport that can only lend what it has buffered
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  stdcxx::shared_ptr<TBufferedTransport> transport(new TBufferedTransport(buffer, 16, 16));
+  Protocol proto(transport);
+  uint32_t written = e.write(&proto);
+  written += sparse.write(&proto);
+  transport->flush();
+
+  Everything e2;
+  Everything sparse2;
+  uint32_t read = e2.read(&proto);
+  read += sparse2.read(&proto);
+  BOOST_CHECK(e == e2);
+  BOOST_CHECK(sparse == sparse2);
+  BOOST_CHECK_EQUAL(written, read);
+}
+
+BOOST_AUTO_TEST_CASE(test_inline_binary) {
+  checkProtocol<TBinaryProtocol>();
+  checkProtocol<TLEBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_inline_compact) {
+  checkProtocol<TCompactProtocol>();
+}
+
+template <typename Protocol>
+static void checkOutOfOrderFields() {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol proto(buffer);
+  proto.writeStructBegin("Everything");
+  proto.writeFieldBegin("needed", protocol::T_I32, 41);
+  proto.writeI32(9);
+  proto.writeFieldBegin("on", protocol::T_BOOL, 1);
+  proto.writeBool(true);
+  // wrong type
+  proto.writeFieldBegin("small", protocol::T_STRING, 2);
+  proto.writeString(std::string("x"));
+  // unknown
+  proto.writeFieldBegin("unknown", protocol::T_I64, 3000);
+  proto.writeI64(1);
+  proto.writeFieldBegin("medium", protocol::T_I16, 3);
+  proto.writeI16(-3);
+  proto.writeFieldStop();
+  proto.writeStructEnd();
+
+  Everything e;
+  e.read(&proto);
+  BOOST_CHECK_EQUAL(9, e.needed);
+  BOOST_CHECK(e.on);
+  BOOST_CHECK_EQUAL(0, e.small);
+  BOOST_CHECK(!e.__isset.small);
+  BOOST_CHECK_EQUAL(-3, e.medium);
+  BOOST_CHECK_EQUAL(0, buffer->available_read());
+}
+
+BOOST_AUTO_TEST_CASE(test_inline_out_of_order) {
+  checkOutOfOrderFields<TBinaryProtocol>();
+  checkOutOfOrderFields<TCompactProtocol>();
+}
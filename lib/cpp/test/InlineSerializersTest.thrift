@@ -0,0 +1,57 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+namespace cpp inlinetest
+
+// structs for InlineSerializersTest.cpp, generated with cpp:inline_serializers
+
+enum Color {
+  RED = 1,
+  GREEN = 2,
+  BLUE = 3
+}
+
+struct Point {
+  1: i32 x,
+  2: i32 y
+}
+
+struct Everything {
+  1: bool on,
+  2: byte small,
+  3: i16 medium,
+  4: i32 large,
+  5: i64 huge,
+  6: double real,
+  7: Color color,
+  8: string name,
+  9: binary blob,
+  10: optional i32 maybe,
+  11: optional bool flag,
+  12: list<Point> points,
+  13: map<string, i64> counts,
+  14: Point origin,
+  15: set<bool> bools,
+  16: list<Point> path (cpp.lazy),
+  // far enough from the last field for the compact protocol to spell out its id
+  40: i64 far,
+  41: required i32 needed,
+  // declared out of order
+  35: optional string late
+}
@@ -19,8 +19,11 @@
 
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <cstring>
 #include <iomanip>
+#include <limits>
 #include <sstream>
+#include <vector>
 #include <thrift/protocol/TJSONProtocol.h>
 #include <thrift/stdcxx.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -31,6 +34,7 @@
 
 using namespace thrift::test::debug;
 using namespace apache::thrift;
+using apache::thrift::transport::TBufferedTransport;
 using apache::thrift::transport::TMemoryBuffer;
 using apache::thrift::protocol::TJSONProtocol;
 
@@ -55,8 +59,8 @@ BOOST_AUTO_TEST_CASE(test_json_proto_1) {
 
   const std::string expected_result(
   "{\"1\":{\"tf\":1},\"2\":{\"tf\":0},\"3\":{\"i8\":127},\"4\":{\"i16\":27000},"
-  "\"5\":{\"i32\":16777216},\"6\":{\"i64\":6000000000},\"7\":{\"dbl\":3.1415926"
-  "535897931},\"8\":{\"str\":\"JSON THIS! \\\"\\u0001\"},\"9\":{\"str\":\"\xd7\\"
+  "\"5\":{\"i32\":16777216},\"6\":{\"i64\":6000000000},\"7\":{\"dbl\":3.141592"
+  "653589793},\"8\":{\"str\":\"JSON THIS! \\\"\\u0001\"},\"9\":{\"str\":\"\xd7\\"
   "n\\u0007\\t\"},\"10\":{\"tf\":0},\"11\":{\"str\":\"AQIDrQ\"},\"12\":{\"lst\""
   ":[\"i8\",3,1,2,3]},\"13\":{\"lst\":[\"i16\",3,1,2,3]},\"14\":{\"lst\":[\"i64"
   "\",3,1,2,3]}}");
@@ -95,7 +99,7 @@ BOOST_AUTO_TEST_CASE(test_json_proto_2) {
     "{\"1\":{\"rec\":{\"1\":{\"i32\":31337},\"2\":{\"str\":\"I am a bonk... xor"
     "!\"}}},\"2\":{\"rec\":{\"1\":{\"tf\":1},\"2\":{\"tf\":0},\"3\":{\"i8\":127"
     "},\"4\":{\"i16\":16},\"5\":{\"i32\":32},\"6\":{\"i64\":64},\"7\":{\"dbl\":"
-    "1.6180339887498949},\"8\":{\"str\":\":R (me going \\\"rrrr\\\")\"},\"9\":{"
+    "1.618033988749895},\"8\":{\"str\":\":R (me going \\\"rrrr\\\")\"},\"9\":{"
     "\"str\":\"ӀⅮΝ Нοⅿоɡгаρℎ Αttαⅽκǃ‼\"},\"10\":{\"tf\":0},\"11\":{\"str\":\""
     "AQIDrQ\"},\"12\":{\"lst\":[\"i8\",3,1,2,3]},\"13\":{\"lst\":[\"i16\",3,1,2"
     ",3]},\"14\":{\"lst\":[\"i64\",3,1,2,3]}}}}"
@@ -159,12 +163,12 @@ BOOST_AUTO_TEST_CASE(test_json_proto_3) {
   const std::string expected_result(
   "{\"1\":{\"lst\":[\"rec\",2,{\"1\":{\"tf\":1},\"2\":{\"tf\":0},\"3\":{\"i8\":"
   "34},\"4\":{\"i16\":27000},\"5\":{\"i32\":16777216},\"6\":{\"i64\":6000000000"
-  "},\"7\":{\"dbl\":3.1415926535897931},\"8\":{\"str\":\"JSON THIS! \\\"\\u0001"
+  "},\"7\":{\"dbl\":3.141592653589793},\"8\":{\"str\":\"JSON THIS! \\\"\\u0001"
   "\"},\"9\":{\"str\":\"\xd7\\n\\u0007\\t\"},\"10\":{\"tf\":0},\"11\":{\"str\":"
   "\"AQIDrQ\"},\"12\":{\"lst\":[\"i8\",3,1,2,3]},\"13\":{\"lst\":[\"i16\",3,1,2"
   ",3]},\"14\":{\"lst\":[\"i64\",3,1,2,3]}},{\"1\":{\"tf\":1},\"2\":{\"tf\":0},"
   "\"3\":{\"i8\":51},\"4\":{\"i16\":16},\"5\":{\"i32\":32},\"6\":{\"i64\":64},"
-  "\"7\":{\"dbl\":1.6180339887498949},\"8\":{\"str\":\":R (me going \\\"rrrr\\\""
+  "\"7\":{\"dbl\":1.618033988749895},\"8\":{\"str\":\":R (me going \\\"rrrr\\\""
   ")\"},\"9\":{\"str\":\"ӀⅮΝ Нοⅿоɡгаρℎ Αttαⅽκǃ‼\"},\"10\":{\"tf\":0},\"11\":{"
   "\"str\":\"AQIDrQ\"},\"12\":{\"lst\":[\"i8\",3,1,2,3]},\"13\":{\"lst\":[\"i16"
   "\",3,1,2,3]},\"14\":{\"lst\":[\"i64\",3,1,2,3]}}]},\"2\":{\"set\":[\"lst\",3"
@@ -225,8 +229,8 @@ BOOST_AUTO_TEST_CASE(test_json_proto_6) {
 
   const std::string expected_result(
   "{\"1\":{\"dbl\":\"NaN\"},\"2\":{\"dbl\":\"Infinity\"},\"3\":{\"dbl\":\"-Infi"
-  "nity\"},\"4\":{\"dbl\":3.3333333333333335},\"5\":{\"dbl\":9.9999999999999994e+"
-  "304},\"6\":{\"dbl\":1e-305},\"7\":{\"dbl\":0},\"8\":{\"dbl\":-0}}"
+  "nity\"},\"4\":{\"dbl\":3.3333333333333335},\"5\":{\"dbl\":1e+305},"
+  "\"6\":{\"dbl\":1e-305},\"7\":{\"dbl\":0},\"8\":{\"dbl\":-0}}"
   );
 
   const std::string result(apache::thrift::ThriftJSONString(dub));
@@ -235,6 +239,107 @@ BOOST_AUTO_TEST_CASE(test_json_proto_6) {
     "Expected:\n" << expected_result << "\nGotten:\n" << result);
 }
 
+BOOST_AUTO_TEST_CASE(test_json_numbers_round_trip) {
+  const double doubles[] = {0.1, -2.5e-8, 1e22, 1e23, 123456789012345678.0, 5e-324,
+                            2.2250738585072014e-308, 1.7976931348623157e308, -0.0, 0.3};
+  const int64_t integers[] = {0, -1, (std::numeric_limits<int64_t>::min)(),
+                              (std::numeric_limits<int64_t>::max)()};
+  const size_t numDoubles = sizeof(doubles) / sizeof(doubles[0]);
+  const size_t numIntegers = sizeof(integers) / sizeof(integers[0]);
+
+  // numbers are parsed in place when the transport lends its buffer, and
+  // copied out when they straddle the end of a small read buffer
+  for (uint32_t readBufferSize = 4; readBufferSize <= 512; readBufferSize *= 128) {
+    stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+    stdcxx::shared_ptr<TBufferedTransport> trans(
+        new TBufferedTransport(buffer, readBufferSize, 512));
+    stdcxx::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(trans));
+
+    proto->writeListBegin(protocol::T_DOUBLE, static_cast<uint32_t>(numDoubles + numIntegers));
+    for (size_t i = 0; i < numDoubles; ++i) {
+      proto->writeDouble(doubles[i]);
+    }
+    for (size_t i = 0; i < numIntegers; ++i) {
+      proto->writeI64(integers[i]);
+    }
+    proto->writeListEnd();
+    trans->flush();
+    BOOST_CHECK(buffer->getBufferAsString().find("0.1,-2.5e-08,1e+22,")
+                != std::string::npos);
+
+    protocol::TType elemType;
+    uint32_t size;
+    proto->readListBegin(elemType, size);
+    for (size_t i = 0; i < numDoubles; ++i) {
+      double d;
+      proto->readDouble(d);
+      BOOST_CHECK(memcmp(&d, &doubles[i], sizeof(d)) == 0);
+    }
+    for (size_t i = 0; i < numIntegers; ++i) {
+      int64_t i64;
+      proto->readI64(i64);
+      BOOST_CHECK_EQUAL(integers[i], i64);
+    }
+    proto->readListEnd();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_json_numbers_out_of_range) {
+  const char* inputs[] = {"[\"i16\",1,32768]", "[\"i16\",1,-32769]", "[\"i16\",1,--1]"};
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+    stdcxx::shared_ptr<TMemoryBuffer> buffer(
+        new TMemoryBuffer((uint8_t*)inputs[i], static_cast<uint32_t>(strlen(inputs[i]))));
+    stdcxx::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+    protocol::TType elemType;
+    uint32_t size;
+    int16_t i16;
+    proto->readListBegin(elemType, size);
+    BOOST_CHECK_THROW(proto->readI16(i16), apache::thrift::protocol::TProtocolException);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_json_strings_round_trip) {
+  // special characters at every offset of a vector-sized block, including
+  // the first byte of a surrogate pair and bytes with the top bit set
+  std::vector<std::string> strings;
+  const char* specials[] = {"\"", "\\", "\n", "\x01", "\x1f", "\x7f", "\xc3\xa9",
+                            "\xf0\x9d\x94\xbe"};
+  for (size_t i = 0; i < sizeof(specials) / sizeof(specials[0]); ++i) {
+    for (size_t offset = 0; offset < 40; offset += 3) {
+      strings.push_back(std::string(offset, 'a') + specials[i] + std::string(40 - offset, 'b'));
+    }
+  }
+  strings.push_back(std::string(100000, 'x') + "\"");
+  strings.push_back("");
+
+  for (uint32_t readBufferSize = 7; readBufferSize <= 7 * 1024; readBufferSize *= 1024) {
+    stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+    stdcxx::shared_ptr<TBufferedTransport> trans(
+        new TBufferedTransport(buffer, readBufferSize, 512));
+    stdcxx::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(trans));
+
+    proto->writeListBegin(protocol::T_STRING, static_cast<uint32_t>(strings.size()));
+    for (size_t i = 0; i < strings.size(); ++i) {
+      proto->writeString(strings[i]);
+    }
+    proto->writeListEnd();
+    trans->flush();
+    BOOST_CHECK(buffer->getBufferAsString().find("\"aaa\\u0001bbb") != std::string::npos);
+    BOOST_CHECK(buffer->getBufferAsString().find("\"aaa\x7f") != std::string::npos);
+
+    protocol::TType elemType;
+    uint32_t size;
+    proto->readListBegin(elemType, size);
+    BOOST_REQUIRE_EQUAL(strings.size(), size);
+    for (size_t i = 0; i < strings.size(); ++i) {
+      std::string str;
+      proto->readString(str);
+      BOOST_CHECK(str == strings[i]);
+    }
+    proto->readListEnd();
+  }
+}
+
 BOOST_AUTO_TEST_CASE(test_json_proto_7) {
   stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
   stdcxx::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
@@ -0,0 +1,328 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdexcept>
+#include <string>
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/Thread.h>
+#include <thrift/processor/TLatencyEventHandler.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/stdcxx.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/ParentService.h"
+
+#define BOOST_TEST_MODULE LatencyEventHandlerTest
+#include <boost/test/unit_test.hpp>
+
+using namespace apache::thrift;
+using namespace apache::thrift::test;
+using apache::thrift::concurrency::Monitor;
+using apache::thrift::concurrency::PlatformThreadFactory;
+using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::processor::TLatencyEventHandler;
+using apache::thrift::processor::TLatencyHistogram;
+using apache::thrift::processor::TLatencySnapshot;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+
+BOOST_AUTO_TEST_CASE(test_histogram_small_values_are_exact) {
+  TLatencyHistogram histogram;
+  BOOST_CHECK_EQUAL(0, histogram.getPercentile(50.0));
+  for (int64_t i = 0; i < 8; ++i) {
+    histogram.record(i);
+  }
+  BOOST_CHECK_EQUAL(8u, histogram.getCount());
+  BOOST_CHECK_EQUAL(0, histogram.getMin());
+  BOOST_CHECK_EQUAL(7, histogram.getMax());
+  BOOST_CHECK_EQUAL(3.5, histogram.getMean());
+  BOOST_CHECK_EQUAL(3, histogram.getPercentile(50.0));
+  BOOST_CHECK_EQUAL(7, histogram.getPercentile(100.0));
+
+  // a step back of the clock counts as no time
+  histogram.record(-5);
+  BOOST_CHECK_EQUAL(0, histogram.getMin());
+}
+
+BOOST_AUTO_TEST_CASE(test_histogram_precision) {
+  TLatencyHistogram histogram;
+  for (int64_t i = 1; i <= 100000; ++i) {
+    histogram.record(i);
+  }
+  const double percents[] = {10.0, 50.0, 90.0, 99.0, 99.9};
+  for (size_t i = 0; i < sizeof(percents) / sizeof(percents[0]); ++i) {
+    double exact = percents[i] * 1000.0;
+    double value = static_cast<double>(histogram.getPercentile(percents[i]));
+    BOOST_CHECK_GE(value, exact);
+    BOOST_CHECK_LE(value, exact * 1.125);
+  }
+  BOOST_CHECK_EQUAL(100000, histogram.getPercentile(100.0));
+
+  // beyond the last bucket, only the maximum is exact
+  histogram.record(1LL << 40);
+  BOOST_CHECK_EQUAL(1LL << 40, histogram.getMax());
+  BOOST_CHECK_EQUAL(1LL << 40, histogram.getPercentile(100.0));
+}
+
+BOOST_AUTO_TEST_CASE(test_histogram_merge) {
+  TLatencyHistogram low;
+  TLatencyHistogram high;
+  for (int64_t i = 0; i < 100; ++i) {
+    low.record(10);
+    high.record(1000);
+  }
+  low.merge(high);
+  BOOST_CHECK_EQUAL(200u, low.getCount());
+  BOOST_CHECK_EQUAL(10, low.getMin());
+  BOOST_CHECK_EQUAL(1000, low.getMax());
+  BOOST_CHECK_EQUAL(505.0, low.getMean());
+  BOOST_CHECK_EQUAL(10, low.getPercentile(50.0));
+  BOOST_CHECK_EQUAL(1000, low.getPercentile(51.0));
+
+  TLatencyHistogram empty;
+  high.merge(empty);
+  BOOST_CHECK_EQUAL(100u, high.getCount());
+  BOOST_CHECK_EQUAL(1000, high.getMin());
+
+  low.clear();
+  BOOST_CHECK_EQUAL(0u, low.getCount());
+  BOOST_CHECK_EQUAL(0, low.getMax());
+}
+
+class Handler : public ParentServiceNull {
+public:
+  void unexpectedExceptionWait(const std::string& message) {
+    throw std::runtime_error(message);
+  }
+};
+
+static void call(TProcessor& processor, void (ParentServiceClient::*send)()) {
+  stdcxx::shared_ptr<TMemoryBuffer> requests(new TMemoryBuffer());
+  stdcxx::shared_ptr<TMemoryBuffer> replies(new TMemoryBuffer());
+  stdcxx::shared_ptr<TProtocol> in(new TBinaryProtocol(requests));
+  ParentServiceClient client(in);
+  (client.*send)();
+  processor.process(in, stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(replies)), NULL);
+  BOOST_CHECK_EQUAL(0u, requests->available_read());
+}
+
+BOOST_AUTO_TEST_CASE(test_records_phases) {
+  ParentServiceProcessor processor(stdcxx::shared_ptr<ParentServiceIf>(new Handler()));
+  stdcxx::shared_ptr<TLatencyEventHandler> latency(new TLatencyEventHandler());
+  processor.setEventHandler(latency);
+
+  call(processor, &ParentServiceClient::send_getGeneration);
+  call(processor, &ParentServiceClient::send_getGeneration);
+  call(processor, &ParentServiceClient::send_onewayWait);
+  stdcxx::shared_ptr<TMemoryBuffer> requests(new TMemoryBuffer());
+  stdcxx::shared_ptr<TProtocol> in(new TBinaryProtocol(requests));
+  ParentServiceClient(in).send_unexpectedExceptionWait("unexpected");
+  processor.process(in, in, NULL);
+
+  TLatencySnapshot snapshot;
+  latency->getSnapshot(snapshot);
+  BOOST_CHECK_EQUAL(3u, snapshot.size());
+
+  const processor::TMethodLatency& get = snapshot["ParentService.getGeneration"];
+  BOOST_CHECK_EQUAL(2u, get.read.getCount());
+  BOOST_CHECK_EQUAL(2u, get.handler.getCount());
+  BOOST_CHECK_EQUAL(2u, get.write.getCount());
+  BOOST_CHECK_EQUAL(2u, get.total.getCount());
+  BOOST_CHECK_EQUAL(0u, get.errors);
+  BOOST_CHECK_LE(get.read.getMax() + get.handler.getMax() + get.write.getMax(),
+                 get.total.getMax() * 3);
+
+  const processor::TMethodLatency& oneway = snapshot["ParentService.onewayWait"];
+  BOOST_CHECK_EQUAL(1u, oneway.handler.getCount());
+  BOOST_CHECK_EQUAL(0u, oneway.write.getCount());
+
+  const processor::TMethodLatency& error = snapshot["ParentService.unexpectedExceptionWait"];
+  BOOST_CHECK_EQUAL(1u, error.errors);
+  BOOST_CHECK_EQUAL(1u, error.total.getCount());
+
+  // snapshots add up
+  latency->getSnapshot(snapshot);
+  BOOST_CHECK_EQUAL(4u, snapshot["ParentService.getGeneration"].total.getCount());
+
+  latency->reset();
+  TLatencySnapshot empty;
+  latency->getSnapshot(empty);
+  BOOST_CHECK(empty.empty());
+}
+
+class Caller : public Runnable {
+public:
+  Caller(stdcxx::shared_ptr<TLatencyEventHandler> latency) : latency_(latency) {}
+
+  void run() {
+    for (int i = 0; i < 1000; ++i) {
+      void* ctx = latency_->getContext("Service.method", NULL);
+      latency_->preRead(ctx, "Service.method");
+      latency_->postRead(ctx, "Service.method", 0);
+      latency_->freeContext(ctx, "Service.method");
+    }
+  }
+
+private:
+  stdcxx::shared_ptr<TLatencyEventHandler> latency_;
+};
+
+BOOST_AUTO_TEST_CASE(test_threads) {
+  stdcxx::shared_ptr<TLatencyEventHandler> latency(new TLatencyEventHandler());
+  PlatformThreadFactory factory(false);
+  std::vector<stdcxx::shared_ptr<Thread> > threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.push_back(factory.newThread(stdcxx::shared_ptr<Runnable>(new Caller(latency))));
+    threads.back()->start();
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->join();
+  }
+
+  TLatencySnapshot snapshot;
+  latency->getSnapshot(snapshot);
+  BOOST_CHECK_EQUAL(8000u, snapshot["Service.method"].total.getCount());
+  BOOST_CHECK_EQUAL(8000u, snapshot["Service.method"].handler.getCount());
+}
+
+BOOST_AUTO_TEST_CASE(test_exited_threads) {
+  stdcxx::shared_ptr<TLatencyEventHandler> latency(new TLatencyEventHandler());
+  PlatformThreadFactory factory(false);
+  // one after the other, so that threads may reuse each other's storage
+  for (int i = 0; i < 20; ++i) {
+    stdcxx::shared_ptr<Thread> thread
+        = factory.newThread(stdcxx::shared_ptr<Runnable>(new Caller(latency)));
+    thread->start();
+    thread->join();
+  }
+
+  TLatencySnapshot snapshot;
+  latency->getSnapshot(snapshot);
+  BOOST_CHECK_EQUAL(20000u, snapshot["Service.method"].total.getCount());
+
+  latency->reset();
+  TLatencySnapshot empty;
+  latency->getSnapshot(empty);
+  BOOST_CHECK(empty.empty());
+}
+
+// records a call, then waits for the handler to be destroyed before exiting
+class Outliver : public Runnable {
+public:
+  Outliver(stdcxx::shared_ptr<TLatencyEventHandler> latency, Monitor& monitor)
+    : latency_(latency), monitor_(monitor), recorded_(false), released_(false) {}
+
+  void run() {
+    latency_->freeContext(latency_->getContext("Service.method", NULL), "Service.method");
+    latency_.reset();
+    Synchronized s(monitor_);
+    recorded_ = true;
+    monitor_.notifyAll();
+    while (!released_) {
+      monitor_.wait();
+    }
+  }
+
+  void waitForRecorded() {
+    Synchronized s(monitor_);
+    while (!recorded_) {
+      monitor_.wait();
+    }
+  }
+
+  void release() {
+    Synchronized s(monitor_);
+    released_ = true;
+    monitor_.notifyAll();
+  }
+
+private:
+  stdcxx::shared_ptr<TLatencyEventHandler> latency_;
+  Monitor& monitor_;
+  bool recorded_;
+  bool released_;
+};
+
+BOOST_AUTO_TEST_CASE(test_thread_outlives_handler) {
+  stdcxx::shared_ptr<TLatencyEventHandler> latency(new TLatencyEventHandler());
+  Monitor monitor;
+  stdcxx::shared_ptr<Outliver> outliver(new Outliver(latency, monitor));
+  stdcxx::shared_ptr<Thread> thread = PlatformThreadFactory(false).newThread(outliver);
+  thread->start();
+  outliver->waitForRecorded();
+
+  TLatencySnapshot snapshot;
+  latency->getSnapshot(snapshot);
+  BOOST_CHECK_EQUAL(1u, snapshot["Service.method"].total.getCount());
+  latency.reset();
+
+  // the exiting thread must not touch the destroyed handler
+  outliver->release();
+  thread->join();
+}
+
+BOOST_AUTO_TEST_CASE(test_handlers_and_names) {
+  stdcxx::shared_ptr<TLatencyEventHandler> latency1(new TLatencyEventHandler());
+  stdcxx::shared_ptr<TLatencyEventHandler> latency2(new TLatencyEventHandler());
+  for (int i = 0; i < 10; ++i) {
+    // the same name from a different pointer each time
+    std::string name1("Service.one");
+    std::string name2(i % 2 == 0 ? "Service.two" : "Service.three");
+    latency1->freeContext(latency1->getContext(name1.c_str(), NULL), name1.c_str());
+    latency2->freeContext(latency2->getContext(name2.c_str(), NULL), name2.c_str());
+  }
+
+  TLatencySnapshot snapshot1;
+  latency1->getSnapshot(snapshot1);
+  BOOST_CHECK_EQUAL(1u, snapshot1.size());
+  BOOST_CHECK_EQUAL(10u, snapshot1["Service.one"].total.getCount());
+
+  TLatencySnapshot snapshot2;
+  latency2->getSnapshot(snapshot2);
+  BOOST_CHECK_EQUAL(2u, snapshot2.size());
+  BOOST_CHECK_EQUAL(5u, snapshot2["Service.two"].total.getCount());
+  BOOST_CHECK_EQUAL(5u, snapshot2["Service.three"].total.getCount());
+}
+
+BOOST_AUTO_TEST_CASE(test_export) {
+  TLatencySnapshot snapshot;
+  snapshot["Service.method"].total.record(12);
+  snapshot["Service.method"].read.record(2);
+  snapshot["Service.method"].errors = 1;
+
+  std::string text = TLatencyEventHandler::toText(snapshot);
+  BOOST_CHECK(text.find("method") == 0);
+  BOOST_CHECK(text.find("Service.method") != std::string::npos);
+  BOOST_CHECK(text.find("handler") == std::string::npos);
+
+  BOOST_CHECK_EQUAL(
+      "{\"Service.method\":{\"errors\":1,"
+      "\"read\":{\"count\":1,\"min\":2,\"mean\":2.0,\"p50\":2,\"p90\":2,\"p99\":2,\"p99.9\":2,"
+      "\"max\":2},"
+      "\"handler\":{\"count\":0,\"min\":0,\"mean\":0.0,\"p50\":0,\"p90\":0,\"p99\":0,\"p99.9\":0,"
+      "\"max\":0},"
+      "\"write\":{\"count\":0,\"min\":0,\"mean\":0.0,\"p50\":0,\"p90\":0,\"p99\":0,\"p99.9\":0,"
+      "\"max\":0},"
+      "\"total\":{\"count\":1,\"min\":12,\"mean\":12.0,\"p50\":12,\"p90\":12,\"p99\":12,"
+      "\"p99.9\":12,\"max\":12}}}",
+      TLatencyEventHandler::toJSON(snapshot));
+}
@@ -0,0 +1,172 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/stdcxx.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/LazyFieldsTest_types.h"
+
+#define BOOST_TEST_MODULE LazyFieldsTest
+#include <boost/test/unit_test.hpp>
+
+using namespace lazytest;
+using namespace apache::thrift;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TJSONProtocol;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+
+static Envelope makeEnvelope() {
+  Envelope env;
+  env.route = "backend-7";
+  env.priority = 3;
+  for (int i = 0; i < 50; ++i) {
+    Item item;
+    item.id = i * 1000;
+    item.payload = std::string(i, 'p');
+    env.mutable_items().push_back(item);
+  }
+  env.mutable_header().id = -1;
+  env.mutable_header().payload = "header";
+  env.mutable_tags()["a"].insert(1);
+  env.mutable_tags()["b"].insert(-2);
+  env.__isset.tags = true;
+  env.trailer = 42;
+  return env;
+}
+
+template <typename Protocol>
+static std::string serialize(const Envelope& env) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol proto(buffer);
+  env.write(&proto);
+  return buffer->getBufferAsString();
+}
+
+template <typename Protocol>
+static Envelope deserialize(const std::string& bytes) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(bytes.data()),
+                static_cast<uint32_t>(bytes.size()));
+  Protocol proto(buffer);
+  Envelope env;
+  uint32_t xfer = env.read(&proto);
+  BOOST_CHECK_EQUAL(bytes.size(), xfer);
+  return env;
+}
+
+template <typename Protocol>
+static void checkUntouchedFieldsAreKept() {
+  Envelope original(makeEnvelope());
+  std::string bytes(serialize<Protocol>(original));
+
+  Envelope env(deserialize<Protocol>(bytes));
+  BOOST_CHECK_EQUAL("backend-7", env.route);
+  BOOST_CHECK_EQUAL(42, env.trailer);
+  BOOST_CHECK(env.__is_encoded_items());
+  BOOST_CHECK(env.__isset.items);
+
+  // written back as they came
+  BOOST_CHECK(serialize<Protocol>(env) == bytes);
+
+  BOOST_CHECK_EQUAL(50, env.get_items().size());
+  BOOST_CHECK(!env.__is_encoded_items());
+  BOOST_CHECK(env.get_header() == original.get_header());
+  BOOST_CHECK(env == original);
+  BOOST_CHECK(serialize<Protocol>(env) == bytes);
+}
+
+BOOST_AUTO_TEST_CASE(test_untouched_fields_are_kept) {
+  checkUntouchedFieldsAreKept<TBinaryProtocol>();
+  checkUntouchedFieldsAreKept<TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_changed_fields_are_encoded) {
+  Envelope original(makeEnvelope());
+  Envelope env(deserialize<TBinaryProtocol>(serialize<TBinaryProtocol>(original)));
+
+  env.mutable_items().resize(2);
+  env.__set_header(Item());
+  Envelope again(deserialize<TBinaryProtocol>(serialize<TBinaryProtocol>(env)));
+  BOOST_CHECK_EQUAL(2, again.get_items().size());
+  BOOST_CHECK(again.get_header() == Item());
+  BOOST_CHECK(again.get_tags() == original.get_tags());
+}
+
+BOOST_AUTO_TEST_CASE(test_const_access_decodes) {
+  Envelope original(makeEnvelope());
+  const Envelope env(deserialize<TBinaryProtocol>(serialize<TBinaryProtocol>(original)));
+  BOOST_CHECK(env.__is_encoded_header());
+  BOOST_CHECK_EQUAL("header", env.get_header().payload);
+  BOOST_CHECK(!env.__is_encoded_header());
+
+  // an edit through mutable_ replaces what was kept
+  Envelope copy(env);
+  BOOST_CHECK(copy.__is_encoded_items());
+  copy.mutable_items().clear();
+  BOOST_CHECK(!copy.__is_encoded_items());
+  BOOST_CHECK(deserialize<TBinaryProtocol>(serialize<TBinaryProtocol>(copy)).get_items().empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_other_protocols_decode) {
+  Envelope original(makeEnvelope());
+
+  // read with one protocol and written with another
+  Envelope env(deserialize<TBinaryProtocol>(serialize<TBinaryProtocol>(original)));
+  BOOST_CHECK(serialize<TCompactProtocol>(env) == serialize<TCompactProtocol>(original));
+
+  // protocols that cannot keep values decode them right away
+  Envelope json(deserialize<TJSONProtocol>(serialize<TJSONProtocol>(original)));
+  BOOST_CHECK(!json.__is_encoded_items());
+  BOOST_CHECK_EQUAL(50, json.get_items().size());
+  BOOST_CHECK(json == original);
+}
+
+BOOST_AUTO_TEST_CASE(test_values_past_the_buffer_are_decoded) {
+  Envelope original(makeEnvelope());
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  stdcxx::shared_ptr<TBufferedTransport> transport(new TBufferedTransport(buffer, 64, 64));
+  TBinaryProtocol proto(transport);
+  uint32_t written = original.write(&proto);
+  transport->flush();
+
+  Envelope env;
+  BOOST_CHECK_EQUAL(written, env.read(&proto));
+  BOOST_CHECK(!env.__is_encoded_items());
+  BOOST_CHECK_EQUAL(50, env.get_items().size());
+  BOOST_CHECK(env == original);
+}
+
+BOOST_AUTO_TEST_CASE(test_copy_and_swap) {
+  Envelope original(makeEnvelope());
+  Envelope env(deserialize<TCompactProtocol>(serialize<TCompactProtocol>(original)));
+
+  Envelope copy(env);
+  BOOST_CHECK(copy.__is_encoded_items());
+  BOOST_CHECK(copy == original);
+
+  Envelope other;
+  swap(env, other);
+  BOOST_CHECK(!env.__is_encoded_items());
+  BOOST_CHECK(other == original);
+}
@@ -20,6 +20,7 @@
 #include <boost/test/auto_unit_test.hpp>
 #include <boost/thread.hpp>
 #include <iostream>
+#include <sstream>
 #include <climits>
 #include <vector>
 #include <thrift/concurrency/Monitor.h>
@@ -46,6 +47,7 @@ using apache::thrift::server::TThreadedServer;
 using apache::thrift::server::TServerEventHandler;
 using apache::thrift::transport::TTransport;
 using apache::thrift::transport::THttpServer;
+using apache::thrift::transport::THttpTransport;
 using apache::thrift::transport::THttpServerTransportFactory;
 using apache::thrift::transport::THttpClient;
 using apache::thrift::transport::TBufferedTransport;
@@ -239,4 +241,86 @@ BOOST_AUTO_TEST_CASE( JSON_BufferedHTTP )
 #endif
 }
 
+BOOST_AUTO_TEST_CASE( HTTPServer_PipelinedRequests )
+{
+  // a body larger than the header buffer, then a chunked request right behind it
+  std::string body(5000, 'x');
+  std::ostringstream requests;
+  requests << "POST /service HTTP/1.1\r\nHost: localhost\r\ncontent-length: " << body.size()
+           << "\r\nX-Forwarded-For: 10.0.0.1\r\n\r\n" << body
+           << "POST /service HTTP/1.1\nTransfer-Encoding: chunked\r\n\r\n"
+           << "3;ext=1\r\nabc\r\nA\r\n0123456789\r\n0\r\n\r\n";
+  std::string input = requests.str();
+
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(input.data()), static_cast<uint32_t>(input.size()));
+  THttpServer server(buffer);
+
+  std::vector<uint8_t> buf(body.size() + 1);
+  BOOST_CHECK_EQUAL(body.size(), server.readAll(&buf[0], static_cast<uint32_t>(body.size())));
+  BOOST_CHECK(std::string(reinterpret_cast<const char*>(&buf[0]), body.size()) == body);
+  server.readEnd();
+  BOOST_CHECK(server.getOrigin().find("10.0.0.1, ") == 0);
+
+  BOOST_CHECK_EQUAL(3u, server.read(&buf[0], static_cast<uint32_t>(buf.size())));
+  BOOST_CHECK(std::string(reinterpret_cast<const char*>(&buf[0]), 3) == "abc");
+  BOOST_CHECK_EQUAL(10u, server.read(&buf[0], static_cast<uint32_t>(buf.size())));
+  BOOST_CHECK(std::string(reinterpret_cast<const char*>(&buf[0]), 10) == "0123456789");
+  server.readEnd();
+  BOOST_CHECK_EQUAL(0u, buffer->available_read());
+
+  server.write(reinterpret_cast<const uint8_t*>("ok"), 2);
+  server.flush();
+  std::string response = buffer->getBufferAsString();
+  BOOST_CHECK(response.find("HTTP/1.1 200 OK\r\nDate: ") == 0);
+  BOOST_CHECK(response.find("\r\nContent-Length: 2\r\n") != std::string::npos);
+  BOOST_CHECK(response.find("\r\n\r\nok") == response.size() - 6);
+}
+
+
+static void checkRejectedRequest(const std::string& input, uint32_t maxMessageSize) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(input.data()), static_cast<uint32_t>(input.size()));
+  THttpServer server(buffer);
+  server.setMaxMessageSize(maxMessageSize);
+
+  uint8_t buf[16];
+  try {
+    server.read(buf, sizeof(buf));
+    BOOST_ERROR("request should have been rejected");
+  } catch (TTransportException& e) {
+    BOOST_CHECK_EQUAL(TTransportException::CORRUPTED_DATA, e.getType());
+  }
+}
+
+BOOST_AUTO_TEST_CASE( HTTPServer_BodySizeLimits )
+{
+  uint32_t defaultSize = THttpTransport::DEFAULT_MAX_MESSAGE_SIZE;
+  BOOST_CHECK_EQUAL(defaultSize,
+                    THttpServer(stdcxx::make_shared<TMemoryBuffer>()).getMaxMessageSize());
+
+  checkRejectedRequest("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\nabc", 1024);
+  checkRejectedRequest("POST / HTTP/1.1\r\nContent-Length: 12ab\r\n\r\nabc", 1024);
+  checkRejectedRequest("POST / HTTP/1.1\r\nContent-Length: 1025\r\n\r\nabc", 1024);
+  checkRejectedRequest("POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n", 1024);
+  checkRejectedRequest("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n401\r\nabc", 1024);
+  checkRejectedRequest("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nFFFFFFFF\r\n", 1024);
+
+  // a body at the limit, several read pieces long, still arrives whole
+  std::string body(200 * 1024 + 7, 'y');
+  std::ostringstream request;
+  request << "POST / HTTP/1.1\r\nContent-Length:  " << body.size() << " \r\n\r\n" << body;
+  std::string input = request.str();
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(input.data()), static_cast<uint32_t>(input.size()));
+  THttpServer server(buffer);
+  server.setMaxMessageSize(static_cast<uint32_t>(body.size()));
+
+  std::vector<uint8_t> buf(body.size());
+  BOOST_CHECK_EQUAL(body.size(), server.readAll(&buf[0], static_cast<uint32_t>(buf.size())));
+  BOOST_CHECK(std::string(reinterpret_cast<const char*>(&buf[0]), buf.size()) == body);
+  server.readEnd();
+  BOOST_CHECK_EQUAL(0u, buffer->available_read());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,336 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <thrift/TApplicationException.h>
+#include <thrift/processor/THeaderPassThroughProcessor.h>
+#include <thrift/processor/TMultiplexedProcessor.h>
+#include <thrift/processor/TPassThroughProcessor.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/THeaderProtocol.h>
+#include <thrift/protocol/TMultiplexedProtocol.h>
+#include <thrift/stdcxx.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TVirtualTransport.h>
+#include "gen-cpp/ParentService.h"
+
+#define BOOST_TEST_MODULE PassThroughProcessorTest
+#include <boost/test/unit_test.hpp>
+
+using namespace apache::thrift;
+using namespace apache::thrift::test;
+using apache::thrift::processor::THeaderPassThroughProcessor;
+using apache::thrift::processor::TPassThroughProcessor;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TCompactProtocolFactory;
+using apache::thrift::protocol::THeaderProtocol;
+using apache::thrift::protocol::THeaderProtocolFactory;
+using apache::thrift::protocol::TMultiplexedProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TVirtualTransport;
+
+/**
+ * Hands each request written to it to a processor on flush(), and reads back
+ * the reply, so that calls can be made without a server.
+ */
+class TProcessorTransport : public TVirtualTransport<TProcessorTransport> {
+public:
+  TProcessorTransport(stdcxx::shared_ptr<TProcessor> processor,
+                      stdcxx::shared_ptr<TProtocolFactory> factory)
+    : processor_(processor),
+      factory_(factory),
+      requests_(new TMemoryBuffer()),
+      replies_(new TMemoryBuffer()),
+      open_(true),
+      opens_(0),
+      dropReply_(false) {}
+
+  bool isOpen() { return open_; }
+
+  void open() {
+    open_ = true;
+    ++opens_;
+  }
+
+  void close() {
+    open_ = false;
+    requests_->resetBuffer();
+    replies_->resetBuffer();
+  }
+
+  uint32_t read(uint8_t* buf, uint32_t len) { return replies_->read(buf, len); }
+
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len) { return replies_->borrow(buf, len); }
+
+  void consume(uint32_t len) { replies_->consume(len); }
+
+  void write(const uint8_t* buf, uint32_t len) { requests_->write(buf, len); }
+
+  void flush() {
+    lastRequest_ = requests_->getBufferAsString();
+    stdcxx::shared_ptr<TProtocol> in = factory_->getProtocol(requests_, replies_);
+    // a header protocol answers through the transport it read from
+    stdcxx::shared_ptr<TProtocol> out = stdcxx::dynamic_pointer_cast<THeaderProtocol>(in)
+                                            ? in
+                                            : factory_->getProtocol(replies_);
+    processor_->process(in, out, NULL);
+    requests_->resetBuffer();
+    if (dropReply_) {
+      // as if the connection went down before the reply was read
+      dropReply_ = false;
+      replies_->resetBuffer();
+    }
+  }
+
+  const std::string& lastRequest() const { return lastRequest_; }
+
+  int opens() const { return opens_; }
+
+  void dropReply() { dropReply_ = true; }
+
+private:
+  stdcxx::shared_ptr<TProcessor> processor_;
+  stdcxx::shared_ptr<TProtocolFactory> factory_;
+  stdcxx::shared_ptr<TMemoryBuffer> requests_;
+  stdcxx::shared_ptr<TMemoryBuffer> replies_;
+  std::string lastRequest_;
+  bool open_;
+  int opens_;
+  bool dropReply_;
+};
+
+class Handler : public ParentServiceNull {
+public:
+  Handler() : generation_(0) {}
+
+  int32_t incrementGeneration() { return ++generation_; }
+
+  int32_t getGeneration() { return generation_; }
+
+  void addString(const std::string& s) { strings_.push_back(s); }
+
+  void getStrings(std::vector<std::string>& _return) { _return = strings_; }
+
+  void getDataWait(std::string& _return, const int32_t length) {
+    _return.assign(length, 'd');
+  }
+
+  void onewayWait() { ++generation_; }
+
+  void exceptionWait(const std::string& message) {
+    MyError e;
+    e.message = message;
+    throw e;
+  }
+
+  int32_t generation_;
+  std::vector<std::string> strings_;
+};
+
+struct Backend {
+  Backend(stdcxx::shared_ptr<TProtocolFactory> factory)
+    : handler(new Handler()),
+      transport(new TProcessorTransport(
+          stdcxx::shared_ptr<TProcessor>(new ParentServiceProcessor(handler)),
+          factory)) {}
+
+  stdcxx::shared_ptr<Handler> handler;
+  stdcxx::shared_ptr<TProcessorTransport> transport;
+};
+
+static void checkCalls(ParentServiceClient& client, Handler& handler) {
+  client.addString("one");
+  client.addString(std::string(1000, 'x'));
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK(strings == handler.strings_);
+  BOOST_CHECK_EQUAL(2, strings.size());
+
+  BOOST_CHECK_EQUAL(1, client.incrementGeneration());
+  client.onewayWait();
+  BOOST_CHECK_EQUAL(2, client.getGeneration());
+
+  std::string data;
+  client.getDataWait(data, 300);
+  BOOST_CHECK_EQUAL(std::string(300, 'd'), data);
+
+  try {
+    client.exceptionWait("forwarded");
+    BOOST_FAIL("expected MyError");
+  } catch (const MyError& e) {
+    BOOST_CHECK_EQUAL("forwarded", e.message);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_same_protocol) {
+  stdcxx::shared_ptr<TProtocolFactory> factory(new TBinaryProtocolFactory());
+  Backend backend(factory);
+  stdcxx::shared_ptr<TPassThroughProcessor> proxy(new TPassThroughProcessor());
+  proxy->setDefaultRoute(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(backend.transport)));
+
+  stdcxx::shared_ptr<TProcessorTransport> transport(new TProcessorTransport(proxy, factory));
+  ParentServiceClient client(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(transport)));
+  checkCalls(client, *backend.handler);
+
+  // the request reaches the backend as the client sent it
+  client.addString("unchanged");
+  BOOST_CHECK(!transport->lastRequest().empty());
+  BOOST_CHECK(transport->lastRequest() == backend.transport->lastRequest());
+}
+
+BOOST_AUTO_TEST_CASE(test_different_protocols) {
+  Backend backend(stdcxx::shared_ptr<TProtocolFactory>(new TCompactProtocolFactory()));
+  stdcxx::shared_ptr<TPassThroughProcessor> proxy(new TPassThroughProcessor());
+  proxy->setDefaultRoute(stdcxx::shared_ptr<TProtocol>(new TCompactProtocol(backend.transport)));
+
+  stdcxx::shared_ptr<TProtocolFactory> factory(new TBinaryProtocolFactory());
+  stdcxx::shared_ptr<TProcessorTransport> transport(new TProcessorTransport(proxy, factory));
+  ParentServiceClient client(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(transport)));
+  checkCalls(client, *backend.handler);
+}
+
+BOOST_AUTO_TEST_CASE(test_routes) {
+  stdcxx::shared_ptr<TProtocolFactory> factory(new TBinaryProtocolFactory());
+  Backend strings(factory);
+  stdcxx::shared_ptr<TMultiplexedProcessor> multiplexed(new TMultiplexedProcessor());
+  Backend generations(factory);
+  multiplexed->registerProcessor("Parent",
+                                 stdcxx::shared_ptr<TProcessor>(
+                                     new ParentServiceProcessor(generations.handler)));
+  stdcxx::shared_ptr<TProcessorTransport> multiplexedTransport(
+      new TProcessorTransport(multiplexed, factory));
+
+  stdcxx::shared_ptr<TPassThroughProcessor> proxy(new TPassThroughProcessor());
+  proxy->addRoute("addString",
+                  stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(strings.transport)));
+  proxy->addRoute("Parent",
+                  stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(multiplexedTransport)));
+
+  stdcxx::shared_ptr<TProcessorTransport> transport(new TProcessorTransport(proxy, factory));
+  stdcxx::shared_ptr<TProtocol> protocol(new TBinaryProtocol(transport));
+  ParentServiceClient client(protocol);
+  client.addString("routed");
+  BOOST_CHECK_EQUAL(1, strings.handler->strings_.size());
+
+  // by service name
+  ParentServiceClient multiplexedClient(
+      stdcxx::shared_ptr<TProtocol>(new TMultiplexedProtocol(protocol, "Parent")));
+  BOOST_CHECK_EQUAL(1, multiplexedClient.incrementGeneration());
+  BOOST_CHECK_EQUAL(1, generations.handler->generation_);
+  BOOST_CHECK_EQUAL(0, strings.handler->generation_);
+
+  try {
+    client.getGeneration();
+    BOOST_FAIL("expected TApplicationException");
+  } catch (const TApplicationException& x) {
+    BOOST_CHECK_EQUAL(TApplicationException::UNKNOWN_METHOD, x.getType());
+  }
+  // the connection is still usable
+  client.addString("again");
+  BOOST_CHECK_EQUAL(2, strings.handler->strings_.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_route_header) {
+  stdcxx::shared_ptr<TProtocolFactory> factory(new THeaderProtocolFactory());
+  Backend a(factory);
+  Backend b(factory);
+
+  // b is behind a second proxy that only knows the header, so it has to be passed on
+  stdcxx::shared_ptr<THeaderPassThroughProcessor> inner(new THeaderPassThroughProcessor());
+  inner->setRouteHeader("backend");
+  inner->addRoute("b", stdcxx::shared_ptr<TProtocol>(new THeaderProtocol(b.transport)));
+  stdcxx::shared_ptr<TProcessorTransport> innerTransport(new TProcessorTransport(inner, factory));
+
+  stdcxx::shared_ptr<THeaderPassThroughProcessor> proxy(new THeaderPassThroughProcessor());
+  proxy->setRouteHeader("backend");
+  proxy->addRoute("b", stdcxx::shared_ptr<TProtocol>(new THeaderProtocol(innerTransport)));
+  proxy->setDefaultRoute(stdcxx::shared_ptr<TProtocol>(new THeaderProtocol(a.transport)));
+
+  stdcxx::shared_ptr<TProcessorTransport> transport(new TProcessorTransport(proxy, factory));
+  stdcxx::shared_ptr<THeaderProtocol> protocol(new THeaderProtocol(transport));
+  ParentServiceClient client(protocol);
+
+  client.addString("to a");
+  protocol->setHeader("backend", "b");
+  client.addString("to b");
+  BOOST_CHECK_EQUAL(1, a.handler->strings_.size());
+  BOOST_REQUIRE_EQUAL(1, b.handler->strings_.size());
+  BOOST_CHECK_EQUAL("to b", b.handler->strings_[0]);
+
+  // headers are sent with one call only
+  std::vector<std::string> strings;
+  protocol->setHeader("backend", "b");
+  client.getStrings(strings);
+  BOOST_CHECK(strings == b.handler->strings_);
+  client.getStrings(strings);
+  BOOST_CHECK(strings == a.handler->strings_);
+}
+
+BOOST_AUTO_TEST_CASE(test_cut_off_call_is_not_sent) {
+  stdcxx::shared_ptr<TProtocolFactory> factory(new TBinaryProtocolFactory());
+  Backend backend(factory);
+  stdcxx::shared_ptr<TPassThroughProcessor> proxy(new TPassThroughProcessor());
+  proxy->setDefaultRoute(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(backend.transport)));
+
+  // a call whose arguments stop part way
+  stdcxx::shared_ptr<TMemoryBuffer> request(new TMemoryBuffer());
+  ParentServiceClient writer(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(request)));
+  writer.send_addString(std::string(100, 'x'));
+  std::string bytes = request->getBufferAsString();
+  request->resetBuffer();
+  request->write(reinterpret_cast<const uint8_t*>(bytes.data()),
+                 static_cast<uint32_t>(bytes.size() - 10));
+  stdcxx::shared_ptr<TMemoryBuffer> reply(new TMemoryBuffer());
+  BOOST_CHECK_THROW(proxy->process(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(request)),
+                                   stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(reply)),
+                                   NULL),
+                    TException);
+  BOOST_CHECK(backend.transport->lastRequest().empty());
+
+  // the upstream is still in step
+  stdcxx::shared_ptr<TProcessorTransport> transport(new TProcessorTransport(proxy, factory));
+  ParentServiceClient client(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(transport)));
+  client.addString("whole");
+  BOOST_REQUIRE_EQUAL(1, backend.handler->strings_.size());
+  BOOST_CHECK_EQUAL("whole", backend.handler->strings_[0]);
+}
+
+BOOST_AUTO_TEST_CASE(test_failed_upstream_is_reopened) {
+  stdcxx::shared_ptr<TProtocolFactory> factory(new TBinaryProtocolFactory());
+  Backend backend(factory);
+  stdcxx::shared_ptr<TPassThroughProcessor> proxy(new TPassThroughProcessor());
+  proxy->setDefaultRoute(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(backend.transport)));
+
+  stdcxx::shared_ptr<TProcessorTransport> transport(new TProcessorTransport(proxy, factory));
+  ParentServiceClient client(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(transport)));
+  backend.transport->dropReply();
+  BOOST_CHECK_THROW(client.incrementGeneration(), TException);
+  BOOST_CHECK(!backend.transport->isOpen());
+
+  transport.reset(new TProcessorTransport(proxy, factory));
+  ParentServiceClient again(stdcxx::shared_ptr<TProtocol>(new TBinaryProtocol(transport)));
+  BOOST_CHECK_EQUAL(2, again.incrementGeneration());
+  BOOST_CHECK_EQUAL(1, backend.transport->opens());
+}
@@ -0,0 +1,136 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string>
+#include <vector>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/stdcxx.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+#include "gen-cpp/Recursive_types.h"
+
+#define BOOST_TEST_MODULE SerializedSizeTest
+#include <boost/test/unit_test.hpp>
+
+using namespace thrift::test::debug;
+using namespace apache::thrift;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+
+template <typename Protocol, typename ThriftStruct>
+static uint32_t writtenSize(const ThriftStruct& ts) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol proto(buffer);
+  uint32_t xfer = ts.write(&proto);
+  BOOST_CHECK_EQUAL(xfer, buffer->available_read());
+  return xfer;
+}
+
+static OneOfEach makeOneOfEach() {
+  OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.a_bite = -0x7f;
+  ooe.integer16 = -27000;
+  ooe.integer32 = 1 << 24;
+  ooe.integer64 = -(int64_t)6000 * 1000 * 1000;
+  ooe.some_characters = "serialized size";
+  ooe.base64 = std::string(200, 'x');
+  ooe.i64_list.assign(20, -1);
+  return ooe;
+}
+
+static HolyMoley makeHolyMoley() {
+  HolyMoley hm;
+  hm.big.push_back(makeOneOfEach());
+  hm.big.push_back(OneOfEach());
+  std::vector<std::string> strings(2, "and a one");
+  hm.contain.insert(strings);
+  std::vector<Bonk> bonks(20);
+  bonks[3].type = 300000;
+  bonks[3].message = "What?";
+  hm.bonks["something"] = bonks;
+  hm.bonks["nothing"];
+  return hm;
+}
+
+BOOST_AUTO_TEST_CASE(test_binary_size_is_exact) {
+  HolyMoley hm(makeHolyMoley());
+  BOOST_CHECK_EQUAL(writtenSize<TBinaryProtocol>(hm), hm.serializedSize<TBinaryProtocol>());
+
+  CompactProtoTestStruct cpts;
+  cpts.i64_byte_map[1LL << 40] = 4;
+  BOOST_CHECK_EQUAL(writtenSize<TBinaryProtocol>(cpts), cpts.serializedSize<TBinaryProtocol>());
+
+  TupleProtocolTestStruct tpts;
+  tpts.__set_field3(-1);
+  BOOST_CHECK_EQUAL(writtenSize<TBinaryProtocol>(tpts), tpts.serializedSize<TBinaryProtocol>());
+
+  // a missing struct is written as an empty one
+  RecList list;
+  list.nextitem.reset(new RecList());
+  list.nextitem->item = 7;
+  BOOST_CHECK_EQUAL(writtenSize<TBinaryProtocol>(list), list.serializedSize<TBinaryProtocol>());
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_size_is_an_upper_bound) {
+  HolyMoley hm(makeHolyMoley());
+  BOOST_CHECK_LE(writtenSize<TCompactProtocol>(hm), hm.serializedSize<TCompactProtocol>());
+
+  CompactProtoTestStruct cpts;
+  BOOST_CHECK_LE(writtenSize<TCompactProtocol>(cpts), cpts.serializedSize<TCompactProtocol>());
+
+  TupleProtocolTestStruct tpts;
+  tpts.__set_field1(1);
+  tpts.__set_field12(-1);
+  BOOST_CHECK_LE(writtenSize<TCompactProtocol>(tpts), tpts.serializedSize<TCompactProtocol>());
+
+  // it is exact without bool fields and with field ids from 1 to 15
+  Bonk bonk;
+  bonk.type = -70000;
+  bonk.message = std::string(300, 'm');
+  BOOST_CHECK_EQUAL(writtenSize<TCompactProtocol>(bonk), bonk.serializedSize<TCompactProtocol>());
+
+  BreaksRubyCompactProtocol brcp;
+  brcp.field2.field2 = "far";
+  BOOST_CHECK_LE(writtenSize<TCompactProtocol>(brcp), brcp.serializedSize<TCompactProtocol>());
+}
+
+BOOST_AUTO_TEST_CASE(test_reserve_before_writing) {
+  HolyMoley hm(makeHolyMoley());
+  uint32_t size = hm.serializedSize<TBinaryProtocol>();
+
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(16));
+  TBinaryProtocol proto(buffer);
+  buffer->reserve(size);
+  BOOST_CHECK_EQUAL(size, buffer->getBufferSize());
+  hm.write(&proto);
+  BOOST_CHECK_EQUAL(size, buffer->getBufferSize());
+  BOOST_CHECK_EQUAL(size, buffer->available_read());
+
+  stdcxx::shared_ptr<TMemoryBuffer> sink(new TMemoryBuffer());
+  stdcxx::shared_ptr<TFramedTransport> framed(new TFramedTransport(sink, 16));
+  TBinaryProtocol framedProto(framed);
+  framed->reserve(size);
+  hm.write(&framedProto);
+  framed->flush();
+  BOOST_CHECK_EQUAL(size + 4, sink->available_read());
+}
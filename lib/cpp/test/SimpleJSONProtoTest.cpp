@@ -0,0 +1,231 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <string>
+#include <vector>
+#include <thrift/protocol/TSimpleJSONProtocol.h>
+#include <thrift/stdcxx.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+
+#define BOOST_TEST_MODULE SimpleJSONProtoTest
+#include <boost/test/unit_test.hpp>
+
+using namespace thrift::test::debug;
+using namespace apache::thrift;
+using apache::thrift::protocol::TProtocolException;
+using apache::thrift::protocol::TSimpleJSONProtocol;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+
+template <typename ThriftStruct>
+static std::string toSimpleJSON(const ThriftStruct& ts) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TSimpleJSONProtocol proto(buffer);
+  ts.write(&proto);
+  return buffer->getBufferAsString();
+}
+
+template <typename ThriftStruct>
+static void fromSimpleJSON(const std::string& json, ThriftStruct& ts) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(
+      new TMemoryBuffer(reinterpret_cast<uint8_t*>(const_cast<char*>(json.data())),
+                        static_cast<uint32_t>(json.size())));
+  TSimpleJSONProtocol proto(buffer);
+  ts.read(&proto);
+}
+
+static OneOfEach makeOneOfEach() {
+  OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.im_false = false;
+  ooe.a_bite = 0x7f;
+  ooe.integer16 = 27000;
+  ooe.integer32 = 1 << 24;
+  ooe.integer64 = (uint64_t)6000 * 1000 * 1000;
+  ooe.double_precision = M_PI;
+  ooe.some_characters = "JSON THIS! \"\1";
+  ooe.zomg_unicode = "\xd7\n\a\t";
+  ooe.base64 = "\1\2\3\255";
+  return ooe;
+}
+
+BOOST_AUTO_TEST_CASE(test_simple_json_keys_fields_by_name) {
+  const std::string expected_result(
+  "{\"im_true\":true,\"im_false\":false,\"a_bite\":127,\"integer16\":27000,"
+  "\"integer32\":16777216,\"integer64\":6000000000,\"double_precision\":3.14159"
+  "2653589793,\"some_characters\":\"JSON THIS! \\\"\\u0001\",\"zomg_unicode\":"
+  "\"\xd7\\n\\u0007\\t\",\"what_who\":false,\"base64\":\"AQIDrQ==\",\"byte_list\""
+  ":[1,2,3],\"i16_list\":[1,2,3],\"i64_list\":[1,2,3]}");
+
+  const std::string result(toSimpleJSON(makeOneOfEach()));
+
+  BOOST_CHECK_MESSAGE(!expected_result.compare(result),
+    "Expected:\n" << expected_result << "\nGotten:\n" << result);
+}
+
+BOOST_AUTO_TEST_CASE(test_simple_json_round_trip) {
+  HolyMoley hm;
+  hm.big.push_back(makeOneOfEach());
+  hm.big.push_back(makeOneOfEach());
+  hm.big[1].base64 = "12";
+  hm.big[1].zomg_unicode = "\xf0\x9f\x98\x80 \\ \"";
+  std::vector<std::string> strings;
+  hm.contain.insert(strings);
+  strings.push_back("and a one");
+  strings.push_back("and a two");
+  hm.contain.insert(strings);
+  std::vector<Bonk> bonks(2);
+  bonks[0].type = 1;
+  bonks[0].message = "Wait.";
+  bonks[1].type = 2;
+  bonks[1].message = "What?";
+  hm.bonks["something"] = bonks;
+  hm.bonks["nothing"];
+
+  // small buffers make values straddle the refills
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  stdcxx::shared_ptr<TBufferedTransport> transport(new TBufferedTransport(buffer, 7, 7));
+  TSimpleJSONProtocol proto(transport);
+  hm.write(&proto);
+  hm.write(&proto);
+  transport->flush();
+
+  HolyMoley hm2;
+  hm2.read(&proto);
+  BOOST_CHECK(hm == hm2);
+  HolyMoley hm3;
+  hm3.read(&proto);
+  BOOST_CHECK(hm == hm3);
+}
+
+BOOST_AUTO_TEST_CASE(test_simple_json_map_keys) {
+  CompactProtoTestStruct cpts;
+  cpts.byte_byte_map[-1] = 1;
+  cpts.i16_byte_map[300] = 2;
+  cpts.i32_byte_map[-70000] = 3;
+  cpts.i64_byte_map[1LL << 40] = 4;
+  cpts.double_byte_map[0.5] = 5;
+  cpts.binary_byte_map["\1\2"] = 6;
+  cpts.boolean_byte_map[true] = 7;
+  cpts.boolean_byte_map[false] = 8;
+  cpts.byte_map_map[1][2] = 3;
+
+  std::string json(toSimpleJSON(cpts));
+  BOOST_CHECK(json.find("\"boolean_byte_map\":{\"false\":8,\"true\":7}") != std::string::npos);
+  BOOST_CHECK(json.find("\"i64_byte_map\":{\"1099511627776\":4}") != std::string::npos);
+
+  CompactProtoTestStruct cpts2;
+  fromSimpleJSON(json, cpts2);
+  BOOST_CHECK(cpts == cpts2);
+
+  // JSON object keys can only be strings
+  std::vector<int8_t> key(1, 1);
+  cpts.list_byte_map[key] = 1;
+  BOOST_CHECK_THROW(toSimpleJSON(cpts), TProtocolException);
+}
+
+BOOST_AUTO_TEST_CASE(test_simple_json_doubles) {
+  Doubles dub;
+  dub.nan = HUGE_VAL / HUGE_VAL;
+  dub.inf = HUGE_VAL;
+  dub.neginf = -HUGE_VAL;
+  dub.repeating = 10.0 / 3.0;
+  dub.big = 1E+305;
+  dub.tiny = 1E-305;
+  dub.zero = 0.0;
+  dub.negzero = -0.0;
+
+  const std::string expected_result(
+  "{\"nan\":\"NaN\",\"inf\":\"Infinity\",\"neginf\":\"-Infinity\",\"repeating\""
+  ":3.3333333333333335,\"big\":1e+305,\"tiny\":1e-305,\"zero\":0,\"negzero\":-0}");
+  const std::string result(toSimpleJSON(dub));
+  BOOST_CHECK_MESSAGE(!expected_result.compare(result),
+    "Expected:\n" << expected_result << "\nGotten:\n" << result);
+
+  Doubles dub2;
+  fromSimpleJSON(result, dub2);
+  BOOST_CHECK(dub2.nan != dub2.nan);
+  BOOST_CHECK_EQUAL(dub.inf, dub2.inf);
+  BOOST_CHECK_EQUAL(dub.neginf, dub2.neginf);
+  BOOST_CHECK_EQUAL(dub.repeating, dub2.repeating);
+  BOOST_CHECK_EQUAL(dub.big, dub2.big);
+  BOOST_CHECK_EQUAL(dub.tiny, dub2.tiny);
+}
+
+BOOST_AUTO_TEST_CASE(test_simple_json_reads_hand_written_json) {
+  const std::string json(
+      " {\n"
+      "  \"my_ooe\": {\"integer32\": 32, \"unknown\": {\"a\": [1, {\"b\": null}], \"c\": \"}\"},\n"
+      "              \"some_characters\": \"\\u00e9\\ud83d\\ude00\\/\\t\", \"integer16\": null,\n"
+      "              \"base64\": \"AQID\", \"byte_list\": [], \"im_true\": false},\n"
+      "  \"my_bonk\": {\"message\": \"hi\", \"type\": -7}\n"
+      "} ");
+
+  Nesting n;
+  fromSimpleJSON(json, n);
+  BOOST_CHECK_EQUAL(32, n.my_ooe.integer32);
+  BOOST_CHECK_EQUAL(std::string("\xc3\xa9\xf0\x9f\x98\x80/\t"), n.my_ooe.some_characters);
+  BOOST_CHECK_EQUAL(std::string("\1\2\3"), n.my_ooe.base64);
+  BOOST_CHECK(n.my_ooe.byte_list.empty());
+  BOOST_CHECK(!n.my_ooe.im_true);
+  // null and missing fields keep their defaults
+  BOOST_CHECK_EQUAL(OneOfEach().integer16, n.my_ooe.integer16);
+  BOOST_CHECK_EQUAL(-7, n.my_bonk.type);
+  BOOST_CHECK_EQUAL("hi", n.my_bonk.message);
+}
+
+BOOST_AUTO_TEST_CASE(test_simple_json_rejects_bad_input) {
+  Bonk bonk;
+  BOOST_CHECK_THROW(fromSimpleJSON("{\"type\": \"x\"}", bonk), TProtocolException);
+  BOOST_CHECK_THROW(fromSimpleJSON("{\"type\": 1e3}", bonk), TProtocolException);
+  BOOST_CHECK_THROW(fromSimpleJSON("{\"type\": 4294967296}", bonk), TProtocolException);
+  BOOST_CHECK_THROW(fromSimpleJSON("{\"message\": 1}", bonk), TProtocolException);
+  BOOST_CHECK_THROW(fromSimpleJSON("{\"message\": \"x\" \"type\": 1}", bonk), TProtocolException);
+  BOOST_CHECK_THROW(fromSimpleJSON("{\"message\": \"\\ud83d\"}", bonk), TProtocolException);
+  BOOST_CHECK_THROW(fromSimpleJSON("[]", bonk), TProtocolException);
+  BOOST_CHECK_THROW(fromSimpleJSON("{\"type\": tru}", bonk), TProtocolException);
+}
+
+BOOST_AUTO_TEST_CASE(test_simple_json_message) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TSimpleJSONProtocol proto(buffer);
+  Bonk bonk;
+  bonk.type = 5;
+  bonk.message = "m";
+  proto.writeMessageBegin("getBonk", protocol::T_REPLY, 9);
+  bonk.write(&proto);
+  proto.writeMessageEnd();
+  BOOST_CHECK_EQUAL("[\"getBonk\",2,9,{\"type\":5,\"message\":\"m\"}]",
+                    buffer->getBufferAsString());
+
+  std::string name;
+  protocol::TMessageType type;
+  int32_t seqid;
+  Bonk bonk2;
+  proto.readMessageBegin(name, type, seqid);
+  bonk2.read(&proto);
+  proto.readMessageEnd();
+  BOOST_CHECK_EQUAL("getBonk", name);
+  BOOST_CHECK_EQUAL(protocol::T_REPLY, type);
+  BOOST_CHECK_EQUAL(9, seqid);
+  BOOST_CHECK(bonk == bonk2);
+}
@@ -27,8 +27,19 @@
 #endif
 #include <getopt.h>
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
+#include <thrift/transport/TCrc32c.h>
 #include <thrift/transport/TFileTransport.h>
+#include <thrift/transport/TMappedFileTransport.h>
+#include <thrift/transport/TParallelFileProcessor.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/protocol/TBinaryProtocol.h>
 
 #ifdef __MINGW32__
   #include <io.h>
@@ -39,6 +50,15 @@
 #endif
 
 using namespace apache::thrift::transport;
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::PlatformThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
 
 /**************************************************************************
  * Global state
@@ -350,6 +370,358 @@ BOOST_AUTO_TEST_CASE(test_noop_flush) {
   }
 }
 
+/**
+ * Make sure events come back intact and in order when they pass through
+ * several ring buffers, are batched into shared writes, and are padded at
+ * chunk boundaries.
+ */
+BOOST_AUTO_TEST_CASE(test_ring_buffers_and_batched_writes) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  unsigned int const NUM_EVENTS = 2000;
+  std::vector<std::string> events;
+  for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+    // mostly smaller than the write buffer, with the odd one larger
+    size_t size = (n % 97 == 0) ? 2000 : 1 + (n * 37) % 900;
+    events.push_back(std::string(size, static_cast<char>('a' + n % 26)));
+  }
+
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(4096);
+    transport.setEventBufferSize(8);
+    transport.setEventBufferCount(3);
+    transport.setWriteBuffSize(1024);
+    for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+      transport.write(reinterpret_cast<const uint8_t*>(events[n].data()),
+                      static_cast<uint32_t>(events[n].size()));
+    }
+    transport.flush();
+  }
+
+  TFileTransport reader(f.getPath(), true);
+  reader.setReadTimeout(TFileTransport::NO_TAIL_READ_TIMEOUT);
+  reader.setChunkSize(4096);
+  uint8_t buf[4096];
+  for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+    uint32_t got = reader.read(buf, sizeof(buf));
+    BOOST_REQUIRE_EQUAL(got, events[n].size());
+    BOOST_CHECK(std::string(reinterpret_cast<const char*>(buf), got) == events[n]);
+  }
+  BOOST_CHECK_EQUAL(0u, reader.read(buf, sizeof(buf)));
+}
+
+BOOST_AUTO_TEST_CASE(test_crc32c) {
+  const uint8_t digits[] = "123456789";
+  BOOST_CHECK_EQUAL(0xe3069283u, crc32c(digits, 9));
+  // checksumming in pieces gives the same result
+  BOOST_CHECK_EQUAL(0xe3069283u, crc32c(digits + 4, 5, crc32c(digits, 4)));
+
+  std::vector<uint8_t> zeros(32, 0);
+  BOOST_CHECK_EQUAL(0x8a9136aau, crc32c(&zeros[0], zeros.size()));
+  std::vector<uint8_t> ascending(32);
+  for (size_t i = 0; i < ascending.size(); ++i) {
+    ascending[i] = static_cast<uint8_t>(i);
+  }
+  BOOST_CHECK_EQUAL(0x46dd794eu, crc32c(&ascending[0], ascending.size()));
+}
+
+/**
+ * Damage one event's contents and another event's size in a checksummed
+ * log, and make sure readers lose only those two events.
+ */
+BOOST_AUTO_TEST_CASE(test_checksum_resync) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  unsigned int const NUM_EVENTS = 50;
+  std::vector<std::string> events;
+  std::vector<long> offsets;
+  long offset = 0;
+  for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "event %u ", n);
+    events.push_back(std::string(buf) + std::string(n % 30, 'x'));
+    offsets.push_back(offset);
+    offset += 8 + static_cast<long>(events[n].size());
+  }
+
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(4096);
+    transport.setChecksumEvents(true);
+    for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+      transport.write(reinterpret_cast<const uint8_t*>(events[n].data()),
+                      static_cast<uint32_t>(events[n].size()));
+    }
+    transport.flush();
+  }
+
+  FILE* file = fopen(f.getPath(), "r+b");
+  BOOST_REQUIRE(file != NULL);
+  fseek(file, offsets[10] + 8 + 3, SEEK_SET);
+  fputc('?', file);
+  fseek(file, offsets[20] + 3, SEEK_SET);
+  fputc(0x7f, file);
+  fclose(file);
+
+  std::vector<std::string> expected;
+  for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+    if (n != 10 && n != 20) {
+      expected.push_back(events[n]);
+    }
+  }
+
+  // a bound on the event size keeps resyncing from checksumming
+  // candidates that cannot be events
+  TFileTransport reader(f.getPath(), true);
+  reader.setReadTimeout(TFileTransport::NO_TAIL_READ_TIMEOUT);
+  reader.setChunkSize(4096);
+  reader.setMaxEventSize(64);
+  uint8_t buf[4096];
+  for (size_t n = 0; n < expected.size(); ++n) {
+    uint32_t got = reader.read(buf, sizeof(buf));
+    BOOST_CHECK(std::string(reinterpret_cast<const char*>(buf), got) == expected[n]);
+  }
+  BOOST_CHECK_EQUAL(0u, reader.read(buf, sizeof(buf)));
+
+#ifndef _WIN32
+  TMappedFileTransport mapped(f.getPath());
+  mapped.setChunkSize(4096);
+  mapped.setMaxEventSize(64);
+  const uint8_t* data;
+  uint32_t size;
+  for (size_t n = 0; n < expected.size(); ++n) {
+    BOOST_REQUIRE(mapped.nextEvent(data, size));
+    BOOST_CHECK(std::string(reinterpret_cast<const char*>(data), size) == expected[n]);
+  }
+  BOOST_CHECK(!mapped.nextEvent(data, size));
+#endif
+}
+
+#ifndef _WIN32
+/**
+ * Read a log back through TMappedFileTransport, and use the sidecar index
+ * to seek by offset and by time.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_reader_and_index) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  std::string indexPath = TFileTransport::getIndexPath(f.getPath());
+
+  unsigned int const NUM_EVENTS = 500;
+  std::vector<std::string> events;
+  for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "event %u ", n);
+    events.push_back(std::string(buf) + std::string(n % 200, 'x'));
+  }
+
+  struct timeval start;
+  THRIFT_GETTIMEOFDAY(&start, NULL);
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(4096);
+    transport.setIndexInterval(16);
+    for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+      transport.write(reinterpret_cast<const uint8_t*>(events[n].data()),
+                      static_cast<uint32_t>(events[n].size()));
+    }
+    transport.flush();
+  }
+
+  TMappedFileTransport reader(f.getPath());
+  reader.setChunkSize(4096);
+  BOOST_REQUIRE(reader.loadIndex());
+  BOOST_CHECK(reader.getIndexSize() >= NUM_EVENTS / 16);
+
+  // whole events without a copy, and reads that stop at event boundaries
+  std::vector<uint64_t> offsets;
+  for (unsigned int n = 0; n < NUM_EVENTS; ++n) {
+    offsets.push_back(reader.getOffset());
+    if (n % 2 == 0) {
+      const uint8_t* data;
+      uint32_t size;
+      BOOST_REQUIRE(reader.nextEvent(data, size));
+      BOOST_CHECK(std::string(reinterpret_cast<const char*>(data), size) == events[n]);
+    } else {
+      uint8_t buf[4096];
+      uint32_t got = reader.read(buf, sizeof(buf));
+      BOOST_CHECK(std::string(reinterpret_cast<const char*>(buf), got) == events[n]);
+    }
+  }
+  uint8_t byte;
+  BOOST_CHECK_EQUAL(0u, reader.read(&byte, 1));
+
+  // seeking by offset lands on the event at or after it
+  reader.seekToOffset(offsets[321]);
+  TMemoryBuffer event;
+  BOOST_REQUIRE(reader.nextEvent(event));
+  BOOST_CHECK(event.getBufferAsString() == events[321]);
+  reader.seekToOffset(offsets[100] + 1);
+  BOOST_REQUIRE(reader.nextEvent(event));
+  BOOST_CHECK(event.getBufferAsString() == events[101]);
+
+  // every event was written after start, so seeking to it goes to the start
+  reader.seekToTime(start.tv_sec * static_cast<int64_t>(1000000) + start.tv_usec - 1);
+  BOOST_CHECK_EQUAL(0u, reader.getOffset());
+  reader.seekToTime(std::numeric_limits<int64_t>::max());
+  BOOST_CHECK_EQUAL(reader.getIndex().back().offset, reader.getOffset());
+
+  // a borrow never crosses into the next event
+  reader.seekToChunk(0);
+  uint8_t buf[4];
+  BOOST_CHECK_EQUAL(4u, reader.readAll(buf, 4));
+  uint32_t len = 1;
+  const uint8_t* borrowed = reader.borrow(NULL, &len);
+  BOOST_REQUIRE(borrowed != NULL);
+  BOOST_CHECK_EQUAL(events[0].size() - 4, len);
+  reader.consume(len);
+  len = 1;
+  BOOST_CHECK(reader.borrow(NULL, &len) == NULL);
+
+  ::unlink(indexPath.c_str());
+}
+
+/**
+ * Processor that records the seqid of every message, per key.  With
+ * throwEvery, it throws std::length_error on every throwEvery-th seqid, as a
+ * generated processor does on a corrupt container size.
+ */
+class RecordingProcessor : public apache::thrift::TProcessor {
+public:
+  explicit RecordingProcessor(int numKeys, int throwEvery = 0)
+    : seen_(numKeys), throwEvery_(throwEvery) {}
+
+  bool process(apache::thrift::stdcxx::shared_ptr<TProtocol> in,
+               apache::thrift::stdcxx::shared_ptr<TProtocol> out,
+               void* connectionContext) {
+    (void)out;
+    (void)connectionContext;
+    std::string name;
+    TMessageType type;
+    int32_t seqid;
+    in->readMessageBegin(name, type, seqid);
+    in->skip(apache::thrift::protocol::T_STRUCT);
+    in->readMessageEnd();
+    if (throwEvery_ != 0 && seqid % throwEvery_ == 0) {
+      throw std::length_error("vector::reserve");
+    }
+
+    Guard g(mutex_);
+    seen_[seqid % seen_.size()].push_back(seqid);
+    return true;
+  }
+
+  std::vector<std::vector<int32_t> > seen_;
+  int throwEvery_;
+  Mutex mutex_;
+};
+
+int const NUM_REPLAY_KEYS = 7;
+
+uint64_t seqidKey(const uint8_t* event, uint32_t size) {
+  TBinaryProtocol protocol(apache::thrift::stdcxx::shared_ptr<TTransport>(
+      new TMemoryBuffer(const_cast<uint8_t*>(event), size)));
+  std::string name;
+  TMessageType type;
+  int32_t seqid;
+  protocol.readMessageBegin(name, type, seqid);
+  return seqid % NUM_REPLAY_KEYS;
+}
+
+/**
+ * Replay a log in parallel, by chunk and with per-key ordering.
+ */
+BOOST_AUTO_TEST_CASE(test_parallel_replay) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  int const NUM_EVENTS = 3000;
+  int const NUM_KEYS = NUM_REPLAY_KEYS;
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(4096);
+    apache::thrift::stdcxx::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+    TBinaryProtocol protocol(buf);
+    for (int n = 0; n < NUM_EVENTS; ++n) {
+      buf->resetBuffer();
+      protocol.writeMessageBegin("event", apache::thrift::protocol::T_ONEWAY, n);
+      protocol.writeStructBegin("args");
+      protocol.writeFieldBegin("payload", apache::thrift::protocol::T_STRING, 1);
+      protocol.writeString(std::string(n % 100, 'p'));
+      protocol.writeFieldEnd();
+      protocol.writeFieldStop();
+      protocol.writeStructEnd();
+      protocol.writeMessageEnd();
+      uint8_t* data;
+      uint32_t size;
+      buf->getBuffer(&data, &size);
+      transport.write(data, size);
+    }
+    transport.flush();
+  }
+
+  apache::thrift::stdcxx::shared_ptr<ThreadManager> threadManager
+      = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(
+      apache::thrift::stdcxx::shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+  threadManager->start();
+  apache::thrift::stdcxx::shared_ptr<TProtocolFactory> protocolFactory(
+      new TBinaryProtocolFactory());
+
+  // by chunk: every event once, in any order
+  apache::thrift::stdcxx::shared_ptr<RecordingProcessor> byChunk(
+      new RecordingProcessor(NUM_KEYS));
+  TParallelFileProcessor chunked(byChunk, protocolFactory, threadManager);
+  chunked.setChunkSize(4096);
+  BOOST_CHECK_EQUAL(static_cast<uint64_t>(NUM_EVENTS), chunked.process(f.getPath()));
+  BOOST_CHECK_EQUAL(0u, chunked.getFailedCount());
+  std::vector<int32_t> all;
+  for (int key = 0; key < NUM_KEYS; ++key) {
+    all.insert(all.end(), byChunk->seen_[key].begin(), byChunk->seen_[key].end());
+  }
+  std::sort(all.begin(), all.end());
+  BOOST_REQUIRE_EQUAL(static_cast<size_t>(NUM_EVENTS), all.size());
+  for (int n = 0; n < NUM_EVENTS; ++n) {
+    BOOST_CHECK_EQUAL(n, all[n]);
+  }
+
+  // by key: events with the same key in file order
+  apache::thrift::stdcxx::shared_ptr<RecordingProcessor> byKey(new RecordingProcessor(NUM_KEYS));
+  TParallelFileProcessor keyed(byKey, protocolFactory, threadManager);
+  keyed.setChunkSize(4096);
+  keyed.setKeyFunction(seqidKey, 3);
+  keyed.setMaxPendingEvents(50);
+  BOOST_CHECK_EQUAL(static_cast<uint64_t>(NUM_EVENTS), keyed.process(f.getPath()));
+  size_t total = 0;
+  for (int key = 0; key < NUM_KEYS; ++key) {
+    const std::vector<int32_t>& seen = byKey->seen_[key];
+    total += seen.size();
+    for (size_t i = 1; i < seen.size(); ++i) {
+      BOOST_CHECK_LT(seen[i - 1], seen[i]);
+    }
+  }
+  BOOST_CHECK_EQUAL(static_cast<size_t>(NUM_EVENTS), total);
+
+  // a processor that throws something other than a TException
+  apache::thrift::stdcxx::shared_ptr<RecordingProcessor> throwing(
+      new RecordingProcessor(NUM_KEYS, 10));
+  TParallelFileProcessor chunkedThrowing(throwing, protocolFactory, threadManager);
+  chunkedThrowing.setChunkSize(4096);
+  BOOST_CHECK_EQUAL(static_cast<uint64_t>(NUM_EVENTS - NUM_EVENTS / 10),
+                    chunkedThrowing.process(f.getPath()));
+  BOOST_CHECK_EQUAL(static_cast<uint64_t>(NUM_EVENTS / 10), chunkedThrowing.getFailedCount());
+
+  TParallelFileProcessor keyedThrowing(throwing, protocolFactory, threadManager);
+  keyedThrowing.setChunkSize(4096);
+  keyedThrowing.setKeyFunction(seqidKey, 3);
+  keyedThrowing.setMaxPendingEvents(50);
+  BOOST_CHECK_EQUAL(static_cast<uint64_t>(NUM_EVENTS - NUM_EVENTS / 10),
+                    keyedThrowing.process(f.getPath()));
+  BOOST_CHECK_EQUAL(static_cast<uint64_t>(NUM_EVENTS / 10), keyedThrowing.getFailedCount());
+
+  threadManager->stop();
+}
+#endif
+
 /**************************************************************************
  * General Initialization
  **************************************************************************/
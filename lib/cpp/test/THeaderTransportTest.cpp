@@ -0,0 +1,311 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE THeaderTransportTest
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THeaderTransport.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::THeaderBufferPool;
+using apache::thrift::transport::THeaderDictionary;
+using apache::thrift::transport::THeaderTransport;
+using apache::thrift::transport::THeaderTransportFactory;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::stdcxx::dynamic_pointer_cast;
+using apache::thrift::stdcxx::shared_ptr;
+
+namespace {
+
+const uint16_t ALL_TRANSFORMS[] = {THeaderTransport::ZLIB_TRANSFORM,
+                                   THeaderTransport::LZ4_TRANSFORM,
+                                   THeaderTransport::ZSTD_TRANSFORM,
+                                   THeaderTransport::SNAPPY_TRANSFORM};
+
+std::string compressiblePayload(size_t len) {
+  std::string payload;
+  while (payload.size() < len) {
+    payload += "header transport payload ";
+  }
+  payload.resize(len);
+  return payload;
+}
+
+std::string randomPayload(size_t len) {
+  std::string payload(len, '\0');
+  uint32_t x = 2463534242u;
+  for (size_t i = 0; i < len; ++i) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    payload[i] = static_cast<char>(x);
+  }
+  return payload;
+}
+
+void send(THeaderTransport& trans, const std::string& payload) {
+  trans.write(reinterpret_cast<const uint8_t*>(payload.data()),
+              static_cast<uint32_t>(payload.size()));
+  trans.flush();
+}
+
+std::string receive(THeaderTransport& trans, size_t len) {
+  std::string payload(len, '\0');
+  trans.readAll(reinterpret_cast<uint8_t*>(&payload[0]), static_cast<uint32_t>(len));
+  trans.readEnd();
+  return payload;
+}
+
+void checkRoundTrip(uint16_t transId, const std::string& payload) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  THeaderTransport writer(wire);
+  THeaderTransport reader(wire);
+  writer.setTransform(transId);
+
+  send(writer, payload);
+  BOOST_CHECK(receive(reader, payload.size()) == payload);
+  BOOST_REQUIRE_EQUAL(1u, reader.getReadTransforms().size());
+  BOOST_CHECK_EQUAL(transId, reader.getReadTransforms()[0]);
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_transforms_round_trip) {
+  for (size_t i = 0; i < sizeof(ALL_TRANSFORMS) / sizeof(ALL_TRANSFORMS[0]); ++i) {
+    uint16_t transId = ALL_TRANSFORMS[i];
+    if (!THeaderTransport::isTransformSupported(transId)) {
+      BOOST_CHECK_THROW(THeaderTransport(shared_ptr<TMemoryBuffer>(new TMemoryBuffer()))
+                            .setTransform(transId),
+                        TTransportException);
+      continue;
+    }
+    checkRoundTrip(transId, compressiblePayload(100));
+    // larger than the default buffers, and incompressible
+    checkRoundTrip(transId, compressiblePayload(1 << 20));
+    checkRoundTrip(transId, randomPayload(1 << 18));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_min_compress_size) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  THeaderTransport writer(wire);
+  THeaderTransport reader(wire);
+  writer.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+  writer.setMinCompressSize(1024);
+
+  std::string small = compressiblePayload(1000);
+  send(writer, small);
+  BOOST_CHECK(receive(reader, small.size()) == small);
+  BOOST_CHECK(reader.getReadTransforms().empty());
+
+  std::string large = compressiblePayload(4096);
+  send(writer, large);
+  BOOST_CHECK(receive(reader, large.size()) == large);
+  BOOST_CHECK_EQUAL(1u, reader.getReadTransforms().size());
+}
+
+BOOST_AUTO_TEST_CASE(test_server_echoes_client_transforms) {
+  shared_ptr<TMemoryBuffer> request(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> response(new TMemoryBuffer());
+  THeaderTransport client(response, request);
+  THeaderTransport server(request, response);
+  client.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+
+  std::string payload = compressiblePayload(2048);
+  send(client, payload);
+  receive(server, payload.size());
+  BOOST_CHECK_EQUAL(1u, server.getNumTransforms());
+
+  send(server, payload);
+  BOOST_CHECK(receive(client, payload.size()) == payload);
+  BOOST_REQUIRE_EQUAL(1u, client.getReadTransforms().size());
+  BOOST_CHECK_EQUAL(THeaderTransport::ZLIB_TRANSFORM, client.getReadTransforms()[0]);
+
+  // an explicit choice is never overridden by the peer
+  server.clearTransforms();
+  send(client, payload);
+  receive(server, payload.size());
+  BOOST_CHECK_EQUAL(0u, server.getNumTransforms());
+}
+
+BOOST_AUTO_TEST_CASE(test_echo_turned_off) {
+  shared_ptr<TMemoryBuffer> request(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> response(new TMemoryBuffer());
+  THeaderTransport client(response, request);
+  THeaderTransport server(request, response);
+  server.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+  client.setEchoTransforms(false);
+
+  // a client that must not compress does not start because its server does
+  std::string payload = compressiblePayload(2048);
+  send(client, payload);
+  receive(server, payload.size());
+  send(server, payload);
+  BOOST_CHECK(receive(client, payload.size()) == payload);
+  BOOST_CHECK_EQUAL(1u, client.getReadTransforms().size());
+  BOOST_CHECK_EQUAL(0u, client.getNumTransforms());
+
+  send(client, payload);
+  receive(server, payload.size());
+  BOOST_CHECK(server.getReadTransforms().empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_streamed_frame_read_in_pieces) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  THeaderTransport writer(wire);
+  THeaderTransport reader(wire);
+  writer.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+
+  // several stream windows, followed by a second frame
+  std::string first = compressiblePayload(5 * THeaderTransport::STREAM_WINDOW_SIZE + 17);
+  std::string second = compressiblePayload(300);
+  send(writer, first);
+  send(writer, second);
+
+  std::string got;
+  uint8_t chunk[1000];
+  while (got.size() < first.size()) {
+    uint32_t want = static_cast<uint32_t>(std::min(sizeof(chunk), first.size() - got.size()));
+    reader.readAll(chunk, want);
+    got.append(reinterpret_cast<const char*>(chunk), want);
+  }
+  reader.readEnd();
+  BOOST_CHECK(got == first);
+  BOOST_CHECK(receive(reader, second.size()) == second);
+}
+
+BOOST_AUTO_TEST_CASE(test_buffer_pool_is_shared) {
+  shared_ptr<THeaderBufferPool> pool(new THeaderBufferPool());
+  THeaderTransportFactory factory(pool);
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  shared_ptr<THeaderTransport> writer
+      = dynamic_pointer_cast<THeaderTransport>(factory.getTransport(wire));
+  shared_ptr<THeaderTransport> reader
+      = dynamic_pointer_cast<THeaderTransport>(factory.getTransport(wire));
+  BOOST_REQUIRE(writer && reader);
+  BOOST_CHECK(writer->getBufferPool() == pool);
+  writer->setTransform(THeaderTransport::ZLIB_TRANSFORM);
+
+  // buffers cycle through the pool instead of being allocated per frame
+  std::string payload = compressiblePayload(8192);
+  size_t idle = 0;
+  for (int i = 0; i < 4; ++i) {
+    send(*writer, payload);
+    BOOST_CHECK(receive(*reader, payload.size()) == payload);
+    if (i == 2) {
+      idle = pool->size();
+    }
+  }
+  BOOST_CHECK(idle > 0);
+  BOOST_CHECK_EQUAL(idle, pool->size());
+
+  boost::scoped_array<uint8_t> buf;
+  uint32_t size = 0;
+  pool->acquire(100, buf, size);
+  BOOST_CHECK(size >= 100);
+  pool->release(buf, size);
+  BOOST_CHECK(!buf);
+  BOOST_CHECK_EQUAL(0u, size);
+}
+
+namespace {
+
+std::string smallMessage(int i) {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\"user\":{\"id\":%d,\"name\":\"user-%d\",\"locale\":\"en_US\",\"flags\":[\"beta\","
+           "\"verified\"]},\"request\":\"getTimeline\",\"limit\":50,\"cursor\":%d}",
+           i, i * 7, i * 13);
+  return buf;
+}
+
+uint32_t frameSize(const shared_ptr<THeaderDictionary>& dict, uint16_t transId) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  THeaderTransport writer(wire);
+  if (dict) {
+    writer.setWriteDictionary(dict);
+  }
+  writer.setTransform(transId);
+  send(writer, smallMessage(1000));
+  return wire->available_read();
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_dictionary_transforms) {
+  std::vector<std::string> samples;
+  for (int i = 0; i < 200; ++i) {
+    samples.push_back(smallMessage(i));
+  }
+  std::string trained = THeaderDictionary::train(samples, 1024);
+  BOOST_CHECK(!trained.empty());
+  BOOST_CHECK(trained.size() <= 1024u);
+  shared_ptr<THeaderDictionary> dict(new THeaderDictionary(42, trained));
+
+  const uint16_t dictTransforms[] = {THeaderTransport::ZLIB_DICT_TRANSFORM,
+                                     THeaderTransport::ZSTD_DICT_TRANSFORM};
+  for (size_t i = 0; i < 2; ++i) {
+    uint16_t transId = dictTransforms[i];
+    if (!THeaderTransport::isTransformSupported(transId)) {
+      continue;
+    }
+    shared_ptr<TMemoryBuffer> request(new TMemoryBuffer());
+    shared_ptr<TMemoryBuffer> response(new TMemoryBuffer());
+    THeaderTransport client(response, request);
+    THeaderTransport server(request, response);
+    client.setWriteDictionary(dict);
+    client.setTransform(transId);
+    server.addDictionary(dict);
+
+    std::string message = smallMessage(1000);
+    send(client, message);
+    BOOST_CHECK(receive(server, message.size()) == message);
+    BOOST_REQUIRE_EQUAL(1u, server.getReadTransforms().size());
+    BOOST_CHECK_EQUAL(transId, server.getReadTransforms()[0]);
+
+    // the server answers with the same dictionary
+    BOOST_CHECK(server.getWriteDictionary() == dict);
+    send(server, message);
+    BOOST_CHECK(receive(client, message.size()) == message);
+  }
+
+  // a primed compressor does much better on a small message
+  BOOST_CHECK(frameSize(dict, THeaderTransport::ZLIB_DICT_TRANSFORM)
+              < frameSize(shared_ptr<THeaderDictionary>(), THeaderTransport::ZLIB_TRANSFORM) / 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_unknown_dictionary) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  THeaderTransport writer(wire);
+  THeaderTransport reader(wire);
+  writer.setWriteDictionary(shared_ptr<THeaderDictionary>(new THeaderDictionary(7, "dictionary")));
+  writer.setTransform(THeaderTransport::ZLIB_DICT_TRANSFORM);
+  send(writer, smallMessage(1));
+
+  uint8_t buf[16];
+  BOOST_CHECK_THROW(reader.read(buf, sizeof(buf)), TTransportException);
+
+  THeaderTransport noDict(shared_ptr<TMemoryBuffer>(new TMemoryBuffer()));
+  noDict.setTransform(THeaderTransport::ZLIB_DICT_TRANSFORM);
+  BOOST_CHECK_THROW(send(noDict, smallMessage(1)), TTransportException);
+}
@@ -0,0 +1,130 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE THedgedCallTest
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/async/THedgedCall.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/transport/TTransportException.h>
+
+#include <string>
+
+using apache::thrift::async::THedgedCall;
+using apache::thrift::async::THedgePolicy;
+using apache::thrift::concurrency::PlatformThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::stdcxx::bind;
+using apache::thrift::stdcxx::function;
+using apache::thrift::stdcxx::shared_ptr;
+namespace placeholders = apache::thrift::stdcxx::placeholders;
+
+namespace {
+
+shared_ptr<ThreadManager> newThreadManager() {
+  shared_ptr<ThreadManager> tm = ThreadManager::newSimpleThreadManager(4);
+  tm->threadFactory(shared_ptr<PlatformThreadFactory>(new PlatformThreadFactory()));
+  tm->start();
+  return tm;
+}
+
+void respond(std::string& result, const std::string& value, int delayMs) {
+  THRIFT_SLEEP_USEC(delayMs * 1000);
+  result = value;
+}
+
+void fail(std::string&, int delayMs) {
+  THRIFT_SLEEP_USEC(delayMs * 1000);
+  throw TTransportException(TTransportException::TIMED_OUT, "leg failed");
+}
+
+typedef function<void(std::string&)> StringLeg;
+
+// hedge after 20ms whatever the observed latencies are
+shared_ptr<THedgePolicy> fixedPolicy() {
+  return shared_ptr<THedgePolicy>(new THedgePolicy(95.0, 20000, 20000));
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_fast_primary_does_not_hedge) {
+  THedgedCall hedge(newThreadManager(), fixedPolicy());
+  std::string result;
+  hedge.call<std::string>(result,
+                          StringLeg(bind(respond, placeholders::_1, "primary", 0)),
+                          StringLeg(bind(respond, placeholders::_1, "backup", 0)));
+  BOOST_CHECK_EQUAL("primary", result);
+  BOOST_CHECK_EQUAL(1u, hedge.getCallCount());
+  BOOST_CHECK_EQUAL(0u, hedge.getHedgeCount());
+}
+
+BOOST_AUTO_TEST_CASE(test_slow_primary_is_hedged) {
+  THedgedCall hedge(newThreadManager(), fixedPolicy());
+  std::string result;
+  hedge.call<std::string>(result,
+                          StringLeg(bind(respond, placeholders::_1, "primary", 500)),
+                          StringLeg(bind(respond, placeholders::_1, "backup", 0)));
+  BOOST_CHECK_EQUAL("backup", result);
+  BOOST_CHECK_EQUAL(1u, hedge.getHedgeCount());
+  BOOST_CHECK_EQUAL(1u, hedge.getBackupWinCount());
+
+  // the primary's late reply is not a sample
+  THRIFT_SLEEP_USEC(700 * 1000);
+  BOOST_CHECK_EQUAL(1u, hedge.getPolicy()->getSampleCount());
+}
+
+BOOST_AUTO_TEST_CASE(test_failed_primary_hedges_immediately) {
+  shared_ptr<THedgePolicy> policy(new THedgePolicy(95.0, 1000000, 1000000));
+  THedgedCall hedge(newThreadManager(), policy);
+  std::string result;
+  hedge.call<std::string>(result,
+                          StringLeg(bind(fail, placeholders::_1, 0)),
+                          StringLeg(bind(respond, placeholders::_1, "backup", 0)));
+  BOOST_CHECK_EQUAL("backup", result);
+  BOOST_CHECK_EQUAL(1u, hedge.getBackupWinCount());
+}
+
+BOOST_AUTO_TEST_CASE(test_all_legs_fail) {
+  THedgedCall hedge(newThreadManager(), fixedPolicy());
+  std::string result;
+  BOOST_CHECK_THROW(hedge.call<std::string>(result,
+                                            StringLeg(bind(fail, placeholders::_1, 50)),
+                                            StringLeg(bind(fail, placeholders::_1, 0))),
+                    TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE(test_policy_percentile) {
+  THedgePolicy policy(90.0, 0, 1000000, 100, 10);
+  BOOST_CHECK_EQUAL(1000000, policy.getHedgeDelay());
+  for (int64_t i = 1; i <= 100; ++i) {
+    policy.recordLatency(i * 100);
+  }
+  BOOST_CHECK_EQUAL(100u, policy.getSampleCount());
+  BOOST_CHECK_EQUAL(9000, policy.getHedgeDelay());
+
+  THedgePolicy p95(95.0, 0, 1000000, 100, 10);
+  for (int64_t i = 100; i >= 1; --i) {
+    p95.recordLatency(i);
+  }
+  BOOST_CHECK_EQUAL(95, p95.getHedgeDelay());
+
+  THedgePolicy clamped(50.0, 5000, 8000, 16, 1);
+  clamped.recordLatency(10);
+  BOOST_CHECK_EQUAL(5000, clamped.getHedgeDelay());
+}
@@ -21,7 +21,6 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/smart_ptr.hpp>
 #include <boost/shared_ptr.hpp>
-#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
 #include "thrift/server/TNonblockingServer.h"
@@ -29,6 +28,7 @@
 #include "thrift/transport/TNonblockingSSLServerSocket.h"
 
 #include "gen-cpp/ParentService.h"
+#include "TestCertificate.h"
 
 #include <event.h>
 
@@ -54,11 +54,8 @@ struct Handler : public test::ParentServiceIf {
   void unexpectedExceptionWait(const std::string&) {}
 };
 
-boost::filesystem::path keyDir;
-boost::filesystem::path certFile(const std::string& filename)
-{
-  return keyDir / filename;
-}
+// made fresh for the run, since the ones in test/keys expire
+TestCertificate* certificate = NULL;
 
 struct GlobalFixtureSSL
 {
@@ -79,19 +76,13 @@ struct GlobalFixtureSSL
       TSSLSocketFactory::setManualOpenSSLInitialization(true);
       apache::thrift::transport::initializeOpenSSL();
 
-      keyDir = boost::filesystem::current_path().parent_path().parent_path().parent_path() / "test" / "keys";
-      if (!boost::filesystem::exists(certFile("server.crt")))
-      {
-        keyDir = boost::filesystem::path(master_test_suite().argv[master_test_suite().argc - 1]);
-        if (!boost::filesystem::exists(certFile("server.crt")))
-        {
-          throw std::invalid_argument("The last argument to this test must be the directory containing the test certificate(s).");
-        }
-      }
+      certificate = new TestCertificate();
     }
 
     virtual ~GlobalFixtureSSL()
     {
+      delete certificate;
+      certificate = NULL;
       apache::thrift::transport::cleanupOpenSSL();
 #ifdef __linux__
       signal(SIGPIPE, SIG_DFL);
@@ -110,8 +101,8 @@ stdcxx::shared_ptr<TSSLSocketFactory> createServerSocketFactory() {
 
   pServerSocketFactory.reset(new TSSLSocketFactory());
   pServerSocketFactory->ciphers("ALL:!ADH:!LOW:!EXP:!MD5:@STRENGTH");
-  pServerSocketFactory->loadCertificate(certFile("server.crt").string().c_str());
-  pServerSocketFactory->loadPrivateKey(certFile("server.key").string().c_str());
+  pServerSocketFactory->loadCertificate(certificate->certFile().c_str());
+  pServerSocketFactory->loadPrivateKey(certificate->keyFile().c_str());
   pServerSocketFactory->server(true);
   return pServerSocketFactory;
 }
@@ -121,9 +112,7 @@ stdcxx::shared_ptr<TSSLSocketFactory> createClientSocketFactory() {
 
   pClientSocketFactory.reset(new TSSLSocketFactory());
   pClientSocketFactory->authenticate(true);
-  pClientSocketFactory->loadCertificate(certFile("client.crt").string().c_str());
-  pClientSocketFactory->loadPrivateKey(certFile("client.key").string().c_str());
-  pClientSocketFactory->loadTrustedCertificates(certFile("CA.pem").string().c_str());
+  pClientSocketFactory->loadTrustedCertificates(certificate->certFile().c_str());
   return pClientSocketFactory;
 }
 
@@ -146,6 +135,7 @@ private:
   struct Runner : public apache::thrift::concurrency::Runnable {
     int port;
     stdcxx::shared_ptr<event_base> userEventBase;
+    stdcxx::shared_ptr<concurrency::ThreadManager> handshakeThreadManager;
     stdcxx::shared_ptr<TProcessor> processor;
     stdcxx::shared_ptr<server::TNonblockingServer> server;
     stdcxx::shared_ptr<ListenEventHandler> listenHandler;
@@ -178,6 +168,7 @@ private:
         server.reset(new server::TNonblockingServer(processor, socket));
 	      server->setServerEventHandler(listenHandler);
         server->setNumIOThreads(1);
+        server->setHandshakeThreadManager(handshakeThreadManager);
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
@@ -213,11 +204,16 @@ protected:
     userEventBase_.reset(user_event_base, EventDeleter());
   }
 
+  void setHandshakeThreadManager(stdcxx::shared_ptr<concurrency::ThreadManager> threadManager) {
+    handshakeThreadManager_ = threadManager;
+  }
+
   int startServer(int port) {
     stdcxx::shared_ptr<Runner> runner(new Runner);
     runner->port = port;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
+    runner->handshakeThreadManager = handshakeThreadManager_;
 
     apache::thrift::stdcxx::scoped_ptr<apache::thrift::concurrency::ThreadFactory> threadFactory(
         new apache::thrift::concurrency::PlatformThreadFactory(
@@ -248,6 +244,7 @@ protected:
 
 private:
   stdcxx::shared_ptr<event_base> userEventBase_;
+  stdcxx::shared_ptr<concurrency::ThreadManager> handshakeThreadManager_;
   stdcxx::shared_ptr<test::ParentServiceProcessor> processor;
 protected:
   stdcxx::shared_ptr<server::TNonblockingServer> server;
@@ -290,4 +287,55 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+BOOST_FIXTURE_TEST_CASE(handshake_on_io_thread, Fixture) {
+  startServer(0);
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+
+  server::THandshakeStats stats = server->getHandshakeStats();
+  BOOST_CHECK_EQUAL(1u, stats.count);
+  BOOST_CHECK_EQUAL(0u, stats.failures);
+  BOOST_CHECK_GE(stats.totalUs, stats.maxUs);
+}
+
+BOOST_FIXTURE_TEST_CASE(handshake_thread_manager, Fixture) {
+  stdcxx::shared_ptr<concurrency::ThreadManager> threadManager
+      = concurrency::ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(stdcxx::make_shared<concurrency::PlatformThreadFactory>());
+  threadManager->start();
+  setHandshakeThreadManager(threadManager);
+  startServer(0);
+
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+  BOOST_CHECK_EQUAL(1u, server->getHandshakeStats().count);
+  BOOST_CHECK_GT(server->getHandshakeStats().workUs, 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(handshake_failure, Fixture) {
+  startServer(0);
+  // a client that does not speak TLS
+  transport::TSocket plain("localhost", server->getListenPort());
+  plain.open();
+  const std::string garbage("not a client hello\r\n\r\n");
+  plain.write(reinterpret_cast<const uint8_t*>(garbage.data()),
+              static_cast<uint32_t>(garbage.size()));
+  plain.flush();
+  uint8_t byte;
+  try {
+    plain.read(&byte, 1);
+  } catch (const transport::TTransportException&) {
+    // the server may reset the connection instead of closing it
+  }
+  plain.close();
+
+  for (int i = 0; i < 100 && server->getHandshakeStats().failures == 0; ++i) {
+    THRIFT_SLEEP_USEC(10000);
+  }
+  BOOST_CHECK_EQUAL(1u, server->getHandshakeStats().failures);
+  BOOST_CHECK_EQUAL(0u, server->getHandshakeStats().count);
+
+  // the server goes on serving
+  BOOST_CHECK(canCommunicate(server->getListenPort()));
+  BOOST_CHECK_EQUAL(1u, server->getHandshakeStats().count);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
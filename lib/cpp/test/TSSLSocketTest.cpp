@@ -0,0 +1,272 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TSSLSocketTest
+#include <boost/test/unit_test.hpp>
+
+#include <boost/thread/thread.hpp>
+
+#include <thrift/stdcxx.h>
+#include <thrift/transport/TSSLServerSocket.h>
+#include <thrift/transport/TSSLSocket.h>
+
+#include <string>
+#include <vector>
+
+#include "TestCertificate.h"
+
+using apache::thrift::transport::TSSLException;
+using apache::thrift::transport::TSSLServerSocket;
+using apache::thrift::transport::TSSLSessionCache;
+using apache::thrift::transport::TSSLSocket;
+using apache::thrift::transport::TSSLSocketFactory;
+using apache::thrift::transport::TSSLTicketKeys;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::stdcxx::dynamic_pointer_cast;
+using apache::thrift::stdcxx::shared_ptr;
+
+namespace {
+
+shared_ptr<TSSLSocketFactory> serverFactory(const TestCertificate& certificate) {
+  shared_ptr<TSSLSocketFactory> factory(new TSSLSocketFactory());
+  factory->server(true);
+  factory->loadCertificate(certificate.certFile().c_str());
+  factory->loadPrivateKey(certificate.keyFile().c_str());
+  return factory;
+}
+
+shared_ptr<TSSLSocketFactory> clientFactory(const TestCertificate& certificate) {
+  shared_ptr<TSSLSocketFactory> factory(new TSSLSocketFactory());
+  factory->loadTrustedCertificates(certificate.certFile().c_str());
+  return factory;
+}
+
+// turns on kernel TLS where this build of OpenSSL supports it
+bool enableKernelTLS(TSSLSocketFactory& factory) {
+  if (!TSSLSocketFactory::isKernelTLSAvailable()) {
+    BOOST_CHECK_THROW(factory.kernelTLS(true), TSSLException);
+    return false;
+  }
+  factory.kernelTLS(true);
+  return true;
+}
+
+/**
+ * Echoes what its connections send until they close, one connection at a
+ * time.
+ */
+class EchoServer {
+public:
+  EchoServer(shared_ptr<TSSLSocketFactory> factory, int connections)
+    : sawEOF(false),
+      kernelSend(false),
+      kernelRecv(false),
+      socket_(new TSSLServerSocket("localhost", 0, factory)) {
+    socket_->listen();
+    thread_ = boost::thread(&EchoServer::serve, this, connections);
+  }
+
+  ~EchoServer() {
+    if (thread_.joinable()) {
+      // a failed test may have left the server waiting for a connection
+      socket_->interrupt();
+      thread_.join();
+    }
+    socket_->close();
+  }
+
+  int getPort() { return socket_->getPort(); }
+
+  // join the server thread and report what it saw
+  void finish() { thread_.join(); }
+
+  std::string error;
+  bool sawEOF;
+  bool kernelSend;
+  bool kernelRecv;
+  std::vector<bool> reused;
+
+private:
+  void serve(int connections) {
+    try {
+      for (int i = 0; i < connections; ++i) {
+        shared_ptr<TSSLSocket> peer = dynamic_pointer_cast<TSSLSocket>(socket_->accept());
+        uint8_t buf[4096];
+        uint32_t got;
+        sawEOF = false;
+        try {
+          while ((got = peer->read(buf, sizeof(buf))) > 0) {
+            peer->write(buf, got);
+            peer->flush();
+          }
+        } catch (const TTransportException& e) {
+          if (e.getType() != TTransportException::END_OF_FILE) {
+            throw;
+          }
+        }
+        sawEOF = true;
+        kernelSend = peer->isKernelTLSSend();
+        kernelRecv = peer->isKernelTLSRecv();
+        reused.push_back(peer->isSessionReused());
+        peer->close();
+      }
+    } catch (const std::exception& e) {
+      error = e.what();
+    }
+  }
+
+  shared_ptr<TSSLServerSocket> socket_;
+  boost::thread thread_;
+};
+
+// sends data through an EchoServer and checks that it comes back intact
+void roundTrip(shared_ptr<TSSLSocket> socket, const std::string& data) {
+  socket->write(reinterpret_cast<const uint8_t*>(data.data()),
+                static_cast<uint32_t>(data.size()));
+  socket->flush();
+  std::string echoed(data.size(), '\0');
+  socket->readAll(reinterpret_cast<uint8_t*>(&echoed[0]), static_cast<uint32_t>(echoed.size()));
+  BOOST_CHECK(data == echoed);
+}
+
+std::string payload(size_t size) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = static_cast<char>(i * 31 + (i >> 8));
+  }
+  return data;
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_kernel_tls_round_trip) {
+  TestCertificate certificate;
+  shared_ptr<TSSLSocketFactory> server = serverFactory(certificate);
+  shared_ptr<TSSLSocketFactory> client = clientFactory(certificate);
+  bool supported = enableKernelTLS(*server) && enableKernelTLS(*client);
+
+  EchoServer echo(server, 1);
+  shared_ptr<TSSLSocket> socket = client->createSocket("localhost", echo.getPort());
+  socket->open();
+  // small writes, then ones spanning many records
+  roundTrip(socket, "hello");
+  roundTrip(socket, payload(1000));
+  roundTrip(socket, payload(300 * 1000));
+
+  // whether the kernel took the keys depends on its "tls" module; either
+  // way the data must have made it, and a direction only goes to the
+  // kernel when the option was on
+  BOOST_TEST_MESSAGE("client kernel TLS send " << socket->isKernelTLSSend() << " recv "
+                                              << socket->isKernelTLSRecv());
+  if (!supported) {
+    BOOST_CHECK(!socket->isKernelTLSSend());
+    BOOST_CHECK(!socket->isKernelTLSRecv());
+  }
+  socket->close();
+
+  // the close_notify alert reaches the server as end of stream
+  echo.finish();
+  BOOST_CHECK_EQUAL("", echo.error);
+  BOOST_CHECK(echo.sawEOF);
+  if (!supported) {
+    BOOST_CHECK(!echo.kernelSend);
+    BOOST_CHECK(!echo.kernelRecv);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_kernel_tls_disabled) {
+  TestCertificate certificate;
+  shared_ptr<TSSLSocketFactory> server = serverFactory(certificate);
+  shared_ptr<TSSLSocketFactory> client = clientFactory(certificate);
+  if (enableKernelTLS(*client)) {
+    client->kernelTLS(false);
+  }
+
+  EchoServer echo(server, 1);
+  shared_ptr<TSSLSocket> socket = client->createSocket("localhost", echo.getPort());
+  socket->open();
+  roundTrip(socket, payload(100 * 1000));
+  BOOST_CHECK(!socket->isKernelTLSSend());
+  BOOST_CHECK(!socket->isKernelTLSRecv());
+  socket->close();
+
+  echo.finish();
+  BOOST_CHECK_EQUAL("", echo.error);
+  BOOST_CHECK(!echo.kernelSend);
+  BOOST_CHECK(!echo.kernelRecv);
+}
+
+namespace {
+
+// connects, exchanges a message and reports whether the session was resumed
+bool connectOnce(TSSLSocketFactory& factory, int port) {
+  shared_ptr<TSSLSocket> socket = factory.createSocket("localhost", port);
+  socket->open();
+  // reading the echo also takes in the session ticket the server sent
+  roundTrip(socket, "resume me");
+  bool reused = socket->isSessionReused();
+  socket->close();
+  return reused;
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_session_resumption) {
+  TestCertificate certificate;
+  shared_ptr<TSSLSocketFactory> server = serverFactory(certificate);
+  shared_ptr<TSSLTicketKeys> keys(new TSSLTicketKeys(2));
+  server->ticketKeys(keys);
+  shared_ptr<TSSLSocketFactory> client = clientFactory(certificate);
+  shared_ptr<TSSLSessionCache> cache(new TSSLSessionCache());
+  client->sessionCache(cache);
+
+  EchoServer echo(server, 4);
+  BOOST_CHECK(!connectOnce(*client, echo.getPort()));
+  BOOST_CHECK_EQUAL(1u, cache->size());
+  BOOST_CHECK(connectOnce(*client, echo.getPort()));
+
+  // a ticket under the previous key is still honoured
+  keys->rotate();
+  BOOST_CHECK(connectOnce(*client, echo.getPort()));
+
+  // once its key is out of the rotation the client falls back to a full
+  // handshake
+  keys->rotate();
+  keys->rotate();
+  BOOST_CHECK(!connectOnce(*client, echo.getPort()));
+
+  echo.finish();
+  BOOST_CHECK_EQUAL("", echo.error);
+  BOOST_REQUIRE_EQUAL(4u, echo.reused.size());
+  BOOST_CHECK(!echo.reused[0]);
+  BOOST_CHECK(echo.reused[1]);
+  BOOST_CHECK(echo.reused[2]);
+  BOOST_CHECK(!echo.reused[3]);
+}
+
+BOOST_AUTO_TEST_CASE(test_no_resumption_without_cache) {
+  TestCertificate certificate;
+  shared_ptr<TSSLSocketFactory> server = serverFactory(certificate);
+  server->ticketKeys(shared_ptr<TSSLTicketKeys>(new TSSLTicketKeys()));
+  shared_ptr<TSSLSocketFactory> client = clientFactory(certificate);
+
+  EchoServer echo(server, 2);
+  BOOST_CHECK(!connectOnce(*client, echo.getPort()));
+  BOOST_CHECK(!connectOnce(*client, echo.getPort()));
+  echo.finish();
+  BOOST_CHECK_EQUAL("", echo.error);
+}
@@ -0,0 +1,98 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TEST_TESTCERTIFICATE_H_
+#define _THRIFT_TEST_TESTCERTIFICATE_H_ 1
+
+#include <boost/filesystem.hpp>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#include <stdio.h>
+#include <string>
+#ifdef __linux__
+#include <signal.h>
+#endif
+
+/**
+ * A self-signed certificate for localhost, made fresh so that the TLS tests
+ * do not depend on the expiry of the ones in test/keys.
+ */
+struct TestCertificate {
+  TestCertificate() {
+    dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+
+    EVP_PKEY* key = NULL;
+    EVP_PKEY_CTX* keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    EVP_PKEY_keygen_init(keyCtx);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyCtx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(keyCtx, &key);
+    EVP_PKEY_CTX_free(keyCtx);
+
+    X509* cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_get_notBefore(cert), -3600);
+    X509_gmtime_adj(X509_get_notAfter(cert), 24 * 3600);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name,
+                               "CN",
+                               MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char*>("localhost"),
+                               -1,
+                               -1,
+                               0);
+    X509_set_issuer_name(cert, name);
+    X509_set_pubkey(cert, key);
+    X509V3_CTX extCtx;
+    X509V3_set_ctx_nodb(&extCtx);
+    X509V3_set_ctx(&extCtx, cert, cert, NULL, NULL, 0);
+    X509_EXTENSION* san = X509V3_EXT_conf_nid(NULL,
+                                              &extCtx,
+                                              NID_subject_alt_name,
+                                              const_cast<char*>("DNS:localhost,IP:127.0.0.1"));
+    X509_add_ext(cert, san, -1);
+    X509_EXTENSION_free(san);
+    X509_sign(cert, key, EVP_sha256());
+
+    FILE* file = fopen(certFile().c_str(), "w");
+    PEM_write_X509(file, cert);
+    fclose(file);
+    file = fopen(keyFile().c_str(), "w");
+    PEM_write_PrivateKey(file, key, NULL, NULL, 0, NULL, NULL);
+    fclose(file);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+#ifdef __linux__
+    // OpenSSL writes without MSG_NOSIGNAL
+    signal(SIGPIPE, SIG_IGN);
+#endif
+  }
+
+  ~TestCertificate() { boost::filesystem::remove_all(dir); }
+
+  std::string certFile() const { return (dir / "cert.pem").string(); }
+  std::string keyFile() const { return (dir / "key.pem").string(); }
+
+  boost::filesystem::path dir;
+};
+
+#endif // _THRIFT_TEST_TESTCERTIFICATE_H_
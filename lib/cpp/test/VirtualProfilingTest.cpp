@@ -0,0 +1,149 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdlib.h>
+#include <string>
+#include <thrift/Thrift.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/Thread.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/stdcxx.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/ParentService.h"
+
+#define BOOST_TEST_MODULE VirtualProfilingTest
+#include <boost/test/unit_test.hpp>
+
+using namespace apache::thrift;
+using namespace apache::thrift::test;
+using apache::thrift::concurrency::PlatformThreadFactory;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+
+static void writeI32s(int count) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol binary(buffer);
+  TProtocol* proto = &binary;
+  for (int i = 0; i < count; ++i) {
+    proto->writeI32(i);
+  }
+}
+
+static bool contains(const std::string& info, const std::string& line) {
+  return info.find(line) != std::string::npos;
+}
+
+BOOST_AUTO_TEST_CASE(test_off_by_default) {
+  BOOST_CHECK_EQUAL(0u, profile_sample_rate.load());
+  writeI32s(100);
+  BOOST_CHECK_EQUAL("", profile_sampling_info());
+}
+
+BOOST_AUTO_TEST_CASE(test_every_call) {
+  profile_sampling_reset();
+  profile_sampling_start(1);
+  writeI32s(100);
+  profile_sampling_stop();
+
+  std::string info = profile_sampling_info();
+  BOOST_CHECK_MESSAGE(contains(info, "T_VIRTUAL_CALL: ~100 calls (100 sampled) to writeI32() on "
+                                     "apache::thrift::protocol::TBinaryProtocolT<"),
+                      info);
+  // the protocol writes to its transport through the virtual interface too
+  BOOST_CHECK_MESSAGE(contains(info, "to write() on apache::thrift::transport::TMemoryBuffer"),
+                      info);
+
+  // stopped
+  writeI32s(100);
+  BOOST_CHECK(info == profile_sampling_info());
+
+  profile_sampling_reset();
+  BOOST_CHECK_EQUAL("", profile_sampling_info());
+}
+
+#ifdef HAVE_PTHREAD_H
+class Writer : public Runnable {
+public:
+  void run() { writeI32s(5); }
+};
+
+BOOST_AUTO_TEST_CASE(test_thread_exit) {
+  profile_sampling_reset();
+  profile_sampling_start(1);
+  // fewer samples than fill a buffer, handed over when the thread exits
+  PlatformThreadFactory factory(false);
+  stdcxx::shared_ptr<Thread> thread = factory.newThread(stdcxx::shared_ptr<Runnable>(new Writer()));
+  thread->start();
+  thread->join();
+  profile_sampling_stop();
+
+  std::string info = profile_sampling_info();
+  BOOST_CHECK_MESSAGE(contains(info, "T_VIRTUAL_CALL: ~5 calls (5 sampled) to writeI32() on "),
+                      info);
+  profile_sampling_reset();
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(test_sample_rate) {
+  profile_sampling_reset();
+  profile_sampling_start(10);
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  transport::TTransport* trans = buffer.get();
+  uint8_t byte = 0;
+  for (int i = 0; i < 10000; ++i) {
+    trans->write(&byte, 1);
+  }
+  profile_sampling_stop();
+
+  // about one call in ten, each standing for ten
+  std::string info = profile_sampling_info();
+  const std::string prefix("T_VIRTUAL_CALL: ~");
+  BOOST_REQUIRE_MESSAGE(info.find(prefix) == 0, info);
+  long calls = atol(info.c_str() + prefix.size());
+  BOOST_CHECK_MESSAGE(calls > 8000 && calls < 12000, info);
+  BOOST_CHECK_MESSAGE(contains(info, " sampled) to write() on "), info);
+  profile_sampling_reset();
+}
+
+BOOST_AUTO_TEST_CASE(test_generic_protocol) {
+  stdcxx::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  stdcxx::shared_ptr<TProtocol> compact(new TCompactProtocol(buffer));
+  ParentServiceClient(compact).send_getGeneration();
+
+  profile_sampling_reset();
+  profile_sampling_start(1);
+  ParentServiceProcessorT<TBinaryProtocol> processor(
+      stdcxx::shared_ptr<ParentServiceIf>(new ParentServiceNull()));
+  processor.process(compact, compact, NULL);
+  profile_sampling_stop();
+
+  std::string info = profile_sampling_info();
+  // one for the input protocol and one for the output protocol
+  BOOST_CHECK_MESSAGE(contains(info, "T_GENERIC_PROTOCOL: ~2 calls (2 sampled) to "
+                                     "apache::thrift::test::ParentServiceProcessorT<"),
+                      info);
+  BOOST_CHECK_MESSAGE(contains(info, "> with a apache::thrift::protocol::TCompactProtocolT<"),
+                      info);
+  profile_sampling_reset();
+}
@@ -43,10 +43,12 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/version.hpp>
 
+#include <thrift/concurrency/Util.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/TZlibTransport.h>
 
 using namespace apache::thrift::transport;
+using apache::thrift::concurrency::Util;
 using apache::thrift::stdcxx::shared_ptr;
 using std::string;
 
@@ -338,6 +340,126 @@ void test_get_underlying_transport() {
   BOOST_CHECK_EQUAL(membuf.get(), zlib_trans->getUnderlyingTransport().get());
 }
 
+void test_stream_pool() {
+  shared_ptr<TZlibStreamPool> pool(new TZlibStreamPool());
+  TZlibTransportFactory factory(pool);
+  string payload(4096, 'x');
+
+  for (int i = 0; i < 3; ++i) {
+    shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+    {
+      shared_ptr<TTransport> w_zlib_trans = factory.getTransport(membuf);
+      w_zlib_trans->write(reinterpret_cast<const uint8_t*>(payload.data()),
+                          static_cast<uint32_t>(payload.size()));
+      w_zlib_trans->flush();
+    }
+    // the writer's streams went back to the pool, reset
+    BOOST_CHECK_EQUAL(pool->size(), (size_t)2);
+
+    shared_ptr<TTransport> r_zlib_trans = factory.getTransport(membuf);
+    string got(payload.size(), '\0');
+    r_zlib_trans->readAll(reinterpret_cast<uint8_t*>(&got[0]), static_cast<uint32_t>(got.size()));
+    BOOST_CHECK(got == payload);
+  }
+}
+
+void test_sync_flush() {
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  TZlibTransport w_zlib_trans(membuf);
+  TZlibTransport r_zlib_trans(membuf);
+  w_zlib_trans.setFlushMode(Z_SYNC_FLUSH);
+  BOOST_CHECK_THROW(w_zlib_trans.setFlushMode(Z_FINISH), TTransportException);
+  TZlibTransportFactory factory;
+  BOOST_CHECK_THROW(factory.setFlushMode(Z_FINISH), TTransportException);
+  BOOST_CHECK_THROW(factory.setFlushMode(-1), TTransportException);
+
+  string message("a small message that repeats");
+  for (int i = 0; i < 10; ++i) {
+    w_zlib_trans.write(reinterpret_cast<const uint8_t*>(message.data()),
+                       static_cast<uint32_t>(message.size()));
+    w_zlib_trans.flush();
+
+    string got(message.size(), '\0');
+    r_zlib_trans.readAll(reinterpret_cast<uint8_t*>(&got[0]), static_cast<uint32_t>(got.size()));
+    BOOST_CHECK(got == message);
+  }
+}
+
+void test_flush_batch() {
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  TZlibTransport w_zlib_trans(membuf);
+  BOOST_CHECK_THROW(w_zlib_trans.setFlushBatch(0), TTransportException);
+  TZlibTransportFactory factory;
+  BOOST_CHECK_THROW(factory.setFlushBatch(0), TTransportException);
+  w_zlib_trans.setFlushBatch(3);
+
+  uint8_t message[100];
+  memset(message, 'm', sizeof(message));
+  for (int i = 0; i < 2; ++i) {
+    w_zlib_trans.write(message, sizeof(message));
+    w_zlib_trans.flush();
+    BOOST_CHECK_EQUAL(membuf->available_read(), (uint32_t)0);
+  }
+  w_zlib_trans.write(message, sizeof(message));
+  w_zlib_trans.flush();
+  BOOST_CHECK(membuf->available_read() > 0);
+
+  // flushNow() does not wait for the batch to fill up
+  uint32_t flushed = membuf->available_read();
+  w_zlib_trans.write(message, sizeof(message));
+  w_zlib_trans.flushNow();
+  BOOST_CHECK(membuf->available_read() > flushed);
+
+  // close() sends what the batch held back
+  flushed = membuf->available_read();
+  w_zlib_trans.write(message, sizeof(message));
+  w_zlib_trans.flush();
+  BOOST_CHECK_EQUAL(membuf->available_read(), flushed);
+  w_zlib_trans.close();
+  BOOST_CHECK(membuf->available_read() > flushed);
+
+  // and so does the destructor
+  shared_ptr<TMemoryBuffer> membuf2(new TMemoryBuffer());
+  {
+    TZlibTransport batched(membuf2);
+    batched.setFlushBatch(3);
+    batched.write(message, sizeof(message));
+    batched.flush();
+    BOOST_CHECK_EQUAL(membuf2->available_read(), (uint32_t)0);
+  }
+  BOOST_CHECK(membuf2->available_read() > 0);
+
+  TZlibTransport r_zlib_trans(membuf);
+  uint8_t got[sizeof(message)];
+  for (int i = 0; i < 5; ++i) {
+    r_zlib_trans.readAll(got, sizeof(got));
+    BOOST_CHECK_EQUAL(memcmp(got, message, sizeof(message)), 0);
+  }
+  TZlibTransport r_batched(membuf2);
+  r_batched.readAll(got, sizeof(got));
+  BOOST_CHECK_EQUAL(memcmp(got, message, sizeof(message)), 0);
+}
+
+void test_flush_max_delay() {
+  shared_ptr<TMemoryBuffer> membuf(new TMemoryBuffer());
+  TZlibTransport w_zlib_trans(membuf);
+  w_zlib_trans.setFlushBatch(100);
+  w_zlib_trans.setFlushMaxDelay(2);
+
+  uint8_t message[100];
+  memset(message, 'm', sizeof(message));
+  int64_t start = Util::monotonicTimeTicks(1000);
+  w_zlib_trans.write(message, sizeof(message));
+  w_zlib_trans.flush();
+  BOOST_CHECK_EQUAL(membuf->available_read(), (uint32_t)0);
+  while (Util::monotonicTimeTicks(1000) - start < 3) {
+  }
+  // the next flush() ends the batch, well short of 100 messages
+  w_zlib_trans.write(message, sizeof(message));
+  w_zlib_trans.flush();
+  BOOST_CHECK(membuf->available_read() > 0);
+}
+
 /*
  * Initialization
  */
@@ -442,6 +564,10 @@ bool init_unit_test_suite() {
   add_tests(suite, gen_random_buffer(buf_len), buf_len, "random");
 
   suite->add(BOOST_TEST_CASE(test_no_write));
+  suite->add(BOOST_TEST_CASE(test_stream_pool));
+  suite->add(BOOST_TEST_CASE(test_sync_flush));
+  suite->add(BOOST_TEST_CASE(test_flush_batch));
+  suite->add(BOOST_TEST_CASE(test_flush_max_delay));
   suite->add(BOOST_TEST_CASE(test_get_underlying_transport));
 
   return true;
@@ -469,6 +595,10 @@ boost::unit_test::test_suite* init_unit_test_suite(int argc, char* argv[]) {
   add_tests(suite, gen_random_buffer(buf_len), buf_len, "random");
 
   suite->add(BOOST_TEST_CASE(test_no_write));
+  suite->add(BOOST_TEST_CASE(test_stream_pool));
+  suite->add(BOOST_TEST_CASE(test_sync_flush));
+  suite->add(BOOST_TEST_CASE(test_flush_batch));
+  suite->add(BOOST_TEST_CASE(test_flush_max_delay));
 
   return NULL;
 }